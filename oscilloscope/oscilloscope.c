@@ -1,4 +1,5 @@
 #include <stdlib.h>
+#include <string.h>
 #include "config.h"
 #ifdef HAVE_INTTYPES_H
 # include <inttypes.h>
@@ -9,61 +10,169 @@
 #include <unistd.h>
 #include <gio/gunixinputstream.h>
 
-#define NPOINTS 1284
+#define MAXPOINTS 4096
+
+/* Binary frames of mower/perimeter/stream, see stm32/ros_usbnode/include/perimeter.h */
+#define FRAME_VERSION 1
+#define FRAME_HEADER_LENGTH 28
+#define FRAME_MAX_LENGTH (FRAME_HEADER_LENGTH+MAXPOINTS*3/2+1)
+
+/* Same signal codes as the firmware (perimeter.c) */
+static const int32_t sigcode1[]={ -2, -2, -2, 2, 2, 2, -2, -2, 2, 2, 2, 2, 2, 2, 2, 0, -2, -2, -2, 1, 2, 2, 2, 2, 2, 1, 0, 0, -2, -2, -2, -2, -2, -2, -2, -1, -1 };
+static const int32_t sigcode2[]={ -2, -3, 0, 3, 3, -1, -2, -1, 3, 3, 3, 3, 3, 2, 0, -2, -2, -2, -2, -2, -2, -2, -2, -2, 3, 3, 3, 3, 3, 3, 1, 0, -1, -2, -2, -2, -2, -2, -2, -1, -1 };
+
+static const char *coil_names[]={"left","center","right","off"};
 
 typedef struct oscilloscope* oscilloscope;
 
+/* One complete acquisition */
+struct acquisition {
+  uint32_t seq,tick;
+  uint8_t coil,code,oversampling;
+  uint16_t settle,overruns;
+  float signal;
+  int npoints;
+  uint16_t data[MAXPOINTS];
+  int ncorr;
+  double corr_max;
+  double corr[MAXPOINTS];
+};
+
 struct oscilloscope {
   GtkWidget *drawing_area;
-  GDataInputStream *input;
+  GInputStream *input;
   int width,height;
-  double fx,fy;
-  uint16_t *show_data;
-  uint16_t *write_data;
-  uint16_t data1[NPOINTS];
-  uint16_t data2[NPOINTS];
+  uint8_t rx[2*FRAME_MAX_LENGTH];
+  int rx_len;
+  int received; /* points of write_acq received so far */
+  unsigned frames,checksum_errors,lost_chunks;
+  struct acquisition *show_acq;
+  struct acquisition *write_acq;
+  struct acquisition acq1;
+  struct acquisition acq2;
 };
 
 oscilloscope oscilloscope_new() {
-  oscilloscope toReturn=malloc(sizeof(struct oscilloscope));
-  memset(toReturn->data1,sizeof(toReturn->data1),0);
-  memset(toReturn->data2,sizeof(toReturn->data2),0);
-  toReturn->show_data=toReturn->data1;
-  toReturn->write_data=toReturn->data2;
+  oscilloscope toReturn=calloc(1,sizeof(struct oscilloscope));
+  toReturn->show_acq=&toReturn->acq1;
+  toReturn->write_acq=&toReturn->acq2;
   return toReturn;
 }
 
-static void line_complete(GObject *source_object,GAsyncResult *res,gpointer user_data) {
-  oscilloscope o=(oscilloscope) user_data;
-  GDataInputStream *s=G_DATA_INPUT_STREAM(source_object);
-  gsize len;
-  GError *e;
-  char* line=g_data_input_stream_read_line_finish(s,res,&len,&e);
-  if (!line) return;
-  int i=0;
-  while (i<NPOINTS && *line) {
-    if (1!=sscanf(line,"%" SCNu16,o->write_data+i)) break;
-    i++;
-    line=strchr(line,',');
-    if (!line) break;
-    line++;
+static uint16_t get16(const uint8_t *p) {
+  return p[0] | (p[1]<<8);
+}
+
+static uint32_t get32(const uint8_t *p) {
+  return p[0] | (p[1]<<8) | (p[2]<<16) | ((uint32_t) p[3]<<24);
+}
+
+/* Same matched filter as the firmware, over the points after the coil settled */
+static void correlate(struct acquisition *a) {
+  const int32_t *code=a->code==2 ? sigcode2 : sigcode1;
+  int m=a->code==2 ? sizeof(sigcode2)/sizeof(int32_t) : sizeof(sigcode1)/sizeof(int32_t);
+  int os=a->oversampling ? a->oversampling : 1;
+  int n=(a->npoints-a->settle)/os;
+  static int32_t d[MAXPOINTS];
+
+  for (int i=0; i<n; i++) {
+    d[i]=0;
+    for (int j=0; j<os; j++) d[i]+=a->data[a->settle+i*os+j];
+  }
+  a->ncorr=n>=m ? n-m+1 : 0;
+  a->corr_max=0;
+  for (int i=0; i<a->ncorr; i++) {
+    int64_t sum=0;
+    for (int j=0; j<m; j++) sum+=d[i+j]*code[j];
+    a->corr[i]=sum;
+    if (llabs(sum)>a->corr_max) a->corr_max=llabs(sum);
+  }
+}
+
+static void frame_received(oscilloscope o,const uint8_t *f) {
+  struct acquisition *a=o->write_acq;
+  uint32_t seq=get32(f+4);
+  int npoints=get16(f+12);
+  int first=get16(f+14);
+  int count=get16(f+16);
+
+  o->frames++;
+  if (npoints>MAXPOINTS || first+count>npoints) return;
+  if (first==0) {
+    a->seq=seq;
+    a->tick=get32(f+8);
+    a->coil=f[3]<=3 ? f[3] : 3;
+    a->npoints=npoints;
+    a->code=f[18];
+    a->oversampling=f[19];
+    a->settle=get16(f+20);
+    a->overruns=get16(f+22);
+    memcpy(&a->signal,f+24,sizeof(float));
+    o->received=0;
+  } else if (seq!=a->seq || first!=o->received) {
+    /* the start of this acquisition or a chunk is missing */
+    if (o->received>=0) o->lost_chunks++;
+    o->received=-1;
+    return;
   }
-  if (i>=NPOINTS) {
-    uint16_t *data=o->write_data;
-    o->write_data=o->show_data;
-    o->show_data=data;
+  const uint8_t *p=f+FRAME_HEADER_LENGTH;
+  for (int i=first; i<first+count; i+=2,p+=3) {
+    a->data[i]=p[0] | ((p[1] & 0x0F)<<8);
+    a->data[i+1]=(p[1]>>4) | (p[2]<<4);
+  }
+  o->received+=count;
+  if (o->received==npoints) {
+    correlate(a);
+    o->write_acq=o->show_acq;
+    o->show_acq=a;
+    o->received=-1;
     gtk_widget_queue_draw_area(o->drawing_area,0,0,o->width,o->height);
   }
-  g_free(line);
-  g_data_input_stream_read_line_async(o->input,G_PRIORITY_DEFAULT,NULL,line_complete,o);
+}
+
+/* Look for the frames in the received bytes, the rest is kept for the next read */
+static void parse(oscilloscope o) {
+  int pos=0;
+  while (o->rx_len-pos>=FRAME_HEADER_LENGTH) {
+    const uint8_t *f=o->rx+pos;
+    if (f[0]!='P' || f[1]!='W' || f[2]!=FRAME_VERSION) {
+      pos++;
+      continue;
+    }
+    int count=get16(f+16);
+    if (count>MAXPOINTS || count%2) {
+      pos++;
+      continue;
+    }
+    int len=FRAME_HEADER_LENGTH+count*3/2+1;
+    if (o->rx_len-pos<len) break;
+    uint8_t sum=0;
+    for (int i=0; i<len-1; i++) sum+=f[i];
+    if (sum!=f[len-1]) {
+      o->checksum_errors++;
+      pos++;
+      continue;
+    }
+    frame_received(o,f);
+    pos+=len;
+  }
+  memmove(o->rx,o->rx+pos,o->rx_len-pos);
+  o->rx_len-=pos;
+}
+
+static void read_complete(GObject *source_object,GAsyncResult *res,gpointer user_data) {
+  oscilloscope o=(oscilloscope) user_data;
+  gssize len=g_input_stream_read_finish(G_INPUT_STREAM(source_object),res,NULL);
+  if (len<=0) return;
+  o->rx_len+=len;
+  parse(o);
+  g_input_stream_read_async(o->input,o->rx+o->rx_len,sizeof(o->rx)-o->rx_len,G_PRIORITY_DEFAULT,NULL,read_complete,o);
 }
 
 static void size_callback(GtkWidget *widget,GdkRectangle *allocation,gpointer user_data) {
   oscilloscope o=(oscilloscope) user_data;
   o->width=allocation->width;
   o->height=allocation->height;
-  o->fx=allocation->width/(double) NPOINTS;
-  o->fy=allocation->height/(double) 4096;
 }
 
 static gboolean draw_callback (GtkWidget *widget, cairo_t *cr, gpointer data)
@@ -71,23 +180,51 @@ static gboolean draw_callback (GtkWidget *widget, cairo_t *cr, gpointer data)
   GdkRGBA color;
   GtkStyleContext *context;
   oscilloscope o=(oscilloscope) data;
+  struct acquisition *a=o->show_acq;
   context = gtk_widget_get_style_context (widget);
 
   gtk_render_background (context, cr, 0, 0, o->width, o->height);
+  if (!a->npoints) return FALSE;
+
+  double fx=o->width/(double) a->npoints;
+  double fy=o->height/(double) 4096;
 
   gtk_style_context_get_color(context,
                               gtk_style_context_get_state (context),
                               &color);
   gdk_cairo_set_source_rgba (cr, &color);
-  for (int i=0; i<NPOINTS; i++) {
-    double x=i*o->fx;
-    double y=o->height-o->fy*o->show_data[i];
+  for (int i=0; i<a->npoints; i++) {
+    double x=i*fx;
+    double y=o->height-fy*a->data[i];
     if (i)
       cairo_line_to(cr,x,y);
     else
       cairo_move_to(cr,x,y);
   }
   cairo_stroke(cr);
+
+  /* correlation, scaled to its maximum around the middle of the window */
+  if (a->ncorr && a->corr_max>0) {
+    double fc=o->height/2.5/a->corr_max;
+    cairo_set_source_rgba(cr,0.9,0.1,0.1,0.8);
+    for (int i=0; i<a->ncorr; i++) {
+      double x=(a->settle+i*a->oversampling)*fx;
+      double y=o->height/2-fc*a->corr[i];
+      if (i)
+        cairo_line_to(cr,x,y);
+      else
+        cairo_move_to(cr,x,y);
+    }
+    cairo_stroke(cr);
+  }
+
+  char text[200];
+  snprintf(text,sizeof(text),"coil %s  seq %" PRIu32 "  t %" PRIu32 " ms  signal %.2f  overruns %u  frames %u  lost %u  checksum errors %u",
+           coil_names[a->coil],a->seq,a->tick,a->signal,a->overruns,o->frames,o->lost_chunks,o->checksum_errors);
+  gdk_cairo_set_source_rgba (cr, &color);
+  cairo_set_font_size(cr,14);
+  cairo_move_to(cr,10,20);
+  cairo_show_text(cr,text);
   return FALSE;
 }
 
@@ -97,7 +234,7 @@ activate (GtkApplication *app,
 {
   GtkWidget *window;
   oscilloscope o=(oscilloscope) user_data;
-  
+
   window = gtk_application_window_new (app);
   gtk_window_set_title (GTK_WINDOW (window), "Perimeter signal");
   gtk_window_set_default_size (GTK_WINDOW (window), 1500, 800);
@@ -108,7 +245,7 @@ activate (GtkApplication *app,
   g_signal_connect(G_OBJECT(o->drawing_area), "size-allocate",G_CALLBACK(size_callback),o);
   g_signal_connect (G_OBJECT(o->drawing_area), "draw", G_CALLBACK (draw_callback),o);
   gtk_container_add (GTK_CONTAINER (window), o->drawing_area);
-  
+
   gtk_widget_show_all (window);
 }
 
@@ -116,12 +253,12 @@ gint handle_local_options(GApplication *application,GVariantDict *options,gpoint
 {
   oscilloscope o=(oscilloscope) user_data;
   if (g_variant_dict_lookup(options,"version","b",NULL)) {
-    g_print("oscilloscope-1.0\n");
+    g_print("oscilloscope-2.0\n");
     return 0;
   }
-  gchar *device="/dev/ttyAMA1";
+  gchar *device="-";
   g_variant_dict_lookup(options,"device","s",&device);
-  int fd=open(device,O_RDONLY);
+  int fd=strcmp(device,"-") ? open(device,O_RDONLY) : STDIN_FILENO;
   if (fd<0) {
     g_print("Cannot open device %s\n",device);
     return 0;
@@ -134,10 +271,10 @@ gint handle_local_options(GApplication *application,GVariantDict *options,gpoint
     mytermios.c_cflag&=~(CSTOPB);
     tcsetattr(fd,TCSANOW,&mytermios);
   }
-  
-  GInputStream *s=g_unix_input_stream_new(fd,TRUE);
-  o->input=g_data_input_stream_new(s);
-  g_data_input_stream_read_line_async(o->input,G_PRIORITY_DEFAULT,NULL,line_complete,o);
+
+  o->input=g_unix_input_stream_new(fd,TRUE);
+  o->received=-1;
+  g_input_stream_read_async(o->input,o->rx,sizeof(o->rx),G_PRIORITY_DEFAULT,NULL,read_complete,o);
   return -1;
 }
 
@@ -152,8 +289,8 @@ int main (int argc,char **argv)
   g_application_add_main_option(G_APPLICATION(app),"version",'v',G_OPTION_FLAG_NONE,G_OPTION_ARG_NONE,
                                 "Show the application version", NULL);
   g_application_add_main_option(G_APPLICATION(app),"device",'d',G_OPTION_FLAG_NONE,G_OPTION_ARG_STRING,
-                                "Read data from this file", NULL);
-  g_application_set_option_context_summary (G_APPLICATION(app),"Display analog data");
+                                "Read the perimeter stream from this file (default - for stdin)", NULL);
+  g_application_set_option_context_summary (G_APPLICATION(app),"Display the perimeter signal");
   g_signal_connect (app, "activate", G_CALLBACK (activate),myoscilloscope);
   g_signal_connect (app, "handle-local-options",G_CALLBACK (handle_local_options),myoscilloscope);
   status = g_application_run (G_APPLICATION (app), argc, argv);
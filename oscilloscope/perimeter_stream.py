@@ -0,0 +1,19 @@
+#!/usr/bin/env python3
+# Forward the perimeter waveform frames published by Mowgli on mower/perimeter/stream
+# to stdout, to be piped into the oscilloscope:
+#   perimeter_stream.py | oscilloscope
+import sys
+
+import rospy
+from std_msgs.msg import UInt8MultiArray
+
+
+def frame_received(msg):
+    sys.stdout.buffer.write(bytes(msg.data))
+    sys.stdout.buffer.flush()
+
+
+if __name__ == '__main__':
+    rospy.init_node('perimeter_stream', anonymous=True)
+    rospy.Subscriber('mower/perimeter/stream', UInt8MultiArray, frame_received, queue_size=100)
+    rospy.spin()
@@ -19,10 +19,62 @@ extern "C" {
 /******************************************************************************
 * Includes
 *******************************************************************************/
+#include "board.h"
 
 /******************************************************************************
 * Preprocessor Constants
 *******************************************************************************/
+#define ADC_VREF_MV 3300
+#define ADC_FULL_SCALE 4095
+#define ADC_CHARGING_INJECTED_RANKS 4      /* current and voltages, the NTC too on the STM32F4 */
+/* charging scans, triggered by TIM2. With ADC_CHARGING_PWM_SYNC TIM2 counts the charge PWM periods
+ * (TIM1 TRGO in the middle of the high side on time) and ADC_CHARGING_AVERAGE scans are averaged,
+ * CHARGER_PWM_HZ comes from charger.h */
+#if ADC_CHARGING_PWM_SYNC
+#define ADC_CHARGING_SYNC_PWM_PERIODS 3    /* PWM periods between two scans */
+#define ADC_CHARGING_AVERAGE 4
+#define ADC_CHARGING_SCAN_HZ (CHARGER_PWM_HZ / ADC_CHARGING_SYNC_PWM_PERIODS)
+#if BOARD_YARDFORCE500_VARIANT_ORIG
+#define ADC_CHARGING_SYNC_WINDOW (72 * 8)  /* sampling time in TIM1 ticks, 71.5 cycles at 9MHz */
+#elif BOARD_YARDFORCE500_VARIANT_B
+#define ADC_CHARGING_SYNC_WINDOW (112 * 4) /* sampling time in TIM1 ticks, 112 cycles at 18MHz */
+#endif
+#elif BOARD_YARDFORCE500_VARIANT_B
+/* the STM32F401 has only ADC1, shared by the perimeter (regular group, DMA) and the charging channels
+ * (injected group). TIM2 paces the perimeter samples, TIM5 counts ADC_CHARGING_PERIMETER_PERIODS
+ * of them and triggers one injected conversion (discontinuous mode) at the start of a period, in the
+ * gap before the perimeter sample at ADC_PERIMETER_TRIGGER_TICKS. Every perimeter sample is evenly
+ * spaced and the 4 injected ranks make a charging scan */
+#define ADC_PERIMETER_SAMPLE_TICKS 672     /* 9.333 µs at 72MHz */
+#define ADC_PERIMETER_TRIGGER_TICKS 416    /* after the injected conversion, 96 cycles at 18MHz */
+#define ADC_CHARGING_PERIMETER_PERIODS 6
+/* the NTC and the charger input voltage share the 4th rank: the NTC is converted once every
+ * ADC_NTC_SCAN_PERIOD scans (about 280Hz, ADC_input() reads it at 100Hz), the charger input voltage
+ * in all the other ones */
+#define ADC_NTC_SCAN_PERIOD 16
+#define ADC_CHARGING_AVERAGE 1
+#define ADC_CHARGING_SCAN_HZ (72000000 / (ADC_PERIMETER_SAMPLE_TICKS * ADC_CHARGING_PERIMETER_PERIODS * ADC_CHARGING_INJECTED_RANKS))
+#else
+#define ADC_CHARGING_AVERAGE 1
+#define ADC_CHARGING_SCAN_HZ 4000
+#endif
+#define ADC_CHARGING_CONTROL_HZ (ADC_CHARGING_SCAN_HZ / ADC_CHARGING_AVERAGE) /* CHARGER_ControlIT() rate */
+
+/* ADC_OVERSAMPLING_CHANNELS bits, in ADC_Charging_channelSelection_e order */
+#define ADC_CHARGING_MASK_CURRENT 0x01
+#define ADC_CHARGING_MASK_CHARGEVOLTAGE 0x02
+#define ADC_CHARGING_MASK_BATTERYVOLTAGE 0x04
+#define ADC_CHARGING_MASK_CHARGERINPUTVOLTAGE 0x08
+#define ADC_CHARGING_MASK_NTC 0x10
+/* scans accumulated per oversampled value */
+#define ADC_OVERSAMPLING_RATIO (ADC_CHARGING_SCAN_HZ / ADC_OVERSAMPLING_HZ)
+
+/* blade motor NTC, the table gives the temperature every 2^ADC_NTC_TABLE_SHIFT counts */
+#define ADC_NTC_R25 10000.0             /* NTC resistance at 25°C (ohm) */
+#define ADC_NTC_BETA 3380.0
+#define ADC_NTC_OHM_PER_VOLT 10000.0    /* NTC resistance from the ADC input voltage */
+#define ADC_NTC_TABLE_SHIFT 4
+#define ADC_NTC_TABLE_SIZE (((ADC_FULL_SCALE + 1) >> ADC_NTC_TABLE_SHIFT) + 1)
 
 /******************************************************************************
 * Constants
@@ -35,12 +87,39 @@ extern "C" {
 /******************************************************************************
 * Typedefs
 *******************************************************************************/
+typedef enum
+{
+    ADC_CHARGING_CHANNEL_CURRENT = 0,
+    ADC_CHARGING_CHANNEL_CHARGEVOLTAGE,
+    ADC_CHARGING_CHANNEL_BATTERYVOLTAGE,
+    ADC_CHARGING_CHANNEL_CHARGERINPUTVOLTAGE,
+    ADC_CHARGING_CHANNEL_NTC,
+    ADC_CHARGING_CHANNEL_MAX,
+} ADC_Charging_channelSelection_e;
+
 /* union to store a float in the U16 backup register */
 union FtoU{
   float  f;
   uint16_t u[2];
 };
 
+/* blade motor NTC temperature (0.01°C) for raw ADC values 0, 16, 32 ... 4096 */
+typedef struct {
+  int16_t ps16CentiDegree[ADC_NTC_TABLE_SIZE];
+} ADC_NtcTable_t;
+
+#ifdef ADC_CYCLE_BENCH
+/* outputs of the former float conversion, ADC_InputFloat() */
+typedef struct {
+  float battery_voltage;
+  float charge_voltage;
+  float current_without_offset;
+  float ntc_voltage;
+  float blade_temperature;
+  float chargerInputVoltage;
+} ADC_FloatView_t;
+#endif
+
 /******************************************************************************
 * Variables
 *******************************************************************************/
@@ -57,6 +136,11 @@ extern float chargerInputVoltage;
 extern union FtoU ampere_acc;
 extern union FtoU charge_current_offset;
 
+extern const ADC_NtcTable_t ADC_sNtcTable; /* built at compile time in adc_ntc.cpp */
+#ifdef ADC_CYCLE_BENCH
+extern ADC_FloatView_t ADC_sFloatView;
+#endif
+
 /******************************************************************************
 * PUBLIC Function Prototypes
 *******************************************************************************/
@@ -65,6 +149,16 @@ void TIM2_Init(void);
 void ADC_Charging_Init(void);
 
 void ADC_input(void);
+int32_t ADC_ChargingSampleMilli(ADC_Charging_channelSelection_e p_eChannel);
+int32_t ADC_NtcCentiDegree(int32_t p_s32RawQ16);
+#ifdef ADC_CYCLE_BENCH
+void ADC_InputFloat(void);
+void ADC_CycleBench(void);
+#endif
+#if BOARD_YARDFORCE500_VARIANT_B && defined(OPTION_PERIMETER)
+void ADC_PerimeterStart(volatile uint16_t *p_pu16Buffer, uint32_t p_u32Length);
+void ADC_PerimeterStop(void);
+#endif
 
 void HAL_ADC_ConvCpltCallback (ADC_HandleTypeDef* hadc);
 
@@ -23,6 +23,7 @@ extern "C" {
 /******************************************************************************
 * Preprocessor Constants
 *******************************************************************************/
+#define BATTERY_UPDATE_MS 100
 
 /******************************************************************************
 * Constants
@@ -43,6 +44,10 @@ extern "C" {
 /******************************************************************************
 * PUBLIC Function Prototypes
 *******************************************************************************/
+void BATTERY_Init(void);
+void BATTERY_Update(void);
+void BATTERY_SetFull(void);
+float BATTERY_GetSoc(void);
 
 
 
@@ -45,15 +45,18 @@ extern bool BLADEMOTOR_bActivated;
 extern uint16_t BLADEMOTOR_u16RPM;
 extern uint16_t BLADEMOTOR_u16Power;
 extern uint32_t BLADEMOTOR_u32Error;
+#ifdef BLADE_LOAD_ADAPTIVE_SPEED
+extern float BLADEMOTOR_fSpeedScale; // ground speed scale from the blade load
+#endif
 /******************************************************************************
 * PUBLIC Function Prototypes
 *******************************************************************************/
 
 void BLADEMOTOR_Init(void);
 void BLADEMOTOR_App(void);
-void BLADEMOTOR_ReceiveIT(void);
 
 void BLADEMOTOR_Set(uint8_t on_off, uint8_t direction);
+void BLADEMOTOR_EmergencyStopIT(void);
 
 
 #ifdef __cplusplus
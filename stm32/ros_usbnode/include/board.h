@@ -54,6 +54,14 @@ extern "C"
 #define OPTION_BUMPER 0
 
 #define BOARD_HAS_MASTER_USART 1
+
+#define EMERGENCY_TIM_INSTANCE TIM6
+#define EMERGENCY_TIM_IRQ TIM6_IRQn
+#define EMERGENCY_TIM_CLK_ENABLE() __HAL_RCC_TIM6_CLK_ENABLE()
+
+#define SOFT_I2C_TIM_INSTANCE TIM7
+#define SOFT_I2C_TIM_IRQ TIM7_IRQn
+#define SOFT_I2C_TIM_CLK_ENABLE() __HAL_RCC_TIM7_CLK_ENABLE()
 #elif BOARD_YARDFORCE500_VARIANT_B
 /////////////////////
 // Yardforce 500 B //
@@ -74,6 +82,14 @@ extern "C"
 
 #define OPTION_ULTRASONIC 0
 #define OPTION_BUMPER 0
+
+#define EMERGENCY_TIM_INSTANCE TIM10
+#define EMERGENCY_TIM_IRQ TIM1_UP_TIM10_IRQn
+#define EMERGENCY_TIM_CLK_ENABLE() __HAL_RCC_TIM10_CLK_ENABLE()
+
+#define SOFT_I2C_TIM_INSTANCE TIM11
+#define SOFT_I2C_TIM_IRQ TIM1_TRG_COM_TIM11_IRQn
+#define SOFT_I2C_TIM_CLK_ENABLE() __HAL_RCC_TIM11_CLK_ENABLE()
 #elif defined(BOARD_LUV1000RI) // TODO: This currently can't be selected via platformio
 #define PANEL_TYPE PANEL_TYPE_YARDFORCE_LUV1000RI
 #define BLADEMOTOR_LENGTH_RECEIVED_MSG 14
@@ -111,20 +127,96 @@ extern "C"
 #define LOW_BAT_THRESHOLD 25.2f /* near 20% SOC */
 #define LOW_CRI_THRESHOLD 23.5f /* near 0% SOC */
 
+// Battery state of charge, coulomb counting corrected by the open circuit voltage (battery.c)
+#define BATTERY_CAPACITY_AH 2.8f
+#define BATTERY_CELLS 7
+#define BATTERY_INTERNAL_RESISTANCE 0.15f // ohm, pack
+#define BATTERY_SOC_PERSIST_DELTA 0.005f  // SOC change saved to the RTC backup registers
+#define BATTERY_SOC_PERSIST_MS 60000      // smaller changes are saved after this time
+
+// Charge controller, PI loops run after every charging ADC scan (4kHz) while charging (CC and CV states).
+// The PWM is the lowest output of the current loop (MAX_CHARGE_CURRENT) and of the voltage loop
+// (battery at the end voltage, charger output at MAX_CHARGE_VOLTAGE)
+#define CHARGER_CURRENT_KP 0.002f  // PWM counts per mA
+#define CHARGER_CURRENT_KI 0.5f    // PWM counts per mA and per second
+#define CHARGER_VOLTAGE_KP 0.02f   // PWM counts per mV
+#define CHARGER_VOLTAGE_KI 1.5f    // PWM counts per mV and per second
+#define CHARGER_PWM_FEEDFORWARD 0.9f // CC starts at this ratio of the PWM matching the battery voltage
+// Charging ADC scans triggered in the middle of the charge PWM on time and averaged (ripple free current),
+// instead of the free running 4kHz TIM2
+#define ADC_CHARGING_PWM_SYNC 0
+// Charging ADC oversampling for ADC_input(), the selected channels (ADC_CHARGING_MASK_xxx) are summed on
+// every scan and decimated to 12 + ADC_OVERSAMPLING_BITS bits at ADC_OVERSAMPLING_HZ.
+// Needs 4^ADC_OVERSAMPLING_BITS scans per value: 4kHz scans give 16 bits up to 15Hz, 14 bits up to 250Hz
+#define ADC_OVERSAMPLING_CHANNELS (ADC_CHARGING_MASK_CURRENT | ADC_CHARGING_MASK_BATTERYVOLTAGE) // 0 to disable
+#define ADC_OVERSAMPLING_BITS 4
+#define ADC_OVERSAMPLING_HZ 10
+// mower/power_telemetry publish rate (1 to 100Hz), min/max/mean of the signals sampled every ms,
+// can be changed at runtime on mower/power_telemetry/rate (std_msgs/UInt8)
+#define POWER_TELEMETRY_HZ 10
+// mower/latency histograms of the emergency and cmd_vel to motor frame latencies, published every second
+#define LATENCY_PROBES 1
+// Count the DWT cycles of ADC_input() and of the former float conversion over this many calls at boot (debug output)
+//#define ADC_CYCLE_BENCH 1000
+
 // Emergency sensor timeouts
 #define ONE_WHEEL_LIFT_EMERGENCY_MILLIS 10000
 #define BOTH_WHEELS_LIFT_EMERGENCY_MILLIS 1000
 #define TILT_EMERGENCY_MILLIS 500 // used for both the mechanical and accelerometer based detection
 #define STOP_BUTTON_EMERGENCY_MILLIS 100
 #define PLAY_BUTTON_CLEAR_EMERGENCY_MILLIS 2000
+// The stop buttons, wheel lifts and mechanical tilt are sampled every ms by EMERGENCY_TIM, the interrupt
+// confirming an emergency queues the stop frames to the drive and blade motors itself
+#define EMERGENCY_TIM_HZ 1000
 #define IMU_ONBOARD_INCLINATION_THRESHOLD 0x38 // stock firmware uses 0x2C (way more allowed inclination)
 
+// Drive motor polling, the next request is sent when the answer to the previous one is received
+// and the poll period is elapsed. If no answer comes back the request is sent again after the timeout
+#define DRIVEMOTOR_POLL_PERIOD_MS 5 // 200Hz
+#define DRIVEMOTOR_RX_TIMEOUT_MS 20
+#define WHEEL_TICKS_PUBLISH_MS 20   // wheel ticks are still published at 50Hz
+
+// Drive motor velocity ramp, the requested wheel speeds are reached with limited acceleration and jerk.
+// It runs on every drive motor request, reversals go through zero. Emergency stops bypass it
+#define DRIVEMOTOR_RAMP 1
+#define DRIVEMOTOR_RAMP_ACCEL 1.0f  // m/s², maximum wheel acceleration
+#define DRIVEMOTOR_RAMP_JERK 10.0f  // m/s³, maximum change of the acceleration
+
+// Drive motor collision detection, checked on every drive motor frame while running.
+// The power (10mA unit) is compared against a rolling baseline taken while driving at the commanded speed
+#define DRIVEMOTOR_COLLISION_DETECTION 1
+#define DRIVEMOTOR_COLLISION_POWER_MARGIN 40  // power above the baseline considered as a hit
+#define DRIVEMOTOR_COLLISION_POWER_SLOPE 8    // power rise between two frames considered as a hit
+#define DRIVEMOTOR_COLLISION_FRAMES 4         // consecutive frames over the margin, 20ms at 200Hz
+#define DRIVEMOTOR_COLLISION_SETTLE_MS 500    // no detection while accelerating after a speed change
+#define DRIVEMOTOR_COLLISION_CMD_DELTA 10     // speed change which restarts the baseline
+
+// Blade motor polling period, the blade load is also used by the adaptive ground speed
+#define BLADEMOTOR_POLL_PERIOD_MS 25
+
+// Scale the cmd_vel ground speed with the blade load while mowing. Slow down when the blade RPM sags
+// or its power rises, speed up to MAX_MPS on light grass. Values have to be tuned on the mower
+//#define BLADE_LOAD_ADAPTIVE_SPEED
+#define BLADE_LOAD_NOMINAL_RPM 3300      // blade RPM without load
+#define BLADE_LOAD_MIN_RPM 2600          // blade RPM considered as full load
+#define BLADE_LOAD_LIGHT_POWER 1000      // blade power (mA) on light grass
+#define BLADE_LOAD_HEAVY_POWER 3000      // blade power (mA) considered as full load
+#define BLADE_LOAD_MAX_SCALE 1.5f        // speed scale on light grass, capped by MAX_MPS
+#define BLADE_LOAD_MIN_SCALE 0.4f        // speed scale at full load
+#define BLADE_LOAD_SLOWDOWN_ALPHA 0.5f   // filter when the load goes up
+#define BLADE_LOAD_SPEEDUP_ALPHA 0.05f   // filter when the load goes down
+
 // Enable Emergency debugging
 //#define EMERGENCY_DEBUG
 
 // IMU configuration options
 #define EXTERNAL_IMU_ACCELERATION  1
 #define EXTERNAL_IMU_ANGULAR       1
+#define EXTERNAL_IMU_ORIENTATION   1        // attitude filter at the sensor rate, imu/orientation switches it off (raw only)
+#define IMU_FUSION_KP              1.0f     // accelerometer correction gain (1/s)
+#define IMU_FUSION_KI              0.01f    // gyro bias gain (1/s^2)
+#define IMU_FUSION_COV_ROLL_PITCH  0.0012f  // orientation covariance (rad^2), about (2 deg)^2
+#define IMU_FUSION_COV_YAW         1.0f     // no magnetometer, yaw is the integrated gyro
 
 // Force disable IMU to be detected - CURRENTLY THIS SETTING DOES NOT WORK!
 //#define DISABLE_LSM6
@@ -301,6 +393,8 @@ extern "C"
 #define SOFT_I2C_SDA_PORT GPIOB
 
 #define SOFT_I2C_GPIO_CLK_ENABLE() __HAL_RCC_GPIOB_CLK_ENABLE();
+// SCL frequency, the bits are clocked by the SOFT_I2C_TIM interrupt at twice this rate
+#define SOFT_I2C_CLOCK_HZ 100000
 #endif
 
 #if !VALID_BOARD_DEFINED
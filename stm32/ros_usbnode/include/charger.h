@@ -23,6 +23,8 @@ extern "C" {
 /******************************************************************************
 * Preprocessor Constants
 *******************************************************************************/
+#define CHARGER_PWM_PERIOD 1400     /* TIM1 period */
+#define CHARGER_PWM_HZ (72000000 / (CHARGER_PWM_PERIOD + 1))
 
 /******************************************************************************
 * Constants
@@ -52,6 +54,11 @@ extern "C" {
   */
  void charger_set_end_voltage(float v);
 
+ /**
+  * Charge control loop, to be called after every charging ADC scan.
+  */
+ void CHARGER_ControlIT(void);
+
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,70 @@
+/****************************************************************************
+* Title                 :   perimeter matched filter
+* Filename              :   corr_filter.h
+* Author                :
+* Origin Date           :
+* Version               :   1.0.0
+
+*****************************************************************************/
+/** \file corr_filter.h
+*  \brief cross correlation of the perimeter coil samples with the signal code,
+*         no HAL dependency so it also builds on the host (tools/corr_filter_bench.c)
+*
+*/
+#ifndef __CORR_FILTER_H
+#define __CORR_FILTER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+/******************************************************************************
+* Includes
+*******************************************************************************/
+#include <stdint.h>
+
+/******************************************************************************
+* Preprocessor Constants
+*******************************************************************************/
+#define CORRFILTER_MAX_CODE_LENGTH 64
+#define CORRFILTER_MAX_CODES 4      /* codes of CORRFILTER_RunBank() */
+
+/******************************************************************************
+* Constants
+*******************************************************************************/
+
+/******************************************************************************
+* Macros
+*******************************************************************************/
+
+/******************************************************************************
+* Typedefs
+*******************************************************************************/
+/* signal code and its difference taps, with S the prefix sums of the points x:
+ * corr[i] = sum(ps32Diff[t] * S[i + pu8Offset[t]]), one tap per change of the code value */
+typedef struct
+{
+    const int32_t *ps32Code;
+    uint8_t u8Length;
+    uint8_t u8Taps;
+    uint8_t pu8Offset[CORRFILTER_MAX_CODE_LENGTH + 1];
+    int32_t ps32Diff[CORRFILTER_MAX_CODE_LENGTH + 1];
+} CORRFILTER_Code_t;
+
+/******************************************************************************
+* Variables
+*******************************************************************************/
+
+/******************************************************************************
+* PUBLIC Function Prototypes
+*******************************************************************************/
+
+void CORRFILTER_Init(CORRFILTER_Code_t *p_psCode, const int32_t *p_ps32Code, uint8_t p_u8Length);
+double CORRFILTER_Run(const CORRFILTER_Code_t *p_psCode, uint16_t *p_pu16Buffer, int p_iNbPts, int p_iOversampling);
+uint8_t CORRFILTER_RunBank(const CORRFILTER_Code_t *p_psCodes, uint8_t p_u8Codes, uint16_t *p_pu16Buffer, int p_iNbPts, int p_iOversampling, double *p_pdSignal);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /*__CORR_FILTER_H*/
+
+/*** End of File **************************************************************/
@@ -49,6 +49,8 @@ extern uint16_t  left_encoder_val;     // non accumulating
 extern uint8_t   right_power;
 extern uint8_t   left_power;
 extern uint32_t  DRIVEMOTOR_u32ErrorCnt;
+extern uint32_t  DRIVEMOTOR_u32RxErrorCnt;  // answers lost, corrupted or timed out
+extern uint32_t  DRIVEMOTOR_u32CollisionCnt; // collisions detected on the motor power
 
 
 /******************************************************************************
@@ -56,10 +58,10 @@ extern uint32_t  DRIVEMOTOR_u32ErrorCnt;
 *******************************************************************************/
 
 void DRIVEMOTOR_Init(void);
-void DRIVEMOTOR_App_10ms(void);
-void DRIVEMOTOR_App_Rx(void);
-void DRIVEMOTOR_ReceiveIT(void);
+void DRIVEMOTOR_App(void);
 void DRIVEMOTOR_SetSpeed(uint8_t left_speed, uint8_t right_speed, uint8_t left_dir, uint8_t right_dir);
+void DRIVEMOTOR_Stop(void);
+void DRIVEMOTOR_EmergencyStopIT(void);
 
 #ifdef __cplusplus
 }
@@ -2,6 +2,7 @@
 #define __EMERGENCY_H
 
 #include <stdint.h>
+#include "stm32f_board_hal.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -16,6 +17,8 @@ int Emergency_WheelLiftBlue(void);
 int Emergency_WheelLiftRed(void);
 int Emergency_LowZAccelerometer(void);
 void EmergencyController(void);
+void Emergency_TimerIT(void);
+void Emergency_TimerPeriodElapsed(TIM_HandleTypeDef *htim);
 void Emergency_Init(void);
 
 #ifdef __cplusplus
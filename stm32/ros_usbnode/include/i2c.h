@@ -3,10 +3,15 @@
 
 #include <stdint.h>
 
+extern uint32_t I2C_u32FifoOverruns;
+
 void I2C_Init(void);
+void I2C_BusRecovery(void);
 uint8_t I2C_Acclerometer_TestDevice(void);
 void I2C_Accelerometer_Setup(void);
+void I2C_Accelerometer_Poll(void);
 void I2C_ReadAccelerometer(float *x, float *y, float *z);
+uint8_t I2C_ReadAccelerometerMean(float *x, float *y, float *z);
 float I2C_ReadAccelerometerTemp(void);
 int32_t I2C_platform_write(void *handle, uint8_t reg, const uint8_t *bufp, uint16_t len);
 int32_t I2C_platform_read(void *handle, uint8_t reg, uint8_t *bufp, uint16_t len);
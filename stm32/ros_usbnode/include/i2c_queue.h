@@ -0,0 +1,79 @@
+/****************************************************************************
+* Title                 :   I2C transaction queue
+* Filename              :   i2c_queue.h
+* Author                :
+* Origin Date           :
+* Version               :   1.0.0
+
+*****************************************************************************/
+/** \file i2c_queue.h
+*  \brief interrupt driven register transactions on the hardware I2C bus
+*         (onboard LIS3DH), with completion callbacks, timeouts and bus recovery
+*
+*/
+#ifndef __I2C_QUEUE_H
+#define __I2C_QUEUE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+/******************************************************************************
+* Includes
+*******************************************************************************/
+#include "stm32f_board_hal.h"
+
+/******************************************************************************
+* Preprocessor Constants
+*******************************************************************************/
+#define I2CQUEUE_LENGTH         8       /* transactions waiting, the running one included */
+#define I2CQUEUE_TIMEOUT_US     2000    /* a transaction is aborted and the bus recovered after this time */
+
+/******************************************************************************
+* Constants
+*******************************************************************************/
+
+/******************************************************************************
+* Macros
+*******************************************************************************/
+
+/******************************************************************************
+* Typedefs
+*******************************************************************************/
+/* called from the I2C interrupt, or from I2CQUEUE_Poll() on timeout, with HAL_OK, HAL_ERROR or HAL_TIMEOUT */
+typedef void (*I2CQUEUE_Callback_t)(HAL_StatusTypeDef p_eStatus, void *p_pvContext);
+
+typedef struct
+{
+    uint8_t u8Address;              /* 8 bit device address */
+    uint8_t u8Register;
+    uint8_t bRead;                  /* 1 read, 0 write */
+    uint8_t *pu8Data;               /* has to stay valid until the callback */
+    uint16_t u16Length;
+    I2CQUEUE_Callback_t pfCallback; /* can be NULL */
+    void *pvContext;
+} I2CQUEUE_Transaction_t;
+
+/******************************************************************************
+* Variables
+*******************************************************************************/
+extern uint32_t I2CQUEUE_u32Errors;     /* transactions failed (bus error, NACK, arbitration lost) */
+extern uint32_t I2CQUEUE_u32Timeouts;   /* transactions aborted after I2CQUEUE_TIMEOUT_US */
+
+/******************************************************************************
+* PUBLIC Function Prototypes
+*******************************************************************************/
+
+void I2CQUEUE_Init(I2C_HandleTypeDef *p_phI2c, void (*p_pfRecover)(void));
+HAL_StatusTypeDef I2CQUEUE_Submit(const I2CQUEUE_Transaction_t *p_psTransaction);
+HAL_StatusTypeDef I2CQUEUE_Transfer(uint8_t p_u8Address, uint8_t p_u8Register, uint8_t p_bRead, uint8_t *p_pu8Data, uint16_t p_u16Length);
+void I2CQUEUE_Poll(void);
+
+void I2CQUEUE_CpltIT(I2C_HandleTypeDef *p_phI2c);
+void I2CQUEUE_ErrorIT(I2C_HandleTypeDef *p_phI2c);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /*__I2C_QUEUE_H*/
+
+/*** End of File **************************************************************/
@@ -1,6 +1,8 @@
 #ifndef __ICM45686_H
 #define __ICM45686_H
 
+#include "imu/imu.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -27,6 +29,22 @@ extern "C" {
 #ifndef ICM45686_GYRO_XOUT_H
 #define ICM45686_GYRO_XOUT_H  0x06 /* GYRO_DATA_X1_UI */
 #endif
+#ifndef ICM45686_TEMP_DATA1
+#define ICM45686_TEMP_DATA1   0x0C /* TEMP_DATA1_UI */
+#endif
+#ifndef ICM45686_FIFO_COUNT_0
+#define ICM45686_FIFO_COUNT_0 0x12 /* FIFO_COUNT_0, packets */
+#endif
+#ifndef ICM45686_FIFO_DATA
+#define ICM45686_FIFO_DATA    0x14 /* FIFO_DATA */
+#endif
+
+/* FIFO_CONFIG0: FIFO_MODE [7:6] = 01 stream, FIFO_DEPTH [5:0] = 0x07 (2 kB) */
+#define ICM45686_FIFO_CONFIG0_STREAM       0x47
+/* FIFO_CONFIG3: FIFO_GYRO_EN, FIFO_ACCEL_EN, FIFO_IF_EN */
+#define ICM45686_FIFO_CONFIG3_ACCEL_GYRO   0x07
+/* FIFO packet header: ACCEL_EN [6], GYRO_EN [5] */
+#define ICM45686_FIFO_HEADER_ACCEL_GYRO    0x60
 
 /* WHO_AM_I register and expected ID */
 #ifndef ICM45686_WHO_AM_I
@@ -179,14 +197,10 @@ uint8_t ICM45686_TestDevice(void);
 void ICM45686_Init(void);
 
 /**
- * Read raw accelerometer (m/s^2)
- */
-void ICM45686_ReadAccelerometerRaw(float *x, float *y, float *z);
-
-/**
- * Read raw gyroscope (rad/s)
+ * Register map of the accel, gyro and temperature burst read
+ * (scale factors of the full scale selected by ICM45686_Init)
  */
-void ICM45686_ReadGyroRaw(float *x, float *y, float *z);
+const IMU_RegisterMap_t *ICM45686_GetRegisterMap(void);
 
 #ifdef __cplusplus
 }
@@ -26,23 +26,79 @@ typedef struct
 
 void IMU_ReadAccelerometer(float *x, float *y, float *z);
 void IMU_Onboard_ReadAccelerometer(float *x, float *y, float *z);
+uint8_t IMU_Onboard_ReadAccelerometerMean(float *x, float *y, float *z);
 float IMU_Onboard_ReadTemp(void);
 void IMU_ReadGyro(float *x, float *y, float *z);
+float IMU_ReadTemp(void);
 typedef float (*IMU_ReadBarometerTemperatureC)(void);
 typedef float (*IMU_ReadBarometerAltitudeMeters)(void);
 void IMU_Onboard_AccelerometerSetCovariance(float *cm);
 void IMU_AccelerometerSetCovariance(float *cm);
 void IMU_GyroSetCovariance(float *cm);
+void IMU_SetOrientation(uint8_t p_bEnable);
+uint8_t IMU_ReadOrientation(float *x, float *y, float *z, float *w);
+void IMU_OrientationSetCovariance(float *cm);
 void IMU_Normalize( VECTOR* p );
 
-/* Any external IMU needs to implement the following functions and adhere to the ROS REP 103 standard (https://www.ros.org/reps/rep-0103.html) */
-typedef void (*IMU_ReadGyroRaw)(float *x, float *y, float *z);
-typedef void (*IMU_ReadAccelerometerRaw)(float *x, float *y, float *z);
+/*
+ * one sample of the external IMU, accel, gyro and temperature come from the same burst read
+ */
+typedef struct
+{
+    float ax, ay, az;               // m/s^2
+    float gx, gy, gz;               // rad/sec
+    float temp;                     // °C
+} IMU_Sample_t;
+
+#define IMU_BURST_MAX           32
+#define IMU_FIFO_BURST_MAX      192             // bytes drained from a FIFO per IMU_POLL_MS
+#define IMU_POLL_MS             20              // IMU_StartSample() period
+#define IMU_RATE_MIN_HZ         1
+#define IMU_RATE_MAX_HZ         50
+#define IMU_RATE_DEFAULT_HZ     50
+#define IMU_CIC_ORDER           2               // decimation filter of the FIFO samples
+
+/* FIFO of an external IMU, drained every IMU_POLL_MS and decimated to the publish rate
+ * the entry callbacks run in the main loop
+ */
+typedef struct
+{
+    uint8_t u8StatusRegister;       // FIFO level, read in one burst
+    uint8_t u8StatusLength;
+    uint8_t u8DataRegister;         // FIFO output, the address rolls back within a burst
+    uint8_t u8EntryLength;          // bytes per FIFO entry
+    uint16_t u16RateHz;             // FIFO sample rate
+    uint16_t (*pfEntries)(const uint8_t *p_pu8Status);                      // entries in the FIFO
+    uint8_t (*pfEntry)(const uint8_t *p_pu8Entry, int16_t *p_ps16Sample);   // decodes an entry, 1 once accel X/Y/Z and gyro X/Y/Z of a sample are in p_ps16Sample
+} IMU_Fifo_t;
+
+/* Any external IMU needs to provide the register map of its data registers and adhere to the ROS REP 103 standard (https://www.ros.org/reps/rep-0103.html)
+ * accel, gyro and temperature have to be readable in one auto incremented burst, each vector is three 16 bit words in X, Y, Z order
+ */
+typedef struct
+{
+    uint8_t u8Address;              // 7 bit I2C address
+    uint8_t u8Register;             // first register of the burst
+    uint8_t u8Length;               // burst length in bytes, up to IMU_BURST_MAX
+    uint8_t bBigEndian;             // words are MSB first
+    int8_t s8Accel;                 // byte offset of accel X in the burst, -1 if there is none
+    int8_t s8Gyro;                  // byte offset of gyro X in the burst, -1 if there is none
+    int8_t s8Temp;                  // byte offset of the temperature in the burst, -1 if there is none
+    float fAccelScale;              // m/s^2 per LSB
+    float fGyroScale;               // rad/sec per LSB
+    float fTempScale;               // °C per LSB
+    float fTempOffset;              // °C at 0 LSB
+    const IMU_Fifo_t *psFifo;       // NULL if the samples are read one by one
+} IMU_RegisterMap_t;
 /* end of functions to implement for IMU */
 
 void IMU_Init();
 int IMU_HasAccelerometer();
 int IMU_HasGyro();
+uint8_t IMU_ReadSample(IMU_Sample_t *p_psSample);
+uint8_t IMU_StartSample(void);
+uint8_t IMU_SampleReady(void);
+uint8_t IMU_SetRate(uint8_t p_u8Hz);
 
 /* IMU calibration (accel/gyro only) */
 #define IMU_CAL_SAMPLES     100
@@ -0,0 +1,60 @@
+/****************************************************************************
+* Title                 :   IMU attitude filter
+* Filename              :   imu_fusion.h
+* Author                :
+* Origin Date           :
+* Version               :   1.0.0
+
+*****************************************************************************/
+/** \file imu_fusion.h
+*  \brief Mahony complementary filter of the external IMU, fed with the raw
+*         samples at the sensor rate. Single precision on the F401, fixed point
+*         on the F103 which has no FPU. No HAL dependency so it also builds on the host.
+*
+*/
+#ifndef __IMU_FUSION_H
+#define __IMU_FUSION_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+/******************************************************************************
+* Includes
+*******************************************************************************/
+#include <stdint.h>
+
+/******************************************************************************
+* Preprocessor Constants
+*******************************************************************************/
+
+/******************************************************************************
+* Constants
+*******************************************************************************/
+
+/******************************************************************************
+* Macros
+*******************************************************************************/
+
+/******************************************************************************
+* Typedefs
+*******************************************************************************/
+
+/******************************************************************************
+* Variables
+*******************************************************************************/
+
+/******************************************************************************
+* PUBLIC Function Prototypes
+*******************************************************************************/
+
+void IMUFUSION_Config(uint16_t p_u16RateHz, float p_fGyroScale, const float *p_pfBias, float p_fKp, float p_fKi);
+void IMUFUSION_Reset(void);
+void IMUFUSION_Update(const int16_t *p_ps16Sample);
+uint8_t IMUFUSION_GetQuaternion(float *p_pfQuaternion);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /*__IMU_FUSION_H*/
+
+/*** End of File **************************************************************/
@@ -2,10 +2,14 @@
 #ifndef __LSM6_H
 #define __LSM6_H
 
+#include "imu/imu.h"
+
 /* Calibration, Conversion factors */
 
 #define LSM6_G_FACTOR           0.000061f           // LSM6DS33 datasheet (page 15)  0.061 mg/LSB
 #define LSM6_DPS_FACTOR         0.00875f            // LSM6DS33 datasheet (page 15)  0.00875 °/sec/LSB 
+#define LSM6_DS33_T_FACTOR      (1.0f/16.0f)        // LSM6DS33 datasheet (page 15)  16 LSB/°C, 0 LSB = 25°C
+#define LSM6_DSO_T_FACTOR       (1.0f/256.0f)       // LSM6DSO datasheet  256 LSB/°C, 0 LSB = 25°C
 
 /* Gyro / Accelerometer */
 #define LSM6_SA0_LOW_ADDRESS 0b1101010
@@ -75,24 +79,25 @@
 #define LSM6_MD1_CFG            0x5E
 #define LSM6_MD2_CFG            0x5F
 
+/* LSM6DSO registers which differ from the LSM6DS33 */
+#define LSM6DSO_FIFO_CTRL3      0x09
+#define LSM6DSO_FIFO_CTRL4      0x0A
+#define LSM6DSO_FIFO_DATA_OUT_TAG 0x78
+#define LSM6DSO_TAG_GYRO        0x01
+#define LSM6DSO_TAG_ACCEL       0x02
+
 
 uint8_t LSM6_TestDevice(void);
 /**
   * @brief  Initialize IMU
-  * LSM6 +/- 2g acceleration 
+  * LSM6 +/- 2g acceleration, 208 Hz into the FIFO
   */
 void LSM6_Init(void);
 
 /**
-  * @brief  Reads the 3 accelerometer channels and stores them in *x,*y,*z
-  * units are m/s^2
-  */
-void LSM6_ReadAccelerometerRaw(float *x, float *y, float *z);
-
-/**
-  * @brief  Reads the 3 gyro channels and stores them in *x,*y,*z
-  * units are rad/sec
+  * @brief  Register map of the accel, gyro and temperature burst read
+  * units are m/s^2, rad/sec and °C
   */
-void LSM6_ReadGyroRaw(float *x, float *y, float *z);
+const IMU_RegisterMap_t *LSM6_GetRegisterMap(void);
 
 #endif /* __LSM6_H */
\ No newline at end of file
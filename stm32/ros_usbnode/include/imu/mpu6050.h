@@ -2,6 +2,8 @@
 #ifndef __MPU6050_H
 #define __MPU6050_H
 
+#include "imu/imu.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -19,16 +21,10 @@ uint8_t MPU6050_TestDevice(void);
 void MPU6050_Init(void);
 
 /**
-  * @brief  Reads the 3 accelerometer channels and stores them in *x,*y,*z
-  * units are m/s^2
-  */
-void MPU6050_ReadAccelerometerRaw(float *x, float *y, float *z);
-
-/**
-  * @brief  Reads the 3 gyro channels and stores them in *x,*y,*z
-  * units are rad/sec
+  * @brief  Register map of the accel, gyro and temperature burst read
+  * units are m/s^2, rad/sec and °C
   */
-void MPU6050_ReadGyroRaw(float *x, float *y, float *z);
+const IMU_RegisterMap_t *MPU6050_GetRegisterMap(void);
 
 #ifdef __cplusplus
 }
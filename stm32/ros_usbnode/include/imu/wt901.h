@@ -19,6 +19,7 @@
 * Includes
 *******************************************************************************/
 #include "stm32f_board_hal.h"
+#include "imu/imu.h"
 
 /**
  * @brief Test for WT901
@@ -33,16 +34,10 @@ uint8_t WT901_TestDevice(void);
 void WT901_Init(void);
 
 /**
-  * @brief  Reads the 3 accelerometer channels and stores them in *x,*y,*z
-  * units are m/s^2
+  * @brief  Register map of the accel, gyro and temperature burst read
+  * units are m/s^2, rad/sec and °C
   */
-void WT901_ReadAccelerometerRaw(float *x, float *y, float *z);
-
-/**
-  * @brief  Reads the 3 gyro channels and stores them in *x,*y,*z
-  * units are rad/sec
-  */
-void WT901_ReadGyroRaw(float *x, float *y, float *z);
+const IMU_RegisterMap_t *WT901_GetRegisterMap(void);
 
 #endif
 #endif /*WT901_H*/ 
@@ -0,0 +1,97 @@
+/****************************************************************************
+* Title                 :   latency probes
+* Filename              :   latency.h
+* Author                :
+* Origin Date           :
+* Version               :   1.0.0
+
+*****************************************************************************/
+/** \file latency.h
+*  \brief trigger to motor frame latency histograms, microsecond timestamps
+*         from the DWT cycle counter, published on mower/latency
+*
+*/
+#ifndef __LATENCY_H
+#define __LATENCY_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+/******************************************************************************
+* Includes
+*******************************************************************************/
+#include <stdint.h>
+
+#include "board.h"
+
+/******************************************************************************
+* Preprocessor Constants
+*******************************************************************************/
+/* bucket b counts the latencies from 2^b to 2^(b+1)-1 µs, the first one also
+ * counts the ones below 1µs and the last one everything above */
+#define LATENCY_BUCKETS 20
+/* statistics before the buckets: count, min (µs), max (µs), sum (µs) low then high 32 bits */
+#define LATENCY_STATS 5
+#define LATENCY_PROBE_LENGTH (LATENCY_STATS + LATENCY_BUCKETS)
+
+/******************************************************************************
+* Constants
+*******************************************************************************/
+
+/******************************************************************************
+* Macros
+*******************************************************************************/
+#define LATENCY_MASK(probe) ((uint8_t)(1U << (probe)))
+
+/******************************************************************************
+* Typedefs
+*******************************************************************************/
+/* a probe starts at its trigger and stops when the DMA starts to send the motor frame answering it */
+typedef enum
+{
+    LATENCY_INPUT_DRIVE = 0,    /* emergency input edge -> drive motor zero speed frame, debounce included */
+    LATENCY_INPUT_BLADE,        /* emergency input edge -> blade motor off frame, debounce included */
+    LATENCY_SERVICE_DRIVE,      /* mower_service/emergency -> drive motor zero speed frame */
+    LATENCY_SERVICE_BLADE,      /* mower_service/emergency -> blade motor off frame */
+    LATENCY_CMD_VEL,            /* cmd_vel received -> next drive motor request */
+    LATENCY_PROBE_MAX
+} LATENCY_Probe_e;
+
+/* time of a trigger, taken before the probe is started */
+typedef struct
+{
+    uint32_t u32Cycles;
+    uint32_t u32Tick;
+} LATENCY_Stamp_t;
+
+/******************************************************************************
+* Variables
+*******************************************************************************/
+
+/******************************************************************************
+* PUBLIC Function Prototypes
+*******************************************************************************/
+#if LATENCY_PROBES
+void LATENCY_Init(void);
+void LATENCY_Start(uint8_t p_u8Mask);
+void LATENCY_Stamp(LATENCY_Stamp_t *p_psStamp);
+void LATENCY_StartAt(uint8_t p_u8Mask, const LATENCY_Stamp_t *p_psStamp);
+uint8_t LATENCY_Armed(uint8_t p_u8Mask);
+void LATENCY_StopIT(uint8_t p_u8Mask);
+void LATENCY_Export(uint32_t *p_pu32Data);
+void LATENCY_Reset(void);
+#else
+#define LATENCY_Init()
+#define LATENCY_Start(mask)
+#define LATENCY_Stamp(stamp)
+#define LATENCY_StartAt(mask, stamp)
+#define LATENCY_Armed(mask) 0
+#define LATENCY_StopIT(mask)
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+#endif /*__LATENCY_H*/
+
+/*** End of File **************************************************************/
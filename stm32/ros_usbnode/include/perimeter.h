@@ -19,6 +19,7 @@
 * Includes
 *******************************************************************************/
 #include <stdbool.h>
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -26,6 +27,27 @@ extern "C" {
 /******************************************************************************
 * Preprocessor Constants
 *******************************************************************************/
+/* waveform stream (debug mode), one acquisition is sent in chunks of PERIMETER_STREAM_CHUNK_PTS,
+ * every chunk is a frame, multi byte fields little endian:
+ *  0  'P' 'W'
+ *  2  u8  version (PERIMETER_STREAM_VERSION)
+ *  3  u8  coil (perimeter_CoilNumber_e)
+ *  4  u32 sequence number of the acquisition
+ *  8  u32 HAL_GetTick() at the end of the acquisition
+ *  12 u16 points of the acquisition
+ *  14 u16 first point of the chunk
+ *  16 u16 points in the chunk (even)
+ *  18 u8  signal code (1 or 2), the strongest one when several are correlated
+ *  19 u8  oversampling of the correlation
+ *  20 u16 first correlated point (coil settling)
+ *  22 u16 acquisitions not correlated in time (overruns, wraps around)
+ *  24 f32 signal of this code detected by the firmware
+ *  28 points, 12 bit packed: 2 points in 3 bytes, p0 bits 0-7 | p0 bits 8-11 + p1 bits 0-3 | p1 bits 4-11
+ *  .. u8  sum of all previous bytes of the frame */
+#define PERIMETER_STREAM_VERSION 1
+#define PERIMETER_STREAM_CHUNK_PTS 428
+#define PERIMETER_STREAM_HEADER_LENGTH 28
+#define PERIMETER_STREAM_MAX_LENGTH (PERIMETER_STREAM_HEADER_LENGTH + PERIMETER_STREAM_CHUNK_PTS * 3 / 2 + 1)
 
 /******************************************************************************
 * Constants
@@ -55,11 +77,12 @@ extern ADC_HandleTypeDef ADC_Handle;
 *******************************************************************************/
 void Perimeter_vInit(void);
 void Perimeter_vApp(void);
-void PERIMETER_vITHandle(void);
+void PERIMETER_vITHandle(uint8_t p_u8Half);
 
 /**
  * @brief Which signal should we listen on?
- * @param sig 0=off, 1=S1, 2=S2 (129, 130=S1,S2 plus debug output).
+ * @param sig 0=off, 1=S1, 2=S2, 3=S1 and S2 (the strongest is reported), 0x80-0x82=S1 on the left, center or right coil only plus waveform stream,
+ *            0x83=S1 on all coils plus waveform stream.
  */
 void Perimeter_ListenOn(uint8_t sig);
 
@@ -70,15 +93,23 @@ int Perimeter_IsActive(void);
 
 /**
  * @brief Read the current signal status of the perimeter.
+ * @param code signal code of the values (1 or 2)
  * @return There was enough data to read.
  */
-int Perimeter_UpdateMsg(float *left,float *center,float *right);
+int Perimeter_UpdateMsg(float *left,float *center,float *right,uint8_t *code);
 
 /**
- * @brief Are perimeter values printed to the debug console?
+ * @brief Are perimeter waveforms streamed (debug mode)?
  */
 int Perimeter_UsesDebug(void);
 
+/**
+ * @brief Next frame of the waveform stream, see PERIMETER_STREAM_VERSION for the format.
+ * @param buffer at least PERIMETER_STREAM_MAX_LENGTH bytes
+ * @return frame length, 0 if there is nothing to send.
+ */
+uint16_t Perimeter_StreamChunk(uint8_t *buffer,uint16_t size);
+
 #ifdef __cplusplus
 }
 #endif
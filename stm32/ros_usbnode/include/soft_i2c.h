@@ -1,6 +1,8 @@
 #ifndef __SOFT_I2C_H
 #define __SOFT_I2C_H
 
+#include <stdint.h>
+
 /* defines */
 //#define GPIO_SW_I2C1_SCL           GPIOC
 //#define GPIO_SW_I2C1_SCL_PIN   GPIO_Pin_0
@@ -18,33 +20,41 @@
 #define SW_I2C9		9
 #define SW_I2C10	10
 
+typedef enum
+{
+    SW_I2C_OK = 0,
+    SW_I2C_NACK_ADDRESS,        /* no device at the address */
+    SW_I2C_NACK_REGISTER,
+    SW_I2C_NACK_DATA,
+    SW_I2C_NACK_READ_ADDRESS,
+    SW_I2C_TIMEOUT              /* SCL held low by a slave */
+} SW_I2C_Status_e;
+
+/* called from the timer interrupt at the end of a SW_I2C_Transfer() */
+typedef void (*SW_I2C_Callback_t)(SW_I2C_Status_e p_eStatus, void *p_pvContext);
+
+extern uint32_t SW_I2C_u32Errors;
+
 /* functions */
 void SW_I2C_Init(void);
 void SW_I2C_DeInit(void);
 
-void i2c_port_initial(void);		
-
 uint8_t SW_I2C_ReadVal_SDA(void);
+uint8_t SW_I2C_ReadVal_SCL(void);
 
-void SW_I2C_Write_Data(uint8_t data);
-uint8_t SW_I2C_Read_Data(void);
+/* non blocking */
+uint8_t SW_I2C_Transfer(uint8_t IICID, uint8_t regaddr, uint8_t bRead, uint8_t *pdata, uint8_t len, SW_I2C_Callback_t p_pfCallback, void *p_pvContext);
+uint8_t SW_I2C_Busy(void);
+void SW_I2C_TimerIT(void);
 
+/* blocking, IICID is the 8 bit address */
 uint8_t SW_I2C_WriteControl_8Bit(uint8_t IICID, uint8_t regaddr, uint8_t data);
-uint8_t SW_I2C_WriteControl_8Bit_OnlyRegAddr(uint8_t IICID, uint8_t regaddr);
-uint8_t SW_I2C_WriteControl_16Bit(uint8_t IICID, uint8_t regaddr, uint16_t data);
-
-uint8_t SW_I2C_ReadControl_8Bit_OnlyRegAddr(uint8_t IICID, uint8_t regaddr);
-uint8_t SW_I2C_ReadControl_8Bit_OnlyData(uint8_t IICID);
-uint16_t SW_I2C_ReadControl_16Bit_OnlyData(uint8_t IICID);
 uint8_t SW_I2C_ReadControl_8Bit(uint8_t IICID, uint8_t regaddr);
-uint16_t SW_I2C_ReadControl_16Bit(uint8_t IICID, uint8_t regaddr);
-
-uint8_t SW_I2C_ReadnControl_8Bit(uint8_t IICID, uint8_t regaddr, uint8_t rcnt, uint8_t (*pdata));
 uint8_t SW_I2C_Multi_ReadnControl_8Bit(uint8_t IICID, uint8_t regaddr, uint8_t rcnt, uint8_t (*pdata));
-uint8_t SW_I2C_Check_SlaveAddr(uint8_t IICID);
 
+/* blocking, IICID is the 7 bit address */
 uint8_t SW_I2C_UTIL_WRITE(uint8_t IICID, uint8_t regaddr, uint8_t data);
 uint8_t SW_I2C_UTIL_Read(uint8_t IICID, uint8_t regaddr);
 uint8_t SW_I2C_UTIL_Read_Multi(uint8_t IICID, uint8_t regaddr, uint8_t rcnt, uint8_t (*pdata));
 
-#endif  /* __SOFT_I2C_H */
\ No newline at end of file
+#endif  /* __SOFT_I2C_H */
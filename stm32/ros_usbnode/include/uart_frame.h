@@ -0,0 +1,103 @@
+/****************************************************************************
+* Title                 :   framed UART engine
+* Filename              :   uart_frame.h
+* Author                :
+* Origin Date           :
+* Version               :   1.0.0
+
+*****************************************************************************/
+/** \file uart_frame.h
+*  \brief shared 0x55 0xAA framed UART protocol engine (circular DMA reception,
+*         streaming parser and TX queue) used by drive, blade, panel and ultrasonic
+*
+*/
+#ifndef __UART_FRAME_H
+#define __UART_FRAME_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+/******************************************************************************
+* Includes
+*******************************************************************************/
+#include "stm32f_board_hal.h"
+#include "main.h"
+
+/******************************************************************************
+* Preprocessor Constants
+*******************************************************************************/
+#define UARTFRAME_MAX_HANDLES       4
+#define UARTFRAME_RX_BUFFER_SIZE    64      /* circular DMA buffer */
+#define UARTFRAME_TX_BUFFER_SIZE    128     /* TX queue */
+#define UARTFRAME_MAX_FRAME_LENGTH  32
+#define UARTFRAME_NO_CRC            0xFF    /* u8CrcOffset value for frames without CRC */
+
+/******************************************************************************
+* Constants
+*******************************************************************************/
+
+/******************************************************************************
+* Macros
+*******************************************************************************/
+
+/******************************************************************************
+* Typedefs
+*******************************************************************************/
+/* description of the frames received from one device */
+typedef struct
+{
+    const uint8_t *pu8Preamble;     /* bytes every frame starts with */
+    uint8_t u8PreambleLength;
+    uint8_t u8Length;               /* full frame length, preamble and CRC included */
+    uint8_t u8CrcOffset;            /* CRC byte position, the CRC is the sum of the bytes before it */
+} UARTFRAME_Descriptor_t;
+
+/* called from the UART interrupt for every complete frame, status is RX_VALID or RX_CRC_ERROR */
+typedef void (*UARTFRAME_Callback_t)(rx_status_e p_eStatus, const uint8_t *p_pu8Frame);
+
+typedef struct
+{
+    UART_HandleTypeDef *phUart;
+    const UARTFRAME_Descriptor_t *psDescriptor;
+    UARTFRAME_Callback_t pfCallback;
+
+    uint8_t pu8RxBuffer[UARTFRAME_RX_BUFFER_SIZE];
+    uint16_t u16RxTail;             /* next byte of the DMA buffer to parse */
+    uint8_t pu8Frame[UARTFRAME_MAX_FRAME_LENGTH];
+    uint8_t u8FrameIdx;
+
+    uint8_t pu8TxBuffer[UARTFRAME_TX_BUFFER_SIZE];
+    uint16_t u16TxHead;
+    uint16_t u16TxTail;
+    uint16_t u16TxCount;            /* bytes in the queue, including the ones being sent */
+    volatile uint16_t u16TxBusy;    /* bytes of the running DMA transfer */
+    uint8_t u8TxProbes;             /* latency probes stopped when the probed frame starts */
+    uint16_t u16TxProbeAhead;       /* bytes queued before the probed frame */
+
+    uint32_t u32RxFrames;
+    uint32_t u32CrcErrors;
+    uint32_t u32TxOverflows;
+} UARTFRAME_Handle_t;
+
+/******************************************************************************
+* Variables
+*******************************************************************************/
+
+/******************************************************************************
+* PUBLIC Function Prototypes
+*******************************************************************************/
+
+void UARTFRAME_Init(UARTFRAME_Handle_t *p_psHandle, UART_HandleTypeDef *p_phUart, const UARTFRAME_Descriptor_t *p_psDescriptor, UARTFRAME_Callback_t p_pfCallback);
+HAL_StatusTypeDef UARTFRAME_Transmit(UARTFRAME_Handle_t *p_psHandle, const uint8_t *p_pu8Data, uint16_t p_u16Length);
+HAL_StatusTypeDef UARTFRAME_TransmitProbe(UARTFRAME_Handle_t *p_psHandle, const uint8_t *p_pu8Data, uint16_t p_u16Length, uint8_t p_u8Probes);
+
+void UARTFRAME_RxEventIT(UART_HandleTypeDef *p_phUart, uint16_t p_u16Position);
+void UARTFRAME_TxCpltIT(UART_HandleTypeDef *p_phUart);
+void UARTFRAME_ErrorIT(UART_HandleTypeDef *p_phUart);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /*__UART_FRAME_H*/
+
+/*** End of File **************************************************************/
@@ -9,7 +9,6 @@ extern "C" {
 
 void ULTRASONICSENSOR_Init(void);
 void ULTRASONICSENSOR_App(void);
-void ULTRASONICSENSOR_ReceiveIT(void);
 uint32_t ULTRASONIC_MessageReceived(void);
 
 uint32_t ULTRASONICSENSOR_u32GetLeftDistance(void);
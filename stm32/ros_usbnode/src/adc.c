@@ -16,60 +16,160 @@
 #include "main.h"
 #include "perimeter.h"
 #include "adc.h"
+#include "charger.h"
+#ifdef ADC_CYCLE_BENCH
 #include <math.h>
+#include <string.h>
+#endif
 /******************************************************************************
  * Module Preprocessor Constants
  *******************************************************************************/
-const float f_RTO = 10000;
-const float beta = 3380;
+
+/* IIR filter coefficients (Q16) of the new sample */
+#define ADC_ALPHA_BATTERYVOLTAGE ADC_Q16(0.2)
+#define ADC_ALPHA_CHARGEVOLTAGE ADC_Q16(0.8)
+#define ADC_ALPHA_CURRENT ADC_Q16(0.8)
+#define ADC_ALPHA_NTC ADC_Q16(0.5)
+#define ADC_ALPHA_CHARGERINPUTVOLTAGE ADC_Q16(0.5)
+
+/* charging channels sampling time, shorter when synchronized to the PWM so the scan fits in
+ * ADC_CHARGING_SYNC_PWM_PERIODS and the current is sampled in ADC_CHARGING_SYNC_WINDOW */
+#if BOARD_YARDFORCE500_VARIANT_ORIG
+#if ADC_CHARGING_PWM_SYNC
+#define ADC_CHARGING_SAMPLETIME ADC_SAMPLETIME_71CYCLES_5
+#else
+#define ADC_CHARGING_SAMPLETIME ADC_SAMPLETIME_239CYCLES_5
+#endif
+#elif BOARD_YARDFORCE500_VARIANT_B
+#if ADC_CHARGING_PWM_SYNC
+#define ADC_CHARGING_SAMPLETIME ADC_SAMPLETIME_112CYCLES
+#else
+/* one conversion before each perimeter trigger: (84 + 12) cycles at 18MHz = 384 TIM2 ticks < ADC_PERIMETER_TRIGGER_TICKS */
+#define ADC_CHARGING_SAMPLETIME ADC_SAMPLETIME_84CYCLES
+#endif
+/* (28 + 12) cycles = 160 TIM2 ticks, done before the next period */
+#define ADC_PERIMETER_SAMPLETIME ADC_SAMPLETIME_28CYCLES
+#endif
+
+#if BOARD_YARDFORCE500_VARIANT_B && ADC_CHARGING_PWM_SYNC && defined(OPTION_PERIMETER)
+#error "ADC_CHARGING_PWM_SYNC can not be used with OPTION_PERIMETER on the STM32F4, TIM2 paces the perimeter samples"
+#endif
+
+#if ADC_OVERSAMPLING_BITS < 1 || ADC_OVERSAMPLING_BITS > 4
+#error "ADC_OVERSAMPLING_BITS has to be 1 to 4"
+#endif
+#if ADC_OVERSAMPLING_RATIO < (1 << (2 * ADC_OVERSAMPLING_BITS))
+#error "ADC_OVERSAMPLING_HZ too high, ADC_OVERSAMPLING_BITS needs 4^bits scans per value"
+#endif
+
+/* raw (Q16) to mV / mA gains, Q16 */
+#define ADC_GAIN_BATTERYVOLTAGE ADC_Q16((double)ADC_VREF_MV * 10.09 / ADC_FULL_SCALE)
+#define ADC_OFFSET_BATTERYVOLTAGE_MV 600
+#define ADC_GAIN_CHARGEVOLTAGE ADC_Q16((double)ADC_VREF_MV * 16 / ADC_FULL_SCALE)
+#define ADC_GAIN_CURRENT ADC_Q16((double)ADC_VREF_MV * 100 / 12 / ADC_FULL_SCALE)
+#define ADC_OFFSET_CURRENT_MA (-2500 * 100 / 12)  /* 2.5V at 0A, 12mV/100mA */
+#define ADC_GAIN_CHARGERINPUTVOLTAGE ADC_Q16((double)ADC_VREF_MV * 16 / ADC_FULL_SCALE)
 
 /******************************************************************************
  * Module Preprocessor Macros
  *******************************************************************************/
+#define ADC_Q16(x) ((int32_t)((x) * 65536.0 + 0.5))
 
 /******************************************************************************
  * Module Typedefs
  *******************************************************************************/
-typedef enum
-{
-    ADC_CHARGING_CHANNEL_CURRENT = 0,
-    ADC_CHARGING_CHANNEL_CHARGEVOLTAGE,
-    ADC_CHARGING_CHANNEL_BATTERYVOLTAGE,
-    ADC_CHARGING_CHANNEL_CHARGERINPUTVOLTAGE,
-    ADC_CHARGING_CHANNEL_NTC,
-    ADC_CHARGING_CHANNEL_MAX,
-} ADC_Charging_channelSelection_e;
 
 /******************************************************************************
  * Module Variable Definitions
  *******************************************************************************/
 TIM_HandleTypeDef TIM2_Handle; // Time Base for ADC
 ADC_HandleTypeDef ADC_Charging_Handle;
+#if BOARD_YARDFORCE500_VARIANT_B
+#if !ADC_CHARGING_PWM_SYNC
+TIM_HandleTypeDef TIM5_Handle; // injected charging conversions, every ADC_CHARGING_PERIMETER_PERIODS TIM2 periods
+#endif
+DMA_HandleTypeDef hdma_adc; // perimeter samples, regular group of the shared ADC1
+#endif
 RTC_HandleTypeDef hrtc = {0};
 
-ADC_Charging_channelSelection_e adc_charging_eChannelSelection = ADC_CHARGING_CHANNEL_CURRENT;
+/* last raw value of every charging channel, average of ADC_CHARGING_AVERAGE TIM2 triggered scans */
+volatile uint16_t adc_pu16ChargingSamples[ADC_CHARGING_CHANNEL_MAX] = {0};
+#if BOARD_YARDFORCE500_VARIANT_B
+/* last injected values, the NTC takes the 4th rank of the charger input voltage once every ADC_NTC_SCAN_PERIOD scans */
+static uint16_t adc_pu16ChargingScan[ADC_CHARGING_CHANNEL_MAX] = {0};
+static ADC_Charging_channelSelection_e adc_eInjectedRank4 = ADC_CHARGING_CHANNEL_CHARGERINPUTVOLTAGE;
+static uint8_t adc_u8NtcScans = 0;
+static const uint32_t adc_pu32ChargingChannels[ADC_CHARGING_CHANNEL_MAX] = {ADC_CHANNEL_1,   // PA1 Charge Current
+                                                                          ADC_CHANNEL_2,   // PA2 Charge Voltage
+                                                                          ADC_CHANNEL_3,   // PA3 Battery
+                                                                          ADC_CHANNEL_7,   // PA7 Charger Input voltage
+                                                                          ADC_CHANNEL_13}; // PC2 Blade NTC
+#ifdef OPTION_PERIMETER
+static volatile uint16_t *adc_pu16PerimeterBuffer = NULL;
+static uint32_t adc_u32PerimeterLength = 0;
+#endif
+#endif
+#if ADC_CHARGING_AVERAGE > 1
+static uint32_t adc_pu32ChargingSum[ADC_CHARGING_CHANNEL_MAX] = {0};
+static uint8_t adc_u8ChargingScans = 0;
+#endif
 
-volatile uint16_t adc_u16BatteryVoltage       = 0;
-volatile uint16_t adc_u16Current              = 0;
-volatile uint16_t adc_u16ChargerVoltage       = 0;
-volatile uint16_t adc_u16ChargerInputVoltage  = 0;
-volatile uint16_t adc_u16Input_NTC            = 0;
+/* oversampling of ADC_OVERSAMPLING_CHANNELS, raw values with ADC_OVERSAMPLING_BITS more bits */
+static volatile uint16_t adc_pu16Oversampled[ADC_CHARGING_CHANNEL_MAX] = {0};
+static uint32_t adc_pu32OversamplingSum[ADC_CHARGING_CHANNEL_MAX] = {0};
+static uint16_t adc_u16OversamplingScans = 0;
+static volatile uint8_t adc_u8OversampledChannels = 0; /* channels with a first value */
 
 float battery_voltage;
 float charge_voltage;
 float current;
 float current_without_offset;
-float ntc_voltage;
 float blade_temperature;
 float chargerInputVoltage;
 
+/* raw to mV / mA conversion of every charging channel, the NTC goes through ADC_sNtcTable */
+static const int32_t adc_ps32Gain[ADC_CHARGING_CHANNEL_MAX] = {
+    [ADC_CHARGING_CHANNEL_CURRENT] = ADC_GAIN_CURRENT,
+    [ADC_CHARGING_CHANNEL_CHARGEVOLTAGE] = ADC_GAIN_CHARGEVOLTAGE,
+    [ADC_CHARGING_CHANNEL_BATTERYVOLTAGE] = ADC_GAIN_BATTERYVOLTAGE,
+    [ADC_CHARGING_CHANNEL_CHARGERINPUTVOLTAGE] = ADC_GAIN_CHARGERINPUTVOLTAGE,
+};
+static const int32_t adc_ps32OffsetMilli[ADC_CHARGING_CHANNEL_MAX] = {
+    [ADC_CHARGING_CHANNEL_CURRENT] = ADC_OFFSET_CURRENT_MA,
+    [ADC_CHARGING_CHANNEL_BATTERYVOLTAGE] = ADC_OFFSET_BATTERYVOLTAGE_MV,
+};
+
+/* filtered raw values (Q16) */
+static int32_t adc_ps32Filtered[ADC_CHARGING_CHANNEL_MAX] = {0};
+static uint8_t adc_bFilterInit = 0;
+
 union FtoU ampere_acc;
 union FtoU charge_current_offset;
 
+#ifdef ADC_CYCLE_BENCH
+/* the former float conversion, only kept to compare against */
+ADC_FloatView_t ADC_sFloatView = {0};
+#endif
+
 /******************************************************************************
  * Function Prototypes
  *******************************************************************************/
-void adc_charging_SetChannel(ADC_Charging_channelSelection_e channel);
+static void adc_charging_ConfigChannels(void);
+#if BOARD_YARDFORCE500_VARIANT_B && !ADC_CHARGING_PWM_SYNC
+static void adc_TIM5_Init(void);
+#endif
+#if BOARD_YARDFORCE500_VARIANT_B && defined(OPTION_PERIMETER)
+static void adc_perimeterHalfCplt(DMA_HandleTypeDef *p_phDma);
+static void adc_perimeterCplt(DMA_HandleTypeDef *p_phDma);
+#endif
+static void adc_charging_ScanDone(const volatile uint16_t *p_pu16Scan);
+static void adc_oversample(const volatile uint16_t *p_pu16Scan);
+static int32_t adc_rawQ16(ADC_Charging_channelSelection_e p_eChannel);
+static void adc_filter(ADC_Charging_channelSelection_e p_eChannel, int32_t p_s32Alpha);
+static int32_t adc_scale(ADC_Charging_channelSelection_e p_eChannel);
+#ifdef ADC_CYCLE_BENCH
+static uint32_t adc_cycles(void (*p_pfInput)(void), uint16_t p_u16Runs);
+#endif
 
 /******************************************************************************
  *  Public Functions
@@ -78,7 +178,9 @@ void adc_charging_SetChannel(ADC_Charging_channelSelection_e channel);
 /**
  * @brief TIM2 Initialization Function
  *
- * Used to start ADC every 250µs
+ * Used to start ADC every 250µs, or every ADC_CHARGING_SYNC_PWM_PERIODS charge PWM periods
+ * with ADC_CHARGING_PWM_SYNC (clocked by TIM1 TRGO).
+ * STM32F4: perimeter sample period, CC2 triggers the perimeter samples and TRGO clocks TIM5
  *
  * @param None
  * @retval None
@@ -99,22 +201,34 @@ void TIM2_Init(void)
 
     /* USER CODE END TIM2_Init 1 */
     TIM2_Handle.Instance = TIM2;
+#if ADC_CHARGING_PWM_SYNC
+    TIM2_Handle.Init.Prescaler = 0;
+    TIM2_Handle.Init.Period = ADC_CHARGING_SYNC_PWM_PERIODS - 1;
+#elif BOARD_YARDFORCE500_VARIANT_B
+    TIM2_Handle.Init.Prescaler = 0;
+    TIM2_Handle.Init.Period = ADC_PERIMETER_SAMPLE_TICKS - 1;
+#else
     TIM2_Handle.Init.Prescaler = 18 - 1; // 72Mhz -> 4Mhz
+    TIM2_Handle.Init.Period = (4000000 / ADC_CHARGING_SCAN_HZ) - 1;
+#endif
     TIM2_Handle.Init.CounterMode = TIM_COUNTERMODE_UP;
-    TIM2_Handle.Init.Period = 1000 - 1; /*1khz*/
     TIM2_Handle.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
     TIM2_Handle.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_DISABLE;
     if (HAL_TIM_OC_Init(&TIM2_Handle) != HAL_OK)
     {
         Error_Handler();
     }
+#if ADC_CHARGING_PWM_SYNC
+    sClockSourceConfig.ClockSource = TIM_CLOCKSOURCE_ITR0; /* TIM1 TRGO, one tick per charge PWM period */
+#else
     sClockSourceConfig.ClockSource = TIM_CLOCKSOURCE_INTERNAL;
+#endif
     if (HAL_TIM_ConfigClockSource(&TIM2_Handle, &sClockSourceConfig) != HAL_OK)
     {
         Error_Handler();
     }
 
-    sMasterConfig.MasterOutputTrigger = TIM_TRGO_RESET;
+    sMasterConfig.MasterOutputTrigger = TIM_TRGO_UPDATE; /* injected charging scan on the STM32F1, TIM5 clock on the STM32F4 */
     sMasterConfig.MasterSlaveMode = TIM_MASTERSLAVEMODE_DISABLE;
     if (HAL_TIMEx_MasterConfigSynchronization(&TIM2_Handle, &sMasterConfig) != HAL_OK)
     {
@@ -122,7 +236,14 @@ void TIM2_Init(void)
     }
 
     sConfigOC.OCMode = TIM_OCMODE_TOGGLE;
+#if ADC_CHARGING_PWM_SYNC
+    sConfigOC.Pulse = 0;
+#elif BOARD_YARDFORCE500_VARIANT_B
+    sConfigOC.OCMode = TIM_OCMODE_PWM2; /* one rising edge per period, after the injected conversion */
+    sConfigOC.Pulse = ADC_PERIMETER_TRIGGER_TICKS;
+#else
     sConfigOC.Pulse = 5;
+#endif
     sConfigOC.OCPolarity = TIM_OCPOLARITY_HIGH;
     sConfigOC.OCFastMode = TIM_OCFAST_DISABLE;
     if (HAL_TIM_OC_ConfigChannel(&TIM2_Handle, &sConfigOC, TIM_CHANNEL_2) != HAL_OK)
@@ -181,22 +302,29 @@ void ADC_Charging_Init(void)
 
     /** Common config
      */
+    /* STM32F1: ADC2 has no DMA request, current and voltages are converted by the injected group
+     *          (4 ranks, TIM2 TRGO) and read in the JEOC interrupt, the NTC by the regular group (TIM2 CC2)
+     * STM32F4: ADC1 is shared with the perimeter. Current and voltages are converted by the injected group
+     *          (4 ranks, one per TIM5 CC4 trigger or the whole scan on TIM2 TRGO with ADC_CHARGING_PWM_SYNC),
+     *          the 4th rank alternates between the charger input voltage and the NTC. The regular group is
+     *          the perimeter (TIM2 CC2, DMA), only triggered while ADC_PerimeterStart() runs
+     */
     ADC_Charging_Handle.Instance = Charging_ADC;
-	// technically ADC_SCAN_DISABLE on STM32f1, but this is compatible with STM32f1 und STM32f4, and zero is zero
-	ADC_Charging_Handle.Init.ScanConvMode = DISABLE;
 	ADC_Charging_Handle.Init.ContinuousConvMode = DISABLE;
 	ADC_Charging_Handle.Init.DiscontinuousConvMode = DISABLE;
 	ADC_Charging_Handle.Init.ExternalTrigConv = ADC_EXTERNALTRIGCONV_T2_CC2;
 	ADC_Charging_Handle.Init.DataAlign = ADC_DATAALIGN_RIGHT;
+#if BOARD_YARDFORCE500_VARIANT_ORIG
+	ADC_Charging_Handle.Init.ScanConvMode = ADC_SCAN_ENABLE; /* needed for the injected sequence */
+	ADC_Charging_Handle.Init.NbrOfConversion = 1;
+#elif BOARD_YARDFORCE500_VARIANT_B
+	ADC_Charging_Handle.Init.ScanConvMode = ENABLE; /* needed for the injected sequence */
 	ADC_Charging_Handle.Init.NbrOfConversion = 1;
-
-#if BOARD_YARDFORCE500_VARIANT_B
 	ADC_Charging_Handle.Init.ClockPrescaler = ADC_CLOCK_SYNC_PCLK_DIV4;
 	ADC_Charging_Handle.Init.Resolution = ADC_RESOLUTION_12B;
-	ADC_Charging_Handle.Init.ExternalTrigConvEdge = ADC_EXTERNALTRIGCONVEDGE_RISING;
-    ADC_Charging_Handle.Init.ExternalTrigConv = ADC_EXTERNALTRIGCONV_T2_CC2;
-	ADC_Charging_Handle.Init.DMAContinuousRequests = DISABLE;
-	ADC_Charging_Handle.Init.EOCSelection = ADC_EOC_SINGLE_CONV;
+	ADC_Charging_Handle.Init.ExternalTrigConvEdge = ADC_EXTERNALTRIGCONVEDGE_NONE; /* set by ADC_PerimeterStart() */
+	ADC_Charging_Handle.Init.DMAContinuousRequests = ENABLE;
+	ADC_Charging_Handle.Init.EOCSelection = ADC_EOC_SEQ_CONV;
 #endif
 
     if (HAL_ADC_Init(&ADC_Charging_Handle) != HAL_OK)
@@ -204,8 +332,25 @@ void ADC_Charging_Init(void)
         Error_Handler();
     }
 
-	adc_charging_eChannelSelection = ADC_CHARGING_CHANNEL_CURRENT;
-	adc_charging_SetChannel(adc_charging_eChannelSelection);
+	adc_charging_ConfigChannels();
+
+#if BOARD_YARDFORCE500_VARIANT_B
+    hdma_adc.Instance = DMA2_Stream0;
+    hdma_adc.Init.Channel = DMA_CHANNEL_0;
+    hdma_adc.Init.Direction = DMA_PERIPH_TO_MEMORY;
+    hdma_adc.Init.PeriphInc = DMA_PINC_DISABLE;
+    hdma_adc.Init.MemInc = DMA_MINC_ENABLE;
+    hdma_adc.Init.PeriphDataAlignment = DMA_PDATAALIGN_HALFWORD;
+    hdma_adc.Init.MemDataAlignment = DMA_MDATAALIGN_HALFWORD;
+    hdma_adc.Init.Mode = DMA_CIRCULAR;
+    hdma_adc.Init.Priority = DMA_PRIORITY_HIGH;
+    hdma_adc.Init.FIFOMode = DMA_FIFOMODE_DISABLE;
+    if (HAL_DMA_Init(&hdma_adc) != HAL_OK)
+    {
+        Error_Handler();
+    }
+    __HAL_LINKDMA(&ADC_Charging_Handle, DMA_Handle, hdma_adc);
+#endif
 
 #if BOARD_YARDFORCE500_VARIANT_ORIG
 	IRQn_Type used_ADC_irq = ADC1_2_IRQn;
@@ -223,8 +368,18 @@ void ADC_Charging_Init(void)
 	// TODO: The STM32f4 does not have a function to calibrate the ADC,
 	//		 so we either need manual calibration or just assume it is
 	// 		 calibrated correctly all the time
+    HAL_ADC_Start(&ADC_Charging_Handle);
+    HAL_ADCEx_InjectedStart_IT(&ADC_Charging_Handle);
+#elif BOARD_YARDFORCE500_VARIANT_B
+    /* perimeter DMA half / transfer complete */
+    HAL_NVIC_SetPriority(DMA2_Stream0_IRQn, 0, 0);
+    HAL_NVIC_EnableIRQ(DMA2_Stream0_IRQn);
+    HAL_ADCEx_InjectedStart_IT(&ADC_Charging_Handle);
+#if !ADC_CHARGING_PWM_SYNC
+    adc_TIM5_Init();
+    HAL_TIM_OC_Start(&TIM5_Handle, TIM_CHANNEL_4);
+#endif
 #endif
-    HAL_ADC_Start_IT(&ADC_Charging_Handle);
     HAL_TIM_OC_Start(&TIM2_Handle, TIM_CHANNEL_2);
 
     /* USER CODE BEGIN RTC_MspInit 0 */
@@ -259,169 +414,469 @@ void ADC_Charging_Init(void)
  */
 
 void ADC_input(void)
+{
+    uint8_t l_u8Idx;
+
+    if (!adc_bFilterInit)
+    {
+        /* start the filters from the first samples instead of 0 */
+        for (l_u8Idx = 0; l_u8Idx < ADC_CHARGING_CHANNEL_MAX; l_u8Idx++)
+        {
+            adc_ps32Filtered[l_u8Idx] = (int32_t)adc_pu16ChargingSamples[l_u8Idx] << 16;
+        }
+        adc_bFilterInit = 1;
+    }
+    adc_filter(ADC_CHARGING_CHANNEL_BATTERYVOLTAGE, ADC_ALPHA_BATTERYVOLTAGE);
+    adc_filter(ADC_CHARGING_CHANNEL_CHARGEVOLTAGE, ADC_ALPHA_CHARGEVOLTAGE);
+    adc_filter(ADC_CHARGING_CHANNEL_CURRENT, ADC_ALPHA_CURRENT);
+    adc_filter(ADC_CHARGING_CHANNEL_NTC, ADC_ALPHA_NTC);
+    adc_filter(ADC_CHARGING_CHANNEL_CHARGERINPUTVOLTAGE, ADC_ALPHA_CHARGERINPUTVOLTAGE);
+
+    /* the conversions are linear so they are done on the filtered raw values,
+     * the floats are only the view used by the charger and the ROS messages */
+    battery_voltage = adc_scale(ADC_CHARGING_CHANNEL_BATTERYVOLTAGE) * 0.001f;
+    charge_voltage = adc_scale(ADC_CHARGING_CHANNEL_CHARGEVOLTAGE) * 0.001f;
+    current_without_offset = adc_scale(ADC_CHARGING_CHANNEL_CURRENT) * 0.001f;
+    /*remove offset*/
+    current = current_without_offset - charge_current_offset.f;
+
+    /* blade motor temperature from the NTC table */
+    blade_temperature = ADC_NtcCentiDegree(adc_ps32Filtered[ADC_CHARGING_CHANNEL_NTC]) * 0.01f;
+
+    /* Input voltage from the external supply*/
+    chargerInputVoltage = adc_scale(ADC_CHARGING_CHANNEL_CHARGERINPUTVOLTAGE) * 0.001f;
+}
+
+#ifdef ADC_CYCLE_BENCH
+/// @brief the float conversion ADC_input() had before the Q16 filters and the NTC table,
+/// same filters, same constants, on the same raw values, into ADC_sFloatView
+/// @param
+void ADC_InputFloat(void)
 {
     float l_fTmp;
 
     /* battery volatge calculation */
-    l_fTmp = ((float)adc_u16BatteryVoltage / 4095.0f) * 3.3f * 10.09 + 0.6f;
-    battery_voltage = 0.2 * l_fTmp + 0.8 * battery_voltage;
+    l_fTmp = ((float)adc_pu16ChargingSamples[ADC_CHARGING_CHANNEL_BATTERYVOLTAGE] / 4095.0f) * 3.3f * 10.09 + 0.6f;
+    ADC_sFloatView.battery_voltage = 0.2 * l_fTmp + 0.8 * ADC_sFloatView.battery_voltage;
 
      /*charger voltage calculation */
-    l_fTmp = ((float)adc_u16ChargerVoltage / 4095.0f) * 3.3f * 16;
-    charge_voltage = 0.8 * l_fTmp + 0.2 * charge_voltage;
+    l_fTmp = ((float)adc_pu16ChargingSamples[ADC_CHARGING_CHANNEL_CHARGEVOLTAGE] / 4095.0f) * 3.3f * 16;
+    ADC_sFloatView.charge_voltage = 0.8 * l_fTmp + 0.2 * ADC_sFloatView.charge_voltage;
 
     /*charge current calculation */
-    l_fTmp = (((float)adc_u16Current / 4095.0f) * 3.3f - 2.5f) * 100 / 12.0;
-    current_without_offset =   0.8 * l_fTmp + 0.2 * current_without_offset;          
-
-    /*remove offset*/
-    current = current_without_offset - charge_current_offset.f;
+    l_fTmp = (((float)adc_pu16ChargingSamples[ADC_CHARGING_CHANNEL_CURRENT] / 4095.0f) * 3.3f - 2.5f) * 100 / 12.0;
+    ADC_sFloatView.current_without_offset =   0.8 * l_fTmp + 0.2 * ADC_sFloatView.current_without_offset;
 
     /*blade motor temperature calculation */
-    l_fTmp = (adc_u16Input_NTC/4095.0f)*3.3f;
-    ntc_voltage = 0.5*l_fTmp + 0.5*ntc_voltage;
+    l_fTmp = (adc_pu16ChargingSamples[ADC_CHARGING_CHANNEL_NTC]/4095.0f)*3.3f;
+    ADC_sFloatView.ntc_voltage = 0.5*l_fTmp + 0.5*ADC_sFloatView.ntc_voltage;
 
     /*calculation for NTC temperature*/
-    l_fTmp = ntc_voltage * 10000;               //Resistance of RT
-    l_fTmp = log(l_fTmp / f_RTO);
-    l_fTmp = (1 / ((l_fTmp / beta) + (1 / (273.15+25)))); //Temperature from thermistor
-    blade_temperature = l_fTmp - 273.15;                 //Conversion to Celsius  
+    l_fTmp = ADC_sFloatView.ntc_voltage * 10000;               //Resistance of RT
+    l_fTmp = log(l_fTmp / (float)ADC_NTC_R25);
+    l_fTmp = (1 / ((l_fTmp / (float)ADC_NTC_BETA) + (1 / (273.15+25)))); //Temperature from thermistor
+    ADC_sFloatView.blade_temperature = l_fTmp - 273.15;                 //Conversion to Celsius
 
     /* Input voltage from the external supply*/
-    l_fTmp = (adc_u16ChargerInputVoltage / 4095.0f) * 3.3f * (32 / 2);
-    chargerInputVoltage = 0.5 * l_fTmp + 0.5 * chargerInputVoltage;
+    l_fTmp = (adc_pu16ChargingSamples[ADC_CHARGING_CHANNEL_CHARGERINPUTVOLTAGE] / 4095.0f) * 3.3f * (32 / 2);
+    ADC_sFloatView.chargerInputVoltage = 0.5 * l_fTmp + 0.5 * ADC_sFloatView.chargerInputVoltage;
+}
 
+/// @brief DWT cycles of ADC_input() and of the former float conversion, on the last samples,
+/// printed on the debug output. The filter states are put back afterwards.
+/// The DWT cycle counter has to run (LATENCY_Init() or I2CQUEUE_Init())
+/// @param
+void ADC_CycleBench(void)
+{
+    int32_t l_ps32Filtered[ADC_CHARGING_CHANNEL_MAX];
+    ADC_FloatView_t l_sFloatView = ADC_sFloatView;
+    uint8_t l_bFilterInit = adc_bFilterInit;
+    uint32_t l_u32Fixed, l_u32Float;
+
+    memcpy(l_ps32Filtered, adc_ps32Filtered, sizeof(l_ps32Filtered));
+    l_u32Fixed = adc_cycles(ADC_input, ADC_CYCLE_BENCH);
+    l_u32Float = adc_cycles(ADC_InputFloat, ADC_CYCLE_BENCH);
+    memcpy(adc_ps32Filtered, l_ps32Filtered, sizeof(l_ps32Filtered));
+    adc_bFilterInit = l_bFilterInit;
+    ADC_sFloatView = l_sFloatView;
+    ADC_input();
+
+    debug_printf("ADC_input(): %lu cycles, former float conversion: %lu cycles (%d runs)\r\n",
+                 (unsigned long)l_u32Fixed, (unsigned long)l_u32Float, ADC_CYCLE_BENCH);
+}
+#endif
+
+/// @brief last sample of a charging channel, not filtered, for the charge control loop
+/// @param p_eChannel charging channel (not the NTC)
+/// @retval mV or mA
+int32_t ADC_ChargingSampleMilli(ADC_Charging_channelSelection_e p_eChannel)
+{
+    return (int32_t)(((int64_t)adc_pu16ChargingSamples[p_eChannel] * adc_ps32Gain[p_eChannel] + (1 << 15)) >> 16) + adc_ps32OffsetMilli[p_eChannel];
+}
+
+#if BOARD_YARDFORCE500_VARIANT_B && defined(OPTION_PERIMETER)
+/// @brief start the perimeter acquisition on the regular group of the shared ADC1, the injected
+/// charging conversions go on. DMA in circular mode, PERIMETER_vITHandle() on every half
+/// @param p_pu16Buffer samples, two halves
+/// @param p_u32Length number of samples in the buffer
+void ADC_PerimeterStart(volatile uint16_t *p_pu16Buffer, uint32_t p_u32Length)
+{
+    adc_pu16PerimeterBuffer = p_pu16Buffer;
+    adc_u32PerimeterLength = p_u32Length;
+
+    /* HAL_ADC_Start_DMA / HAL_ADC_Stop_DMA would start and stop the whole ADC, the DMA is driven directly */
+    hdma_adc.XferHalfCpltCallback = adc_perimeterHalfCplt;
+    hdma_adc.XferCpltCallback = adc_perimeterCplt;
+    hdma_adc.XferErrorCallback = NULL;
+    __HAL_ADC_CLEAR_FLAG(&ADC_Charging_Handle, ADC_FLAG_OVR);
+    __HAL_ADC_ENABLE_IT(&ADC_Charging_Handle, ADC_IT_OVR);
+    SET_BIT(ADC_Charging_Handle.Instance->CR2, ADC_CR2_DMA | ADC_CR2_DDS);
+    if (HAL_DMA_Start_IT(&hdma_adc, (uint32_t)&ADC_Charging_Handle.Instance->DR, (uint32_t)p_pu16Buffer, p_u32Length) != HAL_OK)
+    {
+        Error_Handler();
+    }
+    /* TIM2 CC2 rising edges */
+    MODIFY_REG(ADC_Charging_Handle.Instance->CR2, ADC_CR2_EXTEN, ADC_EXTERNALTRIGCONVEDGE_RISING);
+}
+
+/// @brief stop the perimeter acquisition, the injected charging conversions go on
+/// @param
+void ADC_PerimeterStop(void)
+{
+    CLEAR_BIT(ADC_Charging_Handle.Instance->CR2, ADC_CR2_EXTEN | ADC_CR2_DMA | ADC_CR2_DDS);
+    __HAL_ADC_DISABLE_IT(&ADC_Charging_Handle, ADC_IT_OVR);
+    HAL_DMA_Abort(&hdma_adc);
+    adc_pu16PerimeterBuffer = NULL;
+}
+#endif
+
+#if BOARD_YARDFORCE500_VARIANT_ORIG && defined(OPTION_PERIMETER)
+/// @brief first half of the circular perimeter buffer acquired
+/// @param hadc
+void HAL_ADC_ConvHalfCpltCallback(ADC_HandleTypeDef *hadc)
+{
+    if (hadc == &ADC_Handle)
+    {
+        PERIMETER_vITHandle(0);
+    }
 }
 
 void HAL_ADC_ConvCpltCallback(ADC_HandleTypeDef *hadc)
 {
-#ifdef OPTION_PERIMETER
     if (hadc == &ADC_Handle)
     {
-        PERIMETER_vITHandle();
+        PERIMETER_vITHandle(1);
     }
+}
 #endif
 
+/// @brief end of the injected charging scan, one interrupt per scan
+/// @param hadc
+void HAL_ADCEx_InjectedConvCpltCallback(ADC_HandleTypeDef *hadc)
+{
+#if BOARD_YARDFORCE500_VARIANT_ORIG
+    uint16_t l_pu16Scan[ADC_CHARGING_CHANNEL_MAX];
+
     if (hadc == &ADC_Charging_Handle)
     {
-        uint16_t l_u16Rawdata = ADC_Charging_Handle.Instance->DR;
+        l_pu16Scan[ADC_CHARGING_CHANNEL_CURRENT] = hadc->Instance->JDR1;
+        l_pu16Scan[ADC_CHARGING_CHANNEL_CHARGEVOLTAGE] = hadc->Instance->JDR2;
+        l_pu16Scan[ADC_CHARGING_CHANNEL_BATTERYVOLTAGE] = hadc->Instance->JDR3;
+        l_pu16Scan[ADC_CHARGING_CHANNEL_CHARGERINPUTVOLTAGE] = hadc->Instance->JDR4;
+        /* converted by the regular group, no interrupt for it */
+        l_pu16Scan[ADC_CHARGING_CHANNEL_NTC] = hadc->Instance->DR;
+        adc_charging_ScanDone(l_pu16Scan);
+    }
+#elif BOARD_YARDFORCE500_VARIANT_B
+    ADC_Charging_channelSelection_e l_eRank4;
 
-        switch (adc_charging_eChannelSelection)
+    if (hadc == &ADC_Charging_Handle)
+    {
+        adc_pu16ChargingScan[ADC_CHARGING_CHANNEL_CURRENT] = hadc->Instance->JDR1;
+        adc_pu16ChargingScan[ADC_CHARGING_CHANNEL_CHARGEVOLTAGE] = hadc->Instance->JDR2;
+        adc_pu16ChargingScan[ADC_CHARGING_CHANNEL_BATTERYVOLTAGE] = hadc->Instance->JDR3;
+        adc_pu16ChargingScan[adc_eInjectedRank4] = hadc->Instance->JDR4;
+
+        /* the NTC for the next scan every ADC_NTC_SCAN_PERIOD scans, the injected sequence starts again at rank 1 */
+        adc_u8NtcScans = (adc_u8NtcScans + 1) % ADC_NTC_SCAN_PERIOD;
+        l_eRank4 = adc_u8NtcScans ? ADC_CHARGING_CHANNEL_CHARGERINPUTVOLTAGE : ADC_CHARGING_CHANNEL_NTC;
+        if (l_eRank4 != adc_eInjectedRank4)
         {
-        case ADC_CHARGING_CHANNEL_CURRENT:
-            adc_u16Current = l_u16Rawdata;
-            break;
-
-        case ADC_CHARGING_CHANNEL_CHARGEVOLTAGE:
-            adc_u16ChargerVoltage = l_u16Rawdata;
-            break;
-
-        case ADC_CHARGING_CHANNEL_BATTERYVOLTAGE:
-            adc_u16BatteryVoltage = l_u16Rawdata;
-            break;
-
-        case ADC_CHARGING_CHANNEL_CHARGERINPUTVOLTAGE:
-            adc_u16ChargerInputVoltage = l_u16Rawdata;
-            break;
-
-        case ADC_CHARGING_CHANNEL_NTC:
-            adc_u16Input_NTC = l_u16Rawdata;
-
-            break;
-
-        case ADC_CHARGING_CHANNEL_MAX:
-        default:
-            /* should not get here */
-            break;
+            adc_eInjectedRank4 = l_eRank4;
+            MODIFY_REG(hadc->Instance->JSQR, ADC_JSQR_JSQ4, adc_pu32ChargingChannels[adc_eInjectedRank4] << ADC_JSQR_JSQ4_Pos);
         }
 
-        adc_charging_eChannelSelection++;
-        if (adc_charging_eChannelSelection == ADC_CHARGING_CHANNEL_MAX)
-			adc_charging_eChannelSelection = ADC_CHARGING_CHANNEL_CURRENT;
-		adc_charging_SetChannel(adc_charging_eChannelSelection);
-
-        HAL_ADC_Start_IT(&ADC_Charging_Handle);
+        adc_charging_ScanDone(adc_pu16ChargingScan);
     }
+#endif
 }
 
+#if BOARD_YARDFORCE500_VARIANT_B && defined(OPTION_PERIMETER)
+/// @brief perimeter DMA stopped on an ADC overrun, restart it
+/// @param hadc
+void HAL_ADC_ErrorCallback(ADC_HandleTypeDef *hadc)
+{
+    volatile uint16_t *l_pu16Buffer = adc_pu16PerimeterBuffer;
 
+    if (hadc == &ADC_Charging_Handle && l_pu16Buffer != NULL)
+    {
+        ADC_PerimeterStop();
+        ADC_PerimeterStart(l_pu16Buffer, adc_u32PerimeterLength);
+    }
+}
+#endif
 
 /******************************************************************************
  *  Private Functions
  *******************************************************************************/
 
-void adc_charging_SetChannel(ADC_Charging_channelSelection_e channel)
+#if BOARD_YARDFORCE500_VARIANT_B && !ADC_CHARGING_PWM_SYNC
+/// @brief TIM5 counts the TIM2 periods (perimeter samples), CC4 triggers one injected charging
+/// conversion every ADC_CHARGING_PERIMETER_PERIODS, right at the start of a TIM2 period
+/// @param
+static void adc_TIM5_Init(void)
 {
-    ADC_ChannelConfTypeDef sConfig = {0};
+    TIM_ClockConfigTypeDef sClockSourceConfig = {0};
+    TIM_OC_InitTypeDef sConfigOC = {0};
 
-#if BOARD_YARDFORCE500_VARIANT_ORIG
-	uint32_t adc_SampleTime = ADC_SAMPLETIME_239CYCLES_5;
-#elif BOARD_YARDFORCE500_VARIANT_B
-	uint32_t adc_SampleTime = ADC_SAMPLETIME_480CYCLES;
+    __HAL_RCC_TIM5_CLK_ENABLE();
+
+    TIM5_Handle.Instance = TIM5;
+    TIM5_Handle.Init.Prescaler = 0;
+    TIM5_Handle.Init.Period = ADC_CHARGING_PERIMETER_PERIODS - 1;
+    TIM5_Handle.Init.CounterMode = TIM_COUNTERMODE_UP;
+    TIM5_Handle.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
+    TIM5_Handle.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_DISABLE;
+    if (HAL_TIM_OC_Init(&TIM5_Handle) != HAL_OK)
+    {
+        Error_Handler();
+    }
+    sClockSourceConfig.ClockSource = TIM_CLOCKSOURCE_ITR0; /* TIM2 TRGO */
+    if (HAL_TIM_ConfigClockSource(&TIM5_Handle, &sClockSourceConfig) != HAL_OK)
+    {
+        Error_Handler();
+    }
+    sConfigOC.OCMode = TIM_OCMODE_PWM2; /* rising edge when the counter reaches the pulse */
+    sConfigOC.Pulse = 1;
+    sConfigOC.OCPolarity = TIM_OCPOLARITY_HIGH;
+    sConfigOC.OCFastMode = TIM_OCFAST_DISABLE;
+    if (HAL_TIM_OC_ConfigChannel(&TIM5_Handle, &sConfigOC, TIM_CHANNEL_4) != HAL_OK)
+    {
+        Error_Handler();
+    }
+}
 #endif
 
-    switch (channel)
+#if BOARD_YARDFORCE500_VARIANT_B && defined(OPTION_PERIMETER)
+static void adc_perimeterHalfCplt(DMA_HandleTypeDef *p_phDma)
+{
+    PERIMETER_vITHandle(0);
+}
+
+static void adc_perimeterCplt(DMA_HandleTypeDef *p_phDma)
+{
+    PERIMETER_vITHandle(1);
+}
+#endif
+
+/// @brief configure the charging scan sequence once, in ADC_Charging_channelSelection_e order
+/// @param
+static void adc_charging_ConfigChannels(void)
+{
+#if BOARD_YARDFORCE500_VARIANT_ORIG
+    ADC_ChannelConfTypeDef sConfig = {0};
+    ADC_InjectionConfTypeDef sConfigInjected = {0};
+    const uint32_t l_pu32Channels[4] = {ADC_CHANNEL_1,  // PA1 Charge Current
+                                        ADC_CHANNEL_2,  // PA2 Charge Voltage
+                                        ADC_CHANNEL_3,  // PA3 Battery
+                                        ADC_CHANNEL_7}; // PA7 Charger Input voltage
+    const uint32_t l_pu32Ranks[4] = {ADC_INJECTED_RANK_1, ADC_INJECTED_RANK_2, ADC_INJECTED_RANK_3, ADC_INJECTED_RANK_4};
+    uint8_t l_u8Idx;
+
+    sConfig.Channel = ADC_CHANNEL_13; // PC2 Blade NTC
+    sConfig.Rank = ADC_REGULAR_RANK_1;
+    sConfig.SamplingTime = ADC_CHARGING_SAMPLETIME;
+    if (HAL_ADC_ConfigChannel(&ADC_Charging_Handle, &sConfig) != HAL_OK)
     {
-    case ADC_CHARGING_CHANNEL_CURRENT:
-        sConfig.Channel = ADC_CHANNEL_1; // PA1 Charge Current
-        sConfig.Rank = 1;
-        sConfig.SamplingTime = adc_SampleTime;
-        if (HAL_ADC_ConfigChannel(&ADC_Charging_Handle, &sConfig) != HAL_OK)
-        {
-            Error_Handler();
-        }
-        break;
+        Error_Handler();
+    }
 
-    case ADC_CHARGING_CHANNEL_CHARGEVOLTAGE:
-        sConfig.Channel = ADC_CHANNEL_2; // PA2 Charge Voltage
-        sConfig.Rank = 1;
-        sConfig.SamplingTime = adc_SampleTime;
-        if (HAL_ADC_ConfigChannel(&ADC_Charging_Handle, &sConfig) != HAL_OK)
+    sConfigInjected.InjectedSamplingTime = ADC_CHARGING_SAMPLETIME;
+    sConfigInjected.InjectedOffset = 0;
+    sConfigInjected.InjectedNbrOfConversion = 4;
+    sConfigInjected.InjectedDiscontinuousConvMode = DISABLE;
+    sConfigInjected.AutoInjectedConv = DISABLE;
+    sConfigInjected.ExternalTrigInjecConv = ADC_INJECTED_EXTERNALTRIGCONV_T2_TRGO;
+    for (l_u8Idx = 0; l_u8Idx < 4; l_u8Idx++)
+    {
+        sConfigInjected.InjectedChannel = l_pu32Channels[l_u8Idx];
+        sConfigInjected.InjectedRank = l_pu32Ranks[l_u8Idx];
+        if (HAL_ADCEx_InjectedConfigChannel(&ADC_Charging_Handle, &sConfigInjected) != HAL_OK)
         {
             Error_Handler();
         }
-        break;
+    }
+#elif BOARD_YARDFORCE500_VARIANT_B
+    ADC_InjectionConfTypeDef sConfigInjected = {0};
+    uint8_t l_u8Idx;
+
+    sConfigInjected.InjectedSamplingTime = ADC_CHARGING_SAMPLETIME;
+    sConfigInjected.InjectedOffset = 0;
+    sConfigInjected.InjectedNbrOfConversion = ADC_CHARGING_INJECTED_RANKS;
+    sConfigInjected.AutoInjectedConv = DISABLE;
+    sConfigInjected.ExternalTrigInjecConvEdge = ADC_EXTERNALTRIGINJECCONVEDGE_RISING;
+#if ADC_CHARGING_PWM_SYNC
+    sConfigInjected.InjectedDiscontinuousConvMode = DISABLE;
+    sConfigInjected.ExternalTrigInjecConv = ADC_EXTERNALTRIGINJECCONV_T2_TRGO;
+#else
+    sConfigInjected.InjectedDiscontinuousConvMode = ENABLE; /* one rank per TIM5 trigger */
+    sConfigInjected.ExternalTrigInjecConv = ADC_EXTERNALTRIGINJECCONV_T5_CC4;
+#endif
+    /* the NTC goes to the 4th rank too, so its sampling time is set, then the charger input voltage */
+    for (l_u8Idx = 0; l_u8Idx < ADC_CHARGING_CHANNEL_MAX; l_u8Idx++)
+    {
+        ADC_Charging_channelSelection_e l_eChannel = (l_u8Idx < 3) ? l_u8Idx : (l_u8Idx == 3) ? ADC_CHARGING_CHANNEL_NTC : ADC_CHARGING_CHANNEL_CHARGERINPUTVOLTAGE;
 
-    case ADC_CHARGING_CHANNEL_BATTERYVOLTAGE:
-        sConfig.Channel = ADC_CHANNEL_3; // PA3 Battery
-        sConfig.Rank = 1;
-        sConfig.SamplingTime = adc_SampleTime;
-        if (HAL_ADC_ConfigChannel(&ADC_Charging_Handle, &sConfig) != HAL_OK)
+        sConfigInjected.InjectedChannel = adc_pu32ChargingChannels[l_eChannel];
+        sConfigInjected.InjectedRank = (l_u8Idx < 3) ? l_u8Idx + 1 : ADC_INJECTED_RANK_4;
+        if (HAL_ADCEx_InjectedConfigChannel(&ADC_Charging_Handle, &sConfigInjected) != HAL_OK)
         {
             Error_Handler();
         }
-        break;
+    }
+    adc_eInjectedRank4 = ADC_CHARGING_CHANNEL_CHARGERINPUTVOLTAGE;
+    adc_u8NtcScans = 1;
 
-    case ADC_CHARGING_CHANNEL_CHARGERINPUTVOLTAGE:
-        sConfig.Channel = ADC_CHANNEL_7; // PA7 Charger Input voltage
-        sConfig.Rank = 1;
-        sConfig.SamplingTime = adc_SampleTime;
-        if (HAL_ADC_ConfigChannel(&ADC_Charging_Handle, &sConfig) != HAL_OK)
-        {
-            Error_Handler();
-        }
-        break;
+#ifdef OPTION_PERIMETER
+    ADC_ChannelConfTypeDef sConfig = {0};
 
-    case ADC_CHARGING_CHANNEL_NTC:
-        sConfig.Channel = ADC_CHANNEL_13; // PC2
-        sConfig.Rank = 1;
-        sConfig.SamplingTime = adc_SampleTime;
-        if (HAL_ADC_ConfigChannel(&ADC_Charging_Handle, &sConfig) != HAL_OK)
+    sConfig.Channel = ADC_CHANNEL_6; // PA6 Perimeter sense
+    sConfig.Rank = 1;
+    sConfig.SamplingTime = ADC_PERIMETER_SAMPLETIME;
+    if (HAL_ADC_ConfigChannel(&ADC_Charging_Handle, &sConfig) != HAL_OK)
+    {
+        Error_Handler();
+    }
+#endif
+#endif
+}
+
+/// @brief end of a charging scan, average ADC_CHARGING_AVERAGE scans and run the charge control loop
+/// @param p_pu16Scan raw values in ADC_Charging_channelSelection_e order
+static void adc_charging_ScanDone(const volatile uint16_t *p_pu16Scan)
+{
+    uint8_t l_u8Idx;
+
+    adc_oversample(p_pu16Scan);
+
+#if ADC_CHARGING_AVERAGE > 1
+    for (l_u8Idx = 0; l_u8Idx < ADC_CHARGING_CHANNEL_MAX; l_u8Idx++)
+    {
+        adc_pu32ChargingSum[l_u8Idx] += p_pu16Scan[l_u8Idx];
+    }
+    if (++adc_u8ChargingScans < ADC_CHARGING_AVERAGE)
+    {
+        return;
+    }
+    for (l_u8Idx = 0; l_u8Idx < ADC_CHARGING_CHANNEL_MAX; l_u8Idx++)
+    {
+        adc_pu16ChargingSamples[l_u8Idx] = (adc_pu32ChargingSum[l_u8Idx] + ADC_CHARGING_AVERAGE / 2) / ADC_CHARGING_AVERAGE;
+        adc_pu32ChargingSum[l_u8Idx] = 0;
+    }
+    adc_u8ChargingScans = 0;
+#else
+    for (l_u8Idx = 0; l_u8Idx < ADC_CHARGING_CHANNEL_MAX; l_u8Idx++)
+    {
+        adc_pu16ChargingSamples[l_u8Idx] = p_pu16Scan[l_u8Idx];
+    }
+#endif
+    CHARGER_ControlIT();
+}
+
+/// @brief sum the scan for the oversampled channels, decimate every ADC_OVERSAMPLING_RATIO scans
+/// the extra bits are only real if the noise is above 1 LSB, which is the case on the charging inputs
+/// @param p_pu16Scan raw values in ADC_Charging_channelSelection_e order
+static void adc_oversample(const volatile uint16_t *p_pu16Scan)
+{
+    uint8_t l_u8Idx;
+
+    if (ADC_OVERSAMPLING_CHANNELS == 0)
+    {
+        return;
+    }
+    for (l_u8Idx = 0; l_u8Idx < ADC_CHARGING_CHANNEL_MAX; l_u8Idx++)
+    {
+        if (ADC_OVERSAMPLING_CHANNELS & (1 << l_u8Idx))
         {
-            Error_Handler();
+            adc_pu32OversamplingSum[l_u8Idx] += p_pu16Scan[l_u8Idx];
         }
-        break;
-
-    case ADC_CHARGING_CHANNEL_MAX:
-    default:
-        /* should not get here */
-        sConfig.Channel = ADC_CHANNEL_3; // PA3 Battery
-        sConfig.Rank = 1;
-        sConfig.SamplingTime = adc_SampleTime;
-        if (HAL_ADC_ConfigChannel(&ADC_Charging_Handle, &sConfig) != HAL_OK)
+    }
+    if (++adc_u16OversamplingScans < ADC_OVERSAMPLING_RATIO)
+    {
+        return;
+    }
+    for (l_u8Idx = 0; l_u8Idx < ADC_CHARGING_CHANNEL_MAX; l_u8Idx++)
+    {
+        if (ADC_OVERSAMPLING_CHANNELS & (1 << l_u8Idx))
         {
-            Error_Handler();
+            /* sum >> ADC_OVERSAMPLING_BITS when the ratio is 4^ADC_OVERSAMPLING_BITS, average of more scans above */
+            adc_pu16Oversampled[l_u8Idx] = ((adc_pu32OversamplingSum[l_u8Idx] << ADC_OVERSAMPLING_BITS) + ADC_OVERSAMPLING_RATIO / 2) / ADC_OVERSAMPLING_RATIO;
+            adc_pu32OversamplingSum[l_u8Idx] = 0;
         }
-        break;
     }
+    adc_u16OversamplingScans = 0;
+    adc_u8OversampledChannels = ADC_OVERSAMPLING_CHANNELS;
 }
+
+/// @brief input of the ADC_input() filters, oversampled value once there is one
+/// @param p_eChannel charging channel
+/// @retval raw value (Q16)
+static int32_t adc_rawQ16(ADC_Charging_channelSelection_e p_eChannel)
+{
+    if (adc_u8OversampledChannels & (1 << p_eChannel))
+    {
+        return (int32_t)adc_pu16Oversampled[p_eChannel] << (16 - ADC_OVERSAMPLING_BITS);
+    }
+    return (int32_t)adc_pu16ChargingSamples[p_eChannel] << 16;
+}
+
+/// @brief first order IIR filter of a raw value, y += alpha * (x - y) in Q16
+/// @param p_eChannel charging channel
+/// @param p_s32Alpha weight of the new sample (Q16)
+static void adc_filter(ADC_Charging_channelSelection_e p_eChannel, int32_t p_s32Alpha)
+{
+    int32_t l_s32Error = adc_rawQ16(p_eChannel) - adc_ps32Filtered[p_eChannel];
+
+    adc_ps32Filtered[p_eChannel] += (int32_t)(((int64_t)l_s32Error * p_s32Alpha) >> 16);
+}
+
+/// @brief scale a filtered raw value
+/// @param p_eChannel charging channel
+/// @retval mV or mA
+static int32_t adc_scale(ADC_Charging_channelSelection_e p_eChannel)
+{
+    return (int32_t)(((int64_t)adc_ps32Filtered[p_eChannel] * adc_ps32Gain[p_eChannel] + (1LL << 31)) >> 32) + adc_ps32OffsetMilli[p_eChannel];
+}
+
+#ifdef ADC_CYCLE_BENCH
+/// @brief average DWT cycles of a conversion, interrupts off so only the conversion is counted
+/// @param p_pfInput conversion
+/// @param p_u16Runs number of calls
+/// @retval cycles per call
+static uint32_t adc_cycles(void (*p_pfInput)(void), uint16_t p_u16Runs)
+{
+    uint32_t l_u32Primask = __get_PRIMASK();
+    uint32_t l_u32Start, l_u32Sum = 0;
+    uint16_t l_u16Run;
+
+    __disable_irq();
+    for (l_u16Run = 0; l_u16Run < p_u16Runs; l_u16Run++)
+    {
+        l_u32Start = DWT->CYCCNT;
+        p_pfInput();
+        l_u32Sum += DWT->CYCCNT - l_u32Start;
+    }
+    __set_PRIMASK(l_u32Primask);
+    return l_u32Sum / p_u16Runs;
+}
+#endif
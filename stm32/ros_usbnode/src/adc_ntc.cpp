@@ -0,0 +1,124 @@
+/****************************************************************************
+* Title                 :   blade motor NTC table
+* Filename              :   adc_ntc.cpp
+* Author                :
+* Origin Date           :
+* Version               :   1.0.0
+
+*****************************************************************************/
+/** \file adc_ntc.cpp
+*  \brief temperature lookup table of the blade motor NTC, generated at compile
+*         time from ADC_NTC_R25 and ADC_NTC_BETA (beta equation) so ADC_input()
+*         does not need log() and float divisions at runtime
+*
+*  tools/adc_ntc_bench.cpp checks the table and the conversion on the host
+*/
+/******************************************************************************
+* Includes
+*******************************************************************************/
+#include <stdint.h>
+
+#include "stm32f_board_hal.h"
+#include "adc.h"
+
+/******************************************************************************
+* Module Preprocessor Constants
+*******************************************************************************/
+
+/******************************************************************************
+* Module Typedefs
+*******************************************************************************/
+
+/******************************************************************************
+*  Private Functions
+*******************************************************************************/
+namespace
+{
+
+/* natural logarithm usable in constant expressions, x > 0 */
+constexpr double ntc_ln(double x)
+{
+    int l_iExp = 0;
+
+    while (x > 2.0)
+    {
+        x /= 2.0;
+        l_iExp++;
+    }
+    while (x < 1.0)
+    {
+        x *= 2.0;
+        l_iExp--;
+    }
+    /* ln(x) = 2 atanh((x - 1) / (x + 1)), the ratio is below 1/3 */
+    double l_dY = (x - 1.0) / (x + 1.0);
+    double l_dTerm = l_dY;
+    double l_dSum = 0.0;
+    for (int l_iN = 1; l_iN < 64; l_iN += 2)
+    {
+        l_dSum += l_dTerm / l_iN;
+        l_dTerm *= l_dY * l_dY;
+    }
+    return 2.0 * l_dSum + l_iExp * 0.69314718055994530942;
+}
+
+/* temperature (0.01°C) for a raw ADC value, same equation as the former float code */
+constexpr int16_t ntc_centiDegree(uint32_t p_u32Raw)
+{
+    double l_dVoltage = (p_u32Raw ? p_u32Raw : 1) * (ADC_VREF_MV / 1000.0) / ADC_FULL_SCALE;
+    double l_dResistance = l_dVoltage * ADC_NTC_OHM_PER_VOLT;
+    double l_dKelvin = 1.0 / (ntc_ln(l_dResistance / ADC_NTC_R25) / ADC_NTC_BETA + 1.0 / (273.15 + 25));
+    double l_dCenti = (l_dKelvin - 273.15) * 100.0;
+
+    /* the first entries (shorted NTC) are out of range */
+    if (l_dCenti > INT16_MAX)
+    {
+        return INT16_MAX;
+    }
+    return (int16_t)(l_dCenti < 0 ? l_dCenti - 0.5 : l_dCenti + 0.5);
+}
+
+constexpr ADC_NtcTable_t ntc_buildTable(void)
+{
+    ADC_NtcTable_t l_sTable = {};
+
+    for (uint32_t l_u32Idx = 0; l_u32Idx < ADC_NTC_TABLE_SIZE; l_u32Idx++)
+    {
+        l_sTable.ps16CentiDegree[l_u32Idx] = ntc_centiDegree(l_u32Idx << ADC_NTC_TABLE_SHIFT);
+    }
+    return l_sTable;
+}
+
+constexpr ADC_NtcTable_t ntc_csTable = ntc_buildTable();
+
+} // namespace
+
+/******************************************************************************
+* Module Variable Definitions
+*******************************************************************************/
+extern "C" const ADC_NtcTable_t ADC_sNtcTable = ntc_csTable;
+
+/******************************************************************************
+*  Public Functions
+*******************************************************************************/
+
+/// @brief NTC temperature, linear interpolation in the NTC table
+/// @param p_s32RawQ16 filtered raw value (Q16)
+/// @retval temperature (0.01°C)
+extern "C" int32_t ADC_NtcCentiDegree(int32_t p_s32RawQ16)
+{
+    uint32_t l_u32Idx = (uint32_t)p_s32RawQ16 >> (16 + ADC_NTC_TABLE_SHIFT);
+    int32_t l_s32Frac = ((uint32_t)p_s32RawQ16 >> ADC_NTC_TABLE_SHIFT) & 0xFFFF;
+    int32_t l_s32Low;
+    int32_t l_s32High;
+
+    if (l_u32Idx >= ADC_NTC_TABLE_SIZE - 1)
+    {
+        return ADC_sNtcTable.ps16CentiDegree[ADC_NTC_TABLE_SIZE - 1];
+    }
+    l_s32Low = ADC_sNtcTable.ps16CentiDegree[l_u32Idx];
+    l_s32High = ADC_sNtcTable.ps16CentiDegree[l_u32Idx + 1];
+    return l_s32Low + (((l_s32High - l_s32Low) * l_s32Frac) >> 16);
+}
+
+/*** End of File **************************************************************/
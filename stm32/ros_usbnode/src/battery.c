@@ -9,16 +9,36 @@
 /** \file battery.c
 *  \brief battery module
 * Charge and SOC calculation
+*
+* The SOC is a one state Kalman filter: the charge current is integrated (coulomb
+* counting) and the battery voltage, minus the drop in the internal resistance,
+* corrects it through the open circuit voltage curve. The voltage is trusted more
+* when the current is low, it also brings the SOC back when the current sensor
+* does not see the load.
 */
 /******************************************************************************
 * Includes
 *******************************************************************************/
-
-#include "battery.h" 
+#include "main.h"
+#include "board.h"
+#include "adc.h"
+#include "battery.h"
 
 /******************************************************************************
 * Module Preprocessor Constants
 *******************************************************************************/
+#define BATTERY_OCV_POINTS 11               /* 0% to 100% every 10% */
+
+/* Kalman filter tuning */
+#define BATTERY_KF_PROCESS_NOISE 1e-7f      /* SOC variance added per second (coulomb counting drift) */
+#define BATTERY_KF_VOLTAGE_NOISE 0.0025f    /* voltage variance (V²) at rest */
+#define BATTERY_KF_RESISTANCE_NOISE 0.01f   /* internal resistance variance (ohm²), scaled by I² */
+#define BATTERY_KF_INIT_VARIANCE 0.01f      /* SOC variance when restored from the backup registers */
+#define BATTERY_KF_UNKNOWN_VARIANCE 1.0f    /* SOC variance when nothing was saved */
+
+/* written with the SOC, the backup registers read 0 after a backup domain reset */
+#define BATTERY_BKP_MAGIC_REG RTC_BKP_DR5
+#define BATTERY_BKP_MAGIC 0xB5A7
 
 /******************************************************************************
 * Module Preprocessor Macros
@@ -31,15 +51,185 @@
 /******************************************************************************
 * Module Variable Definitions
 *******************************************************************************/
+/* open circuit voltage of one Li-ion cell */
+static const float battery_pfOcv[BATTERY_OCV_POINTS] = {3.30f, 3.55f, 3.62f, 3.67f, 3.71f, 3.76f, 3.82f, 3.89f, 3.96f, 4.06f, 4.17f};
+
+static float battery_fSoc = 0;
+static float battery_fVariance = BATTERY_KF_UNKNOWN_VARIANCE;
+static float battery_fSavedSoc = -1;
+static uint32_t battery_u32SavedTick = 0;
+static uint8_t battery_bOcvStart = 0;      /* nothing saved, start from the first battery voltage */
 
 /******************************************************************************
 * Function Prototypes
 *******************************************************************************/
+static float battery_ocv(float p_fSoc, float *p_pfSlope);
+static float battery_socFromOcv(float p_fCellVoltage);
+static void battery_persist(void);
 
 /******************************************************************************
 *  Public Functions
 *******************************************************************************/
 
+/// @brief restore the SOC saved in the backup registers (ampere_acc, read by ADC_Charging_Init)
+/// @param
+void BATTERY_Init(void)
+{
+    float l_fSoc = ampere_acc.f / BATTERY_CAPACITY_AH;
+
+    /* the registers are cleared by a backup domain reset, 0 would pass as an empty battery */
+    if (HAL_RTCEx_BKUPRead(&hrtc, BATTERY_BKP_MAGIC_REG) == BATTERY_BKP_MAGIC && l_fSoc >= 0.0f && l_fSoc <= 1.0f)
+    {
+        battery_fSoc = l_fSoc;
+        battery_fVariance = BATTERY_KF_INIT_VARIANCE;
+        battery_fSavedSoc = l_fSoc;
+        battery_bOcvStart = 0;
+    }
+    else
+    {
+        /* the ADC has no value yet, BATTERY_Update() starts from the voltage */
+        battery_fSoc = 0.5f;
+        battery_fVariance = BATTERY_KF_UNKNOWN_VARIANCE;
+        battery_bOcvStart = 1;
+    }
+    battery_u32SavedTick = HAL_GetTick();
+}
+
+/// @brief SOC estimation, to be called every BATTERY_UPDATE_MS
+/// @param
+void BATTERY_Update(void)
+{
+    const float l_fDt = BATTERY_UPDATE_MS * 0.001f;
+    float l_fSlope;
+    float l_fPredicted;
+    float l_fNoise;
+    float l_fGain;
+
+    if (battery_voltage < MIN_BATTERY_VOLTAGE)
+    {
+        /* no battery */
+        return;
+    }
+
+    if (battery_bOcvStart)
+    {
+        battery_fSoc = battery_socFromOcv((battery_voltage - current * BATTERY_INTERNAL_RESISTANCE) / BATTERY_CELLS);
+        battery_fVariance = BATTERY_KF_UNKNOWN_VARIANCE;
+        battery_bOcvStart = 0;
+    }
+
+    /* predict, coulomb counting */
+    battery_fSoc += current * l_fDt / (BATTERY_CAPACITY_AH * 3600.0f);
+    battery_fVariance += BATTERY_KF_PROCESS_NOISE * l_fDt;
+
+    /* correct with the battery voltage */
+    l_fPredicted = BATTERY_CELLS * battery_ocv(battery_fSoc, &l_fSlope) + current * BATTERY_INTERNAL_RESISTANCE;
+    l_fSlope *= BATTERY_CELLS;
+    l_fNoise = BATTERY_KF_VOLTAGE_NOISE + BATTERY_KF_RESISTANCE_NOISE * current * current;
+    l_fGain = battery_fVariance * l_fSlope / (l_fSlope * l_fSlope * battery_fVariance + l_fNoise);
+    battery_fSoc += l_fGain * (battery_voltage - l_fPredicted);
+    battery_fVariance *= 1.0f - l_fGain * l_fSlope;
+
+    if (battery_fSoc < 0.0f)
+    {
+        battery_fSoc = 0.0f;
+    }
+    else if (battery_fSoc > 1.0f)
+    {
+        battery_fSoc = 1.0f;
+    }
+
+    battery_persist();
+}
+
+/// @brief end of charge detected, the battery is full
+/// @param
+void BATTERY_SetFull(void)
+{
+    battery_fSoc = 1.0f;
+    battery_fVariance = 0.0f;
+    battery_persist();
+}
+
+/// @brief state of charge
+/// @param
+/// @retval 0 to 1
+float BATTERY_GetSoc(void)
+{
+    return battery_fSoc;
+}
+
 /******************************************************************************
 *  Private Functions
-*******************************************************************************/
\ No newline at end of file
+*******************************************************************************/
+
+/// @brief open circuit voltage of one cell, linear interpolation in battery_pfOcv
+/// @param p_fSoc 0 to 1
+/// @param p_pfSlope V per unit of SOC at this point
+/// @retval V
+static float battery_ocv(float p_fSoc, float *p_pfSlope)
+{
+    float l_fPos = p_fSoc * (BATTERY_OCV_POINTS - 1);
+    uint8_t l_u8Idx;
+
+    if (l_fPos < 0.0f)
+    {
+        l_fPos = 0.0f;
+    }
+    l_u8Idx = (uint8_t)l_fPos;
+    if (l_u8Idx >= BATTERY_OCV_POINTS - 1)
+    {
+        l_u8Idx = BATTERY_OCV_POINTS - 2;
+    }
+
+    *p_pfSlope = (battery_pfOcv[l_u8Idx + 1] - battery_pfOcv[l_u8Idx]) * (BATTERY_OCV_POINTS - 1);
+    return battery_pfOcv[l_u8Idx] + (battery_pfOcv[l_u8Idx + 1] - battery_pfOcv[l_u8Idx]) * (l_fPos - l_u8Idx);
+}
+
+/// @brief SOC of an open circuit voltage, reverse lookup in battery_pfOcv
+/// @param p_fCellVoltage V
+/// @retval 0 to 1
+static float battery_socFromOcv(float p_fCellVoltage)
+{
+    uint8_t l_u8Idx;
+
+    if (p_fCellVoltage <= battery_pfOcv[0])
+    {
+        return 0.0f;
+    }
+    for (l_u8Idx = 0; l_u8Idx < BATTERY_OCV_POINTS - 1; l_u8Idx++)
+    {
+        if (p_fCellVoltage < battery_pfOcv[l_u8Idx + 1])
+        {
+            return (l_u8Idx + (p_fCellVoltage - battery_pfOcv[l_u8Idx]) / (battery_pfOcv[l_u8Idx + 1] - battery_pfOcv[l_u8Idx])) / (BATTERY_OCV_POINTS - 1);
+        }
+    }
+    return 1.0f;
+}
+
+/// @brief save the SOC in the RTC backup registers 1&2, and the magic in 5, only when it moved enough or once in a while
+/// @param
+static void battery_persist(void)
+{
+    float l_fDelta = battery_fSoc - battery_fSavedSoc;
+
+    if (l_fDelta == 0.0f)
+    {
+        return;
+    }
+    if (l_fDelta < BATTERY_SOC_PERSIST_DELTA && l_fDelta > -BATTERY_SOC_PERSIST_DELTA &&
+        (HAL_GetTick() - battery_u32SavedTick) < BATTERY_SOC_PERSIST_MS)
+    {
+        return;
+    }
+
+    ampere_acc.f = battery_fSoc * BATTERY_CAPACITY_AH;
+    HAL_PWR_EnableBkUpAccess();
+    HAL_RTCEx_BKUPWrite(&hrtc, RTC_BKP_DR1, ampere_acc.u[0]);
+    HAL_RTCEx_BKUPWrite(&hrtc, RTC_BKP_DR2, ampere_acc.u[1]);
+    HAL_RTCEx_BKUPWrite(&hrtc, BATTERY_BKP_MAGIC_REG, BATTERY_BKP_MAGIC);
+    HAL_PWR_DisableBkUpAccess();
+
+    battery_fSavedSoc = battery_fSoc;
+    battery_u32SavedTick = HAL_GetTick();
+}
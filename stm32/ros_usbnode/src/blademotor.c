@@ -20,6 +20,8 @@
 
 #include "main.h"
 #include "board.h"
+#include "uart_frame.h"
+#include "latency.h"
 
 #include "blademotor.h" 
 
@@ -28,6 +30,8 @@
 *******************************************************************************/
 #define BLADEMOTOR_LENGTH_INIT_MSG 22
 #define BLADEMOTOR_LENGTH_RQST_MSG 7
+/* latency probes answered by an off frame */
+#define BLADEMOTOR_STOP_PROBES (LATENCY_MASK(LATENCY_INPUT_BLADE) | LATENCY_MASK(LATENCY_SERVICE_BLADE))
 /******************************************************************************
 * Module Preprocessor Macros
 *******************************************************************************/
@@ -50,21 +54,33 @@ DMA_HandleTypeDef hdma_uart_blade_rx;
 DMA_HandleTypeDef hdma_uart_blade_tx;
 
 static BLADEMOTOR_STATE_e blademotor_eState = BLADEMOTOR_INIT_1;
+static UARTFRAME_Handle_t blademotor_sFrame;
 
 bool BLADEMOTOR_bActivated = false;
 uint16_t BLADEMOTOR_u16RPM = 0;
 uint16_t BLADEMOTOR_u16Power = 0;
 uint32_t BLADEMOTOR_u32Error = 0;
+#ifdef BLADE_LOAD_ADAPTIVE_SPEED
+float BLADEMOTOR_fSpeedScale = 1.0f;
+#endif
 
 static uint8_t blademotor_pu8ReceivedData[BLADEMOTOR_LENGTH_RECEIVED_MSG] = {0};
 static uint8_t blademotor_pu8RqstMessage[BLADEMOTOR_LENGTH_RQST_MSG]  = {0x55, 0xaa, 0x03, 0x20, 0x80, 0x00, 0xA2};
 static uint8_t blademotor_u8OnOff = 0;
+static volatile uint8_t blademotor_u8EmergencyStop = 0; /* set from the emergency interrupt, off until BLADEMOTOR_Set(0) */
+static const uint8_t blademotor_pcu8StopMsg[BLADEMOTOR_LENGTH_RQST_MSG] = {0x55, 0xaa, 0x03, 0x20, 0x80, 0x00, 0xa2};
 
 const uint8_t blademotor_pcu8Preamble[5]  = {0x55,0xAA,0x0A,0x2,0xD0};
+/* only the first 2 bytes of the preamble are checked */
+static const UARTFRAME_Descriptor_t blademotor_csFrameDesc = {blademotor_pcu8Preamble, 2, BLADEMOTOR_LENGTH_RECEIVED_MSG, BLADEMOTOR_LENGTH_RECEIVED_MSG - 1};
 const uint8_t blademotor_pcu8InitMsg[BLADEMOTOR_LENGTH_INIT_MSG] =  { 0x55, 0xaa, 0x12, 0x20, 0x80, 0x00, 0xac, 0x0d, 0x00, 0x02, 0x32, 0x50, 0x1e, 0x04, 0x00, 0x15, 0x21, 0x05, 0x0a, 0x19, 0x3c, 0xaa };
 /******************************************************************************
 * Function Prototypes
 *******************************************************************************/
+static void blademotor_receiveFrame(rx_status_e p_eStatus, const uint8_t *p_pu8Frame);
+#ifdef BLADE_LOAD_ADAPTIVE_SPEED
+static void blademotor_updateSpeedScale(void);
+#endif
 
 /******************************************************************************
 *  Public Functions
@@ -72,7 +88,7 @@ const uint8_t blademotor_pcu8InitMsg[BLADEMOTOR_LENGTH_INIT_MSG] =  { 0x55, 0xaa
 
 void blademotor_prepareMsg(void)
 {    
-    if (blademotor_u8OnOff)
+    if (blademotor_u8OnOff && !blademotor_u8EmergencyStop)
     {
         blademotor_pu8RqstMessage[5] = 0x80; /* change speed Motor */
         blademotor_pu8RqstMessage[6] = 0x22; /* change CRC */
@@ -164,7 +180,7 @@ void BLADEMOTOR_Init(void)
 	hdma_uart_blade_rx.Init.MemInc = DMA_MINC_ENABLE;
 	hdma_uart_blade_rx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
 	hdma_uart_blade_rx.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
-	hdma_uart_blade_rx.Init.Mode = DMA_NORMAL;
+	hdma_uart_blade_rx.Init.Mode = DMA_CIRCULAR;
 	hdma_uart_blade_rx.Init.Priority = DMA_PRIORITY_LOW;
     if (HAL_DMA_Init(&hdma_uart_blade_rx) != HAL_OK)
     {
@@ -207,6 +223,8 @@ void BLADEMOTOR_Init(void)
 	HAL_NVIC_EnableIRQ(usart_irq);
     __HAL_UART_ENABLE_IT(&BLADEMOTOR_USART_Handler, UART_IT_TC);
 
+    UARTFRAME_Init(&blademotor_sFrame, &BLADEMOTOR_USART_Handler, &blademotor_csFrameDesc, blademotor_receiveFrame);
+
     blademotor_eState = BLADEMOTOR_INIT_1;    
 }
 
@@ -217,7 +235,7 @@ void  BLADEMOTOR_App(void){
     {
     case BLADEMOTOR_INIT_1:
 
-        HAL_UART_Transmit_DMA(&BLADEMOTOR_USART_Handler, (uint8_t*)blademotor_pcu8InitMsg, BLADEMOTOR_LENGTH_INIT_MSG);
+        UARTFRAME_Transmit(&blademotor_sFrame, blademotor_pcu8InitMsg, BLADEMOTOR_LENGTH_INIT_MSG);
         blademotor_eState = BLADEMOTOR_RUN;
         debug_printf(" * Blade Motor Controller initialized\r\n");     
         break;
@@ -229,11 +247,19 @@ void  BLADEMOTOR_App(void){
             blademotor_u8OnOff = 0;
             BLADEMOTOR_u32Error++;
         }
-        blademotor_prepareMsg();
-        /* prepare to receive the message before to launch the command */        
-        HAL_UART_Receive_DMA(&BLADEMOTOR_USART_Handler, blademotor_pu8ReceivedData, BLADEMOTOR_LENGTH_RECEIVED_MSG);
-                  
-        HAL_UART_Transmit_DMA(&BLADEMOTOR_USART_Handler, (uint8_t*)blademotor_pu8RqstMessage, BLADEMOTOR_LENGTH_RQST_MSG);    
+#ifdef BLADE_LOAD_ADAPTIVE_SPEED
+        blademotor_updateSpeedScale();
+#endif
+        {
+            uint32_t l_u32Primask = __get_PRIMASK();
+
+            /* an emergency confirmed while the request was prepared must not be followed by an on frame */
+            __disable_irq();
+            blademotor_prepareMsg();
+            UARTFRAME_TransmitProbe(&blademotor_sFrame, blademotor_pu8RqstMessage, BLADEMOTOR_LENGTH_RQST_MSG,
+                                    (blademotor_pu8RqstMessage[5] == 0x00) ? BLADEMOTOR_STOP_PROBES : 0);
+            __set_PRIMASK(l_u32Primask);
+        }
         break;
     
     default:
@@ -260,31 +286,84 @@ void BLADEMOTOR_Set(uint8_t on_off, uint8_t direction)
     {
         blademotor_pu8RqstMessage[5] = 0x00; /* change speed Motor */
         blademotor_pu8RqstMessage[6] = 0xa2; /* change CRC */
+        blademotor_u8EmergencyStop = 0;
     }
 }
 
-/// @brief drive motor receive interrupt handler
-/// @param  
-void BLADEMOTOR_ReceiveIT(void)
+/// @brief emergency confirmed, queue a blade off frame right away, called from the emergency interrupt
+/// the blade stays off until BLADEMOTOR_Set(0, ..) is called from the main loop
+/// @param
+void BLADEMOTOR_EmergencyStopIT(void)
 {
-    /* decode the frame */    
-    if(memcmp(blademotor_pcu8Preamble, blademotor_pu8ReceivedData, 2) == 0){        
-        uint8_t l_u8crc = crcCalc(blademotor_pu8ReceivedData, BLADEMOTOR_LENGTH_RECEIVED_MSG-1);
-
-        if(blademotor_pu8ReceivedData[BLADEMOTOR_LENGTH_RECEIVED_MSG-1] == l_u8crc ){
-            if((blademotor_pu8ReceivedData[5] & 0x80) == 0x80){
-                BLADEMOTOR_bActivated = true;
-            }
-            else{
-                BLADEMOTOR_bActivated = false;
-            }
-            BLADEMOTOR_u16RPM = blademotor_pu8ReceivedData[7] + (blademotor_pu8ReceivedData[8]<<8);
-            BLADEMOTOR_u16Power = blademotor_pu8ReceivedData[9] + (blademotor_pu8ReceivedData[10]<<8) ;           
-        }
-  
+    blademotor_u8EmergencyStop = 1;
+    if (blademotor_sFrame.phUart != NULL)
+    {
+        UARTFRAME_TransmitProbe(&blademotor_sFrame, blademotor_pcu8StopMsg, BLADEMOTOR_LENGTH_RQST_MSG, BLADEMOTOR_STOP_PROBES);
     }
 }
 
 /******************************************************************************
 *  Private Functions
 *******************************************************************************/
+
+/// @brief blade motor frame received, called from the UART interrupt
+/// @param p_eStatus RX_VALID or RX_CRC_ERROR
+/// @param p_pu8Frame received frame
+static void blademotor_receiveFrame(rx_status_e p_eStatus, const uint8_t *p_pu8Frame)
+{
+    if (p_eStatus != RX_VALID)
+    {
+        return;
+    }
+    memcpy(blademotor_pu8ReceivedData, p_pu8Frame, BLADEMOTOR_LENGTH_RECEIVED_MSG);
+
+    if((blademotor_pu8ReceivedData[5] & 0x80) == 0x80){
+        BLADEMOTOR_bActivated = true;
+    }
+    else{
+        BLADEMOTOR_bActivated = false;
+    }
+    BLADEMOTOR_u16RPM = blademotor_pu8ReceivedData[7] + (blademotor_pu8ReceivedData[8]<<8);
+    BLADEMOTOR_u16Power = blademotor_pu8ReceivedData[9] + (blademotor_pu8ReceivedData[10]<<8) ;
+}
+#ifdef BLADE_LOAD_ADAPTIVE_SPEED
+/// @brief compute the ground speed scale from the last blade answer
+/// the load is the worst of the RPM sag and the power rise, the scale goes from BLADE_LOAD_MAX_SCALE
+/// (light grass) to BLADE_LOAD_MIN_SCALE (heavy grass). It drops fast and recovers slowly.
+/// @param
+static void blademotor_updateSpeedScale(void)
+{
+    float l_fRpmLoad;
+    float l_fPowerLoad;
+    float l_fLoad;
+    float l_fTarget;
+
+    if (!BLADEMOTOR_bActivated)
+    {
+        BLADEMOTOR_fSpeedScale = 1.0f;
+        return;
+    }
+
+    l_fRpmLoad = ((float)BLADE_LOAD_NOMINAL_RPM - (float)BLADEMOTOR_u16RPM) / (float)(BLADE_LOAD_NOMINAL_RPM - BLADE_LOAD_MIN_RPM);
+    l_fPowerLoad = ((float)BLADEMOTOR_u16Power - (float)BLADE_LOAD_LIGHT_POWER) / (float)(BLADE_LOAD_HEAVY_POWER - BLADE_LOAD_LIGHT_POWER);
+    l_fLoad = (l_fRpmLoad > l_fPowerLoad) ? l_fRpmLoad : l_fPowerLoad;
+    if (l_fLoad < 0.0f)
+    {
+        l_fLoad = 0.0f;
+    }
+    else if (l_fLoad > 1.0f)
+    {
+        l_fLoad = 1.0f;
+    }
+
+    l_fTarget = BLADE_LOAD_MAX_SCALE - l_fLoad * (BLADE_LOAD_MAX_SCALE - BLADE_LOAD_MIN_SCALE);
+    if (l_fTarget < BLADEMOTOR_fSpeedScale)
+    {
+        BLADEMOTOR_fSpeedScale += (l_fTarget - BLADEMOTOR_fSpeedScale) * BLADE_LOAD_SLOWDOWN_ALPHA;
+    }
+    else
+    {
+        BLADEMOTOR_fSpeedScale += (l_fTarget - BLADEMOTOR_fSpeedScale) * BLADE_LOAD_SPEEDUP_ALPHA;
+    }
+}
+#endif
@@ -17,13 +17,22 @@
 #include "board.h"
 #include "adc.h"
 #include "charger.h"
+#include "battery.h"
 /******************************************************************************
  * Module Preprocessor Constants
  *******************************************************************************/
+#define CHARGER_PWM_MAX 1350
+
+/* PI gains, Q24 PWM counts per mA / mV, the integral ones per charging scan */
+#define CHARGER_CURRENT_KP_Q24 CHARGER_Q24(CHARGER_CURRENT_KP)
+#define CHARGER_CURRENT_KI_Q24 CHARGER_Q24(CHARGER_CURRENT_KI / ADC_CHARGING_CONTROL_HZ)
+#define CHARGER_VOLTAGE_KP_Q24 CHARGER_Q24(CHARGER_VOLTAGE_KP)
+#define CHARGER_VOLTAGE_KI_Q24 CHARGER_Q24(CHARGER_VOLTAGE_KI / ADC_CHARGING_CONTROL_HZ)
 
 /******************************************************************************
  * Module Preprocessor Macros
  *******************************************************************************/
+#define CHARGER_Q24(x) ((int32_t)((x) * 16777216.0 + 0.5))
 
 /******************************************************************************
  * Module Typedefs
@@ -37,22 +46,36 @@ typedef enum{
     CHARGER_STATE_END_CHARGING,
 } CHARGER_STATE_e;
 
+typedef struct {
+    int32_t s32Kp;          /* Q24 */
+    int32_t s32Ki;          /* Q24 */
+} CHARGER_pi_t;
+
 /******************************************************************************
  * Module Variable Definitions
  *******************************************************************************/
 
 TIM_HandleTypeDef TIM1_Handle;  // PWM Charge Controller
 
-float SOC                           = 0;
 uint16_t chargecontrol_pwm_val      = 0;
 uint8_t  chargecontrol_is_charging  = 0;
 
-static CHARGER_STATE_e charger_state = CHARGER_STATE_IDLE;
+static volatile CHARGER_STATE_e charger_state = CHARGER_STATE_IDLE;
 static float charge_end_voltage=BAT_CHARGE_CUTOFF_VOLTAGE ;
 
+/* control loops, the integral (PWM counts, Q16) is shared so the loop taking over starts from the applied PWM */
+static const CHARGER_pi_t charger_sCurrentPi = {CHARGER_CURRENT_KP_Q24, CHARGER_CURRENT_KI_Q24};
+static const CHARGER_pi_t charger_sVoltagePi = {CHARGER_VOLTAGE_KP_Q24, CHARGER_VOLTAGE_KI_Q24};
+static volatile int32_t charger_s32Integral = 0;
+static volatile int32_t charger_s32EndVoltageMv = (int32_t)(BAT_CHARGE_CUTOFF_VOLTAGE * 1000);
+static volatile int32_t charger_s32CurrentOffsetMa = 0;
+
 /******************************************************************************
  * Function Prototypes
  *******************************************************************************/
+static int32_t charger_piIntegrate(const CHARGER_pi_t *p_psPi, int32_t p_s32Error);
+static int32_t charger_piOutput(const CHARGER_pi_t *p_psPi, int32_t p_s32Integral, int32_t p_s32Error);
+static void charger_setPwm(uint16_t p_u16Pwm);
 
 /******************************************************************************
  *  Public Functions
@@ -82,7 +105,7 @@ static float charge_end_voltage=BAT_CHARGE_CUTOFF_VOLTAGE ;
   TIM1_Handle.Instance = TIM1;
   TIM1_Handle.Init.Prescaler = 0;
   TIM1_Handle.Init.CounterMode = TIM_COUNTERMODE_UP;
-  TIM1_Handle.Init.Period = 1400;
+  TIM1_Handle.Init.Period = CHARGER_PWM_PERIOD;
   TIM1_Handle.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
   TIM1_Handle.Init.RepetitionCounter = 0;
   TIM1_Handle.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_ENABLE;
@@ -97,7 +120,11 @@ static float charge_end_voltage=BAT_CHARGE_CUTOFF_VOLTAGE ;
     Error_Handler();
   }
 
+#if ADC_CHARGING_PWM_SYNC
+  sMasterConfig.MasterOutputTrigger = TIM_TRGO_OC3REF; /* clocks TIM2, the charging ADC scans follow the PWM */
+#else
   sMasterConfig.MasterOutputTrigger = TIM_TRGO_RESET;
+#endif
   sMasterConfig.MasterSlaveMode = TIM_MASTERSLAVEMODE_DISABLE;
   if (HAL_TIMEx_MasterConfigSynchronization(&TIM1_Handle, &sMasterConfig) != HAL_OK)
   {
@@ -116,6 +143,16 @@ static float charge_end_voltage=BAT_CHARGE_CUTOFF_VOLTAGE ;
     Error_Handler();
   }
 
+#if ADC_CHARGING_PWM_SYNC
+  /* no output, OC3REF rises at CCR3 (PWM2) in the high side on time, see charger_setPwm() */
+  sConfigOC.OCMode = TIM_OCMODE_PWM2;
+  sConfigOC.Pulse = 1;
+  if (HAL_TIM_PWM_ConfigChannel(&TIM1_Handle, &sConfigOC, TIM_CHANNEL_3) != HAL_OK)
+  {
+    Error_Handler();
+  }
+#endif
+
   sBreakDeadTimeConfig.OffStateRunMode = TIM_OSSR_ENABLE;
   sBreakDeadTimeConfig.OffStateIDLEMode = TIM_OSSI_ENABLE;
   sBreakDeadTimeConfig.LockLevel = TIM_LOCKLEVEL_1;
@@ -153,7 +190,7 @@ static float charge_end_voltage=BAT_CHARGE_CUTOFF_VOLTAGE ;
 
 
     // Charge CH1/CH1N PWM Timer
-  TIM1->CCR1 = 0;  
+  charger_setPwm(0);
   HAL_TIM_PWM_Start(&TIM1_Handle, TIM_CHANNEL_1);
   HAL_TIMEx_PWMN_Start(&TIM1_Handle, TIM_CHANNEL_1);
   DB_TRACE(" * Charge Controler PWM Timers initialized\r\n");
@@ -171,17 +208,71 @@ static float charge_end_voltage=BAT_CHARGE_CUTOFF_VOLTAGE ;
       charger_state=CHARGER_STATE_CHARGING_CC;
     }
     charge_end_voltage=v;
+    charger_s32EndVoltageMv = (int32_t)(v * 1000);
  }
 
+/// @brief charge control loop, called after every charging ADC scan
+/// current PI loop in CC, voltage PI loop in CV, the lowest output drives the PWM so the
+/// voltage loop also keeps the charger output below MAX_CHARGE_VOLTAGE while in CC.
+/// The state machine stays in ChargeController(), the PWM is not touched in the other states
+void CHARGER_ControlIT(void)
+{
+    int32_t l_s32CurrentError;
+    int32_t l_s32VoltageError;
+    int32_t l_s32OutputError;
+    int32_t l_s32CurrentIntegral;
+    int32_t l_s32VoltageIntegral;
+    int32_t l_s32CurrentOutput;
+    int32_t l_s32VoltageOutput;
+    int32_t l_s32Output;
+
+    if (charger_state != CHARGER_STATE_CHARGING_CC && charger_state != CHARGER_STATE_CHARGING_CV)
+    {
+        return;
+    }
+
+    l_s32CurrentError = (int32_t)(MAX_CHARGE_CURRENT * 1000) - (ADC_ChargingSampleMilli(ADC_CHARGING_CHANNEL_CURRENT) - charger_s32CurrentOffsetMa);
+    /* battery at the end voltage, charger output under the max voltage */
+    l_s32VoltageError = charger_s32EndVoltageMv - ADC_ChargingSampleMilli(ADC_CHARGING_CHANNEL_BATTERYVOLTAGE);
+    l_s32OutputError = (int32_t)(MAX_CHARGE_VOLTAGE * 1000) - ADC_ChargingSampleMilli(ADC_CHARGING_CHANNEL_CHARGEVOLTAGE);
+    if (l_s32OutputError < l_s32VoltageError)
+    {
+        l_s32VoltageError = l_s32OutputError;
+    }
+
+    l_s32CurrentIntegral = charger_piIntegrate(&charger_sCurrentPi, l_s32CurrentError);
+    l_s32VoltageIntegral = charger_piIntegrate(&charger_sVoltagePi, l_s32VoltageError);
+    l_s32CurrentOutput = charger_piOutput(&charger_sCurrentPi, l_s32CurrentIntegral, l_s32CurrentError);
+    l_s32VoltageOutput = charger_piOutput(&charger_sVoltagePi, l_s32VoltageIntegral, l_s32VoltageError);
+
+    /* only the loop in control integrates */
+    if (l_s32CurrentOutput <= l_s32VoltageOutput)
+    {
+        l_s32Output = l_s32CurrentOutput;
+        charger_s32Integral = l_s32CurrentIntegral;
+    }
+    else
+    {
+        l_s32Output = l_s32VoltageOutput;
+        charger_s32Integral = l_s32VoltageIntegral;
+    }
+
+    chargecontrol_pwm_val = l_s32Output >> 16;
+    charger_setPwm(chargecontrol_pwm_val);
+}
+
 /*
  * manages the charge voltage, and charge, lowbat LED
  * improvementt need to be done to avoid sparks when connected charger and disconnected 
- * todo PID current measure
- * needs to be called frequently
+ * the PWM is regulated by CHARGER_ControlIT() in the CC and CV states
+ * called every 10ms
  */
 void ChargeController(void)
 {                        
   static uint32_t timestamp = 0;
+  int32_t l_s32Output;
+
+  charger_s32CurrentOffsetMa = (int32_t)(charge_current_offset.f * 1000);
 
   /*charger disconnected force idle state*/
   if(( chargerInputVoltage < MIN_DOCKED_VOLTAGE) ){
@@ -204,22 +295,18 @@ void ChargeController(void)
           HAL_RTCEx_BKUPWrite(&hrtc, RTC_BKP_DR4, charge_current_offset.u[1]);   
           HAL_PWR_DisableBkUpAccess(); 
           HAL_GPIO_WritePin(TF4_GPIO_PORT, TF4_PIN, 1); /* Power on the battery  Powerbus */
+          /* start just under the PWM giving the battery voltage instead of ramping from 0 */
+          l_s32Output = 0;
+          if (chargerInputVoltage > battery_voltage) {
+            l_s32Output = (int32_t)(CHARGER_PWM_FEEDFORWARD * CHARGER_PWM_PERIOD * battery_voltage / chargerInputVoltage);
+          }
+          charger_s32Integral = l_s32Output << 16;
           charger_state = CHARGER_STATE_CHARGING_CC;
         }
 
         break;
 
     case CHARGER_STATE_CHARGING_CC:
-        // cap charge current at 1.5 Amps
-        if ((battery_voltage > charge_end_voltage && (chargecontrol_pwm_val > 0)) || ((current > MAX_CHARGE_CURRENT) && (chargecontrol_pwm_val > 39)))
-        {
-            chargecontrol_pwm_val--;
-        }
-        if ((battery_voltage < charge_end_voltage) && (current < MAX_CHARGE_CURRENT) && (chargecontrol_pwm_val < 1350))
-        {
-            chargecontrol_pwm_val++;
-        }
-
         if(charge_voltage >= charge_end_voltage) {
             charger_state = CHARGER_STATE_CHARGING_CV;
         }
@@ -227,28 +314,11 @@ void ChargeController(void)
         break;
 
     case CHARGER_STATE_CHARGING_CV:
-        // set PWM to approach 29.4V  charge voltage
-        if ((battery_voltage < charge_end_voltage) && (charge_voltage < (MAX_CHARGE_VOLTAGE)) && (chargecontrol_pwm_val < 1350))
-        {
-          chargecontrol_pwm_val++;
-        }            
-        if ((battery_voltage > charge_end_voltage && (chargecontrol_pwm_val > 0)) || (charge_voltage > (MAX_CHARGE_VOLTAGE) && (chargecontrol_pwm_val > 39)))
-        {
-          chargecontrol_pwm_val--;
-        }
-
-        /* the current is limited to 150ma */
-        if ((current > (MAX_CHARGE_CURRENT/10)) && chargecontrol_pwm_val > 0)
-        {
-            chargecontrol_pwm_val--;
-        }
-
         /* battery full ? */
         if (current < CHARGE_END_LIMIT_CURRENT) {
           //charger_state = CHARGER_STATE_END_CHARGING;
           /*consider as the battery full */
-          ampere_acc.f = 2.8;
-          SOC = 100;
+          BATTERY_SetFull();
         }
 
         break;
@@ -272,26 +342,66 @@ void ChargeController(void)
         break;
     }
     
-    ampere_acc.f += ((current - charge_current_offset.f)/(100*60*60));
-    if(ampere_acc.f >= 2.8)ampere_acc.f = 2.8;
-    SOC = ampere_acc.f/2.8;
-
-    // Writes a data in a RTC Backup data Register 1
-    HAL_PWR_EnableBkUpAccess();
-    HAL_RTCEx_BKUPWrite(&hrtc, RTC_BKP_DR1, ampere_acc.u[0]);    
-    HAL_RTCEx_BKUPWrite(&hrtc, RTC_BKP_DR2, ampere_acc.u[1]);   
-    HAL_PWR_DisableBkUpAccess(); 
-
     chargecontrol_is_charging = charger_state;
 
-    /*Check the PWM value for safety */
-    if (chargecontrol_pwm_val > 1350){
-        chargecontrol_pwm_val = 1350;
+    /* in CC and CV the PWM is set by CHARGER_ControlIT() */
+    if (charger_state != CHARGER_STATE_CHARGING_CC && charger_state != CHARGER_STATE_CHARGING_CV) {
+        charger_setPwm(chargecontrol_pwm_val);
     }
-    TIM1->CCR1 = chargecontrol_pwm_val;  
-    
 }
 
 /******************************************************************************
  *  Private Functions
  *******************************************************************************/
+
+/// @brief integral of a PI loop after this step, clamped to the PWM range (no wind up)
+/// @param p_psPi loop
+/// @param p_s32Error setpoint - measure (mA or mV)
+/// @retval PWM counts (Q16)
+static int32_t charger_piIntegrate(const CHARGER_pi_t *p_psPi, int32_t p_s32Error)
+{
+    int32_t l_s32Integral = charger_s32Integral + (int32_t)(((int64_t)p_s32Error * p_psPi->s32Ki) >> 8);
+
+    if (l_s32Integral < 0)
+    {
+        return 0;
+    }
+    if (l_s32Integral > (CHARGER_PWM_MAX << 16))
+    {
+        return CHARGER_PWM_MAX << 16;
+    }
+    return l_s32Integral;
+}
+
+/// @brief output of a PI loop
+/// @param p_psPi loop
+/// @param p_s32Integral integral from charger_piIntegrate()
+/// @param p_s32Error setpoint - measure (mA or mV)
+/// @retval PWM counts (Q16), 0 to CHARGER_PWM_MAX
+static int32_t charger_piOutput(const CHARGER_pi_t *p_psPi, int32_t p_s32Integral, int32_t p_s32Error)
+{
+    int64_t l_s64Output = p_s32Integral + (((int64_t)p_s32Error * p_psPi->s32Kp) >> 8);
+
+    if (l_s64Output < 0)
+    {
+        return 0;
+    }
+    if (l_s64Output > (CHARGER_PWM_MAX << 16))
+    {
+        return CHARGER_PWM_MAX << 16;
+    }
+    return (int32_t)l_s64Output;
+}
+
+/// @brief set the charge PWM
+/// with ADC_CHARGING_PWM_SYNC the ADC trigger (CCR3) follows so the current is sampled
+/// in the middle of the on time, where it equals the average of the ripple
+/// @param p_u16Pwm TIM1 compare value
+static void charger_setPwm(uint16_t p_u16Pwm)
+{
+    TIM1->CCR1 = p_u16Pwm;
+#if ADC_CHARGING_PWM_SYNC
+    /* center the sampling window, the PWM2 mode needs CCR3 > 0 to give an edge */
+    TIM1->CCR3 = (p_u16Pwm > ADC_CHARGING_SYNC_WINDOW + 2) ? (p_u16Pwm - ADC_CHARGING_SYNC_WINDOW) / 2 : 1;
+#endif
+}
@@ -0,0 +1,223 @@
+/****************************************************************************
+* Title                 :   perimeter matched filter
+* Filename              :   corr_filter.c
+* Author                :
+* Origin Date           :
+* Version               :   1.0.0
+
+*****************************************************************************/
+/** \file corr_filter.c
+*  \brief cross correlation of the perimeter coil samples with the signal code
+*
+*  The codes are small integers with long constant runs. The decimated samples
+*  are turned into prefix sums, a run then weighs the difference of two prefix
+*  sums and a correlation costs one multiply per run boundary (difference tap)
+*  instead of one per code value. The prefix sums do not depend on the code so
+*  a bank of codes is correlated over the same buffer in one pass. The integer
+*  arithmetic is exact, the result is the same as the full correlation.
+*/
+/******************************************************************************
+* Includes
+*******************************************************************************/
+#include <math.h>
+
+#include "corr_filter.h"
+
+/******************************************************************************
+* Module Preprocessor Constants
+*******************************************************************************/
+
+/******************************************************************************
+* Module Preprocessor Macros
+*******************************************************************************/
+
+/******************************************************************************
+* Module Typedefs
+*******************************************************************************/
+
+/******************************************************************************
+* Module Variable Definitions
+*******************************************************************************/
+
+/******************************************************************************
+* Function Prototypes
+*******************************************************************************/
+static inline int32_t corrfilter_at(const CORRFILTER_Code_t *p_psCode, const int32_t *p_ps32Prefix);
+static double corrfilter_snr(const CORRFILTER_Code_t *p_psCode, const int32_t *p_ps32Prefix, int p_iN, int32_t p_s32Max, int p_iMaxPos);
+
+/******************************************************************************
+*  Public Functions
+*******************************************************************************/
+
+/// @brief build the difference taps of a signal code
+/// @param p_psCode code descriptor to fill
+/// @param p_ps32Code code values, the sum of all elements must be zero
+/// @param p_u8Length number of values, up to CORRFILTER_MAX_CODE_LENGTH
+void CORRFILTER_Init(CORRFILTER_Code_t *p_psCode, const int32_t *p_ps32Code, uint8_t p_u8Length)
+{
+    int32_t l_s32Previous = 0;
+    int32_t l_s32Current;
+    uint8_t l_u8Idx;
+
+    if (p_u8Length > CORRFILTER_MAX_CODE_LENGTH)
+    {
+        p_u8Length = CORRFILTER_MAX_CODE_LENGTH;
+    }
+    p_psCode->ps32Code = p_ps32Code;
+    p_psCode->u8Length = p_u8Length;
+    p_psCode->u8Taps = 0;
+
+    /* corr[i] = sum over k of c[k] * (S[i+k+1] - S[i+k]) = sum over k = 0..m of (c[k-1] - c[k]) * S[i+k], c[-1] = c[m] = 0 */
+    for (l_u8Idx = 0; l_u8Idx <= p_u8Length; l_u8Idx++)
+    {
+        l_s32Current = (l_u8Idx < p_u8Length) ? p_ps32Code[l_u8Idx] : 0;
+        if (l_s32Current != l_s32Previous)
+        {
+            p_psCode->pu8Offset[p_psCode->u8Taps] = l_u8Idx;
+            p_psCode->ps32Diff[p_psCode->u8Taps] = l_s32Previous - l_s32Current;
+            p_psCode->u8Taps++;
+        }
+        l_s32Previous = l_s32Current;
+    }
+}
+
+/// @brief matched filter (cross correlation) with one code
+/// @param p_psCode signal code, see CORRFILTER_Init
+/// @param p_pu16Buffer coil samples, overwritten
+/// @param p_iNbPts number of samples in the buffer
+/// @param p_iOversampling samples summed per point, 3 to 16
+/// @retval detected signal strength
+double CORRFILTER_Run(const CORRFILTER_Code_t *p_psCode, uint16_t *p_pu16Buffer, int p_iNbPts, int p_iOversampling)
+{
+    double l_dSignal;
+
+    CORRFILTER_RunBank(p_psCode, 1, p_pu16Buffer, p_iNbPts, p_iOversampling, &l_dSignal);
+    return l_dSignal;
+}
+
+/// @brief matched filters of several codes over the same samples, in one pass
+/// the buffer is decimated in place into prefix sums shared by all the codes
+/// @param p_psCodes signal codes, see CORRFILTER_Init
+/// @param p_u8Codes number of codes, up to CORRFILTER_MAX_CODES
+/// @param p_pu16Buffer coil samples, 32 bit aligned, overwritten
+/// @param p_iNbPts number of samples in the buffer
+/// @param p_iOversampling samples summed per point, 3 to 16
+/// @param p_pdSignal detected signal strength (peak over noise deviation) of every code
+/// @retval index of the strongest code
+uint8_t CORRFILTER_RunBank(const CORRFILTER_Code_t *p_psCodes, uint8_t p_u8Codes, uint16_t *p_pu16Buffer, int p_iNbPts, int p_iOversampling, double *p_pdSignal)
+{
+  /* Calculate oversampling: n=effective number of samples */
+  const int n=p_iNbPts/p_iOversampling;
+  int32_t corr_max_abs[CORRFILTER_MAX_CODES],corr_max[CORRFILTER_MAX_CODES]; // Maximum (absolute) correlation
+  int corr_max_pos[CORRFILTER_MAX_CODES]; // Position of the maximum correlation
+  int last=-1; // last position of the shortest code
+  uint8_t strongest=0;
+
+  if (p_u8Codes>CORRFILTER_MAX_CODES) p_u8Codes=CORRFILTER_MAX_CODES;
+
+  /* prefix[i] = sum of the first i points, written over samples already summed:
+   * 4 bytes for every point of at least 3 samples (6 bytes) */
+  int32_t *prefix=(int32_t*) p_pu16Buffer;
+  {
+    const uint16_t *p=p_pu16Buffer;
+    int32_t acc=0;
+    for (int i=0; i<n; i++) {
+      int32_t tmp=*(p++);
+      for (int j=p_iOversampling; --j>0; ) {
+        tmp+=*(p++);
+      }
+      prefix[i]=acc;
+      acc+=tmp;
+    }
+    prefix[n]=acc;
+  }
+
+  for (uint8_t c=0; c<p_u8Codes; c++) {
+    corr_max_abs[c]=corr_max[c]=0;
+    corr_max_pos[c]=0;
+    if (n-p_psCodes[c].u8Length>last) last=n-p_psCodes[c].u8Length;
+  }
+
+  for (int i=0; i<=last; i++) {
+    for (uint8_t c=0; c<p_u8Codes; c++) {
+      if (i>n-p_psCodes[c].u8Length) continue;
+      int32_t sum=corrfilter_at(&p_psCodes[c],prefix+i);
+      if (sum<0) {
+        if (-sum>corr_max_abs[c]) {
+          corr_max[c]=sum;
+          corr_max_abs[c]=-sum;
+          corr_max_pos[c]=i;
+        }
+      } else {
+        if (sum>corr_max_abs[c]) {
+          corr_max_abs[c]=corr_max[c]=sum;
+          corr_max_pos[c]=i;
+        }
+      }
+    }
+  }
+
+  for (uint8_t c=0; c<p_u8Codes; c++) {
+    p_pdSignal[c]=corrfilter_snr(&p_psCodes[c],prefix,n,corr_max[c],corr_max_pos[c]);
+    if (fabs(p_pdSignal[c])>fabs(p_pdSignal[strongest])) strongest=c;
+  }
+  return strongest;
+}
+
+/******************************************************************************
+*  Private Functions
+*******************************************************************************/
+
+/* correlation at the position of p_ps32Prefix: every constant run of the code weighs
+ * the difference of two prefix sums, so one multiply per difference tap */
+static inline int32_t corrfilter_at(const CORRFILTER_Code_t *p_psCode, const int32_t *p_ps32Prefix)
+{
+  int32_t sum=0;
+  for (int t=0; t<p_psCode->u8Taps; t++) sum+=p_ps32Prefix[p_psCode->pu8Offset[t]]*p_psCode->ps32Diff[t];
+  return sum;
+}
+
+/* signal to noise ratio of the correlation peak, the noise around the peak is computed again from the prefix sums */
+static double corrfilter_snr(const CORRFILTER_Code_t *p_psCode, const int32_t *p_ps32Prefix, int p_iN, int32_t p_s32Max, int p_iMaxPos)
+{
+  const int n=p_iN;
+  const int sigcode_length=p_psCode->u8Length;
+  const int32_t corr_max=p_s32Max;
+  const int corr_max_pos=p_iMaxPos;
+
+  if (corr_max==0) return 0;
+
+  /* The perimeter signal seems to be automatically amplified until the whole ADC range is used.
+   * => Calculate signal from signal to noise ratio.
+   */
+  int64_t sx2=0,sx=0;
+  int sn=0;
+
+  int count=n/5;
+  int p=corr_max_pos-3*sigcode_length/2; // Distance to signal;
+  while (count>0 && p>=0) {
+    int64_t s=corrfilter_at(p_psCode,p_ps32Prefix+p);
+    sx+=s;
+    sx2+=s*s;
+    p--;
+    count--;
+    sn++;
+  }
+  count=n/5;
+  p=corr_max_pos+3*sigcode_length/2; // Distance to signal;
+  while (count>0 && p<n-sigcode_length) {
+    int64_t s=corrfilter_at(p_psCode,p_ps32Prefix+p);
+    sx+=s;
+    sx2+=s*s;
+    p++;
+    count--;
+    sn++;
+  }
+
+  if (sn<=1) return 0;
+  double noiseDeviation=sqrt((sx2-sx*sx/(double) sn)/(sn-1));
+  if (noiseDeviation<1) return corr_max;
+  return corr_max/noiseDeviation;
+}
+
+/*** End of File **************************************************************/
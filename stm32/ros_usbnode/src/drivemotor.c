@@ -15,6 +15,7 @@
  *******************************************************************************/
 #include <string.h>
 #include <stdlib.h>
+#include <math.h>
 
 #include "stm32f_board_hal.h"
 
@@ -22,6 +23,8 @@
 #include "ros/ros_custom/cpp_main.h"
 #include "board.h"
 #include "adc.h"
+#include "uart_frame.h"
+#include "latency.h"
 
 #include "drivemotor.h"
 
@@ -31,6 +34,10 @@
 #define DRIVEMOTOR_LENGTH_INIT_MSG 38
 #define DRIVEMOTOR_LENGTH_RQST_MSG 12
 #define DRIVEMOTOR_LENGTH_RECEIVED_MSG 20
+
+#define DRIVEMOTOR_RAMP_MAX_DT 0.05f                                /* s, ramp step limit if requests were skipped */
+#define DRIVEMOTOR_RAMP_ACCEL_PWM (DRIVEMOTOR_RAMP_ACCEL * PWM_PER_MPS) /* PWM/s */
+#define DRIVEMOTOR_RAMP_JERK_PWM (DRIVEMOTOR_RAMP_JERK * PWM_PER_MPS)   /* PWM/s² */
 /******************************************************************************
  * Module Preprocessor Macros
  *******************************************************************************/
@@ -66,6 +73,21 @@ typedef struct
     /*19*/ uint8_t u8_CRC;
 } __attribute__((__packed__)) DRIVEMOTORS_data_t;
 
+typedef struct
+{
+    uint16_t u16Baseline;    /* power rolling baseline, 4 bits fractional */
+    uint8_t u8PrevPower;     /* power of the previous frame */
+    uint8_t u8PrevCmd;       /* commanded speed of the previous frame */
+    uint8_t u8Count;         /* consecutive suspicious frames */
+    uint32_t u32SettleTick;  /* last big change of the commanded speed */
+} DRIVEMOTOR_collision_t;
+
+typedef struct
+{
+    float fSpeed;            /* signed PWM value sent to the motor, negative is backward */
+    float fAccel;            /* PWM/s */
+} DRIVEMOTOR_ramp_t;
+
 /******************************************************************************
  * Module Variable Definitions
  *******************************************************************************/
@@ -74,13 +96,33 @@ UART_HandleTypeDef DRIVEMOTORS_USART_Handler; // UART  Handle
 DMA_HandleTypeDef hdma_usart2_rx;
 DMA_HandleTypeDef hdma_usart2_tx;
 
+static UARTFRAME_Handle_t drivemotor_sFrame;
+
 static DRIVEMOTOR_STATE_e drivemotor_eState = DRIVEMOTOR_INIT_1;
-static rx_status_e drivemotors_eRxFlag = RX_WAIT;
+static volatile rx_status_e drivemotors_eRxFlag = RX_WAIT;
+static uint8_t drivemotor_bRqstPending = 0;
+static uint32_t drivemotor_u32RqstTick = 0;
+static uint32_t drivemotor_u32TicksPublishTick = 0;
+
+#if DRIVEMOTOR_COLLISION_DETECTION
+static DRIVEMOTOR_collision_t drivemotor_sLeftCollision = {0};
+static DRIVEMOTOR_collision_t drivemotor_sRightCollision = {0};
+#endif
+static uint8_t drivemotor_u8Collision = 0; /* bit0 left, bit1 right */
+static volatile uint8_t drivemotor_u8EmergencyStop = 0; /* set from the emergency interrupt, zero speed until DRIVEMOTOR_Stop() */
+
+#if DRIVEMOTOR_RAMP
+static DRIVEMOTOR_ramp_t drivemotor_sLeftRamp = {0};
+static DRIVEMOTOR_ramp_t drivemotor_sRightRamp = {0};
+static uint32_t drivemotor_u32RampTick = 0;
+#endif
 
 static DRIVEMOTORS_data_t drivemotor_psReceivedData = {0};
 static uint8_t drivemotor_pu8RqstMessage[DRIVEMOTOR_LENGTH_RQST_MSG] = {0x55, 0xaa, 0x08, 0x10, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
 
 const uint8_t drivemotor_pcu8Preamble[5] = {0x55, 0xAA, 0x10, 0x01, 0xE0};
+static const UARTFRAME_Descriptor_t drivemotor_csFrameDesc = {drivemotor_pcu8Preamble, 5, DRIVEMOTOR_LENGTH_RECEIVED_MSG, DRIVEMOTOR_LENGTH_RECEIVED_MSG - 1};
+static const uint8_t drivemotor_pcu8StopMsg[DRIVEMOTOR_LENGTH_RQST_MSG] = {0x55, 0xaa, 0x08, 0x10, 0x80, 0xa0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x37};
 // const uint8_t drivemotor_pcu8InitMsg[DRIVEMOTOR_LENGTH_INIT_MSG] = { 0x55, 0xaa, 0x08, 0x10, 0x80, 0xa0, 0x0, 0x0, 0x0, 0x0, 0x0, 0x37};
 const uint8_t drivemotor_pcu8InitMsg[DRIVEMOTOR_LENGTH_INIT_MSG] = {0x55, 0xaa, 0x22, 0x10, 0x80, 0x00, 0x00, 0x00, 0x00, 0x02, 0xC8, 0x46, 0x0C, 0x00, 0x00, 0x00, 0x00, 0x05, 0x0F, 0x14, 0x96, 0x0A, 0x1E, 0x5a, 0xfa, 0x05, 0x0A, 0x14, 0x32, 0x40, 0x04, 0x20, 0x01, 0x00, 0x00, 0x2C, 0x01, 0xEE};
 
@@ -102,6 +144,8 @@ uint8_t right_power = 0;
 uint8_t left_power = 0;
 
 uint32_t DRIVEMOTOR_u32ErrorCnt = 0;
+uint32_t DRIVEMOTOR_u32RxErrorCnt = 0;
+uint32_t DRIVEMOTOR_u32CollisionCnt = 0;
 
 static uint8_t left_speed_req;
 static uint8_t right_speed_req;
@@ -112,6 +156,18 @@ static uint8_t right_dir_req;
  * Function Prototypes
  *******************************************************************************/
 __STATIC_INLINE void drivemotor_prepareMsg(uint8_t left_speed, uint8_t right_speed, uint8_t left_dir, uint8_t right_dir);
+static uint8_t drivemotor_prepareRqst(void);
+static void drivemotor_decodeMsg(void);
+static void drivemotor_receiveFrame(rx_status_e p_eStatus, const uint8_t *p_pu8Frame);
+static void drivemotor_sendSpeed(uint8_t left_speed, uint8_t right_speed, uint8_t left_dir, uint8_t right_dir);
+static uint8_t drivemotor_probes(void);
+#if DRIVEMOTOR_RAMP
+static void drivemotor_rampStep(DRIVEMOTOR_ramp_t *p_psRamp, float p_fTarget, float p_fDt);
+static void drivemotor_rampOutput(const DRIVEMOTOR_ramp_t *p_psRamp, uint8_t *p_pu8Speed, uint8_t *p_pu8Dir);
+#endif
+#if DRIVEMOTOR_COLLISION_DETECTION
+static uint8_t drivemotor_collisionDetect(DRIVEMOTOR_collision_t *p_psWheel, uint8_t p_u8Cmd, uint8_t p_u8Speed, uint8_t p_u8Power);
+#endif
 
 /******************************************************************************
  *  Public Functions
@@ -194,7 +250,7 @@ void DRIVEMOTOR_Init(void)
     hdma_usart2_rx.Init.MemInc = DMA_MINC_ENABLE;
     hdma_usart2_rx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
     hdma_usart2_rx.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
-    hdma_usart2_rx.Init.Mode = DMA_NORMAL;
+    hdma_usart2_rx.Init.Mode = DMA_CIRCULAR;
     hdma_usart2_rx.Init.Priority = DMA_PRIORITY_LOW;
     if (HAL_DMA_Init(&hdma_usart2_rx) != HAL_OK)
     {
@@ -230,6 +286,8 @@ void DRIVEMOTOR_Init(void)
 
     __HAL_UART_ENABLE_IT(&DRIVEMOTORS_USART_Handler, UART_IT_TC);
 
+    UARTFRAME_Init(&drivemotor_sFrame, &DRIVEMOTORS_USART_Handler, &drivemotor_csFrameDesc, drivemotor_receiveFrame);
+
     right_encoder_ticks = 0;
     left_encoder_ticks = 0;
     prev_left_direction = 0;
@@ -240,37 +298,170 @@ void DRIVEMOTOR_Init(void)
     prev_left_wheel_speed_val = 0;
 }
 
-/// @brief handle drive motor messages
+/// @brief drive motor request / answer pipeline, called from the main loop
+/// the next request is sent as soon as the answer to the previous one is received and
+/// DRIVEMOTOR_POLL_PERIOD_MS is elapsed, DRIVEMOTOR_RX_TIMEOUT_MS is the fallback if no answer comes back
 /// @param
-void DRIVEMOTOR_App_10ms(void)
+void DRIVEMOTOR_App(void)
 {
+    uint32_t l_u32Now = HAL_GetTick();
+
+    if (drivemotor_bRqstPending)
+    {
+        if (drivemotors_eRxFlag == RX_WAIT)
+        {
+            if ((l_u32Now - drivemotor_u32RqstTick) < DRIVEMOTOR_RX_TIMEOUT_MS)
+            {
+                return; /* answer not yet received */
+            }
+            drivemotors_eRxFlag = RX_TIMEOUT_ERROR;
+        }
 
+        if (drivemotors_eRxFlag == RX_VALID)
+        {
+            drivemotor_decodeMsg();
+        }
+        else
+        {
+            DRIVEMOTOR_u32RxErrorCnt++;
+        }
+        drivemotors_eRxFlag = RX_WAIT; // ready for next message
+        drivemotor_bRqstPending = 0;
+    }
+
+    if ((l_u32Now - drivemotor_u32RqstTick) < DRIVEMOTOR_POLL_PERIOD_MS)
+    {
+        return;
+    }
+    drivemotor_u32RqstTick = l_u32Now;
+
+    if (drivemotor_prepareRqst())
+    {
+        uint32_t l_u32Primask = __get_PRIMASK();
+
+        /* forget any late answer to a previous request */
+        drivemotors_eRxFlag = RX_WAIT;
+        /* an emergency confirmed while the request was prepared must not be followed by a speed */
+        __disable_irq();
+        if (drivemotor_u8EmergencyStop)
+        {
+            drivemotor_sendSpeed(0, 0, 0, 0);
+        }
+        UARTFRAME_TransmitProbe(&drivemotor_sFrame, drivemotor_pu8RqstMessage, DRIVEMOTOR_LENGTH_RQST_MSG, drivemotor_probes());
+        __set_PRIMASK(l_u32Primask);
+        drivemotor_bRqstPending = 1;
+    }
+}
+
+/// @brief Set drive motor speeds, the motors reach them through the velocity ramp
+/// @param left_speed left motor speed byte
+/// @param right_speed right motor speed byte
+/// @param left_dir left motor direction bit
+/// @param right_dir  left motor direction bit
+void DRIVEMOTOR_SetSpeed(uint8_t left_speed, uint8_t right_speed, uint8_t left_dir, uint8_t right_dir)
+{
+    left_speed_req = left_speed;
+    right_speed_req = right_speed;
+    if(left_speed_req == 0 && right_speed_req ==  0)
+    {
+        left_dir_req = 0;
+        right_dir_req = 0;
+    }
+    else
+    {
+        left_dir_req = left_dir;
+        right_dir_req = right_dir;
+    }
+}
+
+/// @brief Stop the drive motors right away, without going through the velocity ramp
+/// @param
+void DRIVEMOTOR_Stop(void)
+{
+    DRIVEMOTOR_SetSpeed(0, 0, 0, 0);
+#if DRIVEMOTOR_RAMP
+    memset(&drivemotor_sLeftRamp, 0, sizeof(DRIVEMOTOR_ramp_t));
+    memset(&drivemotor_sRightRamp, 0, sizeof(DRIVEMOTOR_ramp_t));
+#endif
+    drivemotor_u8EmergencyStop = 0;
+}
+
+/// @brief emergency confirmed, queue a zero speed frame right away, called from the emergency interrupt
+/// the following requests stay at zero speed until DRIVEMOTOR_Stop() is called from the main loop
+/// @param
+void DRIVEMOTOR_EmergencyStopIT(void)
+{
+    drivemotor_u8EmergencyStop = 1;
+    if (drivemotor_sFrame.phUart != NULL)
+    {
+        UARTFRAME_TransmitProbe(&drivemotor_sFrame, drivemotor_pcu8StopMsg, DRIVEMOTOR_LENGTH_RQST_MSG,
+                                LATENCY_MASK(LATENCY_INPUT_DRIVE) | LATENCY_MASK(LATENCY_SERVICE_DRIVE));
+    }
+}
+
+/******************************************************************************
+ *  Private Functions
+ *******************************************************************************/
+
+/// @brief drive motor frame received, called from the UART interrupt
+/// @param p_eStatus RX_VALID or RX_CRC_ERROR
+/// @param p_pu8Frame received frame
+static void drivemotor_receiveFrame(rx_status_e p_eStatus, const uint8_t *p_pu8Frame)
+{
+    if (p_eStatus == RX_VALID)
+    {
+        memcpy(&drivemotor_psReceivedData, p_pu8Frame, sizeof(DRIVEMOTORS_data_t));
+    }
+    drivemotors_eRxFlag = p_eStatus;
+}
+
+/// @brief run the drive motor state machine and build the next request
+/// @param
+/// @retval 1 if drivemotor_pu8RqstMessage has to be sent, 0 otherwise
+static uint8_t drivemotor_prepareRqst(void)
+{
     static uint32_t l_u32Timestamp = 0;
 
     switch (drivemotor_eState)
     {
     case DRIVEMOTOR_INIT_1:
 
-        HAL_UART_Transmit_DMA(&DRIVEMOTORS_USART_Handler, (uint8_t *)drivemotor_pcu8InitMsg, DRIVEMOTOR_LENGTH_INIT_MSG);
+        UARTFRAME_Transmit(&drivemotor_sFrame, drivemotor_pcu8InitMsg, DRIVEMOTOR_LENGTH_INIT_MSG);
         drivemotor_eState = DRIVEMOTOR_RUN;
         debug_printf(" * Drive Motor Controller initialized\r\n");
-        break;
+        return 0;
 
     case DRIVEMOTOR_RUN:
 
-        /* prepare to receive the message before to launch the command */
-        HAL_UART_Receive_DMA(&DRIVEMOTORS_USART_Handler, (uint8_t *)&drivemotor_psReceivedData, sizeof(DRIVEMOTORS_data_t));
+#if DRIVEMOTOR_RAMP
+        {
+            uint32_t l_u32Now = HAL_GetTick();
+            float l_fDt = (l_u32Now - drivemotor_u32RampTick) / 1000.0f;
+            uint8_t l_u8LeftSpeed, l_u8RightSpeed, l_u8LeftDir, l_u8RightDir;
 
+            drivemotor_u32RampTick = l_u32Now;
+            if (l_fDt > DRIVEMOTOR_RAMP_MAX_DT)
+            {
+                l_fDt = DRIVEMOTOR_RAMP_MAX_DT;
+            }
+            drivemotor_rampStep(&drivemotor_sLeftRamp, left_dir_req ? left_speed_req : -(float)left_speed_req, l_fDt);
+            drivemotor_rampStep(&drivemotor_sRightRamp, right_dir_req ? right_speed_req : -(float)right_speed_req, l_fDt);
+            drivemotor_rampOutput(&drivemotor_sLeftRamp, &l_u8LeftSpeed, &l_u8LeftDir);
+            drivemotor_rampOutput(&drivemotor_sRightRamp, &l_u8RightSpeed, &l_u8RightDir);
+            drivemotor_prepareMsg(l_u8LeftSpeed, l_u8RightSpeed, l_u8LeftDir, l_u8RightDir);
+        }
+#else
         drivemotor_prepareMsg(left_speed_req, right_speed_req, left_dir_req, right_dir_req);
+#endif
         /* error State*/
         if (drivemotor_psReceivedData.u8_error != 0)
         {
-            drivemotor_prepareMsg(0, 0, 0, 0);
+            drivemotor_sendSpeed(0, 0, 0, 0);
             DRIVEMOTOR_u32ErrorCnt++;
         }
 
         /* todo add also accelerometer detection*/
-        if ((HALLSTOP_Left_Sense() || HALLSTOP_Right_Sense()) && (left_dir_req || right_dir_req))
+        if ((HALLSTOP_Left_Sense() || HALLSTOP_Right_Sense() || drivemotor_u8Collision) && (left_dir_req || right_dir_req))
         {
 
             switch (main_eOpenmowerStatus)
@@ -284,7 +475,7 @@ void DRIVEMOTOR_App_10ms(void)
                 /* Get voltage from dock, stop the mower*/
                 if (chargerInputVoltage > MIN_DOCKED_VOLTAGE)
                 {
-                    drivemotor_prepareMsg(0, 0, 0, 0);
+                    drivemotor_sendSpeed(0, 0, 0, 0);
                 }
                 else
                 { /*hit something goes back */
@@ -301,16 +492,11 @@ void DRIVEMOTOR_App_10ms(void)
                 break;
             }
         }
-
-        HAL_UART_Transmit_DMA(&DRIVEMOTORS_USART_Handler, (uint8_t *)drivemotor_pu8RqstMessage, DRIVEMOTOR_LENGTH_RQST_MSG);
-
+        drivemotor_u8Collision = 0;
         break;
 
     case DRIVEMOTOR_BACKWARD:
-        /* prepare to receive the message before to launch the command */
-        HAL_UART_Receive_DMA(&DRIVEMOTORS_USART_Handler, (uint8_t *)&drivemotor_psReceivedData, sizeof(DRIVEMOTORS_data_t));
-        drivemotor_prepareMsg(100, 100, 0, 0); /* set to -0.33m/s  */
-        HAL_UART_Transmit_DMA(&DRIVEMOTORS_USART_Handler, (uint8_t *)drivemotor_pu8RqstMessage, DRIVEMOTOR_LENGTH_RQST_MSG);
+        drivemotor_sendSpeed(100, 100, 0, 0); /* set to -0.33m/s  */
 
         if ((HAL_GetTick() - l_u32Timestamp) > 2000)
         {
@@ -321,10 +507,7 @@ void DRIVEMOTOR_App_10ms(void)
         break;
 
     case DRIVEMOTOR_WAIT:
-        /* prepare to receive the message before to launch the command */
-        HAL_UART_Receive_DMA(&DRIVEMOTORS_USART_Handler, (uint8_t *)&drivemotor_psReceivedData, sizeof(DRIVEMOTORS_data_t));
-        drivemotor_prepareMsg(0, 0, 0, 0);
-        HAL_UART_Transmit_DMA(&DRIVEMOTORS_USART_Handler, (uint8_t *)drivemotor_pu8RqstMessage, DRIVEMOTOR_LENGTH_RQST_MSG);
+        drivemotor_sendSpeed(0, 0, 0, 0);
 
         if ((HAL_GetTick() - l_u32Timestamp) > 1000)
         {
@@ -334,150 +517,248 @@ void DRIVEMOTOR_App_10ms(void)
         break;
 
     default:
-        break;
+        return 0;
     }
 
-    /* TODO error management */
-    switch (drivemotors_eRxFlag)
+    return 1;
+}
+
+/// @brief send a speed bypassing the velocity ramp, the ramp restarts from it
+/// @param left_speed left motor speed byte
+/// @param right_speed right motor speed byte
+/// @param left_dir left motor direction bit
+/// @param right_dir right motor direction bit
+static void drivemotor_sendSpeed(uint8_t left_speed, uint8_t right_speed, uint8_t left_dir, uint8_t right_dir)
+{
+    drivemotor_prepareMsg(left_speed, right_speed, left_dir, right_dir);
+#if DRIVEMOTOR_RAMP
+    drivemotor_sLeftRamp.fSpeed = left_dir ? left_speed : -(float)left_speed;
+    drivemotor_sLeftRamp.fAccel = 0;
+    drivemotor_sRightRamp.fSpeed = right_dir ? right_speed : -(float)right_speed;
+    drivemotor_sRightRamp.fAccel = 0;
+#endif
+}
+
+/// @brief latency probes answered by the request, any request answers cmd_vel, a zero speed one an emergency
+/// @param
+/// @retval LATENCY_MASK() of the probes
+static uint8_t drivemotor_probes(void)
+{
+    uint8_t l_u8Probes = LATENCY_MASK(LATENCY_CMD_VEL);
+
+    if (drivemotor_pu8RqstMessage[6] == 0 && drivemotor_pu8RqstMessage[7] == 0)
     {
-    case RX_VALID:
-        break;
+        l_u8Probes |= LATENCY_MASK(LATENCY_INPUT_DRIVE) | LATENCY_MASK(LATENCY_SERVICE_DRIVE);
+    }
+    return l_u8Probes;
+}
 
-    case RX_WAIT:
+#if DRIVEMOTOR_RAMP
+/// @brief move a wheel speed toward its target with limited acceleration and jerk
+/// the acceleration is reduced while approaching the target so it reaches 0 with the speed,
+/// the speed is signed so a reversal goes through zero
+/// @param p_psRamp wheel ramp
+/// @param p_fTarget target speed, signed PWM
+/// @param p_fDt time since the last step (s)
+static void drivemotor_rampStep(DRIVEMOTOR_ramp_t *p_psRamp, float p_fTarget, float p_fDt)
+{
+    float l_fError = p_fTarget - p_psRamp->fSpeed;
+    float l_fAccel;
+    float l_fDelta;
 
-        /* todo check for timeout */
+    /* highest acceleration which can still be brought back to 0 at the target */
+    l_fAccel = sqrtf(2.0f * DRIVEMOTOR_RAMP_JERK_PWM * fabsf(l_fError));
+    if (l_fAccel > DRIVEMOTOR_RAMP_ACCEL_PWM)
+    {
+        l_fAccel = DRIVEMOTOR_RAMP_ACCEL_PWM;
+    }
+    if (l_fError < 0)
+    {
+        l_fAccel = -l_fAccel;
+    }
 
-        break;
+    /* jerk limit */
+    l_fDelta = l_fAccel - p_psRamp->fAccel;
+    if (l_fDelta > DRIVEMOTOR_RAMP_JERK_PWM * p_fDt)
+    {
+        l_fDelta = DRIVEMOTOR_RAMP_JERK_PWM * p_fDt;
+    }
+    else if (l_fDelta < -DRIVEMOTOR_RAMP_JERK_PWM * p_fDt)
+    {
+        l_fDelta = -DRIVEMOTOR_RAMP_JERK_PWM * p_fDt;
+    }
+    p_psRamp->fAccel += l_fDelta;
+    p_psRamp->fSpeed += p_psRamp->fAccel * p_fDt;
 
-    case RX_CRC_ERROR:
-    case RX_INVALID_ERROR:
-    case RX_TIMEOUT_ERROR:
-    default:
-        /* inform for error */
-        break;
+    /* target reached during this step */
+    if ((l_fError >= 0 && p_psRamp->fSpeed >= p_fTarget) || (l_fError <= 0 && p_psRamp->fSpeed <= p_fTarget))
+    {
+        p_psRamp->fSpeed = p_fTarget;
+        p_psRamp->fAccel = 0;
     }
 }
 
+/// @brief convert a ramp speed to the speed byte and direction bit of the request
+/// @param p_psRamp wheel ramp
+/// @param p_pu8Speed speed byte
+/// @param p_pu8Dir direction bit, 1 forward
+static void drivemotor_rampOutput(const DRIVEMOTOR_ramp_t *p_psRamp, uint8_t *p_pu8Speed, uint8_t *p_pu8Dir)
+{
+    float l_fSpeed = fabsf(p_psRamp->fSpeed) + 0.5f;
+
+    *p_pu8Speed = (l_fSpeed >= 255.0f) ? 255 : (uint8_t)l_fSpeed;
+    *p_pu8Dir = (*p_pu8Speed != 0 && p_psRamp->fSpeed > 0) ? 1 : 0;
+}
+#endif
+
 /// @brief Decode received drive motor messages
 /// @param
-void DRIVEMOTOR_App_Rx(void)
+static void drivemotor_decodeMsg(void)
 {
-    if (drivemotors_eRxFlag == RX_VALID)
+    /* decode */
+    uint8_t direction = drivemotor_psReceivedData.u8_direction;
+    // we need to adjust for direction (+/-) !
+    if ((direction & 0xc0) == 0xc0)
     {
-        /* decode */
-        uint8_t direction = drivemotor_psReceivedData.u8_direction;
-        // we need to adjust for direction (+/-) !
-        if ((direction & 0xc0) == 0xc0)
-        {
-            left_direction = 1;
-        }
-        else if ((direction & 0x80) == 0x80)
-        {
-            left_direction = -1;
-        }
-        else
-        {
-            left_direction = 0;
-        }
-        if ((direction & 0x30) == 0x30)
-        {
-            right_direction = 1;
-        }
-        else if ((direction & 0x20) == 0x20)
-        {
-            right_direction = -1;
-        }
-        else
-        {
-            right_direction = 0;
-        }
+        left_direction = 1;
+    }
+    else if ((direction & 0x80) == 0x80)
+    {
+        left_direction = -1;
+    }
+    else
+    {
+        left_direction = 0;
+    }
+    if ((direction & 0x30) == 0x30)
+    {
+        right_direction = 1;
+    }
+    else if ((direction & 0x20) == 0x20)
+    {
+        right_direction = -1;
+    }
+    else
+    {
+        right_direction = 0;
+    }
 
-        left_encoder_val = drivemotor_psReceivedData.u16_left_ticks;
-        right_encoder_val = drivemotor_psReceivedData.u16_right_ticks;
+    left_encoder_val = drivemotor_psReceivedData.u16_left_ticks;
+    right_encoder_val = drivemotor_psReceivedData.u16_right_ticks;
 
-        // power consumption
-        left_power = drivemotor_psReceivedData.u8_left_power;
-        right_power = drivemotor_psReceivedData.u8_right_power;
+    // power consumption
+    left_power = drivemotor_psReceivedData.u8_left_power;
+    right_power = drivemotor_psReceivedData.u8_right_power;
 
-        /*
-          Encoder value can reset to zero twice when changing direction
-          2nd reset occurs when the speed changes from zero to non-zero
-          something the ticks are holded until the next commands
-        */
+#if DRIVEMOTOR_COLLISION_DETECTION
+    if (drivemotor_eState == DRIVEMOTOR_RUN)
+    {
+        uint8_t l_u8Collision = 0;
 
-        left_wheel_speed_val = left_direction * drivemotor_psReceivedData.u8_left_speed;
-        if (left_direction == 0 || (left_direction != prev_left_direction) || (prev_left_wheel_speed_val == 0 && left_wheel_speed_val != 0))
+        if (drivemotor_collisionDetect(&drivemotor_sLeftCollision, drivemotor_pu8RqstMessage[6], drivemotor_psReceivedData.u8_left_speed, left_power))
         {
-            prev_left_encoder_val = 0;
+            l_u8Collision |= 0x01;
         }
-        left_encoder_ticks += abs(left_direction * (left_encoder_val - prev_left_encoder_val));
-        prev_left_encoder_val = left_encoder_val;
-        prev_left_wheel_speed_val = left_wheel_speed_val;
-        prev_left_direction = left_direction;
-
-        right_wheel_speed_val = right_direction * drivemotor_psReceivedData.u8_right_speed;
-        if (right_direction == 0 || (right_direction != prev_right_direction) || (prev_right_wheel_speed_val == 0 && right_wheel_speed_val != 0))
+        if (drivemotor_collisionDetect(&drivemotor_sRightCollision, drivemotor_pu8RqstMessage[7], drivemotor_psReceivedData.u8_right_speed, right_power))
+        {
+            l_u8Collision |= 0x02;
+        }
+        if (l_u8Collision)
         {
-            prev_right_encoder_val = 0;
+            drivemotor_u8Collision = l_u8Collision;
+            DRIVEMOTOR_u32CollisionCnt++;
+            collision_handler(l_u8Collision);
         }
-        right_encoder_ticks += abs(right_direction * (right_encoder_val - prev_right_encoder_val));
-        prev_right_encoder_val = right_encoder_val;
-        prev_right_wheel_speed_val = right_wheel_speed_val;
-        prev_right_direction = right_direction;
+    }
+    else
+    {
+        /* the mower is stopped or backing off, start again with a new baseline */
+        drivemotor_sLeftCollision.u32SettleTick = drivemotor_sRightCollision.u32SettleTick = HAL_GetTick();
+    }
+#endif
 
-        wheelTicks_handler(left_direction, right_direction, left_encoder_ticks, right_encoder_ticks, left_wheel_speed_val, right_wheel_speed_val);
+    /*
+      Encoder value can reset to zero twice when changing direction
+      2nd reset occurs when the speed changes from zero to non-zero
+      something the ticks are holded until the next commands
+    */
 
-        drivemotors_eRxFlag = RX_WAIT; // ready for next message
+    left_wheel_speed_val = left_direction * drivemotor_psReceivedData.u8_left_speed;
+    if (left_direction == 0 || (left_direction != prev_left_direction) || (prev_left_wheel_speed_val == 0 && left_wheel_speed_val != 0))
+    {
+        prev_left_encoder_val = 0;
     }
-}
+    left_encoder_ticks += abs(left_direction * (left_encoder_val - prev_left_encoder_val));
+    prev_left_encoder_val = left_encoder_val;
+    prev_left_wheel_speed_val = left_wheel_speed_val;
+    prev_left_direction = left_direction;
 
-/// @brief Set drive motor speeds
-/// @param left_speed left motor speed byte
-/// @param right_speed right motor speed byte
-/// @param left_dir left motor direction bit
-/// @param right_dir  left motor direction bit
-void DRIVEMOTOR_SetSpeed(uint8_t left_speed, uint8_t right_speed, uint8_t left_dir, uint8_t right_dir)
-{
-    left_speed_req = left_speed;
-    right_speed_req = right_speed;
-    if(left_speed_req == 0 && right_speed_req ==  0)
+    right_wheel_speed_val = right_direction * drivemotor_psReceivedData.u8_right_speed;
+    if (right_direction == 0 || (right_direction != prev_right_direction) || (prev_right_wheel_speed_val == 0 && right_wheel_speed_val != 0))
     {
-        left_dir_req = 0;
-        right_dir_req = 0;
+        prev_right_encoder_val = 0;
     }
-    else
+    right_encoder_ticks += abs(right_direction * (right_encoder_val - prev_right_encoder_val));
+    prev_right_encoder_val = right_encoder_val;
+    prev_right_wheel_speed_val = right_wheel_speed_val;
+    prev_right_direction = right_direction;
+
+    /* answers come faster than what openmower needs, keep the wheel ticks publish rate */
+    if ((HAL_GetTick() - drivemotor_u32TicksPublishTick) >= WHEEL_TICKS_PUBLISH_MS)
     {
-        left_dir_req = left_dir;
-        right_dir_req = right_dir;
+        drivemotor_u32TicksPublishTick = HAL_GetTick();
+        wheelTicks_handler(left_direction, right_direction, left_encoder_ticks, right_encoder_ticks, left_wheel_speed_val, right_wheel_speed_val);
     }
 }
 
-/// @brief drive motor receive interrupt handler
-/// @param
-void DRIVEMOTOR_ReceiveIT(void)
+#if DRIVEMOTOR_COLLISION_DETECTION
+/// @brief check one wheel for a collision or a stall, called for every received frame
+/// the power is compared against a rolling baseline taken while driving at the commanded speed,
+/// a collision is a power jump or a power above the baseline while the wheel is slower than commanded
+/// @param p_psWheel wheel detector context
+/// @param p_u8Cmd commanded speed
+/// @param p_u8Speed speed reported by the motor controller
+/// @param p_u8Power power reported by the motor controller
+/// @retval 1 if a collision is detected
+static uint8_t drivemotor_collisionDetect(DRIVEMOTOR_collision_t *p_psWheel, uint8_t p_u8Cmd, uint8_t p_u8Speed, uint8_t p_u8Power)
 {
-    /* decode the frame */
-    if (memcmp(drivemotor_pcu8Preamble, (uint8_t *)&drivemotor_psReceivedData, 5) == 0)
+    uint8_t l_u8Return = 0;
+    int16_t l_s16Over = (int16_t)p_u8Power - (int16_t)(p_psWheel->u16Baseline >> 4);
+    int16_t l_s16Rise = (int16_t)p_u8Power - (int16_t)p_psWheel->u8PrevPower;
+
+    /* acceleration needs more power, restart the baseline on speed changes */
+    if (abs((int16_t)p_u8Cmd - (int16_t)p_psWheel->u8PrevCmd) > DRIVEMOTOR_COLLISION_CMD_DELTA)
     {
-        uint8_t l_u8crc = crcCalc((uint8_t *)&drivemotor_psReceivedData, DRIVEMOTOR_LENGTH_RECEIVED_MSG - 1);
-        if (drivemotor_psReceivedData.u8_CRC == l_u8crc)
-        {
-            drivemotors_eRxFlag = RX_VALID;
-        }
-        else
+        p_psWheel->u32SettleTick = HAL_GetTick();
+        p_psWheel->u8PrevCmd = p_u8Cmd;
+    }
+
+    if (p_u8Cmd == 0 || (HAL_GetTick() - p_psWheel->u32SettleTick) < DRIVEMOTOR_COLLISION_SETTLE_MS)
+    {
+        p_psWheel->u16Baseline = (uint16_t)p_u8Power << 4;
+        p_psWheel->u8Count = 0;
+    }
+    else if (l_s16Over > DRIVEMOTOR_COLLISION_POWER_MARGIN &&
+             (p_psWheel->u8Count || l_s16Rise >= DRIVEMOTOR_COLLISION_POWER_SLOPE || (2 * p_u8Speed) < p_u8Cmd))
+    {
+        if (++p_psWheel->u8Count >= DRIVEMOTOR_COLLISION_FRAMES)
         {
-            drivemotors_eRxFlag = RX_CRC_ERROR;
+            p_psWheel->u8Count = 0;
+            p_psWheel->u32SettleTick = HAL_GetTick();
+            l_u8Return = 1;
         }
     }
     else
     {
-        drivemotors_eRxFlag = RX_INVALID_ERROR;
+        /* baseline += (power - baseline) / 8 */
+        p_psWheel->u16Baseline += (int16_t)(((int16_t)p_u8Power << 4) - (int16_t)p_psWheel->u16Baseline) / 8;
+        p_psWheel->u8Count = 0;
     }
-}
+    p_psWheel->u8PrevPower = p_u8Power;
 
-/******************************************************************************
- *  Private Functions
- *******************************************************************************/
+    return l_u8Return;
+}
+#endif
 
 __STATIC_INLINE void drivemotor_prepareMsg(uint8_t left_speed, uint8_t right_speed, uint8_t left_dir, uint8_t right_dir)
 {
@@ -22,21 +22,53 @@
 #include "board.h"
 #include "main.h"
 #include "i2c.h"
+#include "emergency.h"
+#include "drivemotor.h"
+#include "blademotor.h"
+#include "latency.h"
 
 //#define EMERGENCY_DEBUG 1
 
 #define EMERGENCY_CHECKING_DISABLE 2
 #define EMERGENCY_CHECKING_ENABLE 3
 
-static bool emergency_checking_disabled = false;
-static uint8_t emergency_state = 0;
-static uint32_t stop_emergency_started = 0;
-static uint32_t blue_wheel_lift_emergency_started = 0;
-static uint32_t red_wheel_lift_emergency_started = 0;
-static uint32_t both_wheels_lift_emergency_started = 0;
-static uint32_t tilt_emergency_started = 0;
+/* boards without their own setting (board.h): TIM6 and 1kHz, the timer is free on the STM32F103 */
+#ifndef EMERGENCY_TIM_INSTANCE
+#define EMERGENCY_TIM_INSTANCE TIM6
+#define EMERGENCY_TIM_IRQ TIM6_IRQn
+#define EMERGENCY_TIM_CLK_ENABLE() __HAL_RCC_TIM6_CLK_ENABLE()
+#endif
+#ifndef EMERGENCY_TIM_HZ
+#define EMERGENCY_TIM_HZ 1000
+#endif
+
+/* debounce windows in EMERGENCY_TIM periods */
+#define EMERGENCY_TICKS(ms) ((uint16_t)((ms) * EMERGENCY_TIM_HZ / 1000))
+
+TIM_HandleTypeDef EMERGENCY_TIM_Handle;
+
+static volatile bool emergency_checking_disabled = false;
+static volatile uint8_t emergency_state = 0;
+static volatile uint8_t emergency_u8Report = 0; /* bits raised by the interrupt, printed by EmergencyController() */
+/* debounce counters, incremented every EMERGENCY_TIM period while the input is active */
+static uint16_t stop_emergency_ticks = 0;
+static uint16_t blue_wheel_lift_emergency_ticks = 0;
+static uint16_t red_wheel_lift_emergency_ticks = 0;
+static uint16_t both_wheels_lift_emergency_ticks = 0;
+static uint16_t tilt_emergency_ticks = 0;
 static uint32_t accelerometer_int_emergency_started = 0;
 static uint32_t play_button_started = 0;
+/* first edge of every debounced input, start of the LATENCY_INPUT_* probes */
+static LATENCY_Stamp_t stop_emergency_edge;
+static LATENCY_Stamp_t blue_wheel_lift_emergency_edge;
+static LATENCY_Stamp_t red_wheel_lift_emergency_edge;
+static LATENCY_Stamp_t both_wheels_lift_emergency_edge;
+static LATENCY_Stamp_t tilt_emergency_edge;
+static LATENCY_Stamp_t accelerometer_int_emergency_edge;
+
+static bool emergency_debounce(uint16_t *p_pu16Ticks, bool p_bActive, uint16_t p_u16Window, LATENCY_Stamp_t *p_psEdge);
+static const LATENCY_Stamp_t *emergency_oldest(const LATENCY_Stamp_t *p_psEdge, const LATENCY_Stamp_t *p_psOther);
+static uint8_t emergency_raise(uint8_t p_u8Bits, const LATENCY_Stamp_t *p_psEdge);
 
 
 /**
@@ -121,18 +153,91 @@ int Emergency_LowZAccelerometer(void)
    return(I2C_TestZLowINT());
 }
 
-/*
- * Manages the emergency sensors
+/**
+ * @brief Confirm the stop buttons, wheel lifts and mechanical tilt, called every EMERGENCY_TIM period
+ *        A new emergency stops the drive and blade motors from here, without waiting for the main loop
+ * @retval None
  */
-void EmergencyController(void)
+void Emergency_TimerIT(void)
 {
     uint8_t stop_button_yellow = Emergency_StopButtonYellow();
     uint8_t stop_button_white = Emergency_StopButtonWhite();
     uint8_t wheel_lift_blue = Emergency_WheelLiftBlue();
     uint8_t wheel_lift_red = Emergency_WheelLiftRed();
     uint8_t tilt = Emergency_Tilt();
+    uint8_t l_u8Bits = 0;
+    const LATENCY_Stamp_t *l_psEdge = NULL;
+
+    if (emergency_checking_disabled) {
+        stop_emergency_ticks = 0;
+        both_wheels_lift_emergency_ticks = 0;
+        blue_wheel_lift_emergency_ticks = 0;
+        red_wheel_lift_emergency_ticks = 0;
+        tilt_emergency_ticks = 0;
+        return;
+    }
+
+    if (emergency_debounce(&stop_emergency_ticks, stop_button_yellow || stop_button_white, EMERGENCY_TICKS(STOP_BUTTON_EMERGENCY_MILLIS), &stop_emergency_edge))
+    {
+        l_psEdge = &stop_emergency_edge;
+        if (stop_button_yellow)
+        {
+            l_u8Bits |= 0b00010;
+        }
+        if (stop_button_white)
+        {
+            l_u8Bits |= 0b00100;
+        }
+    }
+    if (emergency_debounce(&both_wheels_lift_emergency_ticks, wheel_lift_blue && wheel_lift_red, EMERGENCY_TICKS(BOTH_WHEELS_LIFT_EMERGENCY_MILLIS), &both_wheels_lift_emergency_edge))
+    {
+        l_u8Bits |= 0b11000;
+        l_psEdge = emergency_oldest(l_psEdge, &both_wheels_lift_emergency_edge);
+    }
+    if (emergency_debounce(&blue_wheel_lift_emergency_ticks, wheel_lift_blue, EMERGENCY_TICKS(ONE_WHEEL_LIFT_EMERGENCY_MILLIS), &blue_wheel_lift_emergency_edge))
+    {
+        l_u8Bits |= 0b01000;
+        l_psEdge = emergency_oldest(l_psEdge, &blue_wheel_lift_emergency_edge);
+    }
+    if (emergency_debounce(&red_wheel_lift_emergency_ticks, wheel_lift_red, EMERGENCY_TICKS(ONE_WHEEL_LIFT_EMERGENCY_MILLIS), &red_wheel_lift_emergency_edge))
+    {
+        l_u8Bits |= 0b10000;
+        l_psEdge = emergency_oldest(l_psEdge, &red_wheel_lift_emergency_edge);
+    }
+    if (emergency_debounce(&tilt_emergency_ticks, tilt, EMERGENCY_TICKS(TILT_EMERGENCY_MILLIS), &tilt_emergency_edge))
+    {
+        l_u8Bits |= 0b100000;
+        l_psEdge = emergency_oldest(l_psEdge, &tilt_emergency_edge);
+    }
+
+    if (l_u8Bits)
+    {
+        emergency_u8Report |= emergency_raise(l_u8Bits, l_psEdge);
+    }
+}
+
+/**
+ * @brief HAL_TIM_PeriodElapsedCallback() dispatch, EMERGENCY_TIM is only known here (board.h or the defaults above)
+ * @param htim timer that elapsed
+ * @retval None
+ */
+void Emergency_TimerPeriodElapsed(TIM_HandleTypeDef *htim)
+{
+    if (htim->Instance == EMERGENCY_TIM_INSTANCE)
+    {
+        Emergency_TimerIT();
+    }
+}
+
+/*
+ * Manages the emergency sensors, the GPIO inputs are confirmed by Emergency_TimerIT(),
+ * the accelerometer is read over I2C so it stays in the main loop
+ */
+void EmergencyController(void)
+{
     GPIO_PinState play_button = !HAL_GPIO_ReadPin(PLAY_BUTTON_PORT, PLAY_BUTTON_PIN); // pullup, active low    
     uint8_t accelerometer_int_triggered = Emergency_LowZAccelerometer();
+    uint8_t l_u8Report;
 
     uint32_t now = HAL_GetTick();
     static uint32_t l_u32timestamp = 0;
@@ -144,7 +249,7 @@ void EmergencyController(void)
     debug_printf("  >> wheel_lift_blue: %d\r\n", Emergency_WheelLiftBlue());
     debug_printf("  >> wheel_lift_red: %d\r\n", Emergency_WheelLiftRed());
     debug_printf("  >> tilt: %d\r\n", Emergency_Tilt());
-    debug_printf("  >> accelerometer_int_triggered: %d\r\n", Emergency_LowZAccelerometer());
+    debug_printf("  >> accelerometer_int_triggered: %d\r\n", accelerometer_int_triggered);
     debug_printf("  >> play_button: %d\r\n",play_button);
 #endif
 
@@ -153,74 +258,34 @@ void EmergencyController(void)
         return;
     }
 
-    if (stop_button_yellow || stop_button_white)
+    __disable_irq();
+    l_u8Report = emergency_u8Report;
+    emergency_u8Report = 0;
+    __enable_irq();
+
+    if (l_u8Report & 0b00010)
     {
-        if (stop_emergency_started == 0)
-        {
-            stop_emergency_started = now;
-        }
-        else
-        {
-            if (now - stop_emergency_started >= STOP_BUTTON_EMERGENCY_MILLIS)
-            {
-                if (stop_button_yellow)
-                {
-                    emergency_state |= 0b00010;
-                    debug_printf(" \e[01;31m## EMERGENCY ##\e[0m - STOP BUTTON (\e[33myellow\e[0m) triggered\r\n");
-                }
-                if (stop_button_white) {
-                    emergency_state |= 0b00100;
-                    debug_printf(" \e[01;31m## EMERGENCY ##\e[0m - STOP BUTTON (\e[37m0mwhite\e[) triggered\r\n");
-                }
-            }
-        }
+        debug_printf(" \e[01;31m## EMERGENCY ##\e[0m - STOP BUTTON (\e[33myellow\e[0m) triggered\r\n");
     }
-    else
+    if (l_u8Report & 0b00100)
     {
-        stop_emergency_started = 0;
+        debug_printf(" \e[01;31m## EMERGENCY ##\e[0m - STOP BUTTON (\e[37m0mwhite\e[) triggered\r\n");
     }
-
-    if (wheel_lift_blue && wheel_lift_red)
+    if ((l_u8Report & 0b11000) == 0b11000)
     {
-        if (both_wheels_lift_emergency_started==0)
-        {
-            both_wheels_lift_emergency_started=now;
-        }
-        else if (now-both_wheels_lift_emergency_started>=BOTH_WHEELS_LIFT_EMERGENCY_MILLIS)
-        {
-            emergency_state |= 0b11000;
-            debug_printf(" \e[01;31m## EMERGENCY ##\e[0m - WHEEL LIFT (\e[31mred\e[0m and \e[34mblue\e[0m) triggered\r\n");
-        }
-    } else {
-        both_wheels_lift_emergency_started=0;
+        debug_printf(" \e[01;31m## EMERGENCY ##\e[0m - WHEEL LIFT (\e[31mred\e[0m and \e[34mblue\e[0m) triggered\r\n");
     }
-    if (wheel_lift_blue)
+    else if (l_u8Report & 0b01000)
     {
-        if (blue_wheel_lift_emergency_started==0)
-        {
-            blue_wheel_lift_emergency_started=now;
-        }
-        else if (now-blue_wheel_lift_emergency_started>=ONE_WHEEL_LIFT_EMERGENCY_MILLIS)
-        {
-            emergency_state |= 0b01000;
-            debug_printf(" \e[01;31m## EMERGENCY ##\e[0m - WHEEL LIFT (\e[34mblue\e[0m) triggered\r\n");
-        }
-    } else {
-        blue_wheel_lift_emergency_started=0;
+        debug_printf(" \e[01;31m## EMERGENCY ##\e[0m - WHEEL LIFT (\e[34mblue\e[0m) triggered\r\n");
     }
-    if (wheel_lift_red)
+    else if (l_u8Report & 0b10000)
     {
-        if (red_wheel_lift_emergency_started==0)
-        {
-            red_wheel_lift_emergency_started=now;
-        }
-        else if (now-red_wheel_lift_emergency_started>=ONE_WHEEL_LIFT_EMERGENCY_MILLIS)
-        {
-            emergency_state |= 0b10000;
-            debug_printf(" \e[01;31m## EMERGENCY ##\e[0m - WHEEL LIFT (\e[31mred\e[0m) triggered\r\n");
-        }
-    } else {
-        red_wheel_lift_emergency_started=0;
+        debug_printf(" \e[01;31m## EMERGENCY ##\e[0m - WHEEL LIFT (\e[31mred\e[0m) triggered\r\n");
+    }
+    if (l_u8Report & 0b100000)
+    {
+        debug_printf(" \e[01;31m## EMERGENCY ##\e[0m - MECHANICAL TILT triggered\r\n");
     }
 
     if (accelerometer_int_triggered)
@@ -228,12 +293,17 @@ void EmergencyController(void)
         if(accelerometer_int_emergency_started == 0)
         {
             accelerometer_int_emergency_started = now;
+            LATENCY_Stamp(&accelerometer_int_emergency_edge);
         }
         else
         {
             if (now - accelerometer_int_emergency_started >= TILT_EMERGENCY_MILLIS) {
-                emergency_state |= 0b100000;
-                debug_printf(" \e[01;31m## EMERGENCY ##\e[0m - ACCELEROMETER TILT triggered\r\n");
+                if (emergency_raise(0b100000, &accelerometer_int_emergency_edge)) {
+                    debug_printf(" \e[01;31m## EMERGENCY ##\e[0m - ACCELEROMETER TILT triggered\r\n");
+                } else {
+                    /* already raised, raising it again would come from the clear */
+                    LATENCY_Stamp(&accelerometer_int_emergency_edge);
+                }
             }
         }     
     }
@@ -241,25 +311,6 @@ void EmergencyController(void)
     {
         accelerometer_int_emergency_started = 0;
     }
-    
-    if (tilt)
-    {
-        if(tilt_emergency_started == 0)
-        {
-            tilt_emergency_started = now;
-        }
-        else
-        {
-            if (now - tilt_emergency_started >= TILT_EMERGENCY_MILLIS) {
-                emergency_state |= 0b100000;
-                debug_printf(" \e[01;31m## EMERGENCY ##\e[0m - MECHANICAL TILT triggered\r\n");
-            }
-        }
-    }
-    else
-    {
-        tilt_emergency_started = 0;
-    }
 
     if (emergency_state && play_button)
     {
@@ -323,4 +374,99 @@ void Emergency_Init(void)
     GPIO_InitStruct.Pull = GPIO_PULLDOWN;
     HAL_GPIO_Init(WHEEL_LIFT_RED_PORT, &GPIO_InitStruct);
 
+#ifndef I_DONT_NEED_MY_FINGERS
+    /* sampling timer, 1MHz count */
+    EMERGENCY_TIM_CLK_ENABLE();
+    EMERGENCY_TIM_Handle.Instance = EMERGENCY_TIM_INSTANCE;
+    EMERGENCY_TIM_Handle.Init.Prescaler = SystemCoreClock / 1000000 - 1;  /* the timer clock is the core clock (APB1 x2, APB2 x1) */
+    EMERGENCY_TIM_Handle.Init.Period = 1000000 / EMERGENCY_TIM_HZ - 1;
+    EMERGENCY_TIM_Handle.Init.CounterMode = TIM_COUNTERMODE_UP;
+    EMERGENCY_TIM_Handle.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
+    EMERGENCY_TIM_Handle.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_DISABLE;
+    if (HAL_TIM_Base_Init(&EMERGENCY_TIM_Handle) != HAL_OK)
+    {
+        Error_Handler();
+    }
+    HAL_NVIC_SetPriority(EMERGENCY_TIM_IRQ, 0, 0);
+    HAL_NVIC_EnableIRQ(EMERGENCY_TIM_IRQ);
+    if (HAL_TIM_Base_Start_IT(&EMERGENCY_TIM_Handle) != HAL_OK)
+    {
+        Error_Handler();
+    }
+#endif
+}
+
+/**
+ * @brief Debounce one input
+ * @param p_pu16Ticks periods the input has been active
+ * @param p_bActive input state
+ * @param p_u16Window periods to confirm
+ * @param p_psEdge time of the first active period, the current one once confirmed: an emergency
+ *        raised again after being cleared comes from the clear, not from the edge
+ * @retval true once the input is active for the whole window
+ */
+static bool emergency_debounce(uint16_t *p_pu16Ticks, bool p_bActive, uint16_t p_u16Window, LATENCY_Stamp_t *p_psEdge)
+{
+    if (!p_bActive)
+    {
+        *p_pu16Ticks = 0;
+        return false;
+    }
+    if (*p_pu16Ticks == 0)
+    {
+        LATENCY_Stamp(p_psEdge);
+    }
+    if (*p_pu16Ticks < p_u16Window)
+    {
+        (*p_pu16Ticks)++;
+    }
+    else
+    {
+        LATENCY_Stamp(p_psEdge);
+    }
+    return (*p_pu16Ticks >= p_u16Window);
+}
+
+/**
+ * @brief Input confirmed first, the ones confirmed for a while carry the current time
+ * @param p_psEdge edge so far, NULL if none
+ * @param p_psOther edge of another confirmed input
+ * @retval the oldest edge
+ */
+static const LATENCY_Stamp_t *emergency_oldest(const LATENCY_Stamp_t *p_psEdge, const LATENCY_Stamp_t *p_psOther)
+{
+    if (p_psEdge == NULL || (int32_t)(p_psOther->u32Tick - p_psEdge->u32Tick) < 0)
+    {
+        return p_psOther;
+    }
+    return p_psEdge;
+}
+
+/**
+ * @brief Set Emergency State bits, a new emergency queues the stop frames to the motors
+ * @param p_u8Bits emergency bits
+ * @param p_psEdge first edge of the input, start of the latency probes
+ * @retval bits that were not already set
+ */
+static uint8_t emergency_raise(uint8_t p_u8Bits, const LATENCY_Stamp_t *p_psEdge)
+{
+    uint32_t l_u32Primask = __get_PRIMASK();
+    uint8_t l_u8New;
+
+    __disable_irq();
+    l_u8New = p_u8Bits & ~emergency_state;
+    emergency_state |= p_u8Bits;
+    __set_PRIMASK(l_u32Primask);
+
+    if (l_u8New)
+    {
+        LATENCY_StartAt(LATENCY_MASK(LATENCY_INPUT_DRIVE) | LATENCY_MASK(LATENCY_INPUT_BLADE), p_psEdge);
+#ifdef DRIVEMOTORS_USART_ENABLED
+        DRIVEMOTOR_EmergencyStopIT();
+#endif
+#ifdef BLADEMOTOR_USART_ENABLED
+        BLADEMOTOR_EmergencyStopIT();
+#endif
+    }
+    return l_u8New;
 }
@@ -18,18 +18,108 @@
 
 #include "board.h"
 #include "main.h"
+#include "i2c.h"
 #include "imu/imu.h"
 #include "stm32f_board_hal.h"
 #include "i2c_lis3dh.h"
+#include "i2c_queue.h"
+
+/* the FIFO is drained once it holds this many samples (10ms each at 100Hz) */
+#define I2C_FIFO_WATERMARK    5
+#define I2C_FIFO_SIZE         32
+/* OUT_X_L .. OUT_Z_H, the address wraps back to OUT_X_L on the next FIFO level */
+#define I2C_FIFO_SAMPLE_LENGTH 6
+/* STATUS_REG_AUX then OUT_ADC1_L .. OUT_ADC3_H, the temperature is on ADC3 */
+#define I2C_TEMP_LENGTH       7
+/* temperature read every 100 polls (1s) */
+#define I2C_TEMP_POLL_DIVIDER 100
+/* same threshold as the INT1 z low generator */
+#define I2C_TILT_THRESHOLD_MG ((float)IMU_ONBOARD_INCLINATION_THRESHOLD * 16.0f)
 
 I2C_HandleTypeDef I2C_Handle;
 
+/* LIS3DH values updated by the I2C interrupt, see I2C_Accelerometer_Poll() */
+static uint8_t i2c_u8FifoSrc;
+static uint8_t i2c_pu8FifoData[I2C_FIFO_SIZE * I2C_FIFO_SAMPLE_LENGTH];
+static uint8_t i2c_pu8TempData[I2C_TEMP_LENGTH];
+static uint8_t i2c_u8TempDivider = 0;
+static volatile uint8_t i2c_u8Pending = 0;
+static volatile float i2c_fAccelX = 0, i2c_fAccelY = 0, i2c_fAccelZ = 0;
+static volatile float i2c_fSumX = 0, i2c_fSumY = 0, i2c_fSumZ = 0;
+static volatile uint8_t i2c_u8SumSamples = 0;
+static volatile float i2c_fTemperature = 0;
+static volatile uint8_t i2c_bZLow = 0;             // z below the tilt threshold on the latest FIFO sample
+uint32_t I2C_u32FifoOverruns = 0;
+
+static void i2c_hwInit(void);
+static void i2c_waitUs(uint32_t p_u32Us);
+static void i2c_fifoSrcDone(HAL_StatusTypeDef p_eStatus, void *p_pvContext);
+static void i2c_fifoDone(HAL_StatusTypeDef p_eStatus, void *p_pvContext);
+static void i2c_tempDone(HAL_StatusTypeDef p_eStatus, void *p_pvContext);
+
 /**
   * @brief I2C Initialization Function
   * @param None
   * @retval None
   */ 
 void I2C_Init(void)
+{
+  i2c_hwInit();
+  I2CQUEUE_Init(&I2C_Handle, I2C_BusRecovery);
+}
+
+/**
+  * @brief free a slave holding SDA low (reset in the middle of a read) with 9 SCL
+  *        pulses and a STOP, then reset and initialize the peripheral again
+  * @param None
+  * @retval None
+  */
+void I2C_BusRecovery(void)
+{
+   GPIO_InitTypeDef GPIO_InitStruct = {0};
+   uint8_t i;
+
+   HAL_NVIC_DisableIRQ(I2C1_EV_IRQn);
+   HAL_NVIC_DisableIRQ(I2C1_ER_IRQn);
+   HAL_I2C_DeInit(&I2C_Handle);
+   __HAL_RCC_I2C1_FORCE_RESET();
+   __HAL_RCC_I2C1_RELEASE_RESET();
+
+   HAL_GPIO_WritePin(GPIOB, GPIO_PIN_6|GPIO_PIN_7, GPIO_PIN_SET);
+   GPIO_InitStruct.Pin = GPIO_PIN_6|GPIO_PIN_7;
+   GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_OD;
+   GPIO_InitStruct.Pull = GPIO_NOPULL;
+   GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_HIGH;
+   HAL_GPIO_Init(GPIOB, &GPIO_InitStruct);
+
+   for (i = 0; i < 9 && HAL_GPIO_ReadPin(GPIOB, GPIO_PIN_7) == GPIO_PIN_RESET; i++)
+   {
+      HAL_GPIO_WritePin(GPIOB, GPIO_PIN_6, GPIO_PIN_RESET);
+      i2c_waitUs(5);
+      HAL_GPIO_WritePin(GPIOB, GPIO_PIN_6, GPIO_PIN_SET);
+      i2c_waitUs(5);
+   }
+   /* STOP: SDA low -> high while SCL is high */
+   HAL_GPIO_WritePin(GPIOB, GPIO_PIN_6, GPIO_PIN_RESET);
+   HAL_GPIO_WritePin(GPIOB, GPIO_PIN_7, GPIO_PIN_RESET);
+   i2c_waitUs(5);
+   HAL_GPIO_WritePin(GPIOB, GPIO_PIN_6, GPIO_PIN_SET);
+   i2c_waitUs(5);
+   HAL_GPIO_WritePin(GPIOB, GPIO_PIN_7, GPIO_PIN_SET);
+   i2c_waitUs(5);
+
+   i2c_hwInit();
+}
+
+/* busy wait on the DWT cycle counter, started by I2CQUEUE_Init() */
+static void i2c_waitUs(uint32_t p_u32Us)
+{
+   uint32_t l_u32Start = DWT->CYCCNT;
+
+   while ((DWT->CYCCNT - l_u32Start) < p_u32Us * (SystemCoreClock / 1000000));
+}
+
+static void i2c_hwInit(void)
 {
    GPIO_InitTypeDef GPIO_InitStruct = {0};
    GPIO_InitStruct.Pin = GPIO_PIN_6|GPIO_PIN_7;
@@ -65,102 +155,122 @@ void I2C_Init(void)
     Error_Handler();
   }
   /* USER CODE BEGIN I2C1_Init 2 */
-
+  /* transfers run on the interrupts, see i2c_queue.c */
+  HAL_NVIC_SetPriority(I2C1_EV_IRQn, 0, 0);
+  HAL_NVIC_EnableIRQ(I2C1_EV_IRQn);
+  HAL_NVIC_SetPriority(I2C1_ER_IRQn, 0, 0);
+  HAL_NVIC_EnableIRQ(I2C1_ER_IRQn);
   /* USER CODE END I2C1_Init 2 */
 }
 
 /*
- * I2C send function
+ * I2C send function, blocking: only for the setup
  */
 int32_t I2C_platform_write(void *handle, uint8_t reg, const uint8_t *bufp, uint16_t len)
 {
   reg |= 0x80;
-  HAL_I2C_Mem_Write(handle, LIS3DH_I2C_ADD_L, reg, I2C_MEMADD_SIZE_8BIT, (uint8_t*) bufp, len, 1000);
-  return 0;
+  return(I2CQUEUE_Transfer(LIS3DH_I2C_ADD_L, reg, 0, (uint8_t*) bufp, len) != HAL_OK);
 }
 
 /*
- * I2C receive function
+ * I2C receive function, blocking: only for the setup
  */
 int32_t I2C_platform_read(void *handle, uint8_t reg, uint8_t *bufp, uint16_t len)
 {
   /* Read multiple command */
   reg |= 0x80;
-  HAL_I2C_Mem_Read(handle, LIS3DH_I2C_ADD_L, reg, I2C_MEMADD_SIZE_8BIT, bufp, len, 1000);
-  return 0;
+  return(I2CQUEUE_Transfer(LIS3DH_I2C_ADD_L, reg, 1, bufp, len) != HAL_OK);
 }
 
 /*
- * read onboard acclerometer values
+ * check the FIFO level every 10ms from the main loop, it is drained in one burst from the I2C
+ * interrupt once it reaches I2C_FIFO_WATERMARK, the temperature is read every second
+ * INT1 drives the hardware blade stop, so the watermark can't be routed to a pin and is polled
  */
-void I2C_ReadAccelerometer(float *x, float *y, float *z)
+void I2C_Accelerometer_Poll(void)
 {
-    uint8_t max_tries = 3;
+    I2CQUEUE_Transaction_t l_sTransaction;
+    uint32_t l_u32Primask;
+    uint8_t l_u8Queued = 0;
 
-    stmdev_ctx_t dev_ctx;
-    dev_ctx.write_reg = I2C_platform_write;
-    dev_ctx.read_reg = I2C_platform_read;
-    dev_ctx.handle = &I2C_Handle;
+    if (i2c_u8Pending)
+    {
+        return; /* previous reads still queued, the bus recovers from a timeout */
+    }
 
-    int16_t data_raw_acceleration[3];            
-    lis3dh_reg_t reg;        
+    l_sTransaction.u8Address = LIS3DH_I2C_ADD_L;
+    l_sTransaction.bRead = 1;
+    l_sTransaction.pvContext = NULL;
 
-    lis3dh_xl_data_ready_get(&dev_ctx, &reg.byte);        
-    while (!reg.byte && max_tries) {            
-      lis3dh_xl_data_ready_get(&dev_ctx, &reg.byte);        
-      HAL_Delay(1);
-      max_tries--;
-    }    
-    if (reg.byte) {            
-            memset(data_raw_acceleration, 0x00, 3 * sizeof(int16_t));
-            lis3dh_acceleration_raw_get(&dev_ctx, data_raw_acceleration);
-            *x = lis3dh_from_fs2_hr_to_mg(data_raw_acceleration[0]) / 1000.0 * MS2_PER_G;
-            *y = lis3dh_from_fs2_hr_to_mg(data_raw_acceleration[1]) / 1000.0 * MS2_PER_G;
-            *z = lis3dh_from_fs2_hr_to_mg(data_raw_acceleration[2]) / 1000.0 * MS2_PER_G;
-           // debug_printf("Acceleration [ms^2]: X=%4.2f\tY=%4.2f\tZ=%4.2f\r\n", *x, *y, *z);  
-    }    
-    else
+    l_sTransaction.u8Register = LIS3DH_FIFO_SRC_REG;
+    l_sTransaction.pu8Data = &i2c_u8FifoSrc;
+    l_sTransaction.u16Length = 1;
+    l_sTransaction.pfCallback = i2c_fifoSrcDone;
+    if (I2CQUEUE_Submit(&l_sTransaction) == HAL_OK)
     {
-        //debug_printf("\e[01;31mWARNING: timeout while waiting for I2C onboard acceleration sensor !\e[0m");
-        I2C_Init();
-        *z = 0;
-        *y = 0;
-        *z = 0;        
+        l_u8Queued++;
     }
+
+    if (++i2c_u8TempDivider >= I2C_TEMP_POLL_DIVIDER)
+    {
+        i2c_u8TempDivider = 0;
+        l_sTransaction.u8Register = LIS3DH_STATUS_REG_AUX | 0x80;
+        l_sTransaction.pu8Data = i2c_pu8TempData;
+        l_sTransaction.u16Length = I2C_TEMP_LENGTH;
+        l_sTransaction.pfCallback = i2c_tempDone;
+        if (I2CQUEUE_Submit(&l_sTransaction) == HAL_OK)
+        {
+            l_u8Queued++;
+        }
+    }
+
+    /* the callbacks of the queued reads decrement it from the interrupt, they may already
+     * have run: one update with the interrupts off, the count wraps back to the right value */
+    l_u32Primask = __get_PRIMASK();
+    __disable_irq();
+    i2c_u8Pending += l_u8Queued;
+    __set_PRIMASK(l_u32Primask);
 }
 
 /*
- * read onboard acclerometer temperature value
+ * onboard acclerometer values of the last FIFO sample, zero after a bus error
  */
-float I2C_ReadAccelerometerTemp(void)
-{        
-
-    stmdev_ctx_t dev_ctx;    
-    dev_ctx.write_reg = I2C_platform_write;
-    dev_ctx.read_reg = I2C_platform_read;
-    dev_ctx.handle = &I2C_Handle;
-
-    static float temperature_degC = 0.0;
-    static int16_t data_raw_temperature;
-    lis3dh_reg_t reg;  
+void I2C_ReadAccelerometer(float *x, float *y, float *z)
+{
+    *x = i2c_fAccelX;
+    *y = i2c_fAccelY;
+    *z = i2c_fAccelZ;
+}
 
-    lis3dh_temp_data_ready_get(&dev_ctx, &reg.byte);
+/*
+ * mean of the onboard acclerometer FIFO samples drained since the last call
+ * returns the number of samples, 0 (values untouched) if nothing new
+ */
+uint8_t I2C_ReadAccelerometerMean(float *x, float *y, float *z)
+{
+    uint32_t l_u32Primask = __get_PRIMASK();
+    uint8_t l_u8Samples;
 
-    // Read temperature data 
-    if (reg.byte)
+    __disable_irq();
+    l_u8Samples = i2c_u8SumSamples;
+    if (l_u8Samples)
     {
-        memset(&data_raw_temperature, 0x00, sizeof(int16_t));
-        lis3dh_temperature_raw_get(&dev_ctx, &data_raw_temperature);
-        temperature_degC =lis3dh_from_lsb_hr_to_celsius(data_raw_temperature);            
-        // debug_printf("Temperature [degC]:%6.2f\r\n", temperature_degC);
-        return(temperature_degC);    
-    }
-    else
-    {
-        //debug_printf("\e[01;31mWARNING: timeout while waiting for I2C onboard temp sensor !\e[0m");
-        I2C_Init();
-        return(0);
+        *x = i2c_fSumX / l_u8Samples;
+        *y = i2c_fSumY / l_u8Samples;
+        *z = i2c_fSumZ / l_u8Samples;
+        i2c_fSumX = i2c_fSumY = i2c_fSumZ = 0;
+        i2c_u8SumSamples = 0;
     }
+    __set_PRIMASK(l_u32Primask);
+    return(l_u8Samples);
+}
+
+/*
+ * onboard acclerometer temperature value of the last I2C_Accelerometer_Poll()
+ */
+float I2C_ReadAccelerometerTemp(void)
+{        
+    return(i2c_fTemperature);
 }
 
 /*
@@ -184,21 +294,13 @@ uint8_t I2C_Acclerometer_TestDevice(void)
 }
 
 /*
- * INT1 will latch if triggered
- * this function will return its state and unlatch the INT
+ * z low (tilt) on the latest FIFO sample, same threshold as INT1
+ * a level like INT1_SRC, reading it clears nothing, the emergency check times how long it holds
+ * INT1 itself only drives the hardware blade stop
  */
 uint8_t I2C_TestZLowINT(void)
 {
-    stmdev_ctx_t dev_ctx;
-
-    dev_ctx.write_reg = I2C_platform_write;
-    dev_ctx.read_reg = I2C_platform_read;
-    dev_ctx.handle = &I2C_Handle;
-
-    lis3dh_int1_src_t int1_src;
-    lis3dh_int1_gen_source_get(&dev_ctx, &int1_src); 
-    
-    return(int1_src.zl && int1_src.ia);
+    return(i2c_bZLow);
 }
 
 /*
@@ -260,8 +362,96 @@ void I2C_Accelerometer_Setup(void)
     ctrl_reg3.i1_ia1 = 1;   // enable INT1
     lis3dh_pin_int1_config_set(&dev_ctx, &ctrl_reg3); 
 
-    /* FIFO control */    
-    lis3dh_fifo_mode_set(&dev_ctx, 0);
+    /* FIFO control, stream mode: the oldest samples are dropped when it is full */
+    lis3dh_fifo_watermark_set(&dev_ctx, I2C_FIFO_WATERMARK);
     lis3dh_fifo_trigger_event_set(&dev_ctx, 0);
-    lis3dh_fifo_watermark_set(&dev_ctx, 0x0);
+    lis3dh_fifo_mode_set(&dev_ctx, LIS3DH_DYNAMIC_STREAM_MODE);
+    lis3dh_fifo_set(&dev_ctx, PROPERTY_ENABLE);
+}
+
+static void i2c_fifoSrcDone(HAL_StatusTypeDef p_eStatus, void *p_pvContext)
+{
+    lis3dh_fifo_src_reg_t *l_psFifoSrc = (lis3dh_fifo_src_reg_t *)&i2c_u8FifoSrc;
+    I2CQUEUE_Transaction_t l_sTransaction;
+    uint8_t l_u8Samples;
+
+    if (p_eStatus != HAL_OK)
+    {
+        i2c_fAccelX = i2c_fAccelY = i2c_fAccelZ = 0;
+    }
+    else if (l_psFifoSrc->wtm || l_psFifoSrc->ovrn_fifo)
+    {
+        if (l_psFifoSrc->ovrn_fifo)
+        {
+            I2C_u32FifoOverruns++;
+            l_u8Samples = I2C_FIFO_SIZE;
+        }
+        else
+        {
+            l_u8Samples = l_psFifoSrc->fss;
+        }
+        /* drain all the levels in one burst */
+        l_sTransaction.u8Address = LIS3DH_I2C_ADD_L;
+        l_sTransaction.u8Register = LIS3DH_OUT_X_L | 0x80;
+        l_sTransaction.bRead = 1;
+        l_sTransaction.pu8Data = i2c_pu8FifoData;
+        l_sTransaction.u16Length = l_u8Samples * I2C_FIFO_SAMPLE_LENGTH;
+        l_sTransaction.pfCallback = i2c_fifoDone;
+        l_sTransaction.pvContext = (void *)(uint32_t)l_u8Samples;
+        if (I2CQUEUE_Submit(&l_sTransaction) == HAL_OK)
+        {
+            return; /* still pending */
+        }
+    }
+    i2c_u8Pending--;
+}
+
+static void i2c_fifoDone(HAL_StatusTypeDef p_eStatus, void *p_pvContext)
+{
+    uint8_t l_u8Samples = (uint8_t)(uint32_t)p_pvContext;
+    int16_t l_s16Raw[3];
+    float l_fX, l_fY, l_fZ;
+    uint8_t i;
+
+    if (p_eStatus != HAL_OK)
+    {
+        i2c_fAccelX = i2c_fAccelY = i2c_fAccelZ = 0;
+        i2c_u8Pending--;
+        return;
+    }
+    for (i = 0; i < l_u8Samples; i++)
+    {
+        memcpy(l_s16Raw, &i2c_pu8FifoData[i * I2C_FIFO_SAMPLE_LENGTH], sizeof(l_s16Raw));
+        l_fX = lis3dh_from_fs2_hr_to_mg(l_s16Raw[0]);
+        l_fY = lis3dh_from_fs2_hr_to_mg(l_s16Raw[1]);
+        l_fZ = lis3dh_from_fs2_hr_to_mg(l_s16Raw[2]);
+        i2c_bZLow = (l_fZ < I2C_TILT_THRESHOLD_MG);
+        l_fX = l_fX / 1000.0f * MS2_PER_G;
+        l_fY = l_fY / 1000.0f * MS2_PER_G;
+        l_fZ = l_fZ / 1000.0f * MS2_PER_G;
+        i2c_fSumX += l_fX;
+        i2c_fSumY += l_fY;
+        i2c_fSumZ += l_fZ;
+        if (i2c_u8SumSamples < 255)
+        {
+            i2c_u8SumSamples++;
+        }
+    }
+    i2c_fAccelX = l_fX;
+    i2c_fAccelY = l_fY;
+    i2c_fAccelZ = l_fZ;
+    i2c_u8Pending--;
+}
+
+static void i2c_tempDone(HAL_StatusTypeDef p_eStatus, void *p_pvContext)
+{
+    lis3dh_status_reg_aux_t *l_psStatus = (lis3dh_status_reg_aux_t *)&i2c_pu8TempData[0];
+    int16_t l_s16Raw;
+
+    if (p_eStatus == HAL_OK && l_psStatus->_3da)
+    {
+        memcpy(&l_s16Raw, &i2c_pu8TempData[5], sizeof(l_s16Raw));
+        i2c_fTemperature = lis3dh_from_lsb_hr_to_celsius(l_s16Raw);
+    }
+    i2c_u8Pending--;
 }
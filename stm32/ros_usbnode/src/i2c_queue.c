@@ -0,0 +1,279 @@
+/****************************************************************************
+* Title                 :   I2C transaction queue
+* Filename              :   i2c_queue.c
+* Author                :
+* Origin Date           :
+* Version               :   1.0.0
+
+*****************************************************************************/
+/** \file i2c_queue.c
+*  \brief interrupt driven register transactions on the hardware I2C bus
+*
+*  The transactions are queued and run one after the other with the HAL
+*  interrupt API, the next one starts from the completion interrupt. A
+*  transaction which does not complete within I2CQUEUE_TIMEOUT_US (stretched or
+*  stuck bus) is aborted by I2CQUEUE_Poll(), a bus error or a timeout runs the
+*  bus recovery of the owner before the next transaction. The main loop never
+*  waits on the bus, I2CQUEUE_Transfer() is the blocking wrapper for the setup.
+*/
+/******************************************************************************
+* Includes
+*******************************************************************************/
+#include <string.h>
+
+#include "stm32f_board_hal.h"
+
+#include "main.h"
+#include "i2c_queue.h"
+
+/******************************************************************************
+* Module Preprocessor Constants
+*******************************************************************************/
+
+/******************************************************************************
+* Module Preprocessor Macros
+*******************************************************************************/
+
+/******************************************************************************
+* Module Typedefs
+*******************************************************************************/
+typedef struct
+{
+    volatile uint8_t bDone;
+    HAL_StatusTypeDef eStatus;
+} I2CQUEUE_sync_t;
+
+/******************************************************************************
+* Module Variable Definitions
+*******************************************************************************/
+uint32_t I2CQUEUE_u32Errors = 0;
+uint32_t I2CQUEUE_u32Timeouts = 0;
+
+static I2C_HandleTypeDef *i2cqueue_phI2c = NULL;
+static void (*i2cqueue_pfRecover)(void) = NULL;
+
+static I2CQUEUE_Transaction_t i2cqueue_psQueue[I2CQUEUE_LENGTH];
+static uint8_t i2cqueue_u8Head = 0;
+static uint8_t i2cqueue_u8Tail = 0;             /* running transaction */
+static uint8_t i2cqueue_u8Count = 0;
+static volatile uint8_t i2cqueue_bBusy = 0;     /* the tail transaction is on the bus */
+static volatile uint8_t i2cqueue_bRecover = 0;  /* recover the bus before the next transaction */
+static uint32_t i2cqueue_u32StartCycles = 0;
+static uint32_t i2cqueue_u32CyclesPerUs = 72;
+
+/******************************************************************************
+* Function Prototypes
+*******************************************************************************/
+static void i2cqueue_start(void);
+static void i2cqueue_abort(void);
+static void i2cqueue_finish(HAL_StatusTypeDef p_eStatus);
+static void i2cqueue_syncDone(HAL_StatusTypeDef p_eStatus, void *p_pvContext);
+
+/******************************************************************************
+*  Public Functions
+*******************************************************************************/
+
+/// @brief attach the queue to an initialized I2C peripheral, its event and error interrupts enabled
+/// @param p_phI2c I2C handle
+/// @param p_pfRecover frees a stuck bus and initializes the peripheral again, called from I2CQUEUE_Poll()
+void I2CQUEUE_Init(I2C_HandleTypeDef *p_phI2c, void (*p_pfRecover)(void))
+{
+    i2cqueue_phI2c = p_phI2c;
+    i2cqueue_pfRecover = p_pfRecover;
+    i2cqueue_u8Head = i2cqueue_u8Tail = i2cqueue_u8Count = 0;
+    i2cqueue_bBusy = 0;
+    i2cqueue_bRecover = 0;
+
+    /* microsecond timeouts from the DWT cycle counter */
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    i2cqueue_u32CyclesPerUs = SystemCoreClock / 1000000;
+}
+
+/// @brief queue a register read or write, it starts right away if the bus is free, interrupt safe
+/// @param p_psTransaction transaction, copied
+/// @retval HAL_OK if queued, HAL_BUSY if the queue is full
+HAL_StatusTypeDef I2CQUEUE_Submit(const I2CQUEUE_Transaction_t *p_psTransaction)
+{
+    uint32_t l_u32Primask = __get_PRIMASK();
+
+    __disable_irq();
+    if (i2cqueue_u8Count == I2CQUEUE_LENGTH)
+    {
+        __set_PRIMASK(l_u32Primask);
+        return HAL_BUSY;
+    }
+    i2cqueue_psQueue[i2cqueue_u8Head] = *p_psTransaction;
+    i2cqueue_u8Head = (i2cqueue_u8Head + 1) % I2CQUEUE_LENGTH;
+    i2cqueue_u8Count++;
+    if (!i2cqueue_bBusy && !i2cqueue_bRecover)
+    {
+        i2cqueue_start();
+    }
+    __set_PRIMASK(l_u32Primask);
+    return HAL_OK;
+}
+
+/// @brief blocking register read or write, for the device setup only (not from an interrupt)
+/// @param p_u8Address 8 bit device address
+/// @param p_u8Register register
+/// @param p_bRead 1 read, 0 write
+/// @param p_pu8Data data
+/// @param p_u16Length data length
+/// @retval HAL_OK, HAL_ERROR, HAL_TIMEOUT or HAL_BUSY (queue full)
+HAL_StatusTypeDef I2CQUEUE_Transfer(uint8_t p_u8Address, uint8_t p_u8Register, uint8_t p_bRead, uint8_t *p_pu8Data, uint16_t p_u16Length)
+{
+    I2CQUEUE_sync_t l_sSync = {0, HAL_ERROR};
+    I2CQUEUE_Transaction_t l_sTransaction = {p_u8Address, p_u8Register, p_bRead, p_pu8Data, p_u16Length, i2cqueue_syncDone, &l_sSync};
+
+    if (I2CQUEUE_Submit(&l_sTransaction) != HAL_OK)
+    {
+        return HAL_BUSY;
+    }
+    /* bounded by the timeouts of the transactions ahead */
+    while (!l_sSync.bDone)
+    {
+        I2CQUEUE_Poll();
+    }
+    return l_sSync.eStatus;
+}
+
+/// @brief abort a transaction running for more than I2CQUEUE_TIMEOUT_US and recover the bus,
+/// to be called from the main loop
+/// @param
+void I2CQUEUE_Poll(void)
+{
+    uint32_t l_u32Primask = __get_PRIMASK();
+    uint8_t l_bRecover;
+
+    __disable_irq();
+    if (i2cqueue_bBusy && (DWT->CYCCNT - i2cqueue_u32StartCycles) / i2cqueue_u32CyclesPerUs > I2CQUEUE_TIMEOUT_US)
+    {
+        I2CQUEUE_u32Timeouts++;
+        i2cqueue_bRecover = 1;
+        i2cqueue_abort();
+        i2cqueue_finish(HAL_TIMEOUT);
+    }
+    l_bRecover = i2cqueue_bRecover && !i2cqueue_bBusy;
+    __set_PRIMASK(l_u32Primask);
+
+    if (!l_bRecover)
+    {
+        return;
+    }
+    if (i2cqueue_pfRecover != NULL)
+    {
+        i2cqueue_pfRecover();
+    }
+
+    __disable_irq();
+    i2cqueue_bRecover = 0;
+    if (!i2cqueue_bBusy)
+    {
+        i2cqueue_start();
+    }
+    __set_PRIMASK(l_u32Primask);
+}
+
+/// @brief transfer done, start the next one
+/// to be called from HAL_I2C_MemRxCpltCallback and HAL_I2C_MemTxCpltCallback
+/// @param p_phI2c I2C handle
+void I2CQUEUE_CpltIT(I2C_HandleTypeDef *p_phI2c)
+{
+    if (p_phI2c != i2cqueue_phI2c || !i2cqueue_bBusy)
+    {
+        return;
+    }
+    i2cqueue_finish(HAL_OK);
+    if (!i2cqueue_bBusy && !i2cqueue_bRecover)
+    {
+        i2cqueue_start();
+    }
+}
+
+/// @brief transfer failed, the bus is recovered by I2CQUEUE_Poll() before the next one
+/// to be called from HAL_I2C_ErrorCallback
+/// @param p_phI2c I2C handle
+void I2CQUEUE_ErrorIT(I2C_HandleTypeDef *p_phI2c)
+{
+    if (p_phI2c != i2cqueue_phI2c || !i2cqueue_bBusy)
+    {
+        return;
+    }
+    I2CQUEUE_u32Errors++;
+    i2cqueue_bRecover = 1;
+    i2cqueue_finish(HAL_ERROR);
+}
+
+/******************************************************************************
+*  Private Functions
+*******************************************************************************/
+
+/* start the transaction at the tail, interrupts disabled or from the I2C interrupt */
+static void i2cqueue_start(void)
+{
+    I2CQUEUE_Transaction_t *l_psTransaction;
+    HAL_StatusTypeDef l_eStatus;
+
+    if (i2cqueue_u8Count == 0)
+    {
+        return;
+    }
+    l_psTransaction = &i2cqueue_psQueue[i2cqueue_u8Tail];
+    if (l_psTransaction->bRead)
+    {
+        l_eStatus = HAL_I2C_Mem_Read_IT(i2cqueue_phI2c, l_psTransaction->u8Address, l_psTransaction->u8Register, I2C_MEMADD_SIZE_8BIT,
+                                        l_psTransaction->pu8Data, l_psTransaction->u16Length);
+    }
+    else
+    {
+        l_eStatus = HAL_I2C_Mem_Write_IT(i2cqueue_phI2c, l_psTransaction->u8Address, l_psTransaction->u8Register, I2C_MEMADD_SIZE_8BIT,
+                                         l_psTransaction->pu8Data, l_psTransaction->u16Length);
+    }
+    i2cqueue_u32StartCycles = DWT->CYCCNT;
+    i2cqueue_bBusy = 1;
+    if (l_eStatus != HAL_OK)
+    {
+        /* bus busy (SDA held low) or peripheral in a bad state */
+        I2CQUEUE_u32Errors++;
+        i2cqueue_bRecover = 1;
+        i2cqueue_finish(HAL_ERROR);
+    }
+}
+
+/* stop the running transfer, its interrupt must not write into the buffer of a transaction
+ * given up (the stack of I2CQUEUE_Transfer()). The recovery or the next start enables the
+ * peripheral again */
+static void i2cqueue_abort(void)
+{
+    __HAL_I2C_DISABLE_IT(i2cqueue_phI2c, I2C_IT_EVT | I2C_IT_BUF | I2C_IT_ERR);
+    __HAL_I2C_DISABLE(i2cqueue_phI2c);
+    i2cqueue_phI2c->State = HAL_I2C_STATE_READY;
+    i2cqueue_phI2c->Mode = HAL_I2C_MODE_NONE;
+    __HAL_UNLOCK(i2cqueue_phI2c);
+}
+
+/* pop the tail transaction and call its callback */
+static void i2cqueue_finish(HAL_StatusTypeDef p_eStatus)
+{
+    I2CQUEUE_Callback_t l_pfCallback = i2cqueue_psQueue[i2cqueue_u8Tail].pfCallback;
+    void *l_pvContext = i2cqueue_psQueue[i2cqueue_u8Tail].pvContext;
+
+    i2cqueue_u8Tail = (i2cqueue_u8Tail + 1) % I2CQUEUE_LENGTH;
+    i2cqueue_u8Count--;
+    i2cqueue_bBusy = 0;
+    if (l_pfCallback != NULL)
+    {
+        l_pfCallback(p_eStatus, l_pvContext);
+    }
+}
+
+static void i2cqueue_syncDone(HAL_StatusTypeDef p_eStatus, void *p_pvContext)
+{
+    I2CQUEUE_sync_t *l_psSync = (I2CQUEUE_sync_t *)p_pvContext;
+
+    l_psSync->eStatus = p_eStatus;
+    l_psSync->bDone = 1;
+}
+
+/*** End of File **************************************************************/
@@ -22,11 +22,43 @@ static float icm45686_deg_per_lsb = 250.0f / 32768.0f; /* default for 250 dps */
 static icm45686_accel_fs_sel_t icm45686_accel_fs = ICM45686_ACCEL_FS_SEL_2_G;
 static icm45686_gyro_fs_sel_t icm45686_gyro_fs = ICM45686_GYRO_FS_SEL_250_DPS;
 
+/* FIFO: 16 byte packets of header, accel X/Y/Z, gyro X/Y/Z, temperature and timestamp, little endian */
+static uint16_t icm45686_fifoEntries(const uint8_t *p_pu8Status);
+static uint8_t icm45686_fifoEntry(const uint8_t *p_pu8Entry, int16_t *p_ps16Sample);
+static const IMU_Fifo_t icm45686_fifo = {
+  .u8StatusRegister = ICM45686_FIFO_COUNT_0,
+  .u8StatusLength = 2,
+  .u8DataRegister = ICM45686_FIFO_DATA,
+  .u8EntryLength = 16,
+  .u16RateHz = 200,
+  .pfEntries = icm45686_fifoEntries,
+  .pfEntry = icm45686_fifoEntry
+};
+
+/* one burst from ACCEL_DATA_X1_UI: accel X/Y/Z, gyro X/Y/Z, temperature, little endian
+ * (accel and gyro scale factors are filled in ICM45686_Init) */
+static IMU_RegisterMap_t icm45686_map = {
+    .u8Address = ICM45686_ADDRESS,
+    .u8Register = ICM45686_ACCEL_XOUT_H,
+    .u8Length = 14,
+    .bBigEndian = 0,
+    .s8Accel = 0,
+    .s8Gyro = ICM45686_GYRO_XOUT_H - ICM45686_ACCEL_XOUT_H,
+    .s8Temp = ICM45686_TEMP_DATA1 - ICM45686_ACCEL_XOUT_H,
+    .fAccelScale = 1.0f / 16384.0f * MS2_PER_G,
+    .fGyroScale = 250.0f / 32768.0f * RAD_PER_G,
+    .fTempScale = 1.0f / 128.0f,            /* 128 LSB/degC, 0 LSB = 25 degC */
+    .fTempOffset = 25.0f,
+    .psFifo = &icm45686_fifo
+};
+
 /* Registers used by the simple init sequence (from vendor regmap excerpts) */
 #define ICM45686_REG_MISC2         0x7F
 #define ICM45686_REG_PWR_MGMT0     0x10
 #define ICM45686_REG_ACCEL_CONFIG0 0x1B
 #define ICM45686_REG_GYRO_CONFIG0  0x1C
+#define ICM45686_REG_FIFO_CONFIG0  0x1D
+#define ICM45686_REG_FIFO_CONFIG3  0x21
 
 #ifndef DISABLE_ICM45686
 
@@ -63,14 +95,19 @@ void ICM45686_Init(void)
   SW_I2C_UTIL_WRITE(ICM45686_ADDRESS, ICM45686_REG_PWR_MGMT0, ICM45686_PWR_MGMT0_ACCEL_GYRO_LOW_NOISE);
 
   /* Configure accelerometer and gyro:
-   * - accel FSR: +/-2g, ODR: 100Hz
-   * - gyro FSR: 250 dps, ODR: 100Hz
+   * - accel FSR: +/-2g, ODR: 200Hz
+   * - gyro FSR: 250 dps, ODR: 200Hz
+   * the FIFO is drained at this rate over the 100kHz soft I2C bus
    */
-  uint8_t accel_cfg = ICM45686_ACCEL_CONFIG0_VALUE(ICM45686_ACCEL_FS_SEL_2_G, ICM45686_ACCEL_ODR_100HZ);
-  uint8_t gyro_cfg  = ICM45686_GYRO_CONFIG0_VALUE(ICM45686_GYRO_FS_SEL_250_DPS, ICM45686_GYRO_ODR_100HZ);
+  uint8_t accel_cfg = ICM45686_ACCEL_CONFIG0_VALUE(ICM45686_ACCEL_FS_SEL_2_G, ICM45686_ACCEL_ODR_200HZ);
+  uint8_t gyro_cfg  = ICM45686_GYRO_CONFIG0_VALUE(ICM45686_GYRO_FS_SEL_250_DPS, ICM45686_GYRO_ODR_200HZ);
   SW_I2C_UTIL_WRITE(ICM45686_ADDRESS, ICM45686_REG_ACCEL_CONFIG0, accel_cfg);
   SW_I2C_UTIL_WRITE(ICM45686_ADDRESS, ICM45686_REG_GYRO_CONFIG0, gyro_cfg);
 
+  /* FIFO: stream mode (oldest packets overwritten), accel and gyro packets */
+  SW_I2C_UTIL_WRITE(ICM45686_ADDRESS, ICM45686_REG_FIFO_CONFIG0, ICM45686_FIFO_CONFIG0_STREAM);
+  SW_I2C_UTIL_WRITE(ICM45686_ADDRESS, ICM45686_REG_FIFO_CONFIG3, ICM45686_FIFO_CONFIG3_ACCEL_GYRO);
+
   /* record selected FS and compute scale factors (LSB -> physical units)
    * Accelerometer: assume 16-bit output, so LSB_per_g = 16384 / (FS/2) ???
    * Use canonical formula: LSB_per_g = 16384 / (FS/2) is confusing; instead compute
@@ -108,41 +145,35 @@ void ICM45686_Init(void)
     default: icm45686_deg_per_lsb = 250.0f / 32768.0f; break;
   }
 
+  icm45686_map.fAccelScale = icm45686_g_per_lsb * MS2_PER_G;
+  icm45686_map.fGyroScale = icm45686_deg_per_lsb * RAD_PER_G;
+
   debug_printf(" * ICM-45686 configured (soft-reset, pwr_mgmt, accel/gyro cfg)\r\n");
 }
 
-void ICM45686_ReadAccelerometerRaw(float *x, float *y, float *z)
+const IMU_RegisterMap_t *ICM45686_GetRegisterMap(void)
 {
-    uint8_t accel_xyz[6];
-
-    SW_I2C_UTIL_Read_Multi(ICM45686_ADDRESS, ICM45686_ACCEL_XOUT_H, 6, (uint8_t*)&accel_xyz);
-
-  {
-    // default is little-endian, combine bytes
-    int16_t rx = (int16_t)(accel_xyz[1] << 8 | accel_xyz[0]);
-    int16_t ry = (int16_t)(accel_xyz[3] << 8 | accel_xyz[2]);
-    int16_t rz = (int16_t)(accel_xyz[5] << 8 | accel_xyz[4]);
-    *x = rx * icm45686_g_per_lsb * MS2_PER_G;
-    *y = ry * icm45686_g_per_lsb * MS2_PER_G;
-    *z = rz * icm45686_g_per_lsb * MS2_PER_G;
-  }
+  return &icm45686_map;
 }
 
-void ICM45686_ReadGyroRaw(float *x, float *y, float *z)
+/* FIFO level in packets from FIFO_COUNT_0..1 */
+static uint16_t icm45686_fifoEntries(const uint8_t *p_pu8Status)
 {
-    uint8_t gyro_xyz[6];
-    SW_I2C_UTIL_Read_Multi(ICM45686_ADDRESS, ICM45686_GYRO_XOUT_H, 6, (uint8_t*)&gyro_xyz);
-
-  {
-    // default is little-endian, combine bytes
-    int16_t gx = (int16_t)(gyro_xyz[1] << 8 | gyro_xyz[0]);
-    int16_t gy = (int16_t)(gyro_xyz[3] << 8 | gyro_xyz[2]);
-    int16_t gz = (int16_t)(gyro_xyz[5] << 8 | gyro_xyz[4]);
-    /* deg/sec per LSB * RAD_PER_G (deg->rad) */
-    *x = gx * icm45686_deg_per_lsb * RAD_PER_G;
-    *y = gy * icm45686_deg_per_lsb * RAD_PER_G;
-    *z = gz * icm45686_deg_per_lsb * RAD_PER_G;
+  return (uint16_t)(p_pu8Status[1] << 8 | p_pu8Status[0]);
+}
+
+static uint8_t icm45686_fifoEntry(const uint8_t *p_pu8Entry, int16_t *p_ps16Sample)
+{
+  uint8_t i;
+
+  /* skip empty packets and packets without both sensors */
+  if ((p_pu8Entry[0] & ICM45686_FIFO_HEADER_ACCEL_GYRO) != ICM45686_FIFO_HEADER_ACCEL_GYRO) {
+    return 0;
+  }
+  for (i = 0; i < 6; i++) {
+    p_ps16Sample[i] = (int16_t)(p_pu8Entry[2 + 2 * i] << 8 | p_pu8Entry[1 + 2 * i]);
   }
+  return 1;
 }
 
 #endif
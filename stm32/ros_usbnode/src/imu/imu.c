@@ -13,17 +13,64 @@
   */
 
 #include <math.h>
+#include <string.h>
 
 #include "imu/imu.h"
 #include "imu/lsm6.h"
 #include "imu/mpu6050.h"
 #include "imu/wt901.h"
 #include "imu/icm45686.h"
+#include "imu/imu_fusion.h"
+#include "board.h"
 #include "i2c.h"
+#include "soft_i2c.h"
 #include "main.h"
 
-IMU_ReadAccelerometerRaw imuReadAccelerometerRaw=NULL;
-IMU_ReadGyroRaw imuReadGyroRaw=NULL;
+/* register map of the installed external IMU, NULL if there is none */
+static const IMU_RegisterMap_t *imu_psMap = NULL;
+
+/* background reads, run by the soft I2C timer interrupt */
+typedef enum
+{
+  IMU_STEP_IDLE = 0,
+  IMU_STEP_SAMPLE,                  // sample burst running
+  IMU_STEP_SAMPLE_READY,
+  IMU_STEP_FIFO_STATUS,             // FIFO level read running
+  IMU_STEP_FIFO_STATUS_READY,
+  IMU_STEP_FIFO_DATA,               // FIFO drain running
+  IMU_STEP_FIFO_DATA_READY
+} imu_step_e;
+
+static volatile imu_step_e imu_eStep = IMU_STEP_IDLE;
+static uint8_t imu_pu8Burst[IMU_BURST_MAX];
+static uint8_t imu_pu8Fifo[IMU_FIFO_BURST_MAX];
+static uint8_t imu_u8FifoPending = 0;       // bytes of the running drain
+static uint8_t imu_u8FifoLength = 0;        // bytes drained
+static uint8_t imu_u8FifoIndex = 0;         // next entry to decode
+uint32_t IMU_u32BurstErrors = 0;
+
+/* publish rate */
+static uint8_t imu_u8TickDivider = 1;       // samples read one by one: IMU_POLL_MS ticks per sample
+static uint8_t imu_u8Tick = 0;
+static uint8_t imu_bPublish = 1;            // samples read one by one: the running read is published
+static uint8_t imu_u8Decimation = 1;        // FIFO: samples per published sample
+
+/* CIC decimation filter of the FIFO samples, integrators and combs wrap around modulo 2^32 */
+static uint32_t imu_pu32CicIntegrator[IMU_CIC_ORDER][6];
+static uint32_t imu_pu32CicComb[IMU_CIC_ORDER][6];
+static uint32_t imu_u32CicGain = 1;         // decimation ^ IMU_CIC_ORDER
+static uint8_t imu_u8CicCount = 0;
+static uint8_t imu_u8CicSettling = 0;       // outputs to drop after a reset
+
+/* last calibrated sample */
+static IMU_Sample_t imu_sSample;
+
+/* attitude filter at the sensor rate, imu/orientation switches it at runtime */
+#ifdef EXTERNAL_IMU_ORIENTATION
+static uint8_t imu_bOrientation = 1;
+#else
+static uint8_t imu_bOrientation = 0;
+#endif
 
 /* accelerometer calibration values */
 float imu_cal_ax = 0.0;
@@ -53,35 +100,365 @@ float onboard_imu_cov_az = 0.01;
 // ---------------------
 
 static int assertAccelerometer() {
-  return debug_assert(imuReadAccelerometerRaw!=NULL,"Usage of non installed accelerometer\r\n");
+  return debug_assert(IMU_HasAccelerometer(),"Usage of non installed accelerometer\r\n");
 }
 
 static int assertGyro() {
-  return debug_assert(imuReadGyroRaw!=NULL,"Usage of non installed gryometer\r\n");
+  return debug_assert(IMU_HasGyro(),"Usage of non installed gryometer\r\n");
 }
 
 int IMU_HasAccelerometer() {
-  return imuReadAccelerometerRaw!=NULL;
+  return imu_psMap!=NULL && imu_psMap->s8Accel>=0;
 }
 
 int IMU_HasGyro() {
-  return imuReadGyroRaw!=NULL;
+  return imu_psMap!=NULL && imu_psMap->s8Gyro>=0;
+}
+
+/*
+ * 16 bit word of the burst at p_u8Offset
+ */
+static int16_t imu_word(const uint8_t *p_pu8Burst, uint8_t p_u8Offset)
+{
+  if (imu_psMap->bBigEndian) {
+    return (int16_t)(p_pu8Burst[p_u8Offset] << 8 | p_pu8Burst[p_u8Offset + 1]);
+  }
+  return (int16_t)(p_pu8Burst[p_u8Offset + 1] << 8 | p_pu8Burst[p_u8Offset]);
+}
+
+/*
+ * convert a burst with the register map of the installed IMU, uncalibrated
+ */
+static void imu_convert(const uint8_t *p_pu8Burst, IMU_Sample_t *p_psSample)
+{
+  const IMU_RegisterMap_t *l_psMap = imu_psMap;
+
+  p_psSample->ax = p_psSample->ay = p_psSample->az = 0;
+  p_psSample->gx = p_psSample->gy = p_psSample->gz = 0;
+  p_psSample->temp = 0;
+  if (l_psMap->s8Accel >= 0) {
+    p_psSample->ax = imu_word(p_pu8Burst, l_psMap->s8Accel) * l_psMap->fAccelScale;
+    p_psSample->ay = imu_word(p_pu8Burst, l_psMap->s8Accel + 2) * l_psMap->fAccelScale;
+    p_psSample->az = imu_word(p_pu8Burst, l_psMap->s8Accel + 4) * l_psMap->fAccelScale;
+  }
+  if (l_psMap->s8Gyro >= 0) {
+    p_psSample->gx = imu_word(p_pu8Burst, l_psMap->s8Gyro) * l_psMap->fGyroScale;
+    p_psSample->gy = imu_word(p_pu8Burst, l_psMap->s8Gyro + 2) * l_psMap->fGyroScale;
+    p_psSample->gz = imu_word(p_pu8Burst, l_psMap->s8Gyro + 4) * l_psMap->fGyroScale;
+  }
+  if (l_psMap->s8Temp >= 0) {
+    p_psSample->temp = imu_word(p_pu8Burst, l_psMap->s8Temp) * l_psMap->fTempScale + l_psMap->fTempOffset;
+  }
+}
+
+/*
+ * apply the calibration
+ */
+static void imu_calibrate(IMU_Sample_t *p_psSample)
+{
+  p_psSample->ax -= imu_cal_ax;
+  p_psSample->ay -= imu_cal_ay;
+  p_psSample->az -= imu_cal_az;
+  p_psSample->gx -= imu_cal_gx;
+  p_psSample->gy -= imu_cal_gy;
+  p_psSample->gz -= imu_cal_gz;
+}
+
+/*
+ * blocking burst read, uncalibrated
+ */
+static uint8_t imu_readSampleRaw(IMU_Sample_t *p_psSample)
+{
+  uint8_t l_pu8Burst[IMU_BURST_MAX];
+
+  if (imu_psMap == NULL) return 0;
+  if (!SW_I2C_UTIL_Read_Multi(imu_psMap->u8Address, imu_psMap->u8Register, imu_psMap->u8Length, l_pu8Burst)) return 0;
+  imu_convert(l_pu8Burst, p_psSample);
+  return 1;
+}
+
+static void imu_burstDone(SW_I2C_Status_e p_eStatus, void *p_pvContext)
+{
+  if (p_eStatus == SW_I2C_OK) {
+    // the ..._READY step follows the running one
+    imu_eStep = (imu_step_e)(imu_eStep + 1);
+  }
+  else {
+    IMU_u32BurstErrors++;
+    imu_eStep = IMU_STEP_IDLE;
+  }
+}
+
+/*
+ * start a background read of the installed IMU
+ */
+static uint8_t imu_startRead(imu_step_e p_eStep, uint8_t p_u8Register, uint8_t *p_pu8Data, uint8_t p_u8Length)
+{
+  imu_eStep = p_eStep;
+  if (!SW_I2C_Transfer(imu_psMap->u8Address << 1, p_u8Register, 1, p_pu8Data, p_u8Length, imu_burstDone, NULL)) {
+    imu_eStep = IMU_STEP_IDLE;
+    return 0;
+  }
+  return 1;
+}
+
+static uint8_t imu_fusing(void)
+{
+  return imu_bOrientation && IMU_HasAccelerometer() && IMU_HasGyro();
+}
+
+/*
+ * scale and calibration of the attitude filter, the FIFO feeds it at the FIFO rate, a burst read IMU every IMU_POLL_MS
+ */
+static void imu_fusionConfig(void)
+{
+  float l_pfBias[6];
+
+  if (!IMU_HasAccelerometer() || !IMU_HasGyro()) return;
+  l_pfBias[0] = imu_cal_ax / imu_psMap->fAccelScale;
+  l_pfBias[1] = imu_cal_ay / imu_psMap->fAccelScale;
+  l_pfBias[2] = imu_cal_az / imu_psMap->fAccelScale;
+  l_pfBias[3] = imu_cal_gx / imu_psMap->fGyroScale;
+  l_pfBias[4] = imu_cal_gy / imu_psMap->fGyroScale;
+  l_pfBias[5] = imu_cal_gz / imu_psMap->fGyroScale;
+  IMUFUSION_Config(imu_psMap->psFifo != NULL ? imu_psMap->psFifo->u16RateHz : 1000 / IMU_POLL_MS,
+                   imu_psMap->fGyroScale, l_pfBias, IMU_FUSION_KP, IMU_FUSION_KI);
+}
+
+/*
+ * feed a burst to the attitude filter
+ */
+static void imu_fuseBurst(const uint8_t *p_pu8Burst)
+{
+  int16_t l_ps16Sample[6];
+  uint8_t i;
+
+  for (i = 0; i < 3; i++) {
+    l_ps16Sample[i] = imu_word(p_pu8Burst, imu_psMap->s8Accel + 2 * i);
+    l_ps16Sample[3 + i] = imu_word(p_pu8Burst, imu_psMap->s8Gyro + 2 * i);
+  }
+  IMUFUSION_Update(l_ps16Sample);
+}
+
+static void imu_cicReset(void)
+{
+  memset(imu_pu32CicIntegrator, 0, sizeof(imu_pu32CicIntegrator));
+  memset(imu_pu32CicComb, 0, sizeof(imu_pu32CicComb));
+  imu_u8CicCount = 0;
+  imu_u8CicSettling = IMU_CIC_ORDER;
+}
+
+/*
+ * CIC decimator: IMU_CIC_ORDER integrators at the FIFO rate, IMU_CIC_ORDER combs at the publish rate
+ * the sinc^N response nulls the bands that would alias onto the published samples
+ * returns 1 with the filtered accel X/Y/Z, gyro X/Y/Z in LSB once imu_u8Decimation samples are in
+ */
+static uint8_t imu_cicFilter(const int16_t *p_ps16Sample, float *p_pfOut)
+{
+  uint32_t l_u32Value, l_u32Delayed;
+  uint8_t i, k;
+
+  for (i = 0; i < 6; i++) {
+    l_u32Value = (uint32_t)(int32_t)p_ps16Sample[i];
+    for (k = 0; k < IMU_CIC_ORDER; k++) {
+      imu_pu32CicIntegrator[k][i] += l_u32Value;
+      l_u32Value = imu_pu32CicIntegrator[k][i];
+    }
+  }
+  if (++imu_u8CicCount < imu_u8Decimation) return 0;
+  imu_u8CicCount = 0;
+
+  for (i = 0; i < 6; i++) {
+    l_u32Value = imu_pu32CicIntegrator[IMU_CIC_ORDER - 1][i];
+    for (k = 0; k < IMU_CIC_ORDER; k++) {
+      l_u32Delayed = imu_pu32CicComb[k][i];
+      imu_pu32CicComb[k][i] = l_u32Value;
+      l_u32Value -= l_u32Delayed;
+    }
+    p_pfOut[i] = (float)(int32_t)l_u32Value / imu_u32CicGain;
+  }
+  if (imu_u8CicSettling) {
+    imu_u8CicSettling--;
+    return 0;
+  }
+  return 1;
+}
+
+/*
+ * the FIFO level is in, drain it
+ */
+static void imu_fifoDrain(void)
+{
+  const IMU_Fifo_t *l_psFifo = imu_psMap->psFifo;
+  uint16_t l_u16Entries = l_psFifo->pfEntries(imu_pu8Burst);
+
+  imu_eStep = IMU_STEP_IDLE;
+  if (l_u16Entries > IMU_FIFO_BURST_MAX / l_psFifo->u8EntryLength) {
+    // the rest comes with the next drain
+    l_u16Entries = IMU_FIFO_BURST_MAX / l_psFifo->u8EntryLength;
+  }
+  if (l_u16Entries == 0) return;
+  imu_u8FifoPending = l_u16Entries * l_psFifo->u8EntryLength;
+  imu_startRead(IMU_STEP_FIFO_DATA, l_psFifo->u8DataRegister, imu_pu8Fifo, imu_u8FifoPending);
+}
+
+/*
+ * decode the drained FIFO entries until the decimator has a sample
+ */
+static uint8_t imu_fifoDecode(void)
+{
+  const IMU_Fifo_t *l_psFifo = imu_psMap->psFifo;
+  const uint8_t *l_pu8Entry;
+  int16_t l_ps16Sample[6];
+  float l_pfOut[6];
+
+  while (imu_u8FifoIndex < imu_u8FifoLength) {
+    l_pu8Entry = &imu_pu8Fifo[imu_u8FifoIndex];
+    imu_u8FifoIndex += l_psFifo->u8EntryLength;
+    if (!l_psFifo->pfEntry(l_pu8Entry, l_ps16Sample)) continue;
+    if (imu_fusing()) {
+      // every FIFO sample, ahead of the decimation
+      IMUFUSION_Update(l_ps16Sample);
+    }
+    if (imu_cicFilter(l_ps16Sample, l_pfOut)) {
+      // the temperature is not in the FIFO, it stays the one of the last burst read
+      imu_sSample.ax = l_pfOut[0] * imu_psMap->fAccelScale;
+      imu_sSample.ay = l_pfOut[1] * imu_psMap->fAccelScale;
+      imu_sSample.az = l_pfOut[2] * imu_psMap->fAccelScale;
+      imu_sSample.gx = l_pfOut[3] * imu_psMap->fGyroScale;
+      imu_sSample.gy = l_pfOut[4] * imu_psMap->fGyroScale;
+      imu_sSample.gz = l_pfOut[5] * imu_psMap->fGyroScale;
+      imu_calibrate(&imu_sSample);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/**
+  * @brief  Reads accel, gyro and temperature of the external IMU with one burst read (blocking)
+  * 
+  * units are m/s^2, rad/sec and °C, calibrated
+  * @retval 1 if the IMU answered
+  */ 
+uint8_t IMU_ReadSample(IMU_Sample_t *p_psSample)
+{
+  if (!imu_readSampleRaw(p_psSample)) return 0;
+  imu_calibrate(p_psSample);
+  imu_sSample = *p_psSample;
+  return 1;
 }
 
 /**
-  * @brief  Reads the 3 accelerometer axis and stores them in *x,*y,*z  
+  * @brief  Starts the background read of the external IMU, to be called every IMU_POLL_MS
+  * a FIFO is drained, otherwise the next sample is read with one burst at the publish rate,
+  * or every IMU_POLL_MS while the attitude filter runs
   * 
-  * units are m/s^2 uncalibrated
+  * @retval 0 if there is no external IMU or the last read is not done yet
+  */ 
+uint8_t IMU_StartSample(void)
+{
+  const IMU_Fifo_t *l_psFifo;
+
+  if (imu_psMap == NULL || imu_eStep != IMU_STEP_IDLE) return 0;
+  l_psFifo = imu_psMap->psFifo;
+  if (l_psFifo != NULL) {
+    if (imu_u8FifoIndex < imu_u8FifoLength) return 0;
+    return imu_startRead(IMU_STEP_FIFO_STATUS, l_psFifo->u8StatusRegister, imu_pu8Burst, l_psFifo->u8StatusLength);
+  }
+  imu_bPublish = (++imu_u8Tick >= imu_u8TickDivider);
+  if (imu_bPublish) {
+    imu_u8Tick = 0;
+  }
+  else if (!imu_fusing()) {
+    return 1;
+  }
+  return imu_startRead(IMU_STEP_SAMPLE, imu_psMap->u8Register, imu_pu8Burst, imu_psMap->u8Length);
+}
+
+/**
+  * @brief  Moves the background read on, to be called from the main loop
+  * IMU_ReadAccelerometer(), IMU_ReadGyro() and IMU_ReadTemp() return the new sample
+  * 
+  * @retval 1 once per sample to publish (burst read, or decimated FIFO samples)
+  */ 
+uint8_t IMU_SampleReady(void)
+{
+  if (imu_psMap == NULL) return 0;
+  switch (imu_eStep) {
+  case IMU_STEP_SAMPLE_READY:
+    imu_eStep = IMU_STEP_IDLE;
+    if (imu_fusing()) {
+      imu_fuseBurst(imu_pu8Burst);
+    }
+    imu_convert(imu_pu8Burst, &imu_sSample);
+    imu_calibrate(&imu_sSample);
+    return imu_bPublish;
+
+  case IMU_STEP_FIFO_STATUS_READY:
+    imu_fifoDrain();
+    return 0;
+
+  case IMU_STEP_FIFO_DATA_READY:
+    imu_eStep = IMU_STEP_IDLE;
+    imu_u8FifoLength = imu_u8FifoPending;
+    imu_u8FifoIndex = 0;
+    break;
+
+  default:
+    break;
+  }
+  if (imu_psMap->psFifo == NULL) return 0;
+  return imu_fifoDecode();
+}
+
+/**
+  * @brief  Sets the publish rate, a FIFO is decimated by the nearest divider of its sample rate,
+  * a burst read IMU is published every n-th IMU_POLL_MS
+  * 
+  * @param  p_u8Hz rate, clamped to IMU_RATE_MIN_HZ..IMU_RATE_MAX_HZ
+  * @retval the rate in Hz it runs at
+  */ 
+uint8_t IMU_SetRate(uint8_t p_u8Hz)
+{
+  uint16_t l_u16Divider;
+  uint8_t k;
+
+  if (p_u8Hz < IMU_RATE_MIN_HZ) p_u8Hz = IMU_RATE_MIN_HZ;
+  if (p_u8Hz > IMU_RATE_MAX_HZ) p_u8Hz = IMU_RATE_MAX_HZ;
+
+  if (imu_psMap != NULL && imu_psMap->psFifo != NULL) {
+    l_u16Divider = (imu_psMap->psFifo->u16RateHz + p_u8Hz / 2) / p_u8Hz;
+    // the CIC gain divider^IMU_CIC_ORDER * 2^15 has to fit 32 bit
+    if (l_u16Divider > 255) l_u16Divider = 255;
+    if (l_u16Divider < 1) l_u16Divider = 1;
+    imu_u8Decimation = l_u16Divider;
+    imu_u32CicGain = 1;
+    for (k = 0; k < IMU_CIC_ORDER; k++) {
+      imu_u32CicGain *= imu_u8Decimation;
+    }
+    imu_cicReset();
+    return imu_psMap->psFifo->u16RateHz / imu_u8Decimation;
+  }
+
+  l_u16Divider = ((1000 / IMU_POLL_MS) + p_u8Hz / 2) / p_u8Hz;
+  if (l_u16Divider < 1) l_u16Divider = 1;
+  imu_u8TickDivider = l_u16Divider;
+  imu_u8Tick = 0;
+  return (1000 / IMU_POLL_MS) / imu_u8TickDivider;
+}
+
+/**
+  * @brief  Returns the 3 accelerometer axis of the last sample in *x,*y,*z  
+  * 
+  * units are m/s^2 calibrated
   */ 
 void IMU_ReadAccelerometer(float *x, float *y, float *z)
 {
   if (assertAccelerometer()) return;
-    float imu_x, imu_y, imu_z;
-    imuReadAccelerometerRaw(&imu_x, &imu_y, &imu_z);
-    // apply calibration
-    *x = imu_x - imu_cal_ax;
-    *y = imu_y - imu_cal_ay;
-    *z = imu_z - imu_cal_az;
+  *x = imu_sSample.ax;
+  *y = imu_sSample.ay;
+  *z = imu_sSample.az;
 }
 
 /*
@@ -96,19 +473,24 @@ void IMU_AccelerometerSetCovariance(float *cm)
 
 
 /**
-  * @brief  Reads the 3 accelerometer gyro and stores them in *x,*y,*z  
+  * @brief  Returns the 3 gyro axis of the last sample in *x,*y,*z  
   * 
-  * units are rad/sec uncalibrated
+  * units are rad/sec calibrated
   */ 
 void IMU_ReadGyro(float *x, float *y, float *z)
 {
   if (assertGyro()) return;
-  float imu_x, imu_y, imu_z;
-  imuReadGyroRaw(&imu_x, &imu_y, &imu_z);
-  // apply calibration
-  *x = imu_x - imu_cal_gx;
-  *y = imu_y - imu_cal_gy;
-  *z = imu_z - imu_cal_gz;
+  *x = imu_sSample.gx;
+  *y = imu_sSample.gy;
+  *z = imu_sSample.gz;
+}
+
+/*
+ * Temperature of the last sample in °C
+ */
+float IMU_ReadTemp(void)
+{
+  return(imu_sSample.temp);
 }
 
 /*
@@ -121,6 +503,46 @@ void IMU_GyroSetCovariance(float *cm)
    cm[8] = imu_cov_gz;
 }
 
+/**
+  * @brief  Switches the attitude filter on or off (raw only), it starts over from the accelerometer when switched on
+  */ 
+void IMU_SetOrientation(uint8_t p_bEnable)
+{
+#ifdef EXTERNAL_IMU_ORIENTATION
+  if (p_bEnable && !imu_bOrientation) {
+    IMUFUSION_Reset();
+  }
+  imu_bOrientation = p_bEnable;
+#endif
+}
+
+/**
+  * @brief  Returns the orientation quaternion of the attitude filter in *x,*y,*z,*w
+  * 
+  * @retval 0 if the filter is off or has no estimate yet
+  */ 
+uint8_t IMU_ReadOrientation(float *x, float *y, float *z, float *w)
+{
+  float l_pfQ[4];
+
+  if (!imu_fusing() || !IMUFUSION_GetQuaternion(l_pfQ)) return 0;
+  *w = l_pfQ[0];
+  *x = l_pfQ[1];
+  *y = l_pfQ[2];
+  *z = l_pfQ[3];
+  return 1;
+}
+
+/*
+ * Set covariance matrix values, yaw is the integrated gyro only
+ */
+void IMU_OrientationSetCovariance(float *cm)
+{
+   cm[0] = IMU_FUSION_COV_ROLL_PITCH;
+   cm[4] = IMU_FUSION_COV_ROLL_PITCH;
+   cm[8] = IMU_FUSION_COV_YAW;
+}
+
 /*
  * Read onboard IMU acceleration in ms^2
  */
@@ -129,6 +551,15 @@ void IMU_Onboard_ReadAccelerometer(float *x, float *y, float *z)
    I2C_ReadAccelerometer(x, y, z);
 }
 
+/*
+ * Mean onboard IMU acceleration in ms^2 of the FIFO samples since the last call
+ * returns the number of samples, 0 if there is nothing new
+ */
+uint8_t IMU_Onboard_ReadAccelerometerMean(float *x, float *y, float *z)
+{
+   return(I2C_ReadAccelerometerMean(x, y, z));
+}
+
 /*
  * Set covariance matrix values
  */
@@ -148,87 +579,86 @@ float IMU_Onboard_ReadTemp(void)
 }
 
 
+/*
+ * running mean and variance of one axis (Welford)
+ */
+typedef struct
+{
+    uint16_t n;
+    float mean;
+    float m2;
+} imu_stats_t;
+
+static void imu_statsAdd(imu_stats_t *p_psStats, float p_fValue)
+{
+    float l_fDelta = p_fValue - p_psStats->mean;
+
+    p_psStats->n++;
+    p_psStats->mean += l_fDelta / p_psStats->n;
+    p_psStats->m2 += l_fDelta * (p_fValue - p_psStats->mean);
+}
+
 /**
   * @brief Calibrates IMU accelerometers and gyro by averaging and storing those values as calibration factors 
   * it expects that the bot is leveled and not moving
+  * accel and gyro come from the same burst reads
   * 
   */ 
 void IMU_CalibrateExternal()
 {
-    float imu_sample_x[IMU_CAL_SAMPLES], imu_sample_y[IMU_CAL_SAMPLES], imu_sample_z[IMU_CAL_SAMPLES]; 
-    float stddev_x, stddev_y, stddev_z;
-    float mean_x, mean_y, mean_z;    
-    float sum_x, sum_y, sum_z;
+    IMU_Sample_t l_sSample;
+    imu_stats_t ax = {0}, ay = {0}, az = {0}, gx = {0}, gy = {0}, gz = {0};
     uint16_t i;
     
     
     debug_printf("    > External IMU Calibration started - make sure bot is level and standing still ...\r\n");    
     
+    for (i=0; i<IMU_CAL_SAMPLES; i++)
+    {
+      if (imu_readSampleRaw(&l_sSample))
+      {
+        imu_statsAdd(&ax, l_sSample.ax);
+        imu_statsAdd(&ay, l_sSample.ay);
+        imu_statsAdd(&az, l_sSample.az);
+        imu_statsAdd(&gx, l_sSample.gx);
+        imu_statsAdd(&gy, l_sSample.gy);
+        imu_statsAdd(&gz, l_sSample.gz);
+      }
+      HAL_Delay(10);
+    }
+    if (ax.n == 0)
+    {
+      return;
+    }
+
     /************************************/
     /* calibrate external accelerometer */
     /************************************/
-    if (imuReadAccelerometerRaw) {
-      sum_x = sum_y = sum_z = 0;
-      for (i=0; i<IMU_CAL_SAMPLES; i++)
-      {
-        imuReadAccelerometerRaw(&imu_sample_x[i], &imu_sample_y[i], &imu_sample_z[i]);
-        sum_x += imu_sample_x[i];
-        sum_y += imu_sample_y[i];
-        sum_z += imu_sample_z[i];
-        HAL_Delay(10);      
-      }
-      mean_x = sum_x / IMU_CAL_SAMPLES;
-      mean_y = sum_y / IMU_CAL_SAMPLES;
-      mean_z = sum_z / IMU_CAL_SAMPLES;
-      imu_cal_ax = mean_x;
-      imu_cal_ay = mean_y;
+    if (IMU_HasAccelerometer()) {
+      imu_cal_ax = ax.mean;
+      imu_cal_ay = ay.mean;
       imu_cal_az = 0;    // we dont want to calibrate Z because our IMU Sensor fusion stack expects gravity
       debug_printf("    > External IMU Calibration factors accelerometer [%f %f %f]\r\n", imu_cal_ax, imu_cal_ay, imu_cal_az);
-      stddev_x = stddev_y = stddev_z = 0;
-      for (i=0; i<IMU_CAL_SAMPLES; i++)
-      {
-          stddev_x += pow(imu_sample_x[i] - mean_x, 2);
-          stddev_y += pow(imu_sample_y[i] - mean_y, 2);
-          stddev_z += pow(imu_sample_z[i] - mean_z, 2);        
-      }
-      imu_cov_ax = stddev_x / IMU_CAL_SAMPLES;
-      imu_cov_ay = stddev_y / IMU_CAL_SAMPLES;
-      imu_cov_az = stddev_z / IMU_CAL_SAMPLES;
+      imu_cov_ax = ax.m2 / ax.n;
+      imu_cov_ay = ay.m2 / ay.n;
+      imu_cov_az = az.m2 / az.n;
       debug_printf("    > External IMU Calibration accelerometer covariance diagonal [%f %f %f]\r\n", imu_cov_ax, imu_cov_ay, imu_cov_az); 
     }
 
     /***************************/
     /* calibrate external gyro */
     /***************************/
-    if (imuReadGyroRaw) {
-      sum_x = sum_y = sum_z = 0;    
-      for (i=0; i<IMU_CAL_SAMPLES; i++)
-      {
-        imuReadGyroRaw(&imu_sample_x[i], &imu_sample_y[i], &imu_sample_z[i]);
-        sum_x += imu_sample_x[i];
-        sum_y += imu_sample_y[i];
-        sum_z += imu_sample_z[i];
-        HAL_Delay(10);      
-      }
-      mean_x = sum_x / IMU_CAL_SAMPLES;
-      mean_y = sum_y / IMU_CAL_SAMPLES;
-      mean_z = sum_z / IMU_CAL_SAMPLES;
-      imu_cal_gx = mean_x;
-      imu_cal_gy = mean_y;
-      imu_cal_gz = mean_z;
+    if (IMU_HasGyro()) {
+      imu_cal_gx = gx.mean;
+      imu_cal_gy = gy.mean;
+      imu_cal_gz = gz.mean;
       debug_printf("    > External IMU Calibration factors gyro [%f %f %f]\r\n", imu_cal_gx, imu_cal_gy, imu_cal_gz);
-      stddev_x = stddev_y = stddev_z = 0;
-      for (i=0; i<IMU_CAL_SAMPLES; i++)
-      {
-        stddev_x += pow(imu_sample_x[i] - mean_x, 2);
-        stddev_y += pow(imu_sample_y[i] - mean_y, 2);
-        stddev_z += pow(imu_sample_z[i] - mean_z, 2);        
-      }
-      imu_cov_gx = stddev_x / IMU_CAL_SAMPLES;
-      imu_cov_gy = stddev_y / IMU_CAL_SAMPLES;
-      imu_cov_gz = stddev_z / IMU_CAL_SAMPLES;
+      imu_cov_gx = gx.m2 / gx.n;
+      imu_cov_gy = gy.m2 / gy.n;
+      imu_cov_gz = gz.m2 / gz.n;
       debug_printf("    > External IMU Calibration gyro covariance diagonal [%f %f %f]\r\n", imu_cov_gx, imu_cov_gy, imu_cov_gz); 
     }
+    imu_fusionConfig();
 }
 
 void IMU_CalibrateOnboard()
@@ -247,11 +677,12 @@ void IMU_CalibrateOnboard()
     sum_x = sum_y = sum_z = 0;    
     for (i=0; i<IMU_CAL_SAMPLES; i++)
     {
+      I2C_Accelerometer_Poll();
+      HAL_Delay(10);
       I2C_ReadAccelerometer(&imu_sample_x[i], &imu_sample_y[i], &imu_sample_z[i]);
       sum_x += imu_sample_x[i];
       sum_y += imu_sample_y[i];
       sum_z += imu_sample_z[i];
-      HAL_Delay(10);      
     }
     mean_x = sum_x / IMU_CAL_SAMPLES;
     mean_y = sum_y / IMU_CAL_SAMPLES;
@@ -282,49 +713,48 @@ void IMU_Normalize( VECTOR* p )
 }
 
 void IMU_Init() {
-  imuReadAccelerometerRaw=NULL;
-  imuReadGyroRaw=NULL;
+  imu_psMap=NULL;
 
   uint32_t l_u32Timestamp = HAL_GetTick();
-while (imuReadAccelerometerRaw == NULL && ((HAL_GetTick() - l_u32Timestamp) < 20000) )
+while (imu_psMap == NULL && ((HAL_GetTick() - l_u32Timestamp) < 20000) )
 {
   #ifndef DISABLE_LSM6
     if (LSM6_TestDevice()) {
       LSM6_Init();
-      imuReadAccelerometerRaw=LSM6_ReadAccelerometerRaw;
-      imuReadGyroRaw=LSM6_ReadGyroRaw;
+      imu_psMap=LSM6_GetRegisterMap();
     }
   #endif
 
   #ifndef DISABLE_WT901
-    if ((!imuReadGyroRaw || !imuReadAccelerometerRaw) && WT901_TestDevice()) {
+    if (!imu_psMap && WT901_TestDevice()) {
       WT901_Init();
-      imuReadAccelerometerRaw=WT901_ReadAccelerometerRaw;
-      imuReadGyroRaw=WT901_ReadGyroRaw;
+      imu_psMap=WT901_GetRegisterMap();
     }
   #endif
 
   #ifndef DISABLE_MPU6050
-    if ((!imuReadGyroRaw || !imuReadAccelerometerRaw) && MPU6050_TestDevice()) {
+    if (!imu_psMap && MPU6050_TestDevice()) {
       MPU6050_Init();
-      imuReadAccelerometerRaw=MPU6050_ReadAccelerometerRaw;
-      imuReadGyroRaw=MPU6050_ReadGyroRaw;
+      imu_psMap=MPU6050_GetRegisterMap();
     }
   #endif
 
   HAL_Delay(20);
 }
 
-if(imuReadAccelerometerRaw == NULL){
+if(imu_psMap == NULL){
   chirp(10);
 }
 
 #ifndef DISABLE_ICM45686
-  if ((!imuReadGyroRaw || !imuReadAccelerometerRaw) && ICM45686_TestDevice()) {
+  if (!imu_psMap && ICM45686_TestDevice()) {
     ICM45686_Init();
-    imuReadAccelerometerRaw=ICM45686_ReadAccelerometerRaw;
-    imuReadGyroRaw=ICM45686_ReadGyroRaw;
+    imu_psMap=ICM45686_GetRegisterMap();
   }
 #endif
 
+  IMU_SetRate(IMU_RATE_DEFAULT_HZ);
+  imu_fusionConfig();
+  IMUFUSION_Reset();
+
 }
\ No newline at end of file
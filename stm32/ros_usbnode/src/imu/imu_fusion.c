@@ -0,0 +1,377 @@
+/****************************************************************************
+* Title                 :   IMU attitude filter
+* Filename              :   imu_fusion.c
+* Author                :
+* Origin Date           :
+* Version               :   1.0.0
+
+*****************************************************************************/
+/** \file imu_fusion.c
+*  \brief Mahony complementary filter of the external IMU
+*
+*  The gyro is integrated into the orientation quaternion, the cross product of
+*  the measured and the estimated gravity corrects it with a proportional and an
+*  integral (gyro bias) term. Roll and pitch converge on the accelerometer, yaw
+*  is the integrated gyro only as there is no magnetometer. The first sample with
+*  an accelerometer reading sets roll and pitch directly.
+*
+*  The F103 has no FPU, it runs the filter in fixed point: quaternion and the per
+*  sample half angle increments are Q30, the normalized accelerometer is Q14 and
+*  the gains are scaled to the sample period by IMUFUSION_Config(). The norm of
+*  the quaternion is kept at 1 with one Newton step per sample instead of a
+*  square root and a division.
+*/
+/******************************************************************************
+* Includes
+*******************************************************************************/
+#include <math.h>
+
+#include "imu/imu_fusion.h"
+
+/******************************************************************************
+* Module Preprocessor Constants
+*******************************************************************************/
+#define IMUFUSION_Q30 1073741824.0f
+
+/******************************************************************************
+* Module Preprocessor Macros
+*******************************************************************************/
+
+/******************************************************************************
+* Module Typedefs
+*******************************************************************************/
+
+/******************************************************************************
+* Module Variable Definitions
+*******************************************************************************/
+static uint8_t imufusion_bValid = 0;            // orientation set from the accelerometer
+
+#if BOARD_YARDFORCE500_VARIANT_B
+static float imufusion_pfQ[4] = {1.0f, 0.0f, 0.0f, 0.0f};   // w, x, y, z
+static float imufusion_pfIntegral[3];           // gyro bias estimate in rad/sec
+static float imufusion_pfBias[6];               // calibration in LSB
+static float imufusion_fGyroScale = 0.0f;       // rad/sec per LSB
+static float imufusion_fHalfDt = 0.0f;
+static float imufusion_fKp = 0.0f;
+static float imufusion_fKi = 0.0f;
+#else
+static int32_t imufusion_ps32Q[4] = {1 << 30, 0, 0, 0};     // w, x, y, z in Q30
+static int64_t imufusion_ps64Integral[3];       // gyro bias as half angle per sample, Q48
+static int32_t imufusion_ps32Bias[6];           // calibration in LSB, Q8
+static int32_t imufusion_s32GyroStep = 0;       // half angle per LSB and sample, Q40
+static int32_t imufusion_s32KpStep = 0;         // Kp * dt / 2, Q24
+static int32_t imufusion_s32KiStep = 0;         // Ki * dt^2 / 2, Q34
+#endif
+
+/******************************************************************************
+* Function Prototypes
+*******************************************************************************/
+static void imufusion_fromAccel(float p_fAx, float p_fAy, float p_fAz, float *p_pfQ);
+#if !BOARD_YARDFORCE500_VARIANT_B
+static int32_t imufusion_fixed(float p_fValue, uint8_t p_u8Shift);
+static uint32_t imufusion_sqrt(uint64_t p_u64Value);
+#endif
+
+/******************************************************************************
+*  Public Functions
+*******************************************************************************/
+
+/// @brief set the sample period, the scale and the calibration of the samples, keeps the orientation
+/// @param p_u16RateHz rate IMUFUSION_Update() is called at
+/// @param p_fGyroScale rad/sec per LSB
+/// @param p_pfBias calibration of accel X/Y/Z, gyro X/Y/Z in LSB
+/// @param p_fKp proportional gain of the accelerometer correction (1/sec)
+/// @param p_fKi integral gain of the gyro bias estimate (1/sec^2)
+void IMUFUSION_Config(uint16_t p_u16RateHz, float p_fGyroScale, const float *p_pfBias, float p_fKp, float p_fKi)
+{
+    float l_fDt = 1.0f / (p_u16RateHz ? p_u16RateHz : 1);
+    uint8_t i;
+
+#if BOARD_YARDFORCE500_VARIANT_B
+    for (i = 0; i < 6; i++)
+    {
+        imufusion_pfBias[i] = p_pfBias[i];
+    }
+    for (i = 0; i < 3; i++)
+    {
+        imufusion_pfIntegral[i] = 0.0f;
+    }
+    imufusion_fGyroScale = p_fGyroScale;
+    imufusion_fHalfDt = 0.5f * l_fDt;
+    imufusion_fKp = p_fKp;
+    imufusion_fKi = p_fKi;
+#else
+    for (i = 0; i < 6; i++)
+    {
+        imufusion_ps32Bias[i] = imufusion_fixed(p_pfBias[i], 8);
+    }
+    /* the integral is per sample, it does not carry over to another period */
+    for (i = 0; i < 3; i++)
+    {
+        imufusion_ps64Integral[i] = 0;
+    }
+    imufusion_s32GyroStep = imufusion_fixed(0.5f * l_fDt * p_fGyroScale, 40);
+    imufusion_s32KpStep = imufusion_fixed(0.5f * l_fDt * p_fKp, 24);
+    imufusion_s32KiStep = imufusion_fixed(0.5f * l_fDt * l_fDt * p_fKi, 34);
+#endif
+}
+
+/// @brief forget the orientation, the next sample sets roll and pitch from the accelerometer
+void IMUFUSION_Reset(void)
+{
+    uint8_t i;
+
+#if BOARD_YARDFORCE500_VARIANT_B
+    for (i = 0; i < 3; i++)
+    {
+        imufusion_pfIntegral[i] = 0.0f;
+    }
+#else
+    for (i = 0; i < 3; i++)
+    {
+        imufusion_ps64Integral[i] = 0;
+    }
+#endif
+    imufusion_bValid = 0;
+}
+
+#if BOARD_YARDFORCE500_VARIANT_B
+/// @brief filter one sample
+/// @param p_ps16Sample accel X/Y/Z, gyro X/Y/Z in LSB, uncalibrated
+void IMUFUSION_Update(const int16_t *p_ps16Sample)
+{
+    float *q = imufusion_pfQ;
+    float l_fAx = p_ps16Sample[0] - imufusion_pfBias[0];
+    float l_fAy = p_ps16Sample[1] - imufusion_pfBias[1];
+    float l_fAz = p_ps16Sample[2] - imufusion_pfBias[2];
+    float l_fGx = (p_ps16Sample[3] - imufusion_pfBias[3]) * imufusion_fGyroScale;
+    float l_fGy = (p_ps16Sample[4] - imufusion_pfBias[4]) * imufusion_fGyroScale;
+    float l_fGz = (p_ps16Sample[5] - imufusion_pfBias[5]) * imufusion_fGyroScale;
+    float l_fNorm, l_fVx, l_fVy, l_fVz, l_fEx, l_fEy, l_fEz;
+    float l_fQw, l_fQx, l_fQy;
+
+    l_fNorm = sqrtf(l_fAx * l_fAx + l_fAy * l_fAy + l_fAz * l_fAz);
+    if (l_fNorm > 0.0f)
+    {
+        if (!imufusion_bValid)
+        {
+            imufusion_fromAccel(l_fAx, l_fAy, l_fAz, q);
+            imufusion_bValid = 1;
+            return;
+        }
+        l_fAx /= l_fNorm;
+        l_fAy /= l_fNorm;
+        l_fAz /= l_fNorm;
+
+        /* gravity as the orientation sees it */
+        l_fVx = 2.0f * (q[1] * q[3] - q[0] * q[2]);
+        l_fVy = 2.0f * (q[0] * q[1] + q[2] * q[3]);
+        l_fVz = q[0] * q[0] - q[1] * q[1] - q[2] * q[2] + q[3] * q[3];
+
+        l_fEx = l_fAy * l_fVz - l_fAz * l_fVy;
+        l_fEy = l_fAz * l_fVx - l_fAx * l_fVz;
+        l_fEz = l_fAx * l_fVy - l_fAy * l_fVx;
+
+        imufusion_pfIntegral[0] += imufusion_fKi * l_fEx * 2.0f * imufusion_fHalfDt;
+        imufusion_pfIntegral[1] += imufusion_fKi * l_fEy * 2.0f * imufusion_fHalfDt;
+        imufusion_pfIntegral[2] += imufusion_fKi * l_fEz * 2.0f * imufusion_fHalfDt;
+
+        l_fGx += imufusion_fKp * l_fEx + imufusion_pfIntegral[0];
+        l_fGy += imufusion_fKp * l_fEy + imufusion_pfIntegral[1];
+        l_fGz += imufusion_fKp * l_fEz + imufusion_pfIntegral[2];
+    }
+    if (!imufusion_bValid)
+    {
+        return;
+    }
+
+    l_fGx *= imufusion_fHalfDt;
+    l_fGy *= imufusion_fHalfDt;
+    l_fGz *= imufusion_fHalfDt;
+    l_fQw = q[0];
+    l_fQx = q[1];
+    l_fQy = q[2];
+    q[0] += -l_fQx * l_fGx - l_fQy * l_fGy - q[3] * l_fGz;
+    q[1] += l_fQw * l_fGx + l_fQy * l_fGz - q[3] * l_fGy;
+    q[2] += l_fQw * l_fGy - l_fQx * l_fGz + q[3] * l_fGx;
+    q[3] += l_fQw * l_fGz + l_fQx * l_fGy - l_fQy * l_fGx;
+
+    l_fNorm = 1.0f / sqrtf(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+    q[0] *= l_fNorm;
+    q[1] *= l_fNorm;
+    q[2] *= l_fNorm;
+    q[3] *= l_fNorm;
+}
+
+/// @brief orientation of the IMU in the world frame
+/// @param p_pfQuaternion w, x, y, z
+/// @return 0 until the filter had an accelerometer reading
+uint8_t IMUFUSION_GetQuaternion(float *p_pfQuaternion)
+{
+    uint8_t i;
+
+    for (i = 0; i < 4; i++)
+    {
+        p_pfQuaternion[i] = imufusion_pfQ[i];
+    }
+    return imufusion_bValid;
+}
+#else
+/// @brief filter one sample
+/// @param p_ps16Sample accel X/Y/Z, gyro X/Y/Z in LSB, uncalibrated
+void IMUFUSION_Update(const int16_t *p_ps16Sample)
+{
+    int32_t *q = imufusion_ps32Q;
+    int32_t l_ps32A[3], l_ps32H[3];
+    int32_t l_s32Vx, l_s32Vy, l_s32Vz, l_s32Ex, l_s32Ey, l_s32Ez;
+    int32_t l_s32Qw, l_s32Qx, l_s32Qy, l_s32Norm;
+    uint32_t l_u32Norm;
+    uint8_t i;
+
+    for (i = 0; i < 3; i++)
+    {
+        l_ps32A[i] = (((int32_t)p_ps16Sample[i] << 8) - imufusion_ps32Bias[i]) >> 8;
+        /* Q8 LSB * Q40 >> 18 = Q30 */
+        l_ps32H[i] = (int32_t)(((int64_t)(((int32_t)p_ps16Sample[3 + i] << 8) - imufusion_ps32Bias[3 + i]) * imufusion_s32GyroStep) >> 18);
+    }
+
+    l_u32Norm = imufusion_sqrt((uint64_t)((int64_t)l_ps32A[0] * l_ps32A[0] + (int64_t)l_ps32A[1] * l_ps32A[1] + (int64_t)l_ps32A[2] * l_ps32A[2]));
+    if (l_u32Norm > 0)
+    {
+        if (!imufusion_bValid)
+        {
+            float l_pfQ[4];
+
+            imufusion_fromAccel(l_ps32A[0], l_ps32A[1], l_ps32A[2], l_pfQ);
+            for (i = 0; i < 4; i++)
+            {
+                q[i] = (int32_t)(l_pfQ[i] * IMUFUSION_Q30);
+            }
+            imufusion_bValid = 1;
+            return;
+        }
+        /* Q14, |a| is at most 2^16 so the shift fits 32 bit */
+        for (i = 0; i < 3; i++)
+        {
+            l_ps32A[i] = (l_ps32A[i] << 14) / (int32_t)l_u32Norm;
+        }
+
+        /* gravity as the orientation sees it, Q30 */
+        l_s32Vx = (int32_t)(((int64_t)q[1] * q[3] - (int64_t)q[0] * q[2]) >> 29);
+        l_s32Vy = (int32_t)(((int64_t)q[0] * q[1] + (int64_t)q[2] * q[3]) >> 29);
+        l_s32Vz = (int32_t)(((int64_t)q[0] * q[0] - (int64_t)q[1] * q[1] - (int64_t)q[2] * q[2] + (int64_t)q[3] * q[3]) >> 30);
+
+        /* Q14 * Q30 >> 14 = Q30 */
+        l_s32Ex = (int32_t)(((int64_t)l_ps32A[1] * l_s32Vz - (int64_t)l_ps32A[2] * l_s32Vy) >> 14);
+        l_s32Ey = (int32_t)(((int64_t)l_ps32A[2] * l_s32Vx - (int64_t)l_ps32A[0] * l_s32Vz) >> 14);
+        l_s32Ez = (int32_t)(((int64_t)l_ps32A[0] * l_s32Vy - (int64_t)l_ps32A[1] * l_s32Vx) >> 14);
+
+        /* the increments are far below 1 LSB of Q30, truncated there they would all round down */
+        imufusion_ps64Integral[0] += ((int64_t)l_s32Ex * imufusion_s32KiStep) >> 16;
+        imufusion_ps64Integral[1] += ((int64_t)l_s32Ey * imufusion_s32KiStep) >> 16;
+        imufusion_ps64Integral[2] += ((int64_t)l_s32Ez * imufusion_s32KiStep) >> 16;
+
+        l_ps32H[0] += (int32_t)(((int64_t)l_s32Ex * imufusion_s32KpStep) >> 24) + (int32_t)(imufusion_ps64Integral[0] >> 18);
+        l_ps32H[1] += (int32_t)(((int64_t)l_s32Ey * imufusion_s32KpStep) >> 24) + (int32_t)(imufusion_ps64Integral[1] >> 18);
+        l_ps32H[2] += (int32_t)(((int64_t)l_s32Ez * imufusion_s32KpStep) >> 24) + (int32_t)(imufusion_ps64Integral[2] >> 18);
+    }
+    if (!imufusion_bValid)
+    {
+        return;
+    }
+
+    l_s32Qw = q[0];
+    l_s32Qx = q[1];
+    l_s32Qy = q[2];
+    q[0] += (int32_t)((-(int64_t)l_s32Qx * l_ps32H[0] - (int64_t)l_s32Qy * l_ps32H[1] - (int64_t)q[3] * l_ps32H[2]) >> 30);
+    q[1] += (int32_t)(((int64_t)l_s32Qw * l_ps32H[0] + (int64_t)l_s32Qy * l_ps32H[2] - (int64_t)q[3] * l_ps32H[1]) >> 30);
+    q[2] += (int32_t)(((int64_t)l_s32Qw * l_ps32H[1] - (int64_t)l_s32Qx * l_ps32H[2] + (int64_t)q[3] * l_ps32H[0]) >> 30);
+    q[3] += (int32_t)(((int64_t)l_s32Qw * l_ps32H[2] + (int64_t)l_s32Qx * l_ps32H[1] - (int64_t)l_s32Qy * l_ps32H[0]) >> 30);
+
+    /* the norm stays close to 1: 1/sqrt(n) ~ (3 - n) / 2 */
+    l_s32Norm = (int32_t)(((int64_t)q[0] * q[0] + (int64_t)q[1] * q[1] + (int64_t)q[2] * q[2] + (int64_t)q[3] * q[3]) >> 30);
+    l_s32Norm = (int32_t)(((3LL << 30) - l_s32Norm) >> 1);
+    for (i = 0; i < 4; i++)
+    {
+        q[i] = (int32_t)(((int64_t)q[i] * l_s32Norm) >> 30);
+    }
+}
+
+/// @brief orientation of the IMU in the world frame
+/// @param p_pfQuaternion w, x, y, z
+/// @return 0 until the filter had an accelerometer reading
+uint8_t IMUFUSION_GetQuaternion(float *p_pfQuaternion)
+{
+    uint8_t i;
+
+    for (i = 0; i < 4; i++)
+    {
+        p_pfQuaternion[i] = imufusion_ps32Q[i] / IMUFUSION_Q30;
+    }
+    return imufusion_bValid;
+}
+#endif
+
+/******************************************************************************
+*  Private Functions
+*******************************************************************************/
+
+/// @brief roll and pitch from the gravity vector, yaw 0
+static void imufusion_fromAccel(float p_fAx, float p_fAy, float p_fAz, float *p_pfQ)
+{
+    float l_fRoll = 0.5f * atan2f(p_fAy, p_fAz);
+    float l_fPitch = 0.5f * atan2f(-p_fAx, sqrtf(p_fAy * p_fAy + p_fAz * p_fAz));
+    float l_fCr = cosf(l_fRoll), l_fSr = sinf(l_fRoll);
+    float l_fCp = cosf(l_fPitch), l_fSp = sinf(l_fPitch);
+
+    p_pfQ[0] = l_fCr * l_fCp;
+    p_pfQ[1] = l_fSr * l_fCp;
+    p_pfQ[2] = l_fCr * l_fSp;
+    p_pfQ[3] = -l_fSr * l_fSp;
+}
+
+#if !BOARD_YARDFORCE500_VARIANT_B
+/// @brief p_fValue * 2^p_u8Shift, saturated to 32 bit
+static int32_t imufusion_fixed(float p_fValue, uint8_t p_u8Shift)
+{
+    float l_fValue = ldexpf(p_fValue, p_u8Shift);
+
+    if (l_fValue >= 2147483520.0f)
+    {
+        return INT32_MAX;
+    }
+    if (l_fValue <= -2147483520.0f)
+    {
+        return -INT32_MAX;
+    }
+    return (int32_t)lroundf(l_fValue);
+}
+
+/// @brief integer square root
+static uint32_t imufusion_sqrt(uint64_t p_u64Value)
+{
+    uint64_t l_u64Bit = 1ULL << 62;
+    uint64_t l_u64Root = 0;
+
+    while (l_u64Bit > p_u64Value)
+    {
+        l_u64Bit >>= 2;
+    }
+    while (l_u64Bit != 0)
+    {
+        if (p_u64Value >= l_u64Root + l_u64Bit)
+        {
+            p_u64Value -= l_u64Root + l_u64Bit;
+            l_u64Root = (l_u64Root >> 1) + l_u64Bit;
+        }
+        else
+        {
+            l_u64Root >>= 1;
+        }
+        l_u64Bit >>= 2;
+    }
+    return (uint32_t)l_u64Root;
+}
+#endif
+
+/*** End of File **************************************************************/
@@ -21,11 +21,59 @@
 #include "soft_i2c.h"
 #include "main.h"
 #include <math.h>
+#include <string.h>
 
 #ifndef DISABLE_LSM6
 
 uint8_t lsm6_address = LSM6_SA0_LOW_ADDRESS;
 
+/* LSM6DS33 FIFO: 16 bit words, the pattern of a sample is gyro X/Y/Z then accel X/Y/Z */
+static uint16_t lsm6_ds33FifoEntries(const uint8_t *p_pu8Status);
+static uint8_t lsm6_ds33FifoEntry(const uint8_t *p_pu8Entry, int16_t *p_ps16Sample);
+static const IMU_Fifo_t lsm6_ds33Fifo = {
+    .u8StatusRegister = LSM6_FIFO_STATUS1,
+    .u8StatusLength = 4,
+    .u8DataRegister = LSM6_FIFO_DATA_OUT_L,
+    .u8EntryLength = 2,
+    .u16RateHz = 208,
+    .pfEntries = lsm6_ds33FifoEntries,
+    .pfEntry = lsm6_ds33FifoEntry
+};
+
+/* LSM6DSO FIFO: a tag and the X/Y/Z words of either the gyro or the accel */
+static uint16_t lsm6_dsoFifoEntries(const uint8_t *p_pu8Status);
+static uint8_t lsm6_dsoFifoEntry(const uint8_t *p_pu8Entry, int16_t *p_ps16Sample);
+static const IMU_Fifo_t lsm6_dsoFifo = {
+    .u8StatusRegister = LSM6_FIFO_STATUS1,
+    .u8StatusLength = 2,
+    .u8DataRegister = LSM6DSO_FIFO_DATA_OUT_TAG,
+    .u8EntryLength = 7,
+    .u16RateHz = 208,
+    .pfEntries = lsm6_dsoFifoEntries,
+    .pfEntry = lsm6_dsoFifoEntry
+};
+
+/* sample being assembled from the FIFO, accel X/Y/Z then gyro X/Y/Z */
+static int16_t lsm6_ps16Sample[6];
+static uint8_t lsm6_u8Word = 0;         /* LSM6DS33 pattern position */
+static uint8_t lsm6_u8Valid = 0;        /* words (LSM6DS33) or vectors (LSM6DSO) in lsm6_ps16Sample */
+
+/* one burst from OUT_TEMP_L: temperature, gyro X/Y/Z, accel X/Y/Z, little endian */
+static IMU_RegisterMap_t lsm6_map = {
+    .u8Address = LSM6_SA0_LOW_ADDRESS,
+    .u8Register = LSM6_OUT_TEMP_L,
+    .u8Length = 14,
+    .bBigEndian = 0,
+    .s8Accel = LSM6_OUTX_L_XL - LSM6_OUT_TEMP_L,
+    .s8Gyro = LSM6_OUTX_L_G - LSM6_OUT_TEMP_L,
+    .s8Temp = 0,
+    .fAccelScale = LSM6_G_FACTOR * MS2_PER_G,
+    .fGyroScale = LSM6_DPS_FACTOR * RAD_PER_G,
+    .fTempScale = LSM6_DS33_T_FACTOR,
+    .fTempOffset = 25.0f,
+    .psFifo = &lsm6_ds33Fifo
+};
+
 
 /**
   * @brief  Test Device 
@@ -47,11 +95,15 @@ uint8_t LSM6_TestDevice(void)
     {
         debug_printf("    > [LSM6] - LSM6DS33 (Gyro / Accelerometer) FOUND at I2C addr=0x%0x\r\n", LSM6_SA0_LOW_ADDRESS);
         lsm6_address = LSM6_SA0_LOW_ADDRESS;
+        lsm6_map.fTempScale = LSM6_DS33_T_FACTOR;
+        lsm6_map.psFifo = &lsm6_ds33Fifo;
         return 1;
     } else if (val == DSO_WHO_ID)
     {
         debug_printf("    > [LSM6] - LSM6DSO (Gyro / Accelerometer) FOUND at I2C addr=0x%0x\r\n", LSM6_SA0_LOW_ADDRESS);
         lsm6_address = LSM6_SA0_LOW_ADDRESS;
+        lsm6_map.fTempScale = LSM6_DSO_T_FACTOR;
+        lsm6_map.psFifo = &lsm6_dsoFifo;
         return 1;
     }
 
@@ -61,11 +113,15 @@ uint8_t LSM6_TestDevice(void)
     {
         debug_printf("    > [LSM6] - LSM6DS33 (Gyro / Accelerometer) FOUND at I2C addr=0x%0x\r\n", LSM6_SA0_HIGH_ADDRESS);
         lsm6_address = LSM6_SA0_HIGH_ADDRESS;
+        lsm6_map.fTempScale = LSM6_DS33_T_FACTOR;
+        lsm6_map.psFifo = &lsm6_ds33Fifo;
         return 1;
     } else if (val == DSO_WHO_ID)
     {
         debug_printf("    > [LSM6] - LSM6DSO (Gyro / Accelerometer) FOUND at I2C addr=0x%0x\r\n", LSM6_SA0_HIGH_ADDRESS);
         lsm6_address = LSM6_SA0_HIGH_ADDRESS;
+        lsm6_map.fTempScale = LSM6_DSO_T_FACTOR;
+        lsm6_map.psFifo = &lsm6_dsoFifo;
         return 1;
     }
 
@@ -84,59 +140,120 @@ void LSM6_Init(void)
     /*******************************/
 
     // ACCLEROMETER
-    // 0x80 = 0b10000000
-    // ODR = 1000 (1.66 kHz (high performance)); FS_XL = 00 (+/-2 g full scale)
-    SW_I2C_UTIL_WRITE(lsm6_address, LSM6_CTRL1_XL, 0x80);
+    // 0x50 = 0b01010000
+    // ODR = 0101 (208 Hz); FS_XL = 00 (+/-2 g full scale)
+    // the soft I2C bus (100 kHz) can't drain the FIFO at a higher rate
+    SW_I2C_UTIL_WRITE(lsm6_address, LSM6_CTRL1_XL, 0x50);
     // GYRO
-    // 0x80 = 0b010000000
-    // ODR = 1000 (1.66 kHz (high performance)); FS_XL = 00 (245 degree per s)
-    SW_I2C_UTIL_WRITE(lsm6_address, LSM6_CTRL2_G, 0x80);
+    // 0x50 = 0b01010000
+    // ODR = 0101 (208 Hz); FS_G = 00 (245 degree per s)
+    SW_I2C_UTIL_WRITE(lsm6_address, LSM6_CTRL2_G, 0x50);
     // ACCELEROMETER + GYRO
     // 0x04 = 0b00000100
     // IF_INC = 1 (automatically increment register address)
     SW_I2C_UTIL_WRITE(lsm6_address, LSM6_CTRL3_C, 0x04);   
+
+    // FIFO, continuous mode, overwritten when full
+    if (lsm6_map.psFifo == &lsm6_dsoFifo)
+    {
+        // BDR_GY = BDR_XL = 0101 (208 Hz)
+        SW_I2C_UTIL_WRITE(lsm6_address, LSM6DSO_FIFO_CTRL3, 0x55);
+        // FIFO_MODE = 110 (continuous)
+        SW_I2C_UTIL_WRITE(lsm6_address, LSM6DSO_FIFO_CTRL4, 0x06);
+    }
+    else
+    {
+        // DEC_FIFO_GYRO = DEC_FIFO_XL = 001 (every sample)
+        SW_I2C_UTIL_WRITE(lsm6_address, LSM6_FIFO_CTRL3, 0x09);
+        // ODR_FIFO = 0101 (208 Hz); FIFO_MODE = 110 (continuous)
+        SW_I2C_UTIL_WRITE(lsm6_address, LSM6_FIFO_CTRL5, 0x2E);
+    }
+    lsm6_u8Word = lsm6_u8Valid = 0;
 }
 
 /**
-  * @brief  Reads the 3 accelerometer channels and stores them in *x,*y,*z
-  * units are m/s^2
+  * @brief  Register map of the accel, gyro and temperature burst read
+  * units are m/s^2, rad/sec and °C
   */
-void LSM6_ReadAccelerometerRaw(float *x, float *y, float *z)
+const IMU_RegisterMap_t *LSM6_GetRegisterMap(void)
+{
+    lsm6_map.u8Address = lsm6_address;
+    return(&lsm6_map);
+}
+
+/**
+  * @brief  LSM6DS33 FIFO level from FIFO_STATUS1..4
+  * the pattern (next word to be read) resynchronizes the sample assembly after an overrun
+  */
+static uint16_t lsm6_ds33FifoEntries(const uint8_t *p_pu8Status)
+{
+    uint8_t l_u8Word = ((p_pu8Status[3] & 0x03) << 8 | p_pu8Status[2]) % 6;
+
+    if (l_u8Word != lsm6_u8Word)
+    {
+        lsm6_u8Word = l_u8Word;
+        lsm6_u8Valid = 0;
+    }
+    return (p_pu8Status[1] & 0x0F) << 8 | p_pu8Status[0];
+}
+
+static uint8_t lsm6_ds33FifoEntry(const uint8_t *p_pu8Entry, int16_t *p_ps16Sample)
 {
-    uint8_t accel_xyz[6];   // 2 bytes each
+    // gyro words come first
+    uint8_t l_u8Index = lsm6_u8Word < 3 ? lsm6_u8Word + 3 : lsm6_u8Word - 3;
 
-    uint8_t acked = SW_I2C_UTIL_Read_Multi(lsm6_address, LSM6_OUTX_L_XL, 6, (uint8_t*)&accel_xyz);
-/*
-    uint8_t i;
-    debug_printf("IMU_ReadAccelerometer Raw Bytes: ");
-    for (i=0;i<6;i++)
+    lsm6_ps16Sample[l_u8Index] = (int16_t)(p_pu8Entry[1] << 8 | p_pu8Entry[0]);
+    lsm6_u8Valid |= 1 << l_u8Index;
+    if (++lsm6_u8Word < 6)
     {
-      debug_printf("%02x ", accel_xyz[i]);
+        return 0;
     }
-    debug_printf("\r\n");
-*/
-    if(acked) {
-        *x =  (int16_t)(accel_xyz[1] << 8 | accel_xyz[0]) * LSM6_G_FACTOR * MS2_PER_G;
-        *y =  (int16_t)(accel_xyz[3] << 8 | accel_xyz[2]) * LSM6_G_FACTOR * MS2_PER_G;
-        *z =  (int16_t)(accel_xyz[5] << 8 | accel_xyz[4]) * LSM6_G_FACTOR * MS2_PER_G;    
+    lsm6_u8Word = 0;
+    if (lsm6_u8Valid != 0x3F)
+    {
+        lsm6_u8Valid = 0;
+        return 0;
     }
+    lsm6_u8Valid = 0;
+    memcpy(p_ps16Sample, lsm6_ps16Sample, sizeof(lsm6_ps16Sample));
+    return 1;
 }
 
 /**
-  * @brief  Reads the 3 gyro channels and stores them in *x,*y,*z
-  * units are rad/sec
+  * @brief  LSM6DSO FIFO level from FIFO_STATUS1..2
   */
-void LSM6_ReadGyroRaw(float *x, float *y, float *z)
+static uint16_t lsm6_dsoFifoEntries(const uint8_t *p_pu8Status)
 {
-    uint8_t gyro_xyz[6];   // 2 bytes each
-
-    uint8_t acked = SW_I2C_UTIL_Read_Multi(lsm6_address, LSM6_OUTX_L_G, 6, (uint8_t*)&gyro_xyz);
-    
-    if(acked) {
-      *x = (int16_t)(gyro_xyz[1] << 8 | gyro_xyz[0]) * LSM6_DPS_FACTOR * RAD_PER_G;
-      *y = (int16_t)(gyro_xyz[3] << 8 | gyro_xyz[2]) * LSM6_DPS_FACTOR * RAD_PER_G;
-      *z = (int16_t)(gyro_xyz[5] << 8 | gyro_xyz[4]) * LSM6_DPS_FACTOR * RAD_PER_G;    
+    return (p_pu8Status[1] & 0x03) << 8 | p_pu8Status[0];
+}
+
+static uint8_t lsm6_dsoFifoEntry(const uint8_t *p_pu8Entry, int16_t *p_ps16Sample)
+{
+    uint8_t l_u8Offset, i;
+
+    switch (p_pu8Entry[0] >> 3)
+    {
+    case LSM6DSO_TAG_ACCEL:
+        l_u8Offset = 0;
+        break;
+    case LSM6DSO_TAG_GYRO:
+        l_u8Offset = 3;
+        break;
+    default:
+        return 0;
+    }
+    for (i = 0; i < 3; i++)
+    {
+        lsm6_ps16Sample[l_u8Offset + i] = (int16_t)(p_pu8Entry[2 + 2 * i] << 8 | p_pu8Entry[1 + 2 * i]);
+    }
+    lsm6_u8Valid |= l_u8Offset ? 0x02 : 0x01;
+    if (lsm6_u8Valid != 0x03)
+    {
+        return 0;
     }
+    lsm6_u8Valid = 0;
+    memcpy(p_ps16Sample, lsm6_ps16Sample, sizeof(lsm6_ps16Sample));
+    return 1;
 }
 
 #endif
\ No newline at end of file
@@ -9,6 +9,7 @@
 #define MPU6050_SMPRT_DIV    0x19
 #define MPU6050_CONFIG       0x1a
 #define MPU6050_ACCEL_XOUT_H 0x3b
+#define MPU6050_TEMP_OUT_H   0x41
 #define MPU6050_GYRO_XOUT_H  0x43
 #define MPU6050_PWR_MGMT_1   0x6b
 #define MPU6050_WHO_AM_I     0x75
@@ -18,9 +19,26 @@
 
 #define MPU6050_DPS_FACTOR (1/131.0)
 #define MPU6050_G_FACTOR   (1/16384.0)
+#define MPU6050_T_FACTOR   (1/340.0)        // MPU-6050: 340 LSB/°C, 0 LSB = 36.53°C
+#define MPU6500_T_FACTOR   (1/333.87)       // MPU-6500/9250: 333.87 LSB/°C, 0 LSB = 21°C
 
 #ifndef DISABLE_MPU6050
 
+/* one burst from ACCEL_XOUT_H: accel X/Y/Z, temperature, gyro X/Y/Z, big endian */
+static IMU_RegisterMap_t mpu6050_map = {
+    .u8Address = MPU6050_ADDRESS,
+    .u8Register = MPU6050_ACCEL_XOUT_H,
+    .u8Length = 14,
+    .bBigEndian = 1,
+    .s8Accel = 0,
+    .s8Gyro = MPU6050_GYRO_XOUT_H - MPU6050_ACCEL_XOUT_H,
+    .s8Temp = MPU6050_TEMP_OUT_H - MPU6050_ACCEL_XOUT_H,
+    .fAccelScale = MPU6050_G_FACTOR * MS2_PER_G,
+    .fGyroScale = MPU6050_DPS_FACTOR * RAD_PER_G,
+    .fTempScale = MPU6050_T_FACTOR,
+    .fTempOffset = 36.53f
+};
+
 /**
   * @brief  Test Device 
   * Perform any tests possible before actually enabling and using the device,
@@ -33,15 +51,21 @@ uint8_t MPU6050_TestDevice(void)
   uint8_t  val;
   /* Test who am I */
   val = SW_I2C_UTIL_Read(MPU6050_ADDRESS,MPU6050_WHO_AM_I);
-  if (val == MPU6500_WHO_AM_I ||  val == MPU6050_ADDRESS || val == MPU9255_WHO_AM_I || val == MPU9250_WHO_AM_I) return 1;
+  if (val == MPU6050_ADDRESS) return 1;
+  if (val == MPU6500_WHO_AM_I || val == MPU9255_WHO_AM_I || val == MPU9250_WHO_AM_I)
+  {
+    mpu6050_map.fTempScale = MPU6500_T_FACTOR;
+    mpu6050_map.fTempOffset = 21.0f;
+    return 1;
+  }
   debug_printf("    > [MPU-6050] - Error probing for (Gyro / Accelerometer) at I2C addr=0x%0x %x\r\n", MPU6050_ADDRESS,val);
   return 0;
 }
 
 void MPU6050_Init(void)
 {
-  // Disable temperature sensor, use gyroscope clock
-  SW_I2C_UTIL_WRITE(MPU6050_ADDRESS, MPU6050_PWR_MGMT_1, 0b00001001);
+  // Enable temperature sensor (part of the sample burst), use gyroscope clock
+  SW_I2C_UTIL_WRITE(MPU6050_ADDRESS, MPU6050_PWR_MGMT_1, 0b00000001);
   // Low pass filter 10 Hz
   SW_I2C_UTIL_WRITE(MPU6050_ADDRESS, MPU6050_CONFIG, 0x5);
   // Sample rate divider 10 (=> 1 kHz/(9+1) = 100 Hz)
@@ -51,33 +75,12 @@ void MPU6050_Init(void)
 }
 
 /**
-  * @brief  Reads the 3 accelerometer channels and stores them in *x,*y,*z
-  * units are m/s^2
+  * @brief  Register map of the accel, gyro and temperature burst read
+  * units are m/s^2, rad/sec and °C
   */
-void MPU6050_ReadAccelerometerRaw(float *x, float *y, float *z)
+const IMU_RegisterMap_t *MPU6050_GetRegisterMap(void)
 {
-    uint8_t accel_xyz[6];   // 2 bytes each
-
-    SW_I2C_UTIL_Read_Multi(MPU6050_ADDRESS, MPU6050_ACCEL_XOUT_H, 6, (uint8_t*)&accel_xyz);
-
-    *x =  (int16_t)(accel_xyz[0] << 8 | accel_xyz[1]) * MPU6050_G_FACTOR * MS2_PER_G;
-    *y =  (int16_t)(accel_xyz[2] << 8 | accel_xyz[3]) * MPU6050_G_FACTOR * MS2_PER_G;
-    *z =  (int16_t)(accel_xyz[4] << 8 | accel_xyz[5]) * MPU6050_G_FACTOR * MS2_PER_G;    
-}
-
-/**
-  * @brief  Reads the 3 gyro channels and stores them in *x,*y,*z
-  * units are rad/sec
-  */
-void MPU6050_ReadGyroRaw(float *x, float *y, float *z)
-{
-    uint8_t gyro_xyz[6];   // 2 bytes each
-
-    SW_I2C_UTIL_Read_Multi(MPU6050_ADDRESS, MPU6050_GYRO_XOUT_H, 6, (uint8_t*)&gyro_xyz);
-    
-    *x = (int16_t)(gyro_xyz[0] << 8 | gyro_xyz[1]) * MPU6050_DPS_FACTOR * RAD_PER_G;
-    *y = (int16_t)(gyro_xyz[2] << 8 | gyro_xyz[3]) * MPU6050_DPS_FACTOR * RAD_PER_G;
-    *z = (int16_t)(gyro_xyz[4] << 8 | gyro_xyz[5]) * MPU6050_DPS_FACTOR * RAD_PER_G;    
+    return(&mpu6050_map);
 }
 
 #endif
@@ -31,9 +31,9 @@
 *******************************************************************************/
 #define WT901_ADDRESS 0x50
 
-#define WT901_G_FACTOR 16/32768
-#define WT901_DPS_FACTOR 2000.0f/32768.0f
-#define WT901_T_FACTOR 0.00000015f    
+#define WT901_G_FACTOR (16.0f/32768.0f)
+#define WT901_DPS_FACTOR (2000.0f/32768.0f)
+#define WT901_TEMP_FACTOR (1.0f/100.0f)
 
 #define DIO_MODE_AIN 0
 #define DIO_MODE_DIN 1
@@ -117,6 +117,21 @@ typedef enum {
 /******************************************************************************
 * Module Variable Definitions
 *******************************************************************************/
+/* one burst from AX, each register is a 16 bit word: accel X/Y/Z, gyro X/Y/Z,
+ * magnetometer, angles and temperature, little endian */
+static const IMU_RegisterMap_t wt901_map = {
+    .u8Address = WT901_ADDRESS,
+    .u8Register = AX,
+    .u8Length = (TEMP - AX + 1) * 2,
+    .bBigEndian = 0,
+    .s8Accel = 0,
+    .s8Gyro = (GX - AX) * 2,
+    .s8Temp = (TEMP - AX) * 2,
+    .fAccelScale = WT901_G_FACTOR * MS2_PER_G,
+    .fGyroScale = WT901_DPS_FACTOR * RAD_PER_G,
+    .fTempScale = WT901_TEMP_FACTOR,
+    .fTempOffset = 0.0f
+};
 
 /******************************************************************************
 * Function Prototypes
@@ -168,50 +183,12 @@ void WT901_Init(void)
 }
 
 /**
-  * @brief  Reads the 3 accelerometer channels and stores them in *x,*y,*z
-  * units are m/s^2
+  * @brief  Register map of the accel, gyro and temperature burst read
+  * units are m/s^2, rad/sec and °C
   */
-void WT901_ReadAccelerometerRaw(float *x, float *y, float *z)
+const IMU_RegisterMap_t *WT901_GetRegisterMap(void)
 {
-    uint8_t accel_xyz[6];   // 2 bytes each
-
-    SW_I2C_UTIL_Read_Multi(WT901_ADDRESS, AX, 6, (uint8_t*)accel_xyz);
-
-    *x =  (float)(int16_t)(accel_xyz[1] << 8 | accel_xyz[0]) * WT901_G_FACTOR * MS2_PER_G;
-    *y =  (float)(int16_t)(accel_xyz[3] << 8 | accel_xyz[2]) * WT901_G_FACTOR * MS2_PER_G;
-    *z =  (float)(int16_t)(accel_xyz[5] << 8 | accel_xyz[4]) * WT901_G_FACTOR * MS2_PER_G;    
-}
-
-/**
-  * @brief  Reads the 3 gyro channels and stores them in *x,*y,*z
-  * units are rad/sec
-  */
-void WT901_ReadGyroRaw(float *x, float *y, float *z)
-{
-    uint8_t gyro_xyz[6];   // 2 bytes each
-
-    SW_I2C_UTIL_Read_Multi(WT901_ADDRESS, GX, 6, (uint8_t*)&gyro_xyz);
-    
-    *x = (float)(int16_t)(gyro_xyz[1] << 8 | gyro_xyz[0]) * WT901_DPS_FACTOR * RAD_PER_G;
-    *y = (float)(int16_t)(gyro_xyz[3] << 8 | gyro_xyz[2]) * WT901_DPS_FACTOR * RAD_PER_G;
-    *z = (float)(int16_t)(gyro_xyz[5] << 8 | gyro_xyz[4]) * WT901_DPS_FACTOR * RAD_PER_G;    
-}
-
-/**
-  * @brief  Reads the raw temp value
-  * (internal function only)
-  * @retval float temp in °C
-  */
-float WT901_TempRaw(void)
-{
-    uint8_t temp[2];   
-    float retval; // temp
-    
-    // assert MSB to enable register address auto-increment
-    SW_I2C_UTIL_Read_Multi(WT901_ADDRESS, TEMP, 2, (uint8_t*)&temp);
-
-    retval = (float)(temp[1] << 8 | temp[0])/100;
-    return(retval);    
+    return(&wt901_map);
 }
 
 #endif
\ No newline at end of file
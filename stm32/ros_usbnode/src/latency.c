@@ -0,0 +1,229 @@
+/****************************************************************************
+* Title                 :   latency probes
+* Filename              :   latency.c
+* Author                :
+* Origin Date           :
+* Version               :   1.0.0
+
+*****************************************************************************/
+/** \file latency.c
+*  \brief trigger to motor frame latency histograms
+*
+*  A probe is armed by its trigger (emergency interrupt, rosserial callback)
+*  or from a timestamp taken earlier (first edge of a debounced input),
+*  and stopped by the UART engine when the DMA starts to send the first motor
+*  frame queued after the trigger which answers it, see UARTFRAME_TransmitProbe().
+*  Only the first trigger arms a probe, the following ones are ignored until
+*  the frame goes out. The timestamps come from the DWT cycle counter.
+*/
+/******************************************************************************
+* Includes
+*******************************************************************************/
+#include <string.h>
+
+#include "stm32f_board_hal.h"
+
+#include "main.h"
+#include "latency.h"
+
+#if LATENCY_PROBES
+/******************************************************************************
+* Module Preprocessor Constants
+*******************************************************************************/
+/* the cycle counter wraps after 59s at 72MHz, longer latencies are measured in ms */
+#define LATENCY_CYCLES_MAX_MS 50000
+
+/******************************************************************************
+* Module Preprocessor Macros
+*******************************************************************************/
+
+/******************************************************************************
+* Module Typedefs
+*******************************************************************************/
+typedef struct
+{
+    uint8_t bArmed;
+    uint32_t u32StartCycles;
+    uint32_t u32StartTick;
+    uint32_t u32Count;
+    uint32_t u32Min;        /* µs */
+    uint32_t u32Max;        /* µs */
+    uint64_t u64Sum;        /* µs */
+    uint32_t pu32Buckets[LATENCY_BUCKETS];
+} LATENCY_probe_t;
+
+/******************************************************************************
+* Module Variable Definitions
+*******************************************************************************/
+static LATENCY_probe_t latency_psProbes[LATENCY_PROBE_MAX];
+static uint32_t latency_u32CyclesPerUs = 72;
+
+/******************************************************************************
+* Function Prototypes
+*******************************************************************************/
+static void latency_record(LATENCY_probe_t *p_psProbe, uint32_t p_u32Us);
+
+/******************************************************************************
+*  Public Functions
+*******************************************************************************/
+
+/// @brief start the DWT cycle counter
+/// @param
+void LATENCY_Init(void)
+{
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    latency_u32CyclesPerUs = SystemCoreClock / 1000000;
+    LATENCY_Reset();
+}
+
+/// @brief arm the probes now, the ones already armed keep their first timestamp, interrupt safe
+/// @param p_u8Mask LATENCY_MASK() of the probes
+void LATENCY_Start(uint8_t p_u8Mask)
+{
+    LATENCY_Stamp_t l_sStamp;
+
+    LATENCY_Stamp(&l_sStamp);
+    LATENCY_StartAt(p_u8Mask, &l_sStamp);
+}
+
+/// @brief take a timestamp for LATENCY_StartAt()
+/// @param p_psStamp timestamp
+void LATENCY_Stamp(LATENCY_Stamp_t *p_psStamp)
+{
+    p_psStamp->u32Cycles = DWT->CYCCNT;
+    p_psStamp->u32Tick = HAL_GetTick();
+}
+
+/// @brief arm the probes from an earlier timestamp, the ones already armed keep theirs, interrupt safe
+/// @param p_u8Mask LATENCY_MASK() of the probes
+/// @param p_psStamp time of the trigger
+void LATENCY_StartAt(uint8_t p_u8Mask, const LATENCY_Stamp_t *p_psStamp)
+{
+    uint32_t l_u32Primask = __get_PRIMASK();
+    uint8_t l_u8Probe;
+
+    __disable_irq();
+    for (l_u8Probe = 0; l_u8Probe < LATENCY_PROBE_MAX; l_u8Probe++)
+    {
+        if ((p_u8Mask & LATENCY_MASK(l_u8Probe)) && !latency_psProbes[l_u8Probe].bArmed)
+        {
+            latency_psProbes[l_u8Probe].bArmed = 1;
+            latency_psProbes[l_u8Probe].u32StartCycles = p_psStamp->u32Cycles;
+            latency_psProbes[l_u8Probe].u32StartTick = p_psStamp->u32Tick;
+        }
+    }
+    __set_PRIMASK(l_u32Primask);
+}
+
+/// @brief probes waiting for their frame
+/// @param p_u8Mask LATENCY_MASK() of the probes to check
+/// @retval armed probes of p_u8Mask
+uint8_t LATENCY_Armed(uint8_t p_u8Mask)
+{
+    uint8_t l_u8Armed = 0;
+    uint8_t l_u8Probe;
+
+    for (l_u8Probe = 0; l_u8Probe < LATENCY_PROBE_MAX; l_u8Probe++)
+    {
+        if ((p_u8Mask & LATENCY_MASK(l_u8Probe)) && latency_psProbes[l_u8Probe].bArmed)
+        {
+            l_u8Armed |= LATENCY_MASK(l_u8Probe);
+        }
+    }
+    return l_u8Armed;
+}
+
+/// @brief the frame of the probes starts, record their latency, called by the UART engine with the interrupts disabled
+/// @param p_u8Mask LATENCY_MASK() of the probes
+void LATENCY_StopIT(uint8_t p_u8Mask)
+{
+    uint32_t l_u32Cycles = DWT->CYCCNT;
+    uint32_t l_u32Tick = HAL_GetTick();
+    LATENCY_probe_t *l_psProbe;
+    uint8_t l_u8Probe;
+
+    for (l_u8Probe = 0; l_u8Probe < LATENCY_PROBE_MAX; l_u8Probe++)
+    {
+        l_psProbe = &latency_psProbes[l_u8Probe];
+        if (!(p_u8Mask & LATENCY_MASK(l_u8Probe)) || !l_psProbe->bArmed)
+        {
+            continue;
+        }
+        l_psProbe->bArmed = 0;
+        if ((l_u32Tick - l_psProbe->u32StartTick) < LATENCY_CYCLES_MAX_MS)
+        {
+            latency_record(l_psProbe, (l_u32Cycles - l_psProbe->u32StartCycles) / latency_u32CyclesPerUs);
+        }
+        else
+        {
+            latency_record(l_psProbe, (l_u32Tick - l_psProbe->u32StartTick) * 1000);
+        }
+    }
+}
+
+/// @brief copy the histograms
+/// @param p_pu32Data LATENCY_PROBE_MAX * LATENCY_PROBE_LENGTH values, for every probe
+///        count, min, max, sum (low, high) then the LATENCY_BUCKETS buckets
+void LATENCY_Export(uint32_t *p_pu32Data)
+{
+    uint32_t l_u32Primask;
+    uint8_t l_u8Probe;
+
+    for (l_u8Probe = 0; l_u8Probe < LATENCY_PROBE_MAX; l_u8Probe++)
+    {
+        const LATENCY_probe_t *l_psProbe = &latency_psProbes[l_u8Probe];
+
+        l_u32Primask = __get_PRIMASK();
+        __disable_irq();
+        p_pu32Data[0] = l_psProbe->u32Count;
+        p_pu32Data[1] = l_psProbe->u32Count ? l_psProbe->u32Min : 0;
+        p_pu32Data[2] = l_psProbe->u32Max;
+        p_pu32Data[3] = (uint32_t)l_psProbe->u64Sum;
+        p_pu32Data[4] = (uint32_t)(l_psProbe->u64Sum >> 32);
+        memcpy(&p_pu32Data[LATENCY_STATS], l_psProbe->pu32Buckets, sizeof(l_psProbe->pu32Buckets));
+        __set_PRIMASK(l_u32Primask);
+        p_pu32Data += LATENCY_PROBE_LENGTH;
+    }
+}
+
+/// @brief clear the histograms and disarm the probes
+/// @param
+void LATENCY_Reset(void)
+{
+    uint32_t l_u32Primask = __get_PRIMASK();
+
+    __disable_irq();
+    memset(latency_psProbes, 0, sizeof(latency_psProbes));
+    __set_PRIMASK(l_u32Primask);
+}
+
+/******************************************************************************
+*  Private Functions
+*******************************************************************************/
+
+static void latency_record(LATENCY_probe_t *p_psProbe, uint32_t p_u32Us)
+{
+    uint32_t l_u32Bucket = p_u32Us ? 31 - __CLZ(p_u32Us) : 0;
+
+    if (l_u32Bucket >= LATENCY_BUCKETS)
+    {
+        l_u32Bucket = LATENCY_BUCKETS - 1;
+    }
+    p_psProbe->pu32Buckets[l_u32Bucket]++;
+    if (p_psProbe->u32Count == 0 || p_u32Us < p_psProbe->u32Min)
+    {
+        p_psProbe->u32Min = p_u32Us;
+    }
+    if (p_u32Us > p_psProbe->u32Max)
+    {
+        p_psProbe->u32Max = p_u32Us;
+    }
+    p_psProbe->u64Sum += p_u32Us;
+    p_psProbe->u32Count++;
+}
+
+#endif /* LATENCY_PROBES */
+
+/*** End of File **************************************************************/
@@ -28,14 +28,18 @@
 #include "blademotor.h"
 #include "drivemotor.h"
 #include "emergency.h"
+#include "latency.h"
 #include "blademotor.h"
 #include "drivemotor.h"
 #include "ultrasonic_sensor.h"
+#include "uart_frame.h"
 #include "perimeter.h"
 #include "adc.h"
 #include "charger.h"
+#include "battery.h"
 #include "soft_i2c.h"
 #include "i2c.h"
+#include "i2c_queue.h"
 #include "imu/imu.h"
 #include "usb_device.h"
 #include "usbd_cdc_if.h"
@@ -51,12 +55,13 @@ void TIM4_Init(void);
 void HALLSTOP_Sensor_Init(void);
 
 static nbt_t main_chargecontroller_nbt;
+static nbt_t main_battery_nbt;
 static nbt_t main_statusled_nbt;
 static nbt_t main_emergency_nbt;
 static nbt_t main_blademotor_nbt;
-static nbt_t main_drivemotor_nbt;
 static nbt_t main_wdg_nbt;
 static nbt_t main_buzzer_nbt;
+static nbt_t main_accelerometer_nbt;
 #if (DEBUG_TYPE != DEBUG_TYPE_UART) && (OPTION_ULTRASONIC == 1)
 static nbt_t main_ultrasonicsensor_nbt;
 #endif
@@ -125,6 +130,7 @@ int main(void)
   DB_TRACE(" * LED initialized\r\n");
   TIM2_Init();
   ADC_Charging_Init();
+  BATTERY_Init();
 #ifdef OPTION_PERIMETER
   Perimeter_vInit();
 #endif
@@ -159,6 +165,10 @@ int main(void)
   DB_TRACE(" * Testing supported IMUs:\r\n");
   IMU_Init();
   IMU_CalibrateExternal();
+  LATENCY_Init();
+#ifdef ADC_CYCLE_BENCH
+  ADC_CycleBench();
+#endif
   Emergency_Init();
   DB_TRACE(" * Emergency sensors initialized\r\n");
   TIM1_Init();
@@ -184,15 +194,16 @@ int main(void)
 
   // Initialize Main Timers
   NBT_init(&main_chargecontroller_nbt, 10);
+  NBT_init(&main_battery_nbt, BATTERY_UPDATE_MS);
   NBT_init(&main_statusled_nbt, 1000);
   NBT_init(&main_emergency_nbt, 10);
 #if (DEBUG_TYPE != DEBUG_TYPE_UART) && (OPTION_ULTRASONIC == 1)
   NBT_init(&main_ultrasonicsensor_nbt, 50);
 #endif
-  NBT_init(&main_blademotor_nbt, 100);
-  NBT_init(&main_drivemotor_nbt, 20);
+  NBT_init(&main_blademotor_nbt, BLADEMOTOR_POLL_PERIOD_MS);
   NBT_init(&main_wdg_nbt, 10);
   NBT_init(&main_buzzer_nbt, 200);
+  NBT_init(&main_accelerometer_nbt, 10);
 
   DB_TRACE(" * NBT Main timers initialized\r\n");
 
@@ -219,8 +230,10 @@ int main(void)
     panel_handler();
     spinOnce();
     broadcast_handler();
+    power_handler();
 
-    DRIVEMOTOR_App_Rx();
+    DRIVEMOTOR_App();
+    I2CQUEUE_Poll();
 #ifdef OPTION_PERIMETER
     Perimeter_vApp();
 #endif
@@ -230,10 +243,23 @@ int main(void)
       ADC_input();
       ChargeController();
     }
+    if (NBT_handler(&main_battery_nbt))
+    {
+      BATTERY_Update();
+    }
     if (NBT_handler(&main_statusled_nbt))
     {
       StatusLEDUpdate();
 
+      {
+        uint32_t currentTick;
+        static uint32_t old_tick;
+        DB_TRACE(" temp : %.2f \n", blade_temperature);
+        currentTick = HAL_GetTick();
+        DB_TRACE(" Current ticktime: %d    \r", (currentTick - old_tick));
+        old_tick = currentTick;
+      }
+
       // DB_TRACE("master_rx_STATUS: %d  drivemotors_rx_buf_idx: %d  cnt_usart2_overrun: %x\r\n", master_rx_STATUS, drivemotors_rx_buf_idx, cnt_usart2_overrun);
     }
 #if (DEBUG_TYPE != DEBUG_TYPE_UART) && (OPTION_ULTRASONIC == 1)
@@ -252,26 +278,9 @@ int main(void)
       WATCHDOG_Refresh();
     }
 
-    if (NBT_handler(&main_drivemotor_nbt))
-    {
-      DRIVEMOTOR_App_10ms();
-    }
-
     if (NBT_handler(&main_blademotor_nbt))
     {
       BLADEMOTOR_App();
-
-#ifdef OPTION_PERIMETER
-      if (!Perimeter_UsesDebug())
-#endif
-      {
-        uint32_t currentTick;
-        static uint32_t old_tick;
-        DB_TRACE(" temp : %.2f \n", blade_temperature);
-        currentTick = HAL_GetTick();
-        DB_TRACE(" Current ticktime: %d    \r", (currentTick - old_tick));
-        old_tick = currentTick;
-      }
     }
 
     if (NBT_handler(&main_buzzer_nbt))
@@ -292,6 +301,11 @@ int main(void)
       do_chirp_duration_counter++;
     }
 
+    if (NBT_handler(&main_accelerometer_nbt))
+    {
+      I2C_Accelerometer_Poll();
+    }
+
 #ifndef I_DONT_NEED_MY_FINGERS
     if (NBT_handler(&main_emergency_nbt))
     {
@@ -350,7 +364,7 @@ void MASTER_USART_Init()
   hdma_uart4_rx.Init.MemInc = DMA_MINC_ENABLE;
   hdma_uart4_rx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
   hdma_uart4_rx.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
-  hdma_uart4_rx.Init.Mode = DMA_NORMAL;
+  hdma_uart4_rx.Init.Mode = DMA_CIRCULAR;
   hdma_uart4_rx.Init.Priority = DMA_PRIORITY_LOW;
   if (HAL_DMA_Init(&hdma_uart4_rx) != HAL_OK)
   {
@@ -999,9 +1013,12 @@ static void WATCHDOG_Refresh(void)
   }
 }
 
+/*
+ * restart the framed UART reception stopped by an overrun / framing error
+ */
 void HAL_UART_ErrorCallback(UART_HandleTypeDef *huart)
 {
-  // do nothing here
+  UARTFRAME_ErrorIT(huart);
 }
 
 /*
@@ -1019,6 +1036,7 @@ void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart)
     }
   }
 #endif
+  UARTFRAME_TxCpltIT(huart);
 }
 
 void HAL_UART_TxHalfCpltCallback(UART_HandleTypeDef *huart)
@@ -1027,27 +1045,39 @@ void HAL_UART_TxHalfCpltCallback(UART_HandleTypeDef *huart)
 }
 
 /*
- * Master UART receive ISR
- * DriveMotors UART receive ISR
- * PANEL UART receive ISR
+ * Master UART (ultrasonic), DriveMotors, BladeMotor and PANEL receive ISR
+ * called on DMA half / full transfer and on UART idle line
  */
-void HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart)
+void HAL_UARTEx_RxEventCallback(UART_HandleTypeDef *huart, uint16_t Size)
 {
-#if BOARD_HAS_MASTER_USART
-  if (huart->Instance == MASTER_USART_INSTANCE)
-  {
-#if (DEBUG_TYPE != DEBUG_TYPE_UART) && (OPTION_ULTRASONIC == 1)
-    ULTRASONICSENSOR_ReceiveIT();
-#endif
-  }
-  else
-#endif
-  if (huart->Instance == BLADEMOTOR_USART_INSTANCE)
-  {
-    BLADEMOTOR_ReceiveIT();
-  }
-  else if (huart->Instance == DRIVEMOTORS_USART_INSTANCE)
-  {
-    DRIVEMOTOR_ReceiveIT();
-  }
+  UARTFRAME_RxEventIT(huart, Size);
+}
+
+/*
+ * onboard accelerometer I2C transfer done, start the next queued one
+ */
+void HAL_I2C_MemRxCpltCallback(I2C_HandleTypeDef *hi2c)
+{
+  I2CQUEUE_CpltIT(hi2c);
+}
+
+void HAL_I2C_MemTxCpltCallback(I2C_HandleTypeDef *hi2c)
+{
+  I2CQUEUE_CpltIT(hi2c);
+}
+
+/*
+ * onboard accelerometer I2C bus error / NACK, the main loop recovers the bus
+ */
+void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c)
+{
+  I2CQUEUE_ErrorIT(hi2c);
+}
+
+/*
+ * timer update ISR, EMERGENCY_TIM samples the emergency inputs
+ */
+void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef *htim)
+{
+  Emergency_TimerPeriodElapsed(htim);
 }
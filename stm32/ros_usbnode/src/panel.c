@@ -18,10 +18,12 @@
 #include "panel.h"
 #include "board.h"
 #include "main.h"
+#include "uart_frame.h"
 
 #define PANEL_LENGTH_INIT_MSG 22
 #define PANEL_LENGTH_RQST_MSG 18
 #define PANEL_LENGTH_RECEIVED_MSG 20
+#define PANEL_CRC_OFFSET_RECEIVED_MSG 13 /* the CRC covers the buttons frame at the start of the message */
 
 void PANEL_SendLEDMessage(void);
 
@@ -64,11 +66,14 @@ static uint8_t panel_pu8ReceivedData[50] = {0};
 static uint8_t panel_pu8RqstMessage[50]  = {0};
 
 const uint8_t panel_pcu8PreAmbule[5]  = {0x55,0xAA,0x0A,0x50,0x3C};
+static const UARTFRAME_Descriptor_t panel_csFrameDesc = {panel_pcu8PreAmbule, 5, PANEL_LENGTH_RECEIVED_MSG, PANEL_CRC_OFFSET_RECEIVED_MSG};
+static UARTFRAME_Handle_t panel_sFrame;
 
 static uint8_t panel_u8OldStateButtonStart = 0;
 static uint8_t panel_u8OldStateButtonHome = 0;
 
 void PANEL_Send_Message(uint8_t *data, uint8_t dataLength, uint16_t command);
+static void panel_receiveFrame(rx_status_e p_eStatus, const uint8_t *p_pu8Frame);
 
 /*
  * Initialize HW, USART and send init sequence to panel
@@ -140,7 +145,7 @@ void PANEL_Init(void)
     hdma_uart1_rx.Init.MemInc = DMA_MINC_ENABLE;
     hdma_uart1_rx.Init.PeriphDataAlignment = DMA_PDATAALIGN_BYTE;
     hdma_uart1_rx.Init.MemDataAlignment = DMA_MDATAALIGN_BYTE;
-    hdma_uart1_rx.Init.Mode = DMA_NORMAL;
+    hdma_uart1_rx.Init.Mode = DMA_CIRCULAR;
     hdma_uart1_rx.Init.Priority = DMA_PRIORITY_LOW;
     if (HAL_DMA_Init(&hdma_uart1_rx) != HAL_OK)
     {
@@ -177,6 +182,8 @@ void PANEL_Init(void)
 	HAL_NVIC_EnableIRQ(PANEL_USART_IRQ);     
     __HAL_UART_ENABLE_IT(&PANEL_USART_Handler, UART_IT_TC);
 
+    UARTFRAME_Init(&panel_sFrame, &PANEL_USART_Handler, &panel_csFrameDesc, panel_receiveFrame);
+
     /* TODO maybe put this sequence in the loop */
     memset(Led_States, 0x0, LED_STATE_SIZE);       // all LEDs OFF
     // Initialize Panel Sequence
@@ -212,10 +219,6 @@ void PANEL_Init(void)
     memset(Led_States, 0x0, LED_STATE_SIZE);    
     PANEL_SendLEDMessage();
 
-    /* prepare to receive the next message */
-    HAL_UARTEx_ReceiveToIdle_DMA(&PANEL_USART_Handler,panel_pu8ReceivedData,PANEL_LENGTH_RECEIVED_MSG);
-    __HAL_DMA_DISABLE_IT(&hdma_uart1_rx, DMA_IT_HT);
-
 #endif
 }
 
@@ -299,9 +302,6 @@ void PANEL_Tick(void)
 void PANEL_SendLEDMessage(void){
     uint8_t ptr = 0;
     uint8_t ptr_beginScndMsg = 0;
-//    uint8_t crc = 0;
-
-    while( __HAL_UART_GET_FLAG(&PANEL_USART_Handler, USART_FLAG_TC) != 1);
 
     panel_pu8RqstMessage[ptr++] = 0x55;
     panel_pu8RqstMessage[ptr++] = 0xaa;
@@ -326,7 +326,7 @@ void PANEL_SendLEDMessage(void){
     panel_pu8RqstMessage[ptr++] = crcCalc(&panel_pu8RqstMessage[ptr_beginScndMsg],8); 
 
 #ifdef PANEL_USART_ENABLED
-    HAL_UART_Transmit_DMA(&PANEL_USART_Handler, (uint8_t*)&panel_pu8RqstMessage[0], ptr); 
+    UARTFRAME_Transmit(&panel_sFrame, panel_pu8RqstMessage, ptr);
 #endif
 
 }
@@ -335,8 +335,6 @@ void PANEL_Send_Message(uint8_t *data, uint8_t dataLength, uint16_t command)
 {
     uint8_t ptr = 0;
 
-    while( __HAL_UART_GET_FLAG(&PANEL_USART_Handler, USART_FLAG_TC) != 1);
-
     panel_pu8RqstMessage[ptr++] = 0x55;
     panel_pu8RqstMessage[ptr++] = 0xaa;
     panel_pu8RqstMessage[ptr++] = dataLength + 0x02;
@@ -348,39 +346,22 @@ void PANEL_Send_Message(uint8_t *data, uint8_t dataLength, uint16_t command)
         panel_pu8RqstMessage[ptr++] = data[i];
     }
 
-    uint8_t crc = 0;
-    for (int i = 0; i < dataLength + 5; ++i)
-    {
-        crc += panel_pu8RqstMessage[i];
-    }
-    panel_pu8RqstMessage[dataLength + 5] = crc;
+    panel_pu8RqstMessage[ptr++] = crcCalc(panel_pu8RqstMessage, dataLength + 5);
 
-    
 #ifdef PANEL_USART_ENABLED
-    HAL_UART_Transmit_DMA(&PANEL_USART_Handler, (uint8_t*)&panel_pu8RqstMessage[0], dataLength + 6); 
+    UARTFRAME_Transmit(&panel_sFrame, panel_pu8RqstMessage, ptr);
 #endif
 }
 
 
-void HAL_UARTEx_RxEventCallback(UART_HandleTypeDef *huart, uint16_t Size)
+/*
+ * buttons frame received, called from the UART interrupt
+ */
+static void panel_receiveFrame(rx_status_e p_eStatus, const uint8_t *p_pu8Frame)
 {
-	if (huart->Instance == PANEL_USART_INSTANCE)
-	{
-        /* take only the buttons message */
-        if(Size == PANEL_LENGTH_RECEIVED_MSG ){
-                    /* decode the frame */
-            if(memcmp(panel_pcu8PreAmbule,panel_pu8ReceivedData,5) == 0){
-                uint8_t l_u8crc = crcCalc(panel_pu8ReceivedData,14-1);
-                if(panel_pu8ReceivedData[14-1] == l_u8crc ){
-                    Frame_Received_Panel = 1;
-                }
-            }
-        }
-
-
-        /* prepare to receive the next message */
-        HAL_UARTEx_ReceiveToIdle_DMA(&PANEL_USART_Handler,panel_pu8ReceivedData,PANEL_LENGTH_RECEIVED_MSG);
-        __HAL_DMA_DISABLE_IT(&hdma_uart1_rx, DMA_IT_HT);
-
-	}
-}
\ No newline at end of file
+    if (p_eStatus == RX_VALID)
+    {
+        memcpy(panel_pu8ReceivedData, p_pu8Frame, PANEL_LENGTH_RECEIVED_MSG);
+        Frame_Received_Panel = 1;
+    }
+}
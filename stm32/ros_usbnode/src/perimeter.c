@@ -9,6 +9,13 @@
 /** \file perimeter.c
 *  \brief 
 *
+* The ADC runs continuously in circular DMA mode over two halves of PERIMETER_NBPTS.
+* When a half is full the coil is switched for the next one, the main loop correlates
+* the full half while the other one fills. The first points of every half, while the
+* coil input settles, are not correlated.
+*
+* In debug mode a copy of an acquisition is streamed as binary frames (Perimeter_StreamChunk,
+* published by cpp_main.cpp), the acquisition and the correlation keep running meanwhile.
 */
 /******************************************************************************
 * Includes
@@ -16,17 +23,42 @@
 #include "main.h"
 #include "board.h"
 #include "perimeter.h" 
+#include "corr_filter.h"
+#include "adc.h"
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
 
 #ifdef OPTION_PERIMETER
 
 /******************************************************************************
 * Module Preprocessor Constants
 *******************************************************************************/
-#define PERIMETER_NBPTS 1284 /* 12 ms / 9.333 µs */
+#define PERIMETER_NBPTS 642  /* 6 ms / 9.333 µs, about 5 code periods. A coil gets a new result every 3 halves (18 ms) */
 #define PERIMETER_OVERSAMPLING 3
-#define PERIMETER_AVERAGE_N 3
+#define PERIMETER_AVERAGE_N 6   /* results averaged per coil, 6 * 588 correlated points, about as many as 3 halves of 12 ms */
+#define PERIMETER_SETTLE_PTS 54 /* 0.5 ms after a coil switch */
+#define PERIMETER_MAX_CODES 2   /* signal codes correlated together */
+
+/* CORRFILTER_RunBank() replaces the oversampled points of pu16_PerimeterADC_buffer by their prefix sums */
+#if PERIMETER_OVERSAMPLING>16
+#error Possible overflow in unit16_t
+#endif
+#if PERIMETER_OVERSAMPLING<3
+#error Need oversampling for data storage
+#endif
+#if (PERIMETER_NBPTS - PERIMETER_SETTLE_PTS) % PERIMETER_OVERSAMPLING
+#error The correlated points have to be a whole number of oversampled points
+#endif
+#if PERIMETER_SETTLE_PTS % 2
+#error The prefix sums written over the points must be 32 bit aligned
+#endif
+#if PERIMETER_MAX_CODES>CORRFILTER_MAX_CODES
+#error Too many codes for the correlator bank
+#endif
+#if (PERIMETER_NBPTS % 2) || (PERIMETER_STREAM_CHUNK_PTS % 2)
+#error The stream packs the points two by two
+#endif
 
 /******************************************************************************
 * Module Preprocessor Macros
@@ -48,30 +80,72 @@ static const int32_t sigcode1[]={ -2, -2, -2, 2, 2, 2, -2, -2, 2, 2, 2, 2, 2, 2,
 #define SIGCODE1_LENGTH (sizeof(sigcode1)/sizeof(int32_t))
 static const int32_t sigcode2[]={ -2, -3, 0, 3, 3, -1, -2, -1, 3, 3, 3, 3, 3, 2, 0, -2, -2, -2, -2, -2, -2, -2, -2, -2, 3, 3, 3, 3, 3, 3, 1, 0, -1, -2, -2, -2, -2, -2, -2, -1, -1 };
 #define SIGCODE2_LENGTH (sizeof(sigcode2)/sizeof(int32_t))
-uint16_t pu16_PerimeterADC_buffer[PERIMETER_NBPTS]; /* Input from perimeter coil */
-
-bool perimeter_bFlagIT = false;
-static const int32_t *sigcode=NULL;
-static int sigcode_length;
-static int print_pos=-1;
-
-float coilSigSum[COIL_OFF] = {0.0,0.0,0.0};
+uint16_t pu16_PerimeterADC_buffer[2 * PERIMETER_NBPTS] __attribute__((aligned(4))); /* Input from perimeter coil, two halves */
+
+volatile bool perimeter_bFlagIT = false;
+static volatile uint8_t perimeter_u8ReadyHalf = 0;                  /* half to correlate */
+static volatile perimeter_CoilNumber_e perimeter_eReadyCoil = COIL_OFF; /* coil of the half to correlate */
+static volatile uint32_t perimeter_u32Halves = 0;                   /* halves acquired */
+static volatile uint32_t perimeter_u32ReadyTick = 0;                /* end of the half to correlate */
+static uint32_t perimeter_u32Overruns = 0;                          /* halves dropped, not correlated in time */
+static CORRFILTER_Code_t perimeter_psCodes[PERIMETER_MAX_CODES];   /* correlator bank */
+static uint8_t perimeter_pu8CodeId[PERIMETER_MAX_CODES];            /* signal code (1 or 2) of every correlator */
+static uint8_t perimeter_u8Codes = 0;                               /* correlators in use, 0 when not listening */
+
+/* waveform stream, debug mode */
+static bool perimeter_bStream = false;
+static bool perimeter_bFixedCoil = false;                           /* the coil does not rotate */
+static perimeter_CoilNumber_e perimeter_eStreamCoil = COIL_LEFT;    /* next coil to stream when rotating */
+static uint8_t perimeter_pu8Stream[PERIMETER_NBPTS * 3 / 2];        /* packed copy of the streamed half */
+static uint16_t perimeter_u16StreamPos = PERIMETER_NBPTS;           /* next point to send, PERIMETER_NBPTS when idle */
+static perimeter_CoilNumber_e perimeter_eStreamedCoil;
+static uint32_t perimeter_u32StreamSeq;
+static uint32_t perimeter_u32StreamTick;
+static float perimeter_fStreamSig;
+static uint8_t perimeter_u8StreamCode;
+
+/* last PERIMETER_AVERAGE_N results of every code and coil */
+float coilSig[PERIMETER_MAX_CODES][COIL_OFF][PERIMETER_AVERAGE_N];
 int coilSigN[COIL_OFF]={0,0,0};
+static uint8_t coilSigIdx[COIL_OFF]={0,0,0};
+static uint8_t coilSigNew=0; /* bit per coil with a result not published yet */
 
-perimeter_CoilNumber_e idxCoil = COIL_LEFT;
+volatile perimeter_CoilNumber_e idxCoil = COIL_LEFT; /* coil of the half being acquired */
 
 /******************************************************************************
 * Function Prototypes
 *******************************************************************************/
-static double corrFilter(void);
 void perimeter_SetCoil(perimeter_CoilNumber_e idx);
+static void perimeter_startDma(void);
+static void perimeter_stopDma(void);
+static void perimeter_streamCopy(const uint16_t *p_pu16Points);
 
 /******************************************************************************
 *  Public Functions
 *******************************************************************************/
-// TODO: We can't use ADC1 exclusively for perimeter for the Yardforce 500B, since it is used for charging already!
-// 		 This could be multiplexed, but this is a task for later as perimeter sensing is not needed for now.
+// Yardforce 500: ADC1 is used by the perimeter only
+// Yardforce 500B: ADC1 is shared with the charging channels, the perimeter uses its regular group (see adc.c)
 void Perimeter_vInit(void){
+#if BOARD_YARDFORCE500_VARIANT_B
+    GPIO_InitTypeDef GPIO_InitStruct = {0};
+
+    __HAL_RCC_GPIOA_CLK_ENABLE();
+    __HAL_RCC_GPIOB_CLK_ENABLE();
+
+    /* PA6 ------> Perimeter Sense, ADC1 channel configured by ADC_Charging_Init() */
+    GPIO_InitStruct.Pin = GPIO_PIN_6;
+    GPIO_InitStruct.Mode = GPIO_MODE_ANALOG;
+    HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
+
+    GPIO_InitStruct.Pin = GPIO_PIN_8 | GPIO_PIN_9;
+    GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_PP;
+    GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_MEDIUM;
+    HAL_GPIO_Init(GPIOB, &GPIO_InitStruct);
+
+    perimeter_bFlagIT = false;
+    idxCoil = COIL_OFF;
+    perimeter_SetCoil(idxCoil);
+#endif
 #if BOARD_YARDFORCE500_VARIANT_ORIG
  ADC_ChannelConfTypeDef sConfig = {0};
     
@@ -131,7 +205,7 @@ void Perimeter_vInit(void){
     hdma_adc.Init.MemInc = DMA_MINC_ENABLE;
     hdma_adc.Init.PeriphDataAlignment = DMA_PDATAALIGN_HALFWORD;
     hdma_adc.Init.MemDataAlignment = DMA_MDATAALIGN_HALFWORD;
-    hdma_adc.Init.Mode = DMA_NORMAL;
+    hdma_adc.Init.Mode = DMA_CIRCULAR;
     hdma_adc.Init.Priority = DMA_PRIORITY_HIGH;
     if (HAL_DMA_Init(&hdma_adc) != HAL_OK)
     {
@@ -143,198 +217,237 @@ void Perimeter_vInit(void){
   // calibrate  - important for accuracy !
   HAL_ADCEx_Calibration_Start(&ADC_Handle); 
 
+  /* the acquisition starts with Perimeter_ListenOn() */
   perimeter_bFlagIT = false;
   idxCoil = COIL_OFF;
   perimeter_SetCoil(idxCoil);
-  HAL_ADC_Start_DMA(&ADC_Handle,(uint32_t*)&pu16_PerimeterADC_buffer[0],PERIMETER_NBPTS);
-  __HAL_DMA_DISABLE_IT(&hdma_adc,DMA_IT_HT);
 #endif
 }
 
 void Perimeter_vApp(void){
 
-  if(sigcode && perimeter_bFlagIT == true){
-    if (print_pos>=0) {
-      if (print_pos<PERIMETER_NBPTS) {
-        for (int c=0; c<4 && print_pos<PERIMETER_NBPTS; c++) {
-          DB_TRACE("%c%d",print_pos ? ',' : '\n',(int32_t) pu16_PerimeterADC_buffer[print_pos]);
-          print_pos++;
-        }
-        return;
-      }
-      print_pos=0;
-    }
+  if(perimeter_u8Codes && perimeter_bFlagIT == true){
+    uint32_t l_u32Primask=__get_PRIMASK();
+    __disable_irq();
+    uint8_t l_u8Half=perimeter_u8ReadyHalf;
+    perimeter_CoilNumber_e l_eCoil=perimeter_eReadyCoil;
+    uint32_t l_u32Seq=perimeter_u32Halves;
+    uint32_t l_u32Tick=perimeter_u32ReadyTick;
     perimeter_bFlagIT = false;
+    __set_PRIMASK(l_u32Primask);
 
-    if (print_pos<0) {
-      coilSigSum[idxCoil]+=corrFilter();
-      coilSigN[idxCoil]++;
-      idxCoil ++;
-      if(idxCoil == COIL_OFF){
-        idxCoil = COIL_LEFT;
-      }
-      perimeter_SetCoil(idxCoil);
+    /* the correlation decimates the half in place, copy it first */
+    bool l_bStream=perimeter_bStream && perimeter_u16StreamPos>=PERIMETER_NBPTS
+                   && (perimeter_bFixedCoil || l_eCoil==perimeter_eStreamCoil);
+    if (l_bStream) {
+      perimeter_streamCopy(&pu16_PerimeterADC_buffer[l_u8Half*PERIMETER_NBPTS]);
+    }
+
+    double l_pdSig[PERIMETER_MAX_CODES];
+    uint8_t l_u8Best=CORRFILTER_RunBank(perimeter_psCodes,perimeter_u8Codes,&pu16_PerimeterADC_buffer[l_u8Half*PERIMETER_NBPTS+PERIMETER_SETTLE_PTS],
+                                        PERIMETER_NBPTS-PERIMETER_SETTLE_PTS,PERIMETER_OVERSAMPLING,l_pdSig);
+    if (perimeter_u32Halves!=l_u32Seq || l_eCoil>=COIL_OFF) {
+      /* the DMA is writing this half again, the data may be mixed up */
+      perimeter_u32Overruns++;
+      return;
+    }
+    if (l_bStream) {
+      perimeter_eStreamedCoil=l_eCoil;
+      perimeter_u32StreamSeq=l_u32Seq;
+      perimeter_u32StreamTick=l_u32Tick;
+      perimeter_fStreamSig=l_pdSig[l_u8Best];
+      perimeter_u8StreamCode=perimeter_pu8CodeId[l_u8Best];
+      perimeter_u16StreamPos=0;
+      perimeter_eStreamCoil=(l_eCoil+1)%COIL_OFF;
+    }
+    for (uint8_t k=0; k<perimeter_u8Codes; k++) {
+      coilSig[k][l_eCoil][coilSigIdx[l_eCoil]]=l_pdSig[k];
     }
-    HAL_ADC_Start_DMA(&ADC_Handle,(uint32_t*)&pu16_PerimeterADC_buffer[0],PERIMETER_NBPTS);
-    __HAL_DMA_DISABLE_IT(&hdma_adc,DMA_IT_HT);
+    coilSigIdx[l_eCoil]=(coilSigIdx[l_eCoil]+1)%PERIMETER_AVERAGE_N;
+    if (coilSigN[l_eCoil]<PERIMETER_AVERAGE_N) coilSigN[l_eCoil]++;
+    coilSigNew|=1<<l_eCoil;
   }
 }
 
 void Perimeter_ListenOn(uint8_t sig) {
-  const int32_t *oldsigcode=sigcode;
+  uint8_t oldcodes=perimeter_u8Codes;
+  uint8_t codes[PERIMETER_MAX_CODES];
+  uint8_t ncodes=0;
   switch (sig) {
     case 1:
     case 0x80:
     case 0x81:
     case 0x82:
-      sigcode=sigcode1;
-      sigcode_length=SIGCODE1_LENGTH;
+    case 0x83:
+      codes[ncodes++]=1;
       break;
     case 2:
-      sigcode=sigcode2;
-      sigcode_length=SIGCODE2_LENGTH;
+      codes[ncodes++]=2;
+      break;
+    case 3:
+      codes[ncodes++]=1;
+      codes[ncodes++]=2;
       break;
     default:
-      sigcode=NULL;
+      break;
   }
-  if (sigcode) {
-    print_pos=sig & 0x80 ? 0 : -1;
-    if (!oldsigcode) {
-      idxCoil=COIL_LEFT;
-      perimeter_SetCoil(idxCoil);
+  if (ncodes) {
+    /* new codes, the averages start over */
+    bool changed=(ncodes!=oldcodes);
+    for (uint8_t k=0; k<ncodes; k++) {
+      if (changed || codes[k]!=perimeter_pu8CodeId[k]) {
+        changed=true;
+        perimeter_pu8CodeId[k]=codes[k];
+        if (codes[k]==1) {
+          CORRFILTER_Init(&perimeter_psCodes[k],sigcode1,SIGCODE1_LENGTH);
+        } else {
+          CORRFILTER_Init(&perimeter_psCodes[k],sigcode2,SIGCODE2_LENGTH);
+        }
+      }
+    }
+    perimeter_u8Codes=ncodes;
+    if (changed) {
       for (int i=0; i<COIL_OFF; i++) {
-        coilSigSum[i]=coilSigN[i]=0;
+        coilSigN[i]=coilSigIdx[i]=0;
       }
-      HAL_ADC_Start_DMA(&ADC_Handle,(uint32_t*)&pu16_PerimeterADC_buffer[0],PERIMETER_NBPTS);
-      __HAL_DMA_DISABLE_IT(&hdma_adc,DMA_IT_HT);
+      coilSigNew=0;
     }
-    if (sig & 0x80) {
+    if (!(sig & 0x80) || !perimeter_bStream) {
+      /* stream off or restarted */
+      perimeter_u16StreamPos=PERIMETER_NBPTS;
+    }
+    perimeter_bStream=(sig & 0x80)!=0;
+    perimeter_bFixedCoil=(sig & 0x80) && (sig & 3)!=COIL_OFF;
+    if (perimeter_bFixedCoil) {
       idxCoil=sig & 3;
       perimeter_SetCoil(idxCoil);
     }
+    if (!oldcodes) {
+      if (!perimeter_bFixedCoil) {
+        idxCoil=COIL_LEFT;
+        perimeter_SetCoil(idxCoil);
+      }
+      perimeter_startDma();
+    }
   } else {
-    print_pos=-1;
+    perimeter_u8Codes=0;
+    perimeter_bStream=false;
+    perimeter_bFixedCoil=false;
+    perimeter_u16StreamPos=PERIMETER_NBPTS;
+    if (oldcodes) {
+      perimeter_stopDma();
+      perimeter_bFlagIT=false;
+    }
   }
 }
 
 int Perimeter_IsActive(void) {
-  return sigcode!=NULL;
+  return perimeter_u8Codes!=0;
 }
 
-int Perimeter_UpdateMsg(float *left,float *center,float *right) {
-  if (!sigcode || coilSigN[COIL_LEFT]<PERIMETER_AVERAGE_N
+int Perimeter_UpdateMsg(float *left,float *center,float *right,uint8_t *code) {
+  float avg[PERIMETER_MAX_CODES][COIL_OFF];
+  float strength,beststrength=-1;
+  uint8_t best=0;
+
+  /* moving average, a new message as soon as every coil has a new result */
+  if (!perimeter_u8Codes || coilSigNew!=((1<<COIL_OFF)-1) || coilSigN[COIL_LEFT]<PERIMETER_AVERAGE_N
       || coilSigN[COIL_MIDDLE]<PERIMETER_AVERAGE_N  || coilSigN[COIL_RIGHT]<PERIMETER_AVERAGE_N)
   {
     return 0;
   }
-	*left=coilSigSum[COIL_LEFT]/coilSigN[COIL_LEFT];
-	*center=coilSigSum[COIL_MIDDLE]/coilSigN[COIL_MIDDLE];
-	*right=coilSigSum[COIL_RIGHT]/coilSigN[COIL_RIGHT];
-  for (int i=0; i<COIL_OFF; i++) coilSigSum[i]=coilSigN[i]=0;
+  /* the code received the strongest over the three coils is reported */
+  for (uint8_t k=0; k<perimeter_u8Codes; k++) {
+    strength=0;
+    for (int i=0; i<COIL_OFF; i++) {
+      avg[k][i]=0;
+      for (int j=0; j<PERIMETER_AVERAGE_N; j++) avg[k][i]+=coilSig[k][i][j];
+      avg[k][i]/=PERIMETER_AVERAGE_N;
+      strength+=fabsf(avg[k][i]);
+    }
+    if (strength>beststrength) {
+      beststrength=strength;
+      best=k;
+    }
+  }
+	*left=avg[best][COIL_LEFT];
+	*center=avg[best][COIL_MIDDLE];
+	*right=avg[best][COIL_RIGHT];
+	*code=perimeter_pu8CodeId[best];
+  coilSigNew=0;
   return 1;
 }
 
 int Perimeter_UsesDebug(void) {
-  return print_pos>=0;
+  return perimeter_bStream;
 }
 
-void PERIMETER_vITHandle(void){
-  /* stop DMA and set flag */
-  HAL_ADC_Stop_DMA(&ADC_Handle);
-  perimeter_bFlagIT = true;
+/// @brief next frame of the waveform stream, a chunk of the last copied acquisition
+/// @param buffer frame, at least PERIMETER_STREAM_MAX_LENGTH bytes
+/// @param size buffer size
+/// @retval frame length, 0 if nothing to send
+uint16_t Perimeter_StreamChunk(uint8_t *buffer,uint16_t size) {
+  if (!perimeter_bStream || perimeter_u16StreamPos>=PERIMETER_NBPTS || size<PERIMETER_STREAM_MAX_LENGTH) {
+    return 0;
+  }
+  uint16_t pos=perimeter_u16StreamPos;
+  uint16_t n=PERIMETER_NBPTS-pos;
+  if (n>PERIMETER_STREAM_CHUNK_PTS) n=PERIMETER_STREAM_CHUNK_PTS;
+  uint16_t overruns=(uint16_t) perimeter_u32Overruns;
+
+  buffer[0]='P';
+  buffer[1]='W';
+  buffer[2]=PERIMETER_STREAM_VERSION;
+  buffer[3]=perimeter_eStreamedCoil;
+  memcpy(&buffer[4],&perimeter_u32StreamSeq,4);  /* little endian like the Cortex-M */
+  memcpy(&buffer[8],&perimeter_u32StreamTick,4);
+  buffer[12]=PERIMETER_NBPTS & 0xFF;
+  buffer[13]=PERIMETER_NBPTS >> 8;
+  memcpy(&buffer[14],&pos,2);
+  memcpy(&buffer[16],&n,2);
+  buffer[18]=perimeter_u8StreamCode;
+  buffer[19]=PERIMETER_OVERSAMPLING;
+  buffer[20]=PERIMETER_SETTLE_PTS & 0xFF;
+  buffer[21]=PERIMETER_SETTLE_PTS >> 8;
+  memcpy(&buffer[22],&overruns,2);
+  memcpy(&buffer[24],&perimeter_fStreamSig,4);
+  memcpy(&buffer[PERIMETER_STREAM_HEADER_LENGTH],&perimeter_pu8Stream[pos*3/2],n*3/2);
+
+  uint16_t len=PERIMETER_STREAM_HEADER_LENGTH+n*3/2;
+  uint8_t sum=0;
+  for (uint16_t i=0; i<len; i++) sum+=buffer[i];
+  buffer[len++]=sum;
+
+  perimeter_u16StreamPos=pos+n;
+  return len;
 }
 
-
-/******************************************************************************
-*  Private Functions
-*******************************************************************************/
-/** 
- * @brief matched filter (cross correlation)
- * @return detected signal strength
- */
-double corrFilter() {
-
-  /* Calculate oversampling: n=effective number of samples */
-  const int n=PERIMETER_NBPTS/PERIMETER_OVERSAMPLING;
-  #if PERIMETER_OVERSAMPLING>16
-  #error Possible overflow in unit16_t
-  #endif
-  {
-    uint16_t *p=pu16_PerimeterADC_buffer;
-    for (int i=0; i<n; i++) {
-      uint16_t tmp=*(p++);
-      for (int j=PERIMETER_OVERSAMPLING; --j>0; ) {
-        tmp+=*(p++);
-      }
-      pu16_PerimeterADC_buffer[i]=tmp;
-    }
+/// @brief DMA half or transfer complete, the half is ready and the coil switches for the next one
+/// @param p_u8Half 0 first half (half transfer), 1 second half (transfer complete)
+void PERIMETER_vITHandle(uint8_t p_u8Half){
+  if (perimeter_bFlagIT == true) {
+    /* the previous half was not correlated yet */
+    perimeter_u32Overruns++;
   }
+  perimeter_u8ReadyHalf = p_u8Half;
+  perimeter_eReadyCoil = idxCoil;
+  perimeter_u32Halves++;
+  perimeter_u32ReadyTick = HAL_GetTick();
+  perimeter_bFlagIT = true;
 
-  /* We store the correlation result in the unused part of the same array! */
-#if PERIMETER_OVERSAMPLING<3
-#error Need oversampling for data storage
-#endif
-  int32_t *correlations=(int32_t*) (pu16_PerimeterADC_buffer+n);
-
-  int32_t corr_max_abs=0,corr_max=0; // Maximum (absolute) correlation
-  int corr_max_pos; // Position of the maximum correlation
-
-  for (int i=0; i<=n-sigcode_length; i++) {
-    int32_t sum=0;
-    uint16_t *datap=pu16_PerimeterADC_buffer+i;
-    const int32_t *sigcodep=sigcode;
-
-    for (int j=0; j<sigcode_length; j++) sum+=*(datap++)**(sigcodep++);
-    correlations[i]=sum;
-    if (sum<0) {
-      if (-sum>corr_max_abs) {
-        corr_max=sum;
-        corr_max_abs=-sum;
-        corr_max_pos=i;
-      }
-    } else {
-      if (sum>corr_max_abs) {
-        corr_max_abs=corr_max=sum;
-        corr_max_pos=i;
-      }
+  if (!perimeter_bFixedCoil) {
+    idxCoil ++;
+    if(idxCoil >= COIL_OFF){
+      idxCoil = COIL_LEFT;
     }
+    perimeter_SetCoil(idxCoil);
   }
-
-  if (corr_max_abs==0) return 0;
-
-  /* The perimeter signal seems to be automatically amplified until the whole ADC range is used.
-   * => Calculate signal from signal to noise ratio.
-   */
-  int64_t sx2=0,sx=0;
-  int sn=0;
-  
-  int count=n/5;
-  int p=corr_max_pos-3*sigcode_length/2; // Distance to signal;
-  while (count>0 && p>=0) {
-    int64_t s=correlations[p];
-    sx+=s;
-    sx2+=s*s;
-    p--;
-    count--;
-    sn++;
-  }
-  count=n/5;
-  p=corr_max_pos+3*sigcode_length/2; // Distance to signal;
-  while (count>0 && p<n-sigcode_length) {
-    int64_t s=correlations[p];
-    sx+=s;
-    sx2+=s*s;
-    p++;
-    count--;
-    sn++;
-  }
-
-  if (sn<=1) return 0;
-  double noiseDeviation=sqrt((sx2-sx*sx/(double) sn)/(sn-1));
-  if (noiseDeviation<1) return corr_max;
-  return corr_max/noiseDeviation;
 }
 
+
+/******************************************************************************
+*  Private Functions
+*******************************************************************************/
 void perimeter_SetCoil(perimeter_CoilNumber_e idx){
   switch (idx)
   {
@@ -367,4 +480,34 @@ void perimeter_SetCoil(perimeter_CoilNumber_e idx){
     
   }
 }
+
+/* circular acquisition over both halves, the half transfer interrupt marks the first one */
+static void perimeter_startDma(void){
+  perimeter_bFlagIT = false;
+#if BOARD_YARDFORCE500_VARIANT_ORIG
+  HAL_ADC_Start_DMA(&ADC_Handle,(uint32_t*)&pu16_PerimeterADC_buffer[0],2*PERIMETER_NBPTS);
+#elif BOARD_YARDFORCE500_VARIANT_B
+  ADC_PerimeterStart(&pu16_PerimeterADC_buffer[0],2*PERIMETER_NBPTS);
+#endif
+}
+
+/* 12 bit packing of a half for the stream */
+static void perimeter_streamCopy(const uint16_t *p_pu16Points){
+  uint8_t *p=perimeter_pu8Stream;
+  for (int i=0; i<PERIMETER_NBPTS; i+=2) {
+    uint16_t a=p_pu16Points[i];
+    uint16_t b=p_pu16Points[i+1];
+    *(p++)=a & 0xFF;
+    *(p++)=((a >> 8) & 0x0F) | ((b & 0x0F) << 4);
+    *(p++)=(b >> 4) & 0xFF;
+  }
+}
+
+static void perimeter_stopDma(void){
+#if BOARD_YARDFORCE500_VARIANT_ORIG
+  HAL_ADC_Stop_DMA(&ADC_Handle);
+#elif BOARD_YARDFORCE500_VARIANT_B
+  ADC_PerimeterStop();
+#endif
+}
 #endif // OPTION_PERIMETER
@@ -21,6 +21,7 @@
 #include "board.h"
 #include "main.h"
 #include "panel.h"
+#include "soft_i2c.h"
 #include "stm32f1xx_it.h"
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
@@ -77,6 +78,9 @@ extern DMA_HandleTypeDef hdma_uart4_rx;
 DMA_HandleTypeDef hdma_adc;
 
 extern ADC_HandleTypeDef ADC_Charging_Handle;
+extern TIM_HandleTypeDef EMERGENCY_TIM_Handle;
+extern I2C_HandleTypeDef I2C_Handle;
+extern TIM_HandleTypeDef SOFT_I2C_TIM_Handle;
 
 /* USER CODE BEGIN EV */
 
@@ -380,6 +384,43 @@ void DMA2_Channel4_5_IRQHandler(void)
 
 
 
+/**
+  * @brief This function handles TIM6 global interrupt (emergency inputs sampling).
+  */
+void TIM6_IRQHandler(void)
+{
+  HAL_TIM_IRQHandler(&EMERGENCY_TIM_Handle);
+}
+
+/**
+  * @brief This function handles I2C1 event interrupt (onboard accelerometer).
+  */
+void I2C1_EV_IRQHandler(void)
+{
+  HAL_I2C_EV_IRQHandler(&I2C_Handle);
+}
+
+/**
+  * @brief This function handles I2C1 error interrupt (onboard accelerometer).
+  */
+void I2C1_ER_IRQHandler(void)
+{
+  HAL_I2C_ER_IRQHandler(&I2C_Handle);
+}
+
+/**
+  * @brief This function handles TIM7 global interrupt (soft I2C bit clock).
+  * It runs at twice the SCL rate during a transfer, so HAL_TIM_IRQHandler() is bypassed.
+  */
+void TIM7_IRQHandler(void)
+{
+  if (__HAL_TIM_GET_FLAG(&SOFT_I2C_TIM_Handle, TIM_FLAG_UPDATE))
+  {
+    __HAL_TIM_CLEAR_FLAG(&SOFT_I2C_TIM_Handle, TIM_FLAG_UPDATE);
+    SW_I2C_TimerIT();
+  }
+}
+
 /**
   * @brief This function handles USB low priority or CAN RX0 interrupts.
   */
@@ -21,6 +21,7 @@
 #include "board.h"
 #include "main.h"
 #include "panel.h"
+#include "soft_i2c.h"
 #include "stm32f4xx_it.h"
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
@@ -75,6 +76,9 @@ extern DMA_HandleTypeDef hdma_uart_blade_rx;
 extern DMA_HandleTypeDef hdma_adc;
 
 extern ADC_HandleTypeDef ADC_Charging_Handle;
+extern TIM_HandleTypeDef EMERGENCY_TIM_Handle;
+extern I2C_HandleTypeDef I2C_Handle;
+extern TIM_HandleTypeDef SOFT_I2C_TIM_Handle;
 
 /* USER CODE BEGIN EV */
 
@@ -232,6 +236,20 @@ void ADC_IRQHandler(void)
   /* USER CODE END ADC_IRQn 1 */
 }
 
+/**
+  * @brief This function handles DMA2 stream0 global interrupt. (PERIMETER ADC)
+  */
+void DMA2_Stream0_IRQHandler(void)
+{
+  /* USER CODE BEGIN DMA2_Stream0_IRQn 0 */
+
+  /* USER CODE END DMA2_Stream0_IRQn 0 */
+  HAL_DMA_IRQHandler(&hdma_adc);
+  /* USER CODE BEGIN DMA2_Stream0_IRQn 1 */
+
+  /* USER CODE END DMA2_Stream0_IRQn 1 */
+}
+
 /**
   * @brief This function handles USART1 global interrupt.
   */
@@ -360,6 +378,43 @@ void DMA2_Stream7_IRQHandler (void)
   /* USER CODE END DMA2_Stream7_IRQn 1 */
 }
 
+/**
+  * @brief This function handles TIM1 update and TIM10 global interrupts (emergency inputs sampling).
+  */
+void TIM1_UP_TIM10_IRQHandler(void)
+{
+  HAL_TIM_IRQHandler(&EMERGENCY_TIM_Handle);
+}
+
+/**
+  * @brief This function handles I2C1 event interrupt (onboard accelerometer).
+  */
+void I2C1_EV_IRQHandler(void)
+{
+  HAL_I2C_EV_IRQHandler(&I2C_Handle);
+}
+
+/**
+  * @brief This function handles I2C1 error interrupt (onboard accelerometer).
+  */
+void I2C1_ER_IRQHandler(void)
+{
+  HAL_I2C_ER_IRQHandler(&I2C_Handle);
+}
+
+/**
+  * @brief This function handles TIM1 trigger and commutation and TIM11 global interrupts (soft I2C bit clock).
+  * It runs at twice the SCL rate during a transfer, so HAL_TIM_IRQHandler() is bypassed.
+  */
+void TIM1_TRG_COM_TIM11_IRQHandler(void)
+{
+  if (__HAL_TIM_GET_FLAG(&SOFT_I2C_TIM_Handle, TIM_FLAG_UPDATE))
+  {
+    __HAL_TIM_CLEAR_FLAG(&SOFT_I2C_TIM_Handle, TIM_FLAG_UPDATE);
+    SW_I2C_TimerIT();
+  }
+}
+
 /**
   * @brief This function handles USB On The Go FS global interrupt.
   */
@@ -13,6 +13,8 @@
  ******************************************************************************
  */
 
+#include <math.h>
+
 #include "board.h"
 #include "main.h"
 #include "adc.h"
@@ -20,10 +22,12 @@
 #include <cpp_main.h>
 #include "panel.h"
 #include "charger.h"
+#include "battery.h"
 #include "emergency.h"
 #include "drivemotor.h"
 #include "blademotor.h"
 #include "ultrasonic_sensor.h"
+#include "latency.h"
 #include "stm32f_board_hal.h"
 #include "ringbuffer.h"
 #include "ros.h"
@@ -38,7 +42,10 @@
 #include "std_msgs/UInt8.h"
 #include "std_msgs/UInt16.h"
 #include "std_msgs/UInt32.h"
+#include "std_msgs/UInt32MultiArray.h"
+#include "std_msgs/Empty.h"
 #include "std_msgs/Int16MultiArray.h"
+#include "std_msgs/Float32MultiArray.h"
 #include "nav_msgs/Odometry.h"
 #include "nbt.h"
 #include "geometry_msgs/Twist.h"
@@ -50,6 +57,7 @@
 #include "sensor_msgs/Imu.h"
 #include "sensor_msgs/Range.h"
 #include "sensor_msgs/Temperature.h"
+#include "sensor_msgs/BatteryState.h"
 
 // Flash Configuration Services
 #include "mowgli/SetCfg.h"
@@ -71,12 +79,17 @@
 	#include "perimeter.h"
 	#include "mower_msgs/Perimeter.h"
 	#include "mower_msgs/PerimeterControlSrv.h"
+	#include "std_msgs/UInt8MultiArray.h"
 #endif
 
 #define ODOM_NBT_TIME_MS 100
-#define IMU_NBT_TIME_MS 20
+#define IMU_NBT_TIME_MS (IMU_POLL_MS - 1) // NBT fires when more than the timeout elapsed
 #define MOTORS_NBT_TIME_MS 20
 #define STATUS_NBT_TIME_MS 250
+#define POWER_SAMPLE_NBT_TIME_MS 0 // NBT fires when more than the timeout elapsed, 0 = every ms
+#define POWER_TELEMETRY_MIN_HZ 1
+#define POWER_TELEMETRY_MAX_HZ 100
+#define PERIMETER_STREAM_NBT_TIME_MS 10 // one frame per period, 2 frames per acquisition (642 points, 428 per chunk)
 
 uint8_t RxBuffer[RxBufferSize];
 struct ringbuffer rb;
@@ -89,6 +102,9 @@ static uint8_t left_speed = 0;
 static uint8_t right_speed = 0;
 static uint8_t left_dir = 0;
 static uint8_t right_dir = 0;
+// last cmd_vel wheel speeds, before capping
+static float cmd_left_mps = 0;
+static float cmd_right_mps = 0;
 
 // blade motor control
 static uint8_t target_blade_on_off = 0;
@@ -123,22 +139,61 @@ sensor_msgs::Imu imu_onboard_msg;
 mowgli::status status_msg;
 // om status message
 mower_msgs::Status om_mower_status_msg;
+// battery state of charge
+sensor_msgs::BatteryState battery_state_msg;
+// power telemetry, min/max/mean of every signal over the publish interval
+// data[signal * POWER_STAT_MAX + stat], signals in power_signal_e order, stats min, max, mean
+typedef enum
+{
+	POWER_SIGNAL_BATTERY_VOLTAGE = 0, // V
+	POWER_SIGNAL_CHARGE_CURRENT,	  // A
+	POWER_SIGNAL_INPUT_VOLTAGE,		  // V, charger input
+	POWER_SIGNAL_CHARGE_PWM,		  // TIM1 compare counts
+	POWER_SIGNAL_BLADE_TEMPERATURE,	  // °C
+	POWER_SIGNAL_MAX
+} power_signal_e;
+#define POWER_STAT_MAX 3
+std_msgs::Float32MultiArray power_telemetry_msg;
+static std_msgs::MultiArrayDimension power_telemetry_dim[2];
+static float power_telemetry_data[POWER_SIGNAL_MAX * POWER_STAT_MAX];
+static int32_t power_min[POWER_SIGNAL_MAX];
+static int32_t power_max[POWER_SIGNAL_MAX];
+static int32_t power_sum[POWER_SIGNAL_MAX];
+static uint16_t power_samples = 0;
+#if LATENCY_PROBES
+// latency histograms, data[probe * LATENCY_PROBE_LENGTH + stat], probes in LATENCY_Probe_e order,
+// stats count, min, max, sum (µs, low and high 32 bits) then the LATENCY_BUCKETS log2 buckets
+std_msgs::UInt32MultiArray latency_msg;
+static std_msgs::MultiArrayDimension latency_dim[2];
+static uint32_t latency_data[LATENCY_PROBE_MAX * LATENCY_PROBE_LENGTH];
+#endif
 
 xbot_msgs::WheelTick wheel_ticks_msg;
+std_msgs::UInt8 collision_msg;
 mower_msgs::HighLevelStatus high_level_status;
 float clamp(float d, float min, float max);
+static void drive_setSpeed(float left_mps, float right_mps);
+static void imu_publish(void);
 /*
  * PUBLISHERS
  */
 ros::Publisher pubButtonState("buttonstate", &buttonstate_msg);
 ros::Publisher pubOMStatus("mower/status", &om_mower_status_msg);
+ros::Publisher pubBatteryState("mower/battery_state", &battery_state_msg);
+ros::Publisher pubPowerTelemetry("mower/power_telemetry", &power_telemetry_msg);
 ros::Publisher pubWheelTicks("/mower/wheel_ticks", &wheel_ticks_msg);
+ros::Publisher pubCollision("mower/collision", &collision_msg);
+#if LATENCY_PROBES
+ros::Publisher pubLatency("mower/latency", &latency_msg);
+#endif
 #ifdef ROS_PUBLISH_MOWGLI
 ros::Publisher pubStatus("mowgli/status", &status_msg);
 #endif
 
 // IMU external
 ros::Publisher pubIMU("imu/data_raw", &imu_msg);
+// IMU onboard (LIS3DH accelerometer, mean of the FIFO batch)
+ros::Publisher pubIMUOnboard("imu_onboard/data_raw", &imu_onboard_msg);
 
 #if OPTION_ULTRASONIC == 1
 ros::Publisher pubLeftUltrasonic("ultrasonic/left", &ultrasonic_left_msg);
@@ -155,8 +210,20 @@ ros::Publisher pubRightBumper("bumper/right", &bumper_left_msg);
  */
 extern "C" void CommandVelocityMessageCb(const geometry_msgs::Twist &msg);
 extern "C" void CommandHighLevelStatusMessageCb(const mower_msgs::HighLevelStatus &msg);
+extern "C" void PowerTelemetryRateMessageCb(const std_msgs::UInt8 &msg);
+extern "C" void ImuRateMessageCb(const std_msgs::UInt8 &msg);
 ros::Subscriber<geometry_msgs::Twist> subCommandVelocity("cmd_vel", CommandVelocityMessageCb);
 ros::Subscriber<mower_msgs::HighLevelStatus> subCommandHighLevelStatus("mower_logic/current_state", CommandHighLevelStatusMessageCb);
+ros::Subscriber<std_msgs::UInt8> subPowerTelemetryRate("mower/power_telemetry/rate", PowerTelemetryRateMessageCb);
+ros::Subscriber<std_msgs::UInt8> subImuRate("imu/rate", ImuRateMessageCb);
+#ifdef EXTERNAL_IMU_ORIENTATION
+extern "C" void ImuOrientationMessageCb(const std_msgs::Bool &msg);
+ros::Subscriber<std_msgs::Bool> subImuOrientation("imu/orientation", ImuOrientationMessageCb);
+#endif
+#if LATENCY_PROBES
+extern "C" void LatencyResetMessageCb(const std_msgs::Empty &msg);
+ros::Subscriber<std_msgs::Empty> subLatencyReset("mower/latency/reset", LatencyResetMessageCb);
+#endif
 
 // SERVICES
 void cbSetCfg(const mowgli::SetCfgRequest &req, mowgli::SetCfgResponse &res);
@@ -180,6 +247,10 @@ mower_msgs::Perimeter om_perimeter_msg;
 void cbPerimeterListen(const mower_msgs::PerimeterControlSrvRequest &req, mower_msgs::PerimeterControlSrvResponse &res);
 ros::Publisher pubPerimeter("mower/perimeter",&om_perimeter_msg);
 ros::ServiceServer<mower_msgs::PerimeterControlSrvRequest, mower_msgs::PerimeterControlSrvResponse> svcPerimeterListen("mower_service/perimeter_listen",cbPerimeterListen);
+// waveform stream in debug mode, binary frames (see perimeter.h)
+std_msgs::UInt8MultiArray perimeter_stream_msg;
+static uint8_t perimeter_stream_data[PERIMETER_STREAM_MAX_LENGTH];
+ros::Publisher pubPerimeterStream("mower/perimeter/stream", &perimeter_stream_msg);
 #endif
 
 /*
@@ -191,6 +262,11 @@ static nbt_t motors_nbt;
 static nbt_t panel_nbt;
 static nbt_t imu_nbt;
 static nbt_t status_nbt;
+static nbt_t power_sample_nbt;
+static nbt_t power_publish_nbt;
+#ifdef OPTION_PERIMETER
+static nbt_t perimeter_stream_nbt;
+#endif
 
 /*
  * reboot flag, if true we reboot after next publish_nbt
@@ -284,6 +360,7 @@ extern "C" void CommandHighLevelStatusMessageCb(const mower_msgs::HighLevelStatu
 		main_eOpenmowerStatus = OPENMOWER_STATUS_IDLE;
 		left_dir = right_dir = 1;
 		left_speed = right_speed = blade_on_off = target_blade_on_off = 0;
+		cmd_left_mps = cmd_right_mps = 0;
 		break;
 	}
 }
@@ -297,6 +374,7 @@ extern "C" void CommandVelocityMessageCb(const geometry_msgs::Twist &msg)
 	double l_fVz;
 
 	last_cmd_vel = nh.now();
+	LATENCY_Start(LATENCY_MASK(LATENCY_CMD_VEL));
 	if (main_eOpenmowerStatus == OPENMOWER_STATUS_IDLE)
 	{
 		return;
@@ -308,9 +386,17 @@ extern "C" void CommandVelocityMessageCb(const geometry_msgs::Twist &msg)
 	float right_twist_mps = l_fVz * WHEEL_BASE * 0.5;
 
 	// add them to the linear speed
-	float left_mps = l_fVx + left_twist_mps;
-	float right_mps = l_fVx + right_twist_mps;
+	cmd_left_mps = l_fVx + left_twist_mps;
+	cmd_right_mps = l_fVx + right_twist_mps;
+
+	drive_setSpeed(cmd_left_mps, cmd_right_mps);
+}
 
+/*
+ * cap the wheel speeds to MAX_MPS and convert them to drivemotors PWM values
+ */
+static void drive_setSpeed(float left_mps, float right_mps)
+{
 	// cap left motor speed to MAX_MPS
 	if (left_mps > MAX_MPS)
 	{
@@ -341,6 +427,77 @@ extern "C" void CommandVelocityMessageCb(const geometry_msgs::Twist &msg)
 	//	debug_printf("left_mps: %f (%c)  right_mps: %f (%c)\r\n", left_mps, left_dir?'F':'R', right_mps, right_dir?'F':'R');
 }
 
+/*
+ * restart the power telemetry min/max/mean aggregation
+ */
+static void power_reset(void)
+{
+	for (uint8_t i = 0; i < POWER_SIGNAL_MAX; i++)
+	{
+		power_min[i] = INT32_MAX;
+		power_max[i] = INT32_MIN;
+		power_sum[i] = 0;
+	}
+	power_samples = 0;
+}
+
+/*
+ * set the mower/power_telemetry publish rate, clamped to POWER_TELEMETRY_MIN_HZ..POWER_TELEMETRY_MAX_HZ
+ */
+static void power_setRate(uint8_t hz)
+{
+	if (hz < POWER_TELEMETRY_MIN_HZ)
+	{
+		hz = POWER_TELEMETRY_MIN_HZ;
+	}
+	else if (hz > POWER_TELEMETRY_MAX_HZ)
+	{
+		hz = POWER_TELEMETRY_MAX_HZ;
+	}
+	// NBT fires when more than the timeout elapsed
+	NBT_init(&power_publish_nbt, (1000 / hz) - 1);
+	power_reset();
+}
+
+/*
+ * receive the power telemetry rate (Hz) on mower/power_telemetry/rate
+ */
+extern "C" void PowerTelemetryRateMessageCb(const std_msgs::UInt8 &msg)
+{
+	power_setRate(msg.data);
+}
+
+/*
+ * receive the imu/data_raw rate (Hz) on imu/rate, FIFO samples are decimated to it
+ */
+extern "C" void ImuRateMessageCb(const std_msgs::UInt8 &msg)
+{
+	uint8_t hz = IMU_SetRate(msg.data);
+
+	debug_printf(" * imu/data_raw at %d Hz\r\n", hz);
+}
+
+#ifdef EXTERNAL_IMU_ORIENTATION
+/*
+ * switch the attitude filter on imu/orientation, false publishes imu/data_raw without orientation
+ */
+extern "C" void ImuOrientationMessageCb(const std_msgs::Bool &msg)
+{
+	IMU_SetOrientation(msg.data);
+	debug_printf(" * imu/data_raw orientation %s\r\n", msg.data ? "on" : "off");
+}
+#endif
+
+#if LATENCY_PROBES
+/*
+ * clear the latency histograms on mower/latency/reset
+ */
+extern "C" void LatencyResetMessageCb(const std_msgs::Empty &msg)
+{
+	LATENCY_Reset();
+}
+#endif
+
 uint8_t CDC_DataReceivedHandler(const uint8_t *Buf, uint32_t len)
 {
 
@@ -361,6 +518,11 @@ extern "C" void chatter_handler()
 
 		HAL_GPIO_TogglePin(LED_GPIO_PORT, LED_PIN); // flash LED
 
+#if LATENCY_PROBES
+		LATENCY_Export(latency_data);
+		pubLatency.publish(&latency_msg);
+#endif
+
 		// reboot if set via cbReboot (mowgli/Reboot)
 		if (reboot_flag)
 		{
@@ -382,11 +544,29 @@ extern "C" void motors_handler()
 		blade_on_off = target_blade_on_off;
 		if (Emergency_State())
 		{
-			DRIVEMOTOR_SetSpeed(0, 0, 0, 0);
+			DRIVEMOTOR_Stop();
 			blade_on_off = 0;
 		}
 		else
 		{
+#ifdef BLADE_LOAD_ADAPTIVE_SPEED
+			// scale the ground speed with the blade load, keeping the curvature when capping to MAX_MPS
+			if (main_eOpenmowerStatus == OPENMOWER_STATUS_MOWING && blade_on_off)
+			{
+				float l_fScale = BLADEMOTOR_fSpeedScale;
+				float l_fMaxMps = fmaxf(fabsf(cmd_left_mps), fabsf(cmd_right_mps));
+
+				if (l_fMaxMps * l_fScale > MAX_MPS)
+				{
+					l_fScale = MAX_MPS / l_fMaxMps;
+				}
+				drive_setSpeed(cmd_left_mps * l_fScale, cmd_right_mps * l_fScale);
+			}
+			else
+			{
+				drive_setSpeed(cmd_left_mps, cmd_right_mps);
+			}
+#endif
 			// if the last velocity cmd is older than 1sec we stop the drive motors
 			last_cmd_vel_age = nh.now().toSec() - last_cmd_vel.toSec();
 			if (last_cmd_vel_age > 0.2)
@@ -500,54 +680,166 @@ extern "C" void wheelTicks_handler(int8_t p_u8LeftDirection, int8_t p_u8RightDir
 	pubWheelTicks.publish(&wheel_ticks_msg);
 }
 
-extern "C" void broadcast_handler()
+/* \fn collision_handler
+ * \brief Send collision event to openmower by rosserial
+ * is called when the drive motor power detects a collision, bit0 left wheel, bit1 right wheel
+ */
+extern "C" void collision_handler(uint8_t p_u8Wheels)
 {
-	if (NBT_handler(&imu_nbt))
+	collision_msg.data = p_u8Wheels;
+	pubCollision.publish(&collision_msg);
+}
+
+/* \fn power_handler
+ * \brief power telemetry, samples the charging signals every ms and publishes their
+ * min/max/mean over each interval on mower/power_telemetry (rate set on mower/power_telemetry/rate)
+ */
+extern "C" void power_handler(void)
+{
+	int32_t sample[POWER_SIGNAL_MAX];
+
+	if (NBT_handler(&power_sample_nbt))
 	{
-		////////////////////////////////////////
-		// IMU Messages
-		////////////////////////////////////////
-		imu_msg.header.frame_id = "imu";
+		// unfiltered charging scans (mV, mA) so the ripple shows in min/max, the NTC is only converted by ADC_input()
+		sample[POWER_SIGNAL_BATTERY_VOLTAGE] = ADC_ChargingSampleMilli(ADC_CHARGING_CHANNEL_BATTERYVOLTAGE);
+		sample[POWER_SIGNAL_CHARGE_CURRENT] = ADC_ChargingSampleMilli(ADC_CHARGING_CHANNEL_CURRENT) - (int32_t)(charge_current_offset.f * 1000);
+		sample[POWER_SIGNAL_INPUT_VOLTAGE] = ADC_ChargingSampleMilli(ADC_CHARGING_CHANNEL_CHARGERINPUTVOLTAGE);
+		sample[POWER_SIGNAL_CHARGE_PWM] = chargecontrol_pwm_val;
+		sample[POWER_SIGNAL_BLADE_TEMPERATURE] = (int32_t)(blade_temperature * 100);
+
+		for (uint8_t i = 0; i < POWER_SIGNAL_MAX; i++)
+		{
+			if (sample[i] < power_min[i])
+			{
+				power_min[i] = sample[i];
+			}
+			if (sample[i] > power_max[i])
+			{
+				power_max[i] = sample[i];
+			}
+			power_sum[i] += sample[i];
+		}
+		power_samples++;
+	}
+
+	if (NBT_handler(&power_publish_nbt) && power_samples)
+	{
+		static const float scale[POWER_SIGNAL_MAX] = {0.001f, 0.001f, 0.001f, 1.0f, 0.01f};
 
+		for (uint8_t i = 0; i < POWER_SIGNAL_MAX; i++)
+		{
+			power_telemetry_data[i * POWER_STAT_MAX + 0] = power_min[i] * scale[i];
+			power_telemetry_data[i * POWER_STAT_MAX + 1] = power_max[i] * scale[i];
+			power_telemetry_data[i * POWER_STAT_MAX + 2] = ((float)power_sum[i] / power_samples) * scale[i];
+		}
+		pubPowerTelemetry.publish(&power_telemetry_msg);
+		power_reset();
+	}
+}
+
+static void imu_publish(void)
+{
+	////////////////////////////////////////
+	// IMU Messages
+	////////////////////////////////////////
+	imu_msg.header.frame_id = "imu";
+
+	/**********************************/
+	/* Attitude filter				  */
+	/**********************************/
+#ifdef EXTERNAL_IMU_ORIENTATION
+	if (IMU_ReadOrientation(&imu_msg.orientation.x, &imu_msg.orientation.y, &imu_msg.orientation.z, &imu_msg.orientation.w))
+	{
+		IMU_OrientationSetCovariance(imu_msg.orientation_covariance);
+	}
+	else
+#endif
+	{
 		// No Orientation in IMU message
 		imu_msg.orientation.x =
 		imu_msg.orientation.y = 
 		imu_msg.orientation.z = 
 		imu_msg.orientation.w = 0;
 		imu_msg.orientation_covariance[0] = -1;
+	}
 
-		/**********************************/
-		/* Exernal Accelerometer 		  */
-		/**********************************/
+	/**********************************/
+	/* Exernal Accelerometer 		  */
+	/**********************************/
 #ifdef EXTERNAL_IMU_ACCELERATION
-		// Linear acceleration
-		IMU_ReadAccelerometer(&imu_msg.linear_acceleration.x, &imu_msg.linear_acceleration.y, &imu_msg.linear_acceleration.z);
-		IMU_AccelerometerSetCovariance(imu_msg.linear_acceleration_covariance);
+	// Linear acceleration
+	IMU_ReadAccelerometer(&imu_msg.linear_acceleration.x, &imu_msg.linear_acceleration.y, &imu_msg.linear_acceleration.z);
+	IMU_AccelerometerSetCovariance(imu_msg.linear_acceleration_covariance);
 #else
-		imu_msg.linear_acceleration.x = imu_msg.linear_acceleration.y = imu_msg.linear_acceleration.z = 0;
-		imu_msg.linear_acceleration_covariance[0] = -1;
+	imu_msg.linear_acceleration.x = imu_msg.linear_acceleration.y = imu_msg.linear_acceleration.z = 0;
+	imu_msg.linear_acceleration_covariance[0] = -1;
 #endif
-		/**********************************/
-		/* Exernal Gyro					  */
-		/**********************************/
+	/**********************************/
+	/* Exernal Gyro					  */
+	/**********************************/
 #ifdef EXTERNAL_IMU_ANGULAR
-		// Angular velocity
-		IMU_ReadGyro(&imu_msg.angular_velocity.x, &imu_msg.angular_velocity.y, &imu_msg.angular_velocity.z);
-		IMU_GyroSetCovariance(imu_msg.angular_velocity_covariance);
+	// Angular velocity
+	IMU_ReadGyro(&imu_msg.angular_velocity.x, &imu_msg.angular_velocity.y, &imu_msg.angular_velocity.z);
+	IMU_GyroSetCovariance(imu_msg.angular_velocity_covariance);
 #else
-		imu_msg.angular_velocity.x = imu_msg.angular_velocity.y = imu_msg.angular_velocity.z = 0;
-		imu_msg.angular_velocity_covariance[0] = -1;
+	imu_msg.angular_velocity.x = imu_msg.angular_velocity.y = imu_msg.angular_velocity.z = 0;
+	imu_msg.angular_velocity_covariance[0] = -1;
 #endif
-		imu_msg.header.stamp = nh.now();
-		pubIMU.publish(&imu_msg);
+	imu_msg.header.stamp = nh.now();
+	pubIMU.publish(&imu_msg);
+}
+
+extern "C" void broadcast_handler()
+{
+	if (NBT_handler(&imu_nbt))
+	{
+		// external IMU: FIFO drain or burst read in the background, published once a sample is in
+		if (!IMU_StartSample() && !IMU_HasAccelerometer() && !IMU_HasGyro())
+		{
+			imu_publish();
+		}
+
+		/**********************************/
+		/* Onboard Accelerometer		  */
+		/**********************************/
+		if (IMU_Onboard_ReadAccelerometerMean(&imu_onboard_msg.linear_acceleration.x, &imu_onboard_msg.linear_acceleration.y, &imu_onboard_msg.linear_acceleration.z))
+		{
+			imu_onboard_msg.header.frame_id = "imu_onboard";
+			imu_onboard_msg.orientation.x =
+			imu_onboard_msg.orientation.y =
+			imu_onboard_msg.orientation.z =
+			imu_onboard_msg.orientation.w = 0;
+			imu_onboard_msg.orientation_covariance[0] = -1;
+			imu_onboard_msg.angular_velocity.x = imu_onboard_msg.angular_velocity.y = imu_onboard_msg.angular_velocity.z = 0;
+			imu_onboard_msg.angular_velocity_covariance[0] = -1;
+			IMU_Onboard_AccelerometerSetCovariance(imu_onboard_msg.linear_acceleration_covariance);
+			imu_onboard_msg.header.stamp = nh.now();
+			pubIMUOnboard.publish(&imu_onboard_msg);
+		}
 
 #ifdef OPTION_PERIMETER
-		if (Perimeter_UpdateMsg(&om_perimeter_msg.left,&om_perimeter_msg.center,&om_perimeter_msg.right)) {
+		if (Perimeter_UpdateMsg(&om_perimeter_msg.left,&om_perimeter_msg.center,&om_perimeter_msg.right,&om_perimeter_msg.code)) {
 			pubPerimeter.publish(&om_perimeter_msg);
 		}
 #endif
 	} // if (NBT_handler(&imu_nbt))
 
+	if (IMU_SampleReady())
+	{
+		imu_publish();
+	}
+
+#ifdef OPTION_PERIMETER
+	if (NBT_handler(&perimeter_stream_nbt))
+	{
+		perimeter_stream_msg.data_length = Perimeter_StreamChunk(perimeter_stream_data, sizeof(perimeter_stream_data));
+		if (perimeter_stream_msg.data_length)
+		{
+			pubPerimeterStream.publish(&perimeter_stream_msg);
+		}
+	}
+#endif
+
 	if (NBT_handler(&status_nbt))
 	{
 #ifdef ROS_PUBLISH_MOWGLI
@@ -617,6 +909,34 @@ extern "C" void broadcast_handler()
 		om_mower_status_msg.mow_enabled = target_blade_on_off;
 		pubOMStatus.publish(&om_mower_status_msg);
 
+		battery_state_msg.header.stamp = nh.now();
+		battery_state_msg.voltage = battery_voltage;
+		battery_state_msg.current = current;
+		battery_state_msg.temperature = NAN;
+		battery_state_msg.percentage = BATTERY_GetSoc();
+		battery_state_msg.charge = BATTERY_GetSoc() * BATTERY_CAPACITY_AH;
+		battery_state_msg.capacity = BATTERY_CAPACITY_AH;
+		battery_state_msg.design_capacity = BATTERY_CAPACITY_AH;
+		battery_state_msg.power_supply_technology = sensor_msgs::BatteryState::POWER_SUPPLY_TECHNOLOGY_LION;
+		battery_state_msg.present = battery_voltage >= MIN_BATTERY_VOLTAGE;
+		if (chargerInputVoltage < MIN_DOCKED_VOLTAGE)
+		{
+			battery_state_msg.power_supply_status = sensor_msgs::BatteryState::POWER_SUPPLY_STATUS_DISCHARGING;
+		}
+		else if (BATTERY_GetSoc() >= 1.0f)
+		{
+			battery_state_msg.power_supply_status = sensor_msgs::BatteryState::POWER_SUPPLY_STATUS_FULL;
+		}
+		else if (current >= MIN_CHARGE_CURRENT)
+		{
+			battery_state_msg.power_supply_status = sensor_msgs::BatteryState::POWER_SUPPLY_STATUS_CHARGING;
+		}
+		else
+		{
+			battery_state_msg.power_supply_status = sensor_msgs::BatteryState::POWER_SUPPLY_STATUS_NOT_CHARGING;
+		}
+		pubBatteryState.publish(&battery_state_msg);
+
 	}
 	// if (NBT_handler(&status_nbt))
 }
@@ -642,7 +962,13 @@ void cbEnableMowerMotor(const mower_msgs::MowerControlSrvRequest &req, mower_msg
  */
 void cbSetEmergency(const mower_msgs::EmergencyStopSrvRequest &req, mower_msgs::EmergencyStopSrvResponse &res)
 {
+	uint8_t l_u8Previous = Emergency_State();
+
 	Emergency_SetState(req.emergency);
+	if (!l_u8Previous && Emergency_State())
+	{
+		LATENCY_Start(LATENCY_MASK(LATENCY_SERVICE_DRIVE) | LATENCY_MASK(LATENCY_SERVICE_BLADE));
+	}
 }
 
 #ifdef OPTION_PERIMETER
@@ -722,15 +1048,30 @@ extern "C" void init_ROS()
 
 	nh.advertise(pubButtonState);
 	nh.advertise(pubIMU);
+	nh.advertise(pubIMUOnboard);
 #ifdef ROS_PUBLISH_MOWGLI
 	nh.advertise(pubStatus);
 #endif
 	nh.advertise(pubOMStatus);
+	nh.advertise(pubBatteryState);
+	nh.advertise(pubPowerTelemetry);
 	nh.advertise(pubWheelTicks);
+	nh.advertise(pubCollision);
+#if LATENCY_PROBES
+	nh.advertise(pubLatency);
+#endif
 
 	// Initialize Subscribers
 	nh.subscribe(subCommandVelocity);
 	nh.subscribe(subCommandHighLevelStatus);
+	nh.subscribe(subPowerTelemetryRate);
+	nh.subscribe(subImuRate);
+#ifdef EXTERNAL_IMU_ORIENTATION
+	nh.subscribe(subImuOrientation);
+#endif
+#if LATENCY_PROBES
+	nh.subscribe(subLatencyReset);
+#endif
 
 	// Initialize Services
 	// nh.advertiseService(svcSetCfg);
@@ -743,6 +1084,7 @@ extern "C" void init_ROS()
 
 #ifdef OPTION_PERIMETER
 	nh.advertise(pubPerimeter);
+	nh.advertise(pubPerimeterStream);
 	nh.advertiseService(svcPerimeterListen);
 #endif
 
@@ -753,6 +1095,39 @@ extern "C" void init_ROS()
 	NBT_init(&imu_nbt, IMU_NBT_TIME_MS);
 	NBT_init(&motors_nbt, MOTORS_NBT_TIME_MS);
 	NBT_init(&ros_nbt, 10);
+
+	// power telemetry layout, data[signal * 3 + stat]
+	power_telemetry_dim[0].label = "signal"; // battery_voltage, charge_current, input_voltage, charge_pwm, blade_temperature
+	power_telemetry_dim[0].size = POWER_SIGNAL_MAX;
+	power_telemetry_dim[0].stride = POWER_SIGNAL_MAX * POWER_STAT_MAX;
+	power_telemetry_dim[1].label = "stat"; // min, max, mean
+	power_telemetry_dim[1].size = POWER_STAT_MAX;
+	power_telemetry_dim[1].stride = POWER_STAT_MAX;
+	power_telemetry_msg.layout.dim_length = 2;
+	power_telemetry_msg.layout.dim = power_telemetry_dim;
+	power_telemetry_msg.data_length = POWER_SIGNAL_MAX * POWER_STAT_MAX;
+	power_telemetry_msg.data = power_telemetry_data;
+	NBT_init(&power_sample_nbt, POWER_SAMPLE_NBT_TIME_MS);
+	power_setRate(POWER_TELEMETRY_HZ);
+
+#if LATENCY_PROBES
+	// latency layout, data[probe * LATENCY_PROBE_LENGTH + stat]
+	latency_dim[0].label = "probe"; // input_drive, input_blade, service_drive, service_blade, cmd_vel
+	latency_dim[0].size = LATENCY_PROBE_MAX;
+	latency_dim[0].stride = LATENCY_PROBE_MAX * LATENCY_PROBE_LENGTH;
+	latency_dim[1].label = "stat"; // count, min_us, max_us, sum_us low, sum_us high, then buckets [2^b, 2^(b+1)) us
+	latency_dim[1].size = LATENCY_PROBE_LENGTH;
+	latency_dim[1].stride = LATENCY_PROBE_LENGTH;
+	latency_msg.layout.dim_length = 2;
+	latency_msg.layout.dim = latency_dim;
+	latency_msg.data_length = LATENCY_PROBE_MAX * LATENCY_PROBE_LENGTH;
+	latency_msg.data = latency_data;
+#endif
+
+#ifdef OPTION_PERIMETER
+	perimeter_stream_msg.data = perimeter_stream_data;
+	NBT_init(&perimeter_stream_nbt, PERIMETER_STREAM_NBT_TIME_MS);
+#endif
 }
 
 float clamp(float d, float min, float max)
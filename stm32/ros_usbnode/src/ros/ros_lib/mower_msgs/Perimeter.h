@@ -18,11 +18,14 @@ namespace mower_msgs
       _center_type center;
       typedef float _right_type;
       _right_type right;
+      typedef uint8_t _code_type;
+      _code_type code;
 
     Perimeter():
       left(0),
       center(0),
-      right(0)
+      right(0),
+      code(0)
     {
     }
 
@@ -59,6 +62,8 @@ namespace mower_msgs
       *(outbuffer + offset + 2) = (u_right.base >> (8 * 2)) & 0xFF;
       *(outbuffer + offset + 3) = (u_right.base >> (8 * 3)) & 0xFF;
       offset += sizeof(this->right);
+      *(outbuffer + offset + 0) = (this->code >> (8 * 0)) & 0xFF;
+      offset += sizeof(this->code);
       return offset;
     }
 
@@ -98,11 +103,13 @@ namespace mower_msgs
       u_right.base |= ((uint32_t) (*(inbuffer + offset + 3))) << (8 * 3);
       this->right = u_right.real;
       offset += sizeof(this->right);
+      this->code =  ((uint8_t) (*(inbuffer + offset)));
+      offset += sizeof(this->code);
      return offset;
     }
 
     virtual const char * getType() override { return "mower_msgs/Perimeter"; };
-    virtual const char * getMD5() override { return "1eef3cb68ced22453a42748a6794a55e"; };
+    virtual const char * getMD5() override { return "ccded232335fa5143579bbe773fe8e35"; };
 
   };
 
@@ -11,35 +11,34 @@
   * mostly reworked code from: https://schkorea.tistory.com/437
   * note that you need to turn off JTAG (but not SWD) to free the pins that go to
   * J18 !
+  *
+  * PB3/PB4 can't be routed to a hardware I2C, the bus is bit banged by the
+  * SOFT_I2C_TIM interrupt: every tick moves one SCL edge, so a register
+  * transfer runs in the background and SW_I2C_Transfer() returns at once.
+  * The pins stay open drain outputs, SDA is read back while it is released.
+  * The SW_I2C_UTIL_* functions are blocking wrappers for the device setup.
   ******************************************************************************
   */
 
 #include "stm32f_board_hal.h"
 #include "soft_i2c.h"
 #include "board.h"
-
-
-
-//#define  SW_I2C_WAIT_TIME  25	//(11.0us)
-//#define  SW_I2C_WAIT_TIME  23	//(10.4us)
-#define  SW_I2C_WAIT_TIME  22	//100Khz(10.0us)	100Khz	==	10us
-//#define  SW_I2C_WAIT_TIME  10	//195Khz
-//#define  SW_I2C_WAIT_TIME  9	//205Khz	200Khz	==	5us
-//#define  SW_I2C_WAIT_TIME  8	//237Khz
-//#define  SW_I2C_WAIT_TIME  7	//240Khz	250Khz	==	4us
-//#define  SW_I2C_WAIT_TIME  6	//275Khz
-//#define  SW_I2C_WAIT_TIME  5	//305Khz
-//#define  SW_I2C_WAIT_TIME  4	//350Khz(3.84us)
-//#define  SW_I2C_WAIT_TIME  3	//400Khz(3.44us)
-//#define  SW_I2C_WAIT_TIME  2	//425Khz(3.04us)	333Khz	==	3us
-//#define  SW_I2C_WAIT_TIME  1	//425Khz(2.64us)	400Khz	==	2.5us
+#include "main.h"
 
 #define TRUE 1
 #define FALSE 0
 
+/* boards without their own setting (board.h): TIM7 and 100kHz, the timer is free on the STM32F103 */
+#ifndef SOFT_I2C_TIM_INSTANCE
+#define SOFT_I2C_TIM_INSTANCE TIM7
+#define SOFT_I2C_TIM_IRQ TIM7_IRQn
+#define SOFT_I2C_TIM_CLK_ENABLE() __HAL_RCC_TIM7_CLK_ENABLE()
+#endif
+#ifndef SOFT_I2C_CLOCK_HZ
+#define SOFT_I2C_CLOCK_HZ 100000
+#endif
+
 #define  I2C_READ       0x01
-#define  READ_CMD       1
-#define  WRITE_CMD      0
 
 // map from board.h to what soft_i2c uses
 #define SW_I2C1_SCL_GPIO  SOFT_I2C_SCL_PORT
@@ -47,13 +46,74 @@
 #define SW_I2C1_SCL_PIN   SOFT_I2C_SCL_PIN
 #define SW_I2C1_SDA_PIN   SOFT_I2C_SDA_PIN
 
-
-void  __attribute__ ((optimize(0))) TIMER__Wait_us (uint32_t nCount) 
+/* two ticks (SCL low, SCL high) per bit */
+#define SW_I2C_TICK_HZ          (2 * SOFT_I2C_CLOCK_HZ)
+/* a slave may hold SCL low (clock stretching) for this many ticks before the transfer is aborted */
+#define SW_I2C_STRETCH_TICKS    (SW_I2C_TICK_HZ / 1000)
+
+/* pin access from the tick interrupt, HAL_GPIO_WritePin() is too slow at 200kHz */
+#define SCL_HIGH()  (SW_I2C1_SCL_GPIO->BSRR = SW_I2C1_SCL_PIN)
+#define SCL_LOW()   (SW_I2C1_SCL_GPIO->BSRR = (uint32_t)SW_I2C1_SCL_PIN << 16)
+#define SDA_HIGH()  (SW_I2C1_SDA_GPIO->BSRR = SW_I2C1_SDA_PIN)
+#define SDA_LOW()   (SW_I2C1_SDA_GPIO->BSRR = (uint32_t)SW_I2C1_SDA_PIN << 16)
+#define SCL_READ()  ((SW_I2C1_SCL_GPIO->IDR & SW_I2C1_SCL_PIN) != 0)
+#define SDA_READ()  ((SW_I2C1_SDA_GPIO->IDR & SW_I2C1_SDA_PIN) != 0)
+
+/* what the tick does next */
+typedef enum
+{
+    SW_I2C_STATE_IDLE = 0,
+    SW_I2C_STATE_START,         /* SDA low while SCL is high */
+    SW_I2C_STATE_START_SCL,     /* SCL low, first bit of the address */
+    SW_I2C_STATE_BIT_HIGH,      /* SCL high */
+    SW_I2C_STATE_BIT_SAMPLE,    /* sample SDA, SCL low, next bit */
+    SW_I2C_STATE_RESTART_SCL,   /* SDA released, SCL high */
+    SW_I2C_STATE_STOP_SCL,      /* SDA low, SCL high */
+    SW_I2C_STATE_STOP_SDA       /* SDA high while SCL is high */
+} SW_I2C_State_e;
+
+/* byte on the bus */
+typedef enum
+{
+    SW_I2C_PHASE_ADDRESS_WRITE = 0,
+    SW_I2C_PHASE_REGISTER,
+    SW_I2C_PHASE_WRITE,
+    SW_I2C_PHASE_ADDRESS_READ,
+    SW_I2C_PHASE_READ
+} SW_I2C_Phase_e;
+
+TIM_HandleTypeDef SOFT_I2C_TIM_Handle;
+uint32_t SW_I2C_u32Errors = 0;
+
+static volatile SW_I2C_State_e sw_i2c_eState = SW_I2C_STATE_IDLE;
+static SW_I2C_Phase_e sw_i2c_ePhase;
+static SW_I2C_Status_e sw_i2c_eStatus;
+static uint8_t sw_i2c_u8Address;       /* 8 bit write address */
+static uint8_t sw_i2c_u8Register;
+static uint8_t sw_i2c_bRead;
+static uint8_t *sw_i2c_pu8Data;
+static uint8_t sw_i2c_u8Length;
+static uint8_t sw_i2c_u8Index;
+static uint16_t sw_i2c_u16Out;         /* 8 data bits then the ACK bit, MSB first */
+static uint16_t sw_i2c_u16In;          /* sampled SDA, the ACK bit last */
+static uint8_t sw_i2c_u8Bits;          /* bits left in the byte */
+static uint16_t sw_i2c_u16Stretch;
+static SW_I2C_Callback_t sw_i2c_pfCallback;
+static void *sw_i2c_pvContext;
+
+static void sw_i2c_byte(uint8_t p_u8Data, uint8_t p_bAck);
+static void sw_i2c_byteDone(void);
+static void sw_i2c_stop(SW_I2C_Status_e p_eStatus);
+static void sw_i2c_done(void);
+static void sw_i2c_syncDone(SW_I2C_Status_e p_eStatus, void *p_pvContext);
+
+
+void  __attribute__ ((optimize(0))) TIMER__Wait_us (uint32_t nCount)
 {
     for (; nCount != 0;nCount--);
 }
 
-/* init soft i2c pins */
+/* init soft i2c pins and the bit timer */
 void SW_I2C_Init(void)
 {
     /* PB3, PB4 are used by the JTAG - we need to disable it, as we use SWD anyhow we dont need it */
@@ -74,622 +134,341 @@ void SW_I2C_Init(void)
 	SOFT_I2C_GPIO_CLK_ENABLE();
 
     GPIO_InitTypeDef GPIO_InitStruct;
-    
+
     GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_HIGH;
     GPIO_InitStruct.Mode  = GPIO_MODE_OUTPUT_OD;
     GPIO_InitStruct.Pull = GPIO_PULLUP;
 
+    /* bus idle */
+    SCL_HIGH();
+    SDA_HIGH();
 
     GPIO_InitStruct.Pin   = SW_I2C1_SCL_PIN;
     HAL_GPIO_Init(SW_I2C1_SCL_GPIO, &GPIO_InitStruct);
 
     GPIO_InitStruct.Pin   = SW_I2C1_SDA_PIN;
-    HAL_GPIO_Init(SW_I2C1_SDA_GPIO, &GPIO_InitStruct);    
+    HAL_GPIO_Init(SW_I2C1_SDA_GPIO, &GPIO_InitStruct);
+
+    /* bit timer, only counting during a transfer */
+    SOFT_I2C_TIM_CLK_ENABLE();
+    SOFT_I2C_TIM_Handle.Instance = SOFT_I2C_TIM_INSTANCE;
+    SOFT_I2C_TIM_Handle.Init.Prescaler = 0;
+    SOFT_I2C_TIM_Handle.Init.CounterMode = TIM_COUNTERMODE_UP;
+    SOFT_I2C_TIM_Handle.Init.Period = SystemCoreClock / SW_I2C_TICK_HZ - 1;
+    SOFT_I2C_TIM_Handle.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
+    SOFT_I2C_TIM_Handle.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_DISABLE;
+    if (HAL_TIM_Base_Init(&SOFT_I2C_TIM_Handle) != HAL_OK)
+    {
+        Error_Handler();
+    }
+    __HAL_TIM_CLEAR_FLAG(&SOFT_I2C_TIM_Handle, TIM_FLAG_UPDATE);
+    __HAL_TIM_ENABLE_IT(&SOFT_I2C_TIM_Handle, TIM_IT_UPDATE);
+    HAL_NVIC_SetPriority(SOFT_I2C_TIM_IRQ, 0, 0);
+    HAL_NVIC_EnableIRQ(SOFT_I2C_TIM_IRQ);
 }
 
 /* de-init soft i2c pins */
 void SW_I2C_DeInit(void)
-{ 
+{
+   HAL_NVIC_DisableIRQ(SOFT_I2C_TIM_IRQ);
+   __HAL_TIM_DISABLE(&SOFT_I2C_TIM_Handle);
+   sw_i2c_eState = SW_I2C_STATE_IDLE;
    HAL_GPIO_DeInit(SW_I2C1_SCL_GPIO, SW_I2C1_SCL_PIN);
    HAL_GPIO_DeInit(SW_I2C1_SDA_GPIO, SW_I2C1_SDA_PIN);
 }
 
-// SDA High
-void sda_high(void)
-{ 
-    HAL_GPIO_WritePin(SW_I2C1_SDA_GPIO, SW_I2C1_SDA_PIN, GPIO_PIN_SET);
-}
-
-// SDA low
-void sda_low(void)
-{
-    HAL_GPIO_WritePin(SW_I2C1_SDA_GPIO, SW_I2C1_SDA_PIN, GPIO_PIN_RESET);
-}
-
-// SCL High
-void scl_high(void)
-{   
-    HAL_GPIO_WritePin(SW_I2C1_SCL_GPIO, SW_I2C1_SCL_PIN, GPIO_PIN_SET);
-}
-
-// SCL low
-void scl_low(void)
-{    
-    HAL_GPIO_WritePin(SW_I2C1_SCL_GPIO, SW_I2C1_SCL_PIN, GPIO_PIN_RESET);
-}
-
-void sda_out(uint8_t out)
-{
-    if (out)
-    {
-        sda_high();
-    }
-    else
-    {
-        sda_low();
-    }
-}
-
-void sda_in_mode(void)
-{
-  //  debug_printf("sda_in_mode()\r\n");
-    GPIO_InitTypeDef GPIO_InitStruct;
-
-    GPIO_InitStruct.Speed = GPIO_SPEED_HIGH;
-    GPIO_InitStruct.Mode  = GPIO_MODE_INPUT;	//IPD->IPU
-	GPIO_InitStruct.Pull = GPIO_PULLUP;
-    GPIO_InitStruct.Pin   = SW_I2C1_SDA_PIN;
-    HAL_GPIO_Init(SW_I2C1_SDA_GPIO, &GPIO_InitStruct);  
-}
-
-void sda_out_mode(void)
-{
-    //debug_printf("sda_out_mode()\r\n");
-
-    GPIO_InitTypeDef GPIO_InitStruct;
-    
-    GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_OD;
-    GPIO_InitStruct.Pull = GPIO_PULLUP;
-    GPIO_InitStruct.Speed = GPIO_SPEED_HIGH;
-
-
-    GPIO_InitStruct.Pin   = SW_I2C1_SDA_PIN;
-    HAL_GPIO_Init(SW_I2C1_SDA_GPIO, &GPIO_InitStruct);  
-}
-
-void scl_in_mode(void)
-{
-    GPIO_InitTypeDef GPIO_InitStruct;
-
-    GPIO_InitStruct.Speed = GPIO_SPEED_HIGH;
-    GPIO_InitStruct.Mode  = GPIO_MODE_INPUT;	//IPD->IPU
-    GPIO_InitStruct.Pull = GPIO_PULLUP;
-
-    GPIO_InitStruct.Pin   = SW_I2C1_SCL_PIN;
-    HAL_GPIO_Init(SW_I2C1_SCL_GPIO, &GPIO_InitStruct);
-  
-}
-
-void scl_out_mode(void)
-{
-    GPIO_InitTypeDef GPIO_InitStruct;
-
-    GPIO_InitStruct.Speed = GPIO_SPEED_HIGH;
-    GPIO_InitStruct.Mode  = GPIO_MODE_OUTPUT_OD;		// error point GPIO_Mode_Out_PP	
-    GPIO_InitStruct.Pull = GPIO_PULLUP;
-
-    GPIO_InitStruct.Pin   = SW_I2C1_SCL_PIN;
-    HAL_GPIO_Init(SW_I2C1_SCL_GPIO, &GPIO_InitStruct);
-}
-
-void i2c_clk_data_out(void)
-{
-    scl_high();
-    TIMER__Wait_us(SW_I2C_WAIT_TIME);
-    scl_low();
-    //TIMER__Wait_us(SW_I2C_WAIT_TIME>>2);
-}
-
-void i2c_port_initial(void)
+/* external functions */
+uint8_t SW_I2C_ReadVal_SDA(void)
 {
-    sda_high();
-    scl_high();
+    return HAL_GPIO_ReadPin(SW_I2C1_SDA_GPIO, SW_I2C1_SDA_PIN);
 }
 
-void i2c_start_condition(void)
-{
-    sda_high();
-    scl_high();
-
-    TIMER__Wait_us(SW_I2C_WAIT_TIME);
-    sda_low();
-    TIMER__Wait_us(SW_I2C_WAIT_TIME);
-    scl_low();
-}
-
-void i2c_stop_condition(void)
+uint8_t SW_I2C_ReadVal_SCL(void)
 {
-    sda_low();
-    scl_high();
-
-    TIMER__Wait_us(SW_I2C_WAIT_TIME);
-    sda_high();
-    TIMER__Wait_us(SW_I2C_WAIT_TIME);
-    scl_low();
+    return HAL_GPIO_ReadPin(SW_I2C1_SCL_GPIO, SW_I2C1_SCL_PIN);
 }
 
-static int i2c_check_ack(void)
+/*
+ * start a register read or write in the background, p_pfCallback is called from the
+ * timer interrupt when it is done, p_pu8Data has to stay valid until then
+ * returns FALSE if a transfer is still running
+ */
+uint8_t SW_I2C_Transfer(uint8_t IICID, uint8_t regaddr, uint8_t bRead, uint8_t *pdata, uint8_t len, SW_I2C_Callback_t p_pfCallback, void *p_pvContext)
 {
-    int             i;
-
-    sda_in_mode();
-    TIMER__Wait_us(SW_I2C_WAIT_TIME);
-
-    scl_high();
-
-    for (i = 20000; i > 0; i--)
+    if (sw_i2c_eState != SW_I2C_STATE_IDLE || len == 0)
     {
-        if (!SW_I2C_ReadVal_SDA()) break;	//0=ack , 1=nack
+        return FALSE;
     }
-    scl_low();
-    sda_out_mode();
-
-    return i;
-}
+    sw_i2c_u8Address = IICID & ~I2C_READ;
+    sw_i2c_u8Register = regaddr;
+    sw_i2c_bRead = bRead;
+    sw_i2c_pu8Data = pdata;
+    sw_i2c_u8Length = len;
+    sw_i2c_u8Index = 0;
+    sw_i2c_pfCallback = p_pfCallback;
+    sw_i2c_pvContext = p_pvContext;
+    sw_i2c_ePhase = SW_I2C_PHASE_ADDRESS_WRITE;
+    sw_i2c_eStatus = SW_I2C_OK;
+    sw_i2c_u16Stretch = 0;
+    sw_i2c_eState = SW_I2C_STATE_START;
 
-void i2c_send_not_ack(void)
-{
-    i2c_clk_data_out();
-    TIMER__Wait_us(SW_I2C_WAIT_TIME);
+    __HAL_TIM_SET_COUNTER(&SOFT_I2C_TIM_Handle, 0);
+    __HAL_TIM_ENABLE(&SOFT_I2C_TIM_Handle);
+    return TRUE;
 }
 
-void i2c_send_final_nack(void)
+/* a transfer is running */
+uint8_t SW_I2C_Busy(void)
 {
-    sda_out_mode();
-    sda_high();
-
-    TIMER__Wait_us(SW_I2C_WAIT_TIME);
-    scl_high();
-
-    TIMER__Wait_us(SW_I2C_WAIT_TIME);
-
-    scl_low();
+    return sw_i2c_eState != SW_I2C_STATE_IDLE;
 }
 
-void i2c_check_final_read_not_ack(void)
+/*
+ * one SCL edge, called from the SOFT_I2C_TIM update interrupt
+ */
+void SW_I2C_TimerIT(void)
 {
-    i2c_clk_data_out();
-    TIMER__Wait_us(SW_I2C_WAIT_TIME);
-    sda_out_mode();
-}
-
-
-void i2c_check_not_ack_continue(void)
-{
-//    sda_in_mode();
-    i2c_clk_data_out();
-//    sda_out_mode();
-    TIMER__Wait_us(SW_I2C_WAIT_TIME);
-}
-
-void i2c_byte_out(uint8_t addr)
-{
-    int  x;
-
-    for (x = 128; x ; x>>=1)
+    switch (sw_i2c_eState)
     {
-        sda_out(addr & x);
-        TIMER__Wait_us(SW_I2C_WAIT_TIME);
-        i2c_clk_data_out();
-//        TIMER__Wait_us(SW_I2C_WAIT_TIME);
+    case SW_I2C_STATE_START:
+        SDA_LOW();
+        sw_i2c_eState = SW_I2C_STATE_START_SCL;
+        break;
+
+    case SW_I2C_STATE_START_SCL:
+        SCL_LOW();
+        sw_i2c_byte(sw_i2c_ePhase == SW_I2C_PHASE_ADDRESS_READ ? sw_i2c_u8Address | I2C_READ : sw_i2c_u8Address, 1);
+        break;
+
+    case SW_I2C_STATE_BIT_HIGH:
+        SCL_HIGH();
+        sw_i2c_eState = SW_I2C_STATE_BIT_SAMPLE;
+        break;
+
+    case SW_I2C_STATE_BIT_SAMPLE:
+    case SW_I2C_STATE_STOP_SDA:
+        /* the slave holds SCL low */
+        if (!SCL_READ())
+        {
+            if (++sw_i2c_u16Stretch > SW_I2C_STRETCH_TICKS)
+            {
+                sw_i2c_eStatus = SW_I2C_TIMEOUT;
+                sw_i2c_done();
+            }
+            break;
+        }
+        sw_i2c_u16Stretch = 0;
+        if (sw_i2c_eState == SW_I2C_STATE_STOP_SDA)
+        {
+            SDA_HIGH();
+            sw_i2c_done();
+            break;
+        }
+        sw_i2c_u16In = (sw_i2c_u16In << 1) | SDA_READ();
+        SCL_LOW();
+        if (--sw_i2c_u8Bits)
+        {
+            if (sw_i2c_u16Out & (1 << (sw_i2c_u8Bits - 1))) { SDA_HIGH(); } else { SDA_LOW(); }
+            sw_i2c_eState = SW_I2C_STATE_BIT_HIGH;
+        }
+        else
+        {
+            sw_i2c_byteDone();
+        }
+        break;
+
+    case SW_I2C_STATE_RESTART_SCL:
+        SCL_HIGH();
+        sw_i2c_eState = SW_I2C_STATE_START;
+        break;
+
+    case SW_I2C_STATE_STOP_SCL:
+        SCL_HIGH();
+        sw_i2c_eState = SW_I2C_STATE_STOP_SDA;
+        break;
+
+    default:
+        __HAL_TIM_DISABLE(&SOFT_I2C_TIM_Handle);
+        break;
     }
 }
 
-void i2c_slave_address(uint8_t IICID, uint8_t readwrite)
+/* blocking transfer */
+static uint8_t sw_i2c_transferSync(uint8_t IICID, uint8_t regaddr, uint8_t bRead, uint8_t *pdata, uint8_t len, SW_I2C_Status_e *p_peStatus)
 {
-    i2c_byte_out(IICID | (readwrite ? I2C_READ : 0));
-}
-
-void i2c_send_ack(void)
-{
-    sda_out_mode();
-    sda_low();
-
-    TIMER__Wait_us(SW_I2C_WAIT_TIME);
-    scl_high();
+    volatile uint8_t l_bDone = 0;
 
-    TIMER__Wait_us(SW_I2C_WAIT_TIME);
-
-    scl_low();
-    sda_in_mode();
-    
-    TIMER__Wait_us(SW_I2C_WAIT_TIME);
-}
-
-/* external functions */
-uint8_t SW_I2C_ReadVal_SDA(void)
-{    
-    return HAL_GPIO_ReadPin(SW_I2C1_SDA_GPIO, SW_I2C1_SDA_PIN);       
-}
-
-uint8_t SW_I2C_ReadVal_SCL(void)
-{ 
-    return HAL_GPIO_ReadPin(SW_I2C1_SCL_GPIO, SW_I2C1_SCL_PIN);    
-}
-
-void SW_I2C_Write_Data(uint8_t data)
-{
-    int  x;
-
-    scl_low();
-
-    for (x = 7; x >= 0; x--)
-    {
-        sda_out(data & (1 << x));
-        TIMER__Wait_us(SW_I2C_WAIT_TIME);
-        i2c_clk_data_out();
-//        TIMER__Wait_us(SW_I2C_WAIT_TIME);
-    }
-}
-
-uint8_t SW_I2C_Read_Data_in_in_mode(void)
-{
-    int      x;
-    uint8_t  readdata = 0;
-
-    sda_in_mode();
-    for (x = 128; x; x>>=1)
+    *p_peStatus = SW_I2C_TIMEOUT;
+    while (SW_I2C_Busy());
+    if (!SW_I2C_Transfer(IICID, regaddr, bRead, pdata, len, sw_i2c_syncDone, (void *)&l_bDone))
     {
-        TIMER__Wait_us(SW_I2C_WAIT_TIME);
-        scl_high();
-
-        TIMER__Wait_us(SW_I2C_WAIT_TIME);
-
-        if (SW_I2C_ReadVal_SDA())
-            readdata |= x;
-
-        scl_low();
-
+        return FALSE;
     }
-
-    return readdata;
+    while (!l_bDone);
+    *p_peStatus = sw_i2c_eStatus;
+    return *p_peStatus == SW_I2C_OK;
 }
 
 uint8_t SW_I2C_WriteControl_8Bit(uint8_t IICID, uint8_t regaddr, uint8_t data)
 {
-    uint8_t   returnack = TRUE;
-
-    i2c_start_condition();
-
-    i2c_slave_address(IICID, WRITE_CMD);
-    if (!i2c_check_ack())
-    {
-        returnack = FALSE;
-    }
-
-    i2c_byte_out(regaddr);
-    if (!i2c_check_ack())
-    {
-        returnack = FALSE;
-    }
-
-    SW_I2C_Write_Data(data);
-    if (!i2c_check_ack())
-    {
-        returnack = FALSE;
-    }
-
-    TIMER__Wait_us(SW_I2C_WAIT_TIME);
+    SW_I2C_Status_e l_eStatus;
 
-    i2c_stop_condition();
-
-    return returnack;
+    return sw_i2c_transferSync(IICID, regaddr, 0, &data, 1, &l_eStatus);
 }
 
-uint8_t SW_I2C_WriteControl_8Bit_OnlyRegAddr(uint8_t IICID, uint8_t regaddr)
+uint8_t SW_I2C_ReadControl_8Bit(uint8_t IICID, uint8_t regaddr)
 {
-    uint8_t   returnack = TRUE;
-
-    i2c_start_condition();
-
-    i2c_slave_address(IICID, WRITE_CMD);
-    if (!i2c_check_ack())
-    {
-        returnack = FALSE;
-    }
+    SW_I2C_Status_e l_eStatus;
+    uint8_t  readdata = 0;
 
-    i2c_byte_out(regaddr);
-    if (!i2c_check_ack())
+    sw_i2c_transferSync(IICID, regaddr, 1, &readdata, 1, &l_eStatus);
+    switch (l_eStatus)
     {
-        returnack = FALSE;
+    case SW_I2C_NACK_ADDRESS:       return 0x80; // TODO error handling
+    case SW_I2C_NACK_REGISTER:      return 0x40; // TODO error handling
+    case SW_I2C_NACK_READ_ADDRESS:  return 0x20; // TODO error handling
+    default:                        return readdata;
     }
-
-//    i2c_stop_condition();
-
-    return returnack;
 }
 
-uint8_t SW_I2C_WriteControl_16Bit(uint8_t IICID, uint8_t regaddr, uint16_t data)
+uint8_t SW_I2C_Multi_ReadnControl_8Bit(uint8_t IICID, uint8_t regaddr, uint8_t rcnt, uint8_t (*pdata))
 {
-    uint8_t   returnack = TRUE;
-
-    i2c_start_condition();
-
-    i2c_slave_address(IICID, WRITE_CMD);
-    if (!i2c_check_ack())
-    {
-        returnack = FALSE;
-    }
-
-    TIMER__Wait_us(SW_I2C_WAIT_TIME);
+    SW_I2C_Status_e l_eStatus;
 
-    i2c_byte_out(regaddr);
-    if (!i2c_check_ack())
-    {
-        returnack = FALSE;
-    }
-
-    TIMER__Wait_us(SW_I2C_WAIT_TIME);
-
-    SW_I2C_Write_Data((data >> 8) & 0xFF);
-    if (!i2c_check_ack())
-    {
-        returnack = FALSE;
-    }
-
-    TIMER__Wait_us(SW_I2C_WAIT_TIME);
-
-    SW_I2C_Write_Data(data & 0xFF);
-    if (!i2c_check_ack())
-    {
-        returnack = FALSE;
-    }
-
-    TIMER__Wait_us(SW_I2C_WAIT_TIME);
-
-    i2c_stop_condition();
-
-    return returnack;
+    return sw_i2c_transferSync(IICID, regaddr, 1, pdata, rcnt, &l_eStatus);
 }
 
-uint8_t SW_I2C_ReadControl_8Bit_OnlyRegAddr(uint8_t IICID, uint8_t regaddr)
-{
-    uint8_t   returnack = TRUE;
-
-    i2c_start_condition();
-
-    i2c_slave_address(IICID, WRITE_CMD);
-    if (!i2c_check_ack())
-    {
-        returnack = FALSE;
-    }
-
-    TIMER__Wait_us(SW_I2C_WAIT_TIME);
-
-    i2c_byte_out(regaddr);
-    if (!i2c_check_ack())
-    {
-        returnack = FALSE;
-    }
-
-    TIMER__Wait_us(SW_I2C_WAIT_TIME);
-
-    i2c_stop_condition();
-
-    return returnack;
-}
-
-uint8_t SW_I2C_ReadControl_8Bit_OnlyData(uint8_t IICID)
+uint8_t SW_I2C_UTIL_WRITE(uint8_t IICID, uint8_t regaddr, uint8_t data)
 {
-    uint8_t  readdata = 0;
-
-    i2c_port_initial();
-
-    i2c_start_condition();
-
-    i2c_slave_address(IICID, READ_CMD);
-    i2c_check_ack();
-
-    TIMER__Wait_us(SW_I2C_WAIT_TIME);
-
-    readdata = SW_I2C_Read_Data_in_in_mode();
-
-    i2c_check_final_read_not_ack();
-
-    i2c_stop_condition();
-
-    return readdata;
+	return SW_I2C_WriteControl_8Bit(IICID<<1, regaddr, data);
 }
 
-uint16_t SW_I2C_ReadControl_16Bit_OnlyData(uint8_t IICID)
+uint8_t SW_I2C_UTIL_Read(uint8_t IICID, uint8_t regaddr)
 {
-    uint8_t  readimsi = 0;
-    uint16_t  readdata = 0;
-
-    i2c_start_condition();
-
-    i2c_slave_address(IICID, READ_CMD);
-    i2c_send_not_ack();
-
-    TIMER__Wait_us(SW_I2C_WAIT_TIME);
-
-    readimsi = SW_I2C_Read_Data_in_in_mode();
-    i2c_check_not_ack_continue();
-
-    readdata = readimsi<<8;
-
-    readimsi = SW_I2C_Read_Data_in_in_mode();
-    i2c_check_final_read_not_ack();
-
-    readdata |= readimsi;
-
-    i2c_stop_condition();
-
-    return readdata;
+	return SW_I2C_ReadControl_8Bit(IICID<<1, regaddr);
 }
 
-uint8_t SW_I2C_ReadControl_8Bit(uint8_t IICID, uint8_t regaddr)
+uint8_t SW_I2C_UTIL_Read_Multi(uint8_t IICID, uint8_t regaddr, uint8_t rcnt, uint8_t (*pdata))
 {
-    uint8_t  readdata = 0;
-
-    i2c_port_initial();
-
-    i2c_start_condition();
-
-    i2c_slave_address(IICID, WRITE_CMD);
-    if (!i2c_check_ack()) return 0x80; // TODO error handling
-
-    i2c_byte_out(regaddr);
-    if (!i2c_check_ack()) return 0x40; // TODO error handling
-
-    i2c_start_condition();
-
-    i2c_slave_address(IICID, READ_CMD);
-    if (!i2c_check_ack()) return 0x20; // TODO error handling
-
-    readdata = SW_I2C_Read_Data_in_in_mode();
-
-    i2c_check_final_read_not_ack();
-
-    i2c_stop_condition();
-
-    return readdata;
+	return SW_I2C_Multi_ReadnControl_8Bit(IICID<<1, regaddr, rcnt, pdata);
 }
 
-uint16_t SW_I2C_ReadControl_16Bit(uint8_t IICID, uint8_t regaddr)
+/* load the next byte, SCL is low: put its first bit on SDA */
+static void sw_i2c_byte(uint8_t p_u8Data, uint8_t p_bAck)
 {
-    uint16_t  readdata = 0;
-
-    i2c_port_initial();
-
-    i2c_start_condition();
-
-    i2c_slave_address(IICID, WRITE_CMD);
-    i2c_check_ack();
-
-    i2c_byte_out(regaddr);
-    i2c_check_ack();
-
-    TIMER__Wait_us(SW_I2C_WAIT_TIME);
-
-    i2c_start_condition();
-
-    i2c_slave_address(IICID, READ_CMD);
-    i2c_check_ack();
-
-    TIMER__Wait_us(SW_I2C_WAIT_TIME);
-
-    readdata = SW_I2C_Read_Data_in_in_mode();
-    i2c_send_ack();
-    TIMER__Wait_us(SW_I2C_WAIT_TIME);
-
-    readdata = ((readdata << 8) | SW_I2C_Read_Data_in_in_mode());
-
-    i2c_check_final_read_not_ack();
-
-    i2c_stop_condition();
-
-    return readdata;
+    /* the ACK bit is released (1) by the master when writing */
+    sw_i2c_u16Out = ((uint16_t)p_u8Data << 1) | p_bAck;
+    sw_i2c_u16In = 0;
+    sw_i2c_u8Bits = 9;
+    if (sw_i2c_u16Out & 0x100) { SDA_HIGH(); } else { SDA_LOW(); }
+    sw_i2c_eState = SW_I2C_STATE_BIT_HIGH;
 }
 
-uint8_t SW_I2C_ReadnControl_8Bit(uint8_t IICID, uint8_t regaddr, uint8_t rcnt, uint8_t (*pdata))
+/* 8 bits and the ACK are on the bus, SCL is low */
+static void sw_i2c_byteDone(void)
 {
-    uint8_t   returnack = TRUE;
-    uint8_t  index;
-
-    i2c_port_initial();
-
-    i2c_start_condition();
-
-    i2c_slave_address(IICID, WRITE_CMD);
-    if (!i2c_check_ack()) { returnack = FALSE; }
-
-    TIMER__Wait_us(SW_I2C_WAIT_TIME);
-	
-    i2c_byte_out(regaddr);
-    if (!i2c_check_ack()) { returnack = FALSE; }
-
-    TIMER__Wait_us(SW_I2C_WAIT_TIME);
-
-    i2c_start_condition();
+    uint8_t l_bAck = !(sw_i2c_u16In & 0x01);
 
-    i2c_slave_address(IICID, READ_CMD);
-    if (!i2c_check_ack()) { returnack = FALSE; }
-
-    for ( index = 0 ; index < rcnt ; index++){
-    	TIMER__Wait_us(SW_I2C_WAIT_TIME);
-    	pdata[index] = SW_I2C_Read_Data_in_in_mode();
+    switch (sw_i2c_ePhase)
+    {
+    case SW_I2C_PHASE_ADDRESS_WRITE:
+        if (!l_bAck)
+        {
+            sw_i2c_stop(SW_I2C_NACK_ADDRESS);
+            return;
+        }
+        sw_i2c_ePhase = SW_I2C_PHASE_REGISTER;
+        sw_i2c_byte(sw_i2c_u8Register, 1);
+        break;
+
+    case SW_I2C_PHASE_REGISTER:
+        if (!l_bAck)
+        {
+            sw_i2c_stop(SW_I2C_NACK_REGISTER);
+            return;
+        }
+        if (sw_i2c_bRead)
+        {
+            /* repeated start */
+            sw_i2c_ePhase = SW_I2C_PHASE_ADDRESS_READ;
+            SDA_HIGH();
+            sw_i2c_eState = SW_I2C_STATE_RESTART_SCL;
+        }
+        else
+        {
+            sw_i2c_ePhase = SW_I2C_PHASE_WRITE;
+            sw_i2c_byte(sw_i2c_pu8Data[0], 1);
+        }
+        break;
+
+    case SW_I2C_PHASE_WRITE:
+        if (!l_bAck)
+        {
+            sw_i2c_stop(SW_I2C_NACK_DATA);
+            return;
+        }
+        if (++sw_i2c_u8Index < sw_i2c_u8Length)
+        {
+            sw_i2c_byte(sw_i2c_pu8Data[sw_i2c_u8Index], 1);
+        }
+        else
+        {
+            sw_i2c_stop(SW_I2C_OK);
+        }
+        break;
+
+    case SW_I2C_PHASE_ADDRESS_READ:
+        if (!l_bAck)
+        {
+            sw_i2c_stop(SW_I2C_NACK_READ_ADDRESS);
+            return;
+        }
+        sw_i2c_ePhase = SW_I2C_PHASE_READ;
+        /* SDA released for the data, NACK after the last byte */
+        sw_i2c_byte(0xFF, sw_i2c_u8Length == 1);
+        break;
+
+    case SW_I2C_PHASE_READ:
+        sw_i2c_pu8Data[sw_i2c_u8Index] = (uint8_t)(sw_i2c_u16In >> 1);
+        if (++sw_i2c_u8Index < sw_i2c_u8Length)
+        {
+            sw_i2c_byte(0xFF, sw_i2c_u8Index == sw_i2c_u8Length - 1);
+        }
+        else
+        {
+            sw_i2c_stop(SW_I2C_OK);
+        }
+        break;
     }
-
-    pdata[rcnt-1] = SW_I2C_Read_Data_in_in_mode();
-	
-    i2c_send_final_nack();
-
-    i2c_stop_condition();
-
-    return returnack;
 }
 
-uint8_t SW_I2C_Multi_ReadnControl_8Bit(uint8_t IICID, uint8_t regaddr, uint8_t rcnt, uint8_t (*pdata))
+/* SCL is low: SDA low, then SCL high and SDA high */
+static void sw_i2c_stop(SW_I2C_Status_e p_eStatus)
 {
-    uint8_t   returnack = TRUE;
-    uint8_t  index;
-
-    i2c_port_initial();
-
-    i2c_start_condition();
-
-    i2c_slave_address(IICID, WRITE_CMD);
-    if (!i2c_check_ack()) { returnack = FALSE; }
-
-    i2c_byte_out(regaddr);
-    if (!i2c_check_ack()) { returnack = FALSE; }
-
-    i2c_start_condition();
-
-    i2c_slave_address(IICID, READ_CMD);
-    if (!i2c_check_ack()) { returnack = FALSE; }
-
-    for ( index = 0 ; index < (rcnt-1) ; index++){
-    	pdata[index] = SW_I2C_Read_Data_in_in_mode();
-	    i2c_send_ack();
-	//if (!i2c_check_ack()) { returnack = FALSE; }
-    }
-
-    pdata[rcnt-1] = SW_I2C_Read_Data_in_in_mode();
-	
-    i2c_check_final_read_not_ack();
-    i2c_stop_condition();
-
-    return returnack;
+    sw_i2c_eStatus = p_eStatus;
+    SDA_LOW();
+    sw_i2c_eState = SW_I2C_STATE_STOP_SCL;
 }
 
-uint8_t SW_I2C_Check_SlaveAddr(uint8_t IICID)
+static void sw_i2c_done(void)
 {
-    uint8_t   returnack = TRUE;
-
-    i2c_start_condition();
-
-    i2c_slave_address(IICID, WRITE_CMD);
-    if (!i2c_check_ack())
+    __HAL_TIM_DISABLE(&SOFT_I2C_TIM_Handle);
+    if (sw_i2c_eStatus != SW_I2C_OK)
     {
-        returnack = FALSE;
+        SW_I2C_u32Errors++;
+        /* release the bus */
+        SCL_HIGH();
+        SDA_HIGH();
+    }
+    sw_i2c_eState = SW_I2C_STATE_IDLE;
+    if (sw_i2c_pfCallback != NULL)
+    {
+        sw_i2c_pfCallback(sw_i2c_eStatus, sw_i2c_pvContext);
     }
-	
-    return returnack;
-}
-
-uint8_t SW_I2C_UTIL_WRITE(uint8_t IICID, uint8_t regaddr, uint8_t data)
-{
-	return SW_I2C_WriteControl_8Bit(IICID<<1, regaddr, data);
-}
-
-uint8_t SW_I2C_UTIL_Read(uint8_t IICID, uint8_t regaddr)
-{
-	return SW_I2C_ReadControl_8Bit(IICID<<1, regaddr);
 }
 
-uint8_t SW_I2C_UTIL_Read_Multi(uint8_t IICID, uint8_t regaddr, uint8_t rcnt, uint8_t (*pdata))
+static void sw_i2c_syncDone(SW_I2C_Status_e p_eStatus, void *p_pvContext)
 {
-	return SW_I2C_Multi_ReadnControl_8Bit(IICID<<1, regaddr, rcnt, pdata);
+    (void)p_eStatus;
+    *(volatile uint8_t *)p_pvContext = 1;
 }
@@ -0,0 +1,336 @@
+/****************************************************************************
+* Title                 :   framed UART engine
+* Filename              :   uart_frame.c
+* Author                :
+* Origin Date           :
+* Version               :   1.0.0
+
+*****************************************************************************/
+/** \file uart_frame.c
+*  \brief shared 0x55 0xAA framed UART protocol engine
+*
+*  Reception runs continuously in circular DMA mode, the DMA half / full and
+*  UART idle events feed the new bytes to a streaming parser which looks for
+*  the device preamble, collects the frame and checks the CRC.
+*  Transmission goes through a queue so back to back messages are sent one
+*  after the other instead of being rejected while the DMA is busy.
+*/
+/******************************************************************************
+* Includes
+*******************************************************************************/
+#include <string.h>
+
+#include "stm32f_board_hal.h"
+
+#include "main.h"
+#include "uart_frame.h"
+#include "latency.h"
+
+/******************************************************************************
+* Module Preprocessor Constants
+*******************************************************************************/
+
+/******************************************************************************
+* Module Preprocessor Macros
+*******************************************************************************/
+
+/******************************************************************************
+* Module Typedefs
+*******************************************************************************/
+
+/******************************************************************************
+* Module Variable Definitions
+*******************************************************************************/
+static UARTFRAME_Handle_t *uartframe_psHandles[UARTFRAME_MAX_HANDLES] = {0};
+
+/******************************************************************************
+* Function Prototypes
+*******************************************************************************/
+static UARTFRAME_Handle_t *uartframe_find(UART_HandleTypeDef *p_phUart);
+static void uartframe_startRx(UARTFRAME_Handle_t *p_psHandle);
+static void uartframe_startTx(UARTFRAME_Handle_t *p_psHandle);
+static void uartframe_parse(UARTFRAME_Handle_t *p_psHandle, uint16_t p_u16From, uint16_t p_u16To);
+static void uartframe_resync(UARTFRAME_Handle_t *p_psHandle);
+
+/******************************************************************************
+*  Public Functions
+*******************************************************************************/
+
+/// @brief register a framed UART and start the reception
+/// the UART and its DMA channels have to be initialized, the RX DMA in circular mode
+/// @param p_psHandle engine handle (static storage)
+/// @param p_phUart UART used by the device
+/// @param p_psDescriptor frames received from the device
+/// @param p_pfCallback called for every received frame
+void UARTFRAME_Init(UARTFRAME_Handle_t *p_psHandle, UART_HandleTypeDef *p_phUart, const UARTFRAME_Descriptor_t *p_psDescriptor, UARTFRAME_Callback_t p_pfCallback)
+{
+    uint8_t l_u8Idx;
+
+    memset(p_psHandle, 0, sizeof(UARTFRAME_Handle_t));
+    p_psHandle->phUart = p_phUart;
+    p_psHandle->psDescriptor = p_psDescriptor;
+    p_psHandle->pfCallback = p_pfCallback;
+
+    for (l_u8Idx = 0; l_u8Idx < UARTFRAME_MAX_HANDLES; l_u8Idx++)
+    {
+        if (uartframe_psHandles[l_u8Idx] == NULL || uartframe_psHandles[l_u8Idx] == p_psHandle)
+        {
+            uartframe_psHandles[l_u8Idx] = p_psHandle;
+            break;
+        }
+    }
+    if (l_u8Idx == UARTFRAME_MAX_HANDLES)
+    {
+        Error_Handler();
+    }
+
+    uartframe_startRx(p_psHandle);
+}
+
+/// @brief queue a message, the transmission starts right away if the UART is free
+/// @param p_psHandle engine handle
+/// @param p_pu8Data message
+/// @param p_u16Length message length
+/// @retval HAL_OK if queued, HAL_BUSY if the queue is full (message dropped)
+HAL_StatusTypeDef UARTFRAME_Transmit(UARTFRAME_Handle_t *p_psHandle, const uint8_t *p_pu8Data, uint16_t p_u16Length)
+{
+    return UARTFRAME_TransmitProbe(p_psHandle, p_pu8Data, p_u16Length, 0);
+}
+
+/// @brief queue a message answering latency probes, they stop when the DMA starts to send it
+/// @param p_psHandle engine handle
+/// @param p_pu8Data message
+/// @param p_u16Length message length
+/// @param p_u8Probes LATENCY_MASK() of the probes, only the ones armed before the call are stopped
+/// @retval HAL_OK if queued, HAL_BUSY if the queue is full (message dropped)
+HAL_StatusTypeDef UARTFRAME_TransmitProbe(UARTFRAME_Handle_t *p_psHandle, const uint8_t *p_pu8Data, uint16_t p_u16Length, uint8_t p_u8Probes)
+{
+    uint32_t l_u32Primask;
+    uint16_t l_u16Idx;
+
+    l_u32Primask = __get_PRIMASK();
+    __disable_irq();
+
+    if (p_u16Length > (UARTFRAME_TX_BUFFER_SIZE - p_psHandle->u16TxCount))
+    {
+        p_psHandle->u32TxOverflows++;
+        __set_PRIMASK(l_u32Primask);
+        return HAL_BUSY;
+    }
+
+#if LATENCY_PROBES
+    p_u8Probes = LATENCY_Armed(p_u8Probes);
+    if (p_u8Probes)
+    {
+        if (p_psHandle->u8TxProbes == 0)
+        {
+            p_psHandle->u16TxProbeAhead = p_psHandle->u16TxCount;
+        }
+        p_psHandle->u8TxProbes |= p_u8Probes;
+    }
+#endif
+
+    for (l_u16Idx = 0; l_u16Idx < p_u16Length; l_u16Idx++)
+    {
+        p_psHandle->pu8TxBuffer[p_psHandle->u16TxHead] = p_pu8Data[l_u16Idx];
+        p_psHandle->u16TxHead = (p_psHandle->u16TxHead + 1) % UARTFRAME_TX_BUFFER_SIZE;
+    }
+    p_psHandle->u16TxCount += p_u16Length;
+
+    if (p_psHandle->u16TxBusy == 0)
+    {
+        uartframe_startTx(p_psHandle);
+    }
+
+    __set_PRIMASK(l_u32Primask);
+    return HAL_OK;
+}
+
+/// @brief DMA half / full or UART idle event, parse the new bytes
+/// to be called from HAL_UARTEx_RxEventCallback
+/// @param p_phUart UART which received the bytes
+/// @param p_u16Position DMA write position in the circular buffer
+void UARTFRAME_RxEventIT(UART_HandleTypeDef *p_phUart, uint16_t p_u16Position)
+{
+    UARTFRAME_Handle_t *l_psHandle = uartframe_find(p_phUart);
+
+    if (l_psHandle == NULL || p_u16Position == l_psHandle->u16RxTail)
+    {
+        return;
+    }
+
+    if (p_u16Position > l_psHandle->u16RxTail)
+    {
+        uartframe_parse(l_psHandle, l_psHandle->u16RxTail, p_u16Position);
+    }
+    else
+    {
+        /* the DMA wrapped around */
+        uartframe_parse(l_psHandle, l_psHandle->u16RxTail, UARTFRAME_RX_BUFFER_SIZE);
+        uartframe_parse(l_psHandle, 0, p_u16Position);
+    }
+    l_psHandle->u16RxTail = (p_u16Position == UARTFRAME_RX_BUFFER_SIZE) ? 0 : p_u16Position;
+}
+
+/// @brief DMA transmission done, send the rest of the queue
+/// to be called from HAL_UART_TxCpltCallback
+/// @param p_phUart UART which sent the bytes
+void UARTFRAME_TxCpltIT(UART_HandleTypeDef *p_phUart)
+{
+    UARTFRAME_Handle_t *l_psHandle = uartframe_find(p_phUart);
+
+    if (l_psHandle == NULL || l_psHandle->u16TxBusy == 0)
+    {
+        return;
+    }
+
+    l_psHandle->u16TxTail = (l_psHandle->u16TxTail + l_psHandle->u16TxBusy) % UARTFRAME_TX_BUFFER_SIZE;
+    l_psHandle->u16TxCount -= l_psHandle->u16TxBusy;
+#if LATENCY_PROBES
+    if (l_psHandle->u8TxProbes)
+    {
+        l_psHandle->u16TxProbeAhead -= l_psHandle->u16TxBusy;
+    }
+#endif
+    l_psHandle->u16TxBusy = 0;
+
+    if (l_psHandle->u16TxCount)
+    {
+        uartframe_startTx(l_psHandle);
+    }
+}
+
+/// @brief UART error, HAL stops the DMA reception on overrun or framing errors so restart it
+/// to be called from HAL_UART_ErrorCallback
+/// @param p_phUart UART in error
+void UARTFRAME_ErrorIT(UART_HandleTypeDef *p_phUart)
+{
+    UARTFRAME_Handle_t *l_psHandle = uartframe_find(p_phUart);
+
+    if (l_psHandle == NULL)
+    {
+        return;
+    }
+
+    if (p_phUart->RxState == HAL_UART_STATE_READY)
+    {
+        l_psHandle->u8FrameIdx = 0;
+        uartframe_startRx(l_psHandle);
+    }
+    if (l_psHandle->u16TxBusy && p_phUart->gState == HAL_UART_STATE_READY)
+    {
+        /* transmission aborted, give up the message being sent */
+        UARTFRAME_TxCpltIT(p_phUart);
+    }
+}
+
+/******************************************************************************
+*  Private Functions
+*******************************************************************************/
+
+static UARTFRAME_Handle_t *uartframe_find(UART_HandleTypeDef *p_phUart)
+{
+    uint8_t l_u8Idx;
+
+    for (l_u8Idx = 0; l_u8Idx < UARTFRAME_MAX_HANDLES; l_u8Idx++)
+    {
+        if (uartframe_psHandles[l_u8Idx] != NULL && uartframe_psHandles[l_u8Idx]->phUart == p_phUart)
+        {
+            return uartframe_psHandles[l_u8Idx];
+        }
+    }
+    return NULL;
+}
+
+static void uartframe_startRx(UARTFRAME_Handle_t *p_psHandle)
+{
+    p_psHandle->u16RxTail = 0;
+    HAL_UARTEx_ReceiveToIdle_DMA(p_psHandle->phUart, p_psHandle->pu8RxBuffer, UARTFRAME_RX_BUFFER_SIZE);
+}
+
+/* send the queue up to its end, the rest goes with the next TX complete */
+static void uartframe_startTx(UARTFRAME_Handle_t *p_psHandle)
+{
+    uint16_t l_u16Length = p_psHandle->u16TxCount;
+
+    if (l_u16Length > (UARTFRAME_TX_BUFFER_SIZE - p_psHandle->u16TxTail))
+    {
+        l_u16Length = UARTFRAME_TX_BUFFER_SIZE - p_psHandle->u16TxTail;
+    }
+    if (HAL_UART_Transmit_DMA(p_psHandle->phUart, &p_psHandle->pu8TxBuffer[p_psHandle->u16TxTail], l_u16Length) == HAL_OK)
+    {
+        p_psHandle->u16TxBusy = l_u16Length;
+#if LATENCY_PROBES
+        if (p_psHandle->u8TxProbes && p_psHandle->u16TxProbeAhead < l_u16Length)
+        {
+            LATENCY_StopIT(p_psHandle->u8TxProbes);
+            p_psHandle->u8TxProbes = 0;
+        }
+#endif
+    }
+}
+
+static void uartframe_parse(UARTFRAME_Handle_t *p_psHandle, uint16_t p_u16From, uint16_t p_u16To)
+{
+    const UARTFRAME_Descriptor_t *l_psDesc = p_psHandle->psDescriptor;
+    uint16_t l_u16Idx;
+    uint8_t l_u8Byte;
+
+    for (l_u16Idx = p_u16From; l_u16Idx < p_u16To; l_u16Idx++)
+    {
+        l_u8Byte = p_psHandle->pu8RxBuffer[l_u16Idx];
+        p_psHandle->pu8Frame[p_psHandle->u8FrameIdx++] = l_u8Byte;
+
+        if (p_psHandle->u8FrameIdx <= l_psDesc->u8PreambleLength &&
+            l_u8Byte != l_psDesc->pu8Preamble[p_psHandle->u8FrameIdx - 1])
+        {
+            /* out of sync, the next frame may start within the bytes collected so far */
+            uartframe_resync(p_psHandle);
+            continue;
+        }
+
+        if (p_psHandle->u8FrameIdx == l_psDesc->u8Length)
+        {
+            if (l_psDesc->u8CrcOffset == UARTFRAME_NO_CRC ||
+                crcCalc(p_psHandle->pu8Frame, l_psDesc->u8CrcOffset) == p_psHandle->pu8Frame[l_psDesc->u8CrcOffset])
+            {
+                p_psHandle->u8FrameIdx = 0;
+                p_psHandle->u32RxFrames++;
+                p_psHandle->pfCallback(RX_VALID, p_psHandle->pu8Frame);
+            }
+            else
+            {
+                p_psHandle->u32CrcErrors++;
+                p_psHandle->pfCallback(RX_CRC_ERROR, p_psHandle->pu8Frame);
+                /* a short frame ran into the next one, keep its start */
+                uartframe_resync(p_psHandle);
+            }
+        }
+    }
+}
+
+/* drop the collected bytes up to the next one that can start a frame: the rest
+ * matches the preamble as far as it goes */
+static void uartframe_resync(UARTFRAME_Handle_t *p_psHandle)
+{
+    const UARTFRAME_Descriptor_t *l_psDesc = p_psHandle->psDescriptor;
+    uint8_t l_u8Count = p_psHandle->u8FrameIdx;
+    uint8_t l_u8Start, l_u8Idx;
+
+    for (l_u8Start = 1; l_u8Start < l_u8Count; l_u8Start++)
+    {
+        for (l_u8Idx = 0; l_u8Idx < l_psDesc->u8PreambleLength && l_u8Start + l_u8Idx < l_u8Count; l_u8Idx++)
+        {
+            if (p_psHandle->pu8Frame[l_u8Start + l_u8Idx] != l_psDesc->pu8Preamble[l_u8Idx])
+            {
+                break;
+            }
+        }
+        if (l_u8Idx == l_psDesc->u8PreambleLength || l_u8Start + l_u8Idx == l_u8Count)
+        {
+            break;
+        }
+    }
+    memmove(p_psHandle->pu8Frame, &p_psHandle->pu8Frame[l_u8Start], l_u8Count - l_u8Start);
+    p_psHandle->u8FrameIdx = l_u8Count - l_u8Start;
+}
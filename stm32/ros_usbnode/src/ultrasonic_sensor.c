@@ -5,6 +5,7 @@
 // stm32 custom
 #include "board.h"
 #include "main.h"
+#include "uart_frame.h"
 #include "ultrasonic_sensor.h"
 
 extern UART_HandleTypeDef MASTER_USART_Handler; // UART  Handle
@@ -22,18 +23,21 @@ const uint8_t ultrasonic_InitMessage2[6] = {0x55,0xAA,0x02,0xFF,0xFB,0xFB};
 const uint8_t ultrasonic_RqstMessage[6]  = {0x55,0xAA,0x02,0x70,0x39,0xAA};
 
 const uint8_t ultrasonic_PreAmbule[5]  = {0x55,0xAA,0x06,0x70,0x39};
-
-static uint8_t ultrasonic_pu8ReceivedData[10] = {0};
+static const UARTFRAME_Descriptor_t ultrasonic_FrameDesc = {ultrasonic_PreAmbule, 5, 10, 9};
+static UARTFRAME_Handle_t ultrasonic_Frame;
 
 static uint8_t ultrasonic_RxFlag = 0;
 
 static uint32_t ultrasonic_u32LeftDistance = 0;
 static uint32_t ultrasonic_u32RightDistance = 0;
 
+static void ultrasonic_ReceiveFrame(rx_status_e p_eStatus, const uint8_t *p_pu8Frame);
+
 void ULTRASONICSENSOR_Init(void){
     ultrasonic_state = ULTRASONIC_INIT_1;
     ultrasonic_u32LeftDistance = 0;
     ultrasonic_u32RightDistance = 0;
+    UARTFRAME_Init(&ultrasonic_Frame, &MASTER_USART_Handler, &ultrasonic_FrameDesc, ultrasonic_ReceiveFrame);
 }
 
 void ULTRASONICSENSOR_App(void){
@@ -41,22 +45,17 @@ void ULTRASONICSENSOR_App(void){
     switch (ultrasonic_state)
     {
     case ULTRASONIC_INIT_1:
-        HAL_UART_Transmit_DMA(&MASTER_USART_Handler, (uint8_t*)ultrasonic_InitMessage1, 6);
+        UARTFRAME_Transmit(&ultrasonic_Frame, ultrasonic_InitMessage1, 6);
         ultrasonic_state = ULTRASONIC_INIT_2;
         break;
     
     case ULTRASONIC_INIT_2:
-        HAL_UART_Transmit_DMA(&MASTER_USART_Handler, (uint8_t*)ultrasonic_InitMessage2, 6);
+        UARTFRAME_Transmit(&ultrasonic_Frame, ultrasonic_InitMessage2, 6);
         ultrasonic_state = ULTRASONIC_RUN;
         break;
 
     case ULTRASONIC_RUN:
-        
-        /* prepare to receive the message before to lauch the command */
-        HAL_UART_Receive_DMA(&MASTER_USART_Handler,ultrasonic_pu8ReceivedData,10);
-        HAL_UART_Transmit_DMA(&MASTER_USART_Handler, (uint8_t*)ultrasonic_RqstMessage, 6);
-
-
+        UARTFRAME_Transmit(&ultrasonic_Frame, ultrasonic_RqstMessage, 6);
         break;
     
     default:
@@ -64,13 +63,12 @@ void ULTRASONICSENSOR_App(void){
     }
 }
 
-void ULTRASONICSENSOR_ReceiveIT(void)
+/* distances frame received, called from the UART interrupt */
+static void ultrasonic_ReceiveFrame(rx_status_e p_eStatus, const uint8_t *p_pu8Frame)
 {
-    /* decode the frame */
-    if(memcmp(ultrasonic_PreAmbule,ultrasonic_pu8ReceivedData,5) == 0){
-        /* todo calculate the CRC */
-        ultrasonic_u32LeftDistance = (ultrasonic_pu8ReceivedData[5] << 8) + ultrasonic_pu8ReceivedData[6];
-        ultrasonic_u32RightDistance  = (ultrasonic_pu8ReceivedData[7] << 8) + ultrasonic_pu8ReceivedData[8];
+    if(p_eStatus == RX_VALID){
+        ultrasonic_u32LeftDistance = (p_pu8Frame[5] << 8) + p_pu8Frame[6];
+        ultrasonic_u32RightDistance  = (p_pu8Frame[7] << 8) + p_pu8Frame[8];
 
         DB_TRACE(" R: %dmm, L: %dmm \r\n",ultrasonic_u32RightDistance/10,ultrasonic_u32LeftDistance/10);
         ultrasonic_RxFlag = 1;
@@ -0,0 +1,197 @@
+/****************************************************************************
+* Title                 :   charging ADC conversion host test
+* Filename              :   adc_filter_test.c
+* Author                :
+* Origin Date           :
+* Version               :   1.0.0
+
+*****************************************************************************/
+/** \file adc_filter_test.c
+*  \brief runs ADC_input() (Q16 filters, scaling, NTC table) and the former float
+*         conversion, ADC_InputFloat(), on the same raw samples and compares them
+*
+*  Build and run on the host, from stm32/ros_usbnode:
+*
+*        g++ -O2 -Iinclude -c tools/adc_filter_test.c -o adc_ntc.o
+*        gcc -O2 -Iinclude tools/adc_filter_test.c adc_ntc.o -o adc_filter_test -lm
+*        ./adc_filter_test
+*
+*  The NTC table is C++ (adc_ntc.cpp): compiled as C++ this file only builds it,
+*  with the same stubs.
+*
+*  adc.c is built without a board variant and with ADC_CYCLE_BENCH, the HAL types
+*  and calls it uses are stubbed below. The oversampling is not fed, so both
+*  conversions see adc_pu16ChargingSamples. The former code started its filters
+*  from 0, the comparison starts once they have settled. The raw values walk
+*  randomly over the whole ADC range, with full scale steps in between.
+*
+*  The cycle counts that matter are the ones of the FPU-less F103: define
+*  ADC_CYCLE_BENCH in board.h and ADC_CycleBench() prints them at boot.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+
+/* board.h settings without a board */
+#define VALID_BOARD_DEFINED 1
+#define ADC_CYCLE_BENCH 1000
+#define Charging_ADC 0
+#define used_ADC_irq 0
+
+/* HAL stubs */
+typedef enum { HAL_OK = 0, HAL_ERROR } HAL_StatusTypeDef;
+typedef enum { DISABLE = 0, ENABLE } FunctionalState;
+typedef struct { uint32_t Pin, Mode, Pull, Speed; } GPIO_InitTypeDef;
+typedef struct { uint32_t Prescaler, CounterMode, Period, ClockDivision, AutoReloadPreload, RepetitionCounter; } TIM_Base_InitTypeDef;
+typedef struct { int Instance; TIM_Base_InitTypeDef Init; } TIM_HandleTypeDef;
+typedef struct { uint32_t ClockSource; } TIM_ClockConfigTypeDef;
+typedef struct { uint32_t MasterOutputTrigger, MasterSlaveMode; } TIM_MasterConfigTypeDef;
+typedef struct { uint32_t OCMode, Pulse, OCPolarity, OCFastMode; } TIM_OC_InitTypeDef;
+typedef struct { uint32_t ScanConvMode, ContinuousConvMode, DiscontinuousConvMode, ExternalTrigConv, DataAlign, NbrOfConversion; } ADC_InitTypeDef;
+typedef struct { int Instance; ADC_InitTypeDef Init; } ADC_HandleTypeDef;
+typedef struct { int Instance; } RTC_HandleTypeDef;
+typedef struct { uint32_t CYCCNT; } DWT_Type;
+
+static DWT_Type dwt;
+#define DWT (&dwt)
+#define TIM2 0
+#define TIM_COUNTERMODE_UP 0
+#define TIM_CLOCKDIVISION_DIV1 0
+#define TIM_AUTORELOAD_PRELOAD_DISABLE 0
+#define TIM_CLOCKSOURCE_INTERNAL 0
+#define TIM_TRGO_UPDATE 0
+#define TIM_MASTERSLAVEMODE_DISABLE 0
+#define TIM_OCMODE_TOGGLE 0
+#define TIM_OCPOLARITY_HIGH 0
+#define TIM_OCFAST_DISABLE 0
+#define TIM_CHANNEL_2 0
+#define GPIOA 0
+#define GPIOC 0
+#define GPIO_PIN_1 0
+#define GPIO_PIN_2 0
+#define GPIO_PIN_3 0
+#define GPIO_PIN_7 0
+#define GPIO_MODE_ANALOG 0
+#define ADC_EXTERNALTRIGCONV_T2_CC2 0
+#define ADC_DATAALIGN_RIGHT 0
+#define RTC_BKP_DR1 1
+#define RTC_BKP_DR2 2
+#define RTC_BKP_DR3 3
+#define RTC_BKP_DR4 4
+#define __HAL_RCC_TIM2_CLK_ENABLE()
+#define __HAL_RCC_GPIOA_CLK_ENABLE()
+#define __HAL_RCC_GPIOC_CLK_ENABLE()
+#define __HAL_RCC_PWR_CLK_ENABLE()
+#define __HAL_RCC_RTC_ENABLE()
+
+static uint32_t __get_PRIMASK(void) { return 0; }
+static void __set_PRIMASK(uint32_t p_u32Primask) { (void)p_u32Primask; }
+static void __disable_irq(void) {}
+static HAL_StatusTypeDef HAL_TIM_OC_Init(TIM_HandleTypeDef *h) { (void)h; return HAL_OK; }
+static HAL_StatusTypeDef HAL_TIM_OC_Start(TIM_HandleTypeDef *h, uint32_t c) { (void)h; (void)c; return HAL_OK; }
+static HAL_StatusTypeDef HAL_TIM_ConfigClockSource(TIM_HandleTypeDef *h, TIM_ClockConfigTypeDef *c) { (void)h; (void)c; return HAL_OK; }
+static HAL_StatusTypeDef HAL_TIMEx_MasterConfigSynchronization(TIM_HandleTypeDef *h, TIM_MasterConfigTypeDef *c) { (void)h; (void)c; return HAL_OK; }
+static HAL_StatusTypeDef HAL_TIM_OC_ConfigChannel(TIM_HandleTypeDef *h, TIM_OC_InitTypeDef *c, uint32_t n) { (void)h; (void)c; (void)n; return HAL_OK; }
+static void HAL_GPIO_Init(int p, GPIO_InitTypeDef *g) { (void)p; (void)g; }
+static HAL_StatusTypeDef HAL_ADC_Init(ADC_HandleTypeDef *h) { (void)h; return HAL_OK; }
+static void HAL_NVIC_SetPriority(int i, uint32_t p, uint32_t s) { (void)i; (void)p; (void)s; }
+static void HAL_NVIC_EnableIRQ(int i) { (void)i; }
+static void HAL_PWR_EnableBkUpAccess(void) {}
+static uint32_t HAL_RTCEx_BKUPRead(RTC_HandleTypeDef *h, uint32_t r) { (void)h; (void)r; return 0; }
+
+#ifdef __cplusplus
+#include "../src/adc_ntc.cpp"
+#else
+#include "../src/adc.c"
+
+void Error_Handler(void) {}
+void CHARGER_ControlIT(void) {}
+void debug_printf(const char *fmt, ...) { (void)fmt; }
+
+#define STEPS 200000
+#define SETTLE 50               /* ADC_input() calls, the slowest filter (0.2) is below 1e-4 */
+
+/* limits against the former float code */
+#define VOLTAGE_LIMIT 0.001     /* V */
+#define CURRENT_LIMIT 0.001     /* A */
+#define NTC_LIMIT 0.5           /* °C, NTC above 500 ohm (below ~160°C), the table is 16 counts wide */
+#define NTC_MIN_OHM 500.0
+
+static double max_dev[5];
+static const char *names[5] = { "battery voltage (V)", "charge voltage (V)", "current (A)", "charger input (V)", "blade temperature (C)" };
+
+static void compare(int p_iIdx, double p_dFixed, double p_dFloat)
+{
+    double l_dDev = fabs(p_dFixed - p_dFloat);
+
+    if (l_dDev > max_dev[p_iIdx])
+    {
+        max_dev[p_iIdx] = l_dDev;
+    }
+}
+
+static uint16_t walk(uint16_t p_u16Raw, int p_iStep)
+{
+    int l_iRaw = p_u16Raw + (rand() % (2 * p_iStep + 1)) - p_iStep;
+
+    return (uint16_t)(l_iRaw < 0 ? 0 : l_iRaw > ADC_FULL_SCALE ? ADC_FULL_SCALE : l_iRaw);
+}
+
+int main(void)
+{
+    const double ntc_raw_min = NTC_MIN_OHM / ADC_NTC_OHM_PER_VOLT * ADC_FULL_SCALE / (ADC_VREF_MV / 1000.0);
+    static const double limits[5] = { VOLTAGE_LIMIT, VOLTAGE_LIMIT, CURRENT_LIMIT, VOLTAGE_LIMIT, NTC_LIMIT };
+    int n, i, settled = 0, fails = 0;
+
+    srand(1);
+    for (i = 0; i < ADC_CHARGING_CHANNEL_MAX; i++)
+    {
+        adc_pu16ChargingSamples[i] = ADC_FULL_SCALE / 2;
+    }
+    for (n = 0; n < STEPS; n++)
+    {
+        if (n % 1000 == 0)
+        {
+            /* a step, the filters have to follow it the same way */
+            for (i = 0; i < ADC_CHARGING_CHANNEL_MAX; i++)
+            {
+                adc_pu16ChargingSamples[i] = (uint16_t)(rand() % (ADC_FULL_SCALE + 1));
+            }
+        }
+        else
+        {
+            for (i = 0; i < ADC_CHARGING_CHANNEL_MAX; i++)
+            {
+                adc_pu16ChargingSamples[i] = walk(adc_pu16ChargingSamples[i], 20);
+            }
+        }
+        ADC_input();
+        ADC_InputFloat();
+        if (++settled < SETTLE)
+        {
+            continue;
+        }
+        compare(0, battery_voltage, ADC_sFloatView.battery_voltage);
+        compare(1, charge_voltage, ADC_sFloatView.charge_voltage);
+        compare(2, current_without_offset, ADC_sFloatView.current_without_offset);
+        compare(3, chargerInputVoltage, ADC_sFloatView.chargerInputVoltage);
+        /* same input for both: the filtered raw value of the former code */
+        if (ADC_sFloatView.ntc_voltage * ADC_FULL_SCALE / (ADC_VREF_MV / 1000.0) >= ntc_raw_min)
+        {
+            compare(4, blade_temperature, ADC_sFloatView.blade_temperature);
+        }
+    }
+
+    for (i = 0; i < 5; i++)
+    {
+        int l_bOk = max_dev[i] < limits[i];
+
+        printf("%-24s max deviation %.5f (limit %.3f)  %s\n", names[i], max_dev[i], limits[i], l_bOk ? "ok" : "FAIL");
+        fails += !l_bOk;
+    }
+
+    printf("%s\n", fails ? "FAILED" : "all passed");
+    return fails ? 1 : 0;
+}
+#endif
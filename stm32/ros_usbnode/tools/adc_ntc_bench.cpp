@@ -0,0 +1,165 @@
+/****************************************************************************
+* Title                 :   blade motor NTC conversion host benchmark
+* Filename              :   adc_ntc_bench.cpp
+* Author                :
+* Origin Date           :
+* Version               :   1.0.0
+
+*****************************************************************************/
+/** \file adc_ntc_bench.cpp
+*  \brief checks the compile time NTC table and ADC_NtcCentiDegree() against the
+*         former float conversion and times both
+*
+*  Build and run on the host, from stm32/ros_usbnode:
+*
+*        g++ -O2 -Iinclude tools/adc_ntc_bench.cpp -o adc_ntc_bench
+*        ./adc_ntc_bench [passes]
+*
+*  The table has to be bit identical to the one built at runtime with the libm
+*  log(). The interpolated temperature is compared with the float code of the
+*  former ADC_input(), on every raw value in 1/16 count steps. The former code
+*  is not bit exact with any table, the largest deviation is reported and has
+*  to stay below 0.5°C where the NTC reads above 500 ohm (below ~160°C).
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+
+/* board.h settings without a board */
+#define VALID_BOARD_DEFINED 1
+
+/* HAL stubs, adc.h only declares handles */
+typedef struct { int dummy; } ADC_HandleTypeDef;
+typedef struct { int dummy; } RTC_HandleTypeDef;
+
+#include "../src/adc_ntc.cpp"
+
+#define RAW_STEPS 16            /* raw values tested per ADC count */
+#define NTC_MIN_OHM 500.0       /* below, the table steps are too coarse (> 160°C) */
+
+/* the former conversion of ADC_input(), after its float filter */
+static const float f_RTO = 10000;
+static const float beta = 3380;
+
+static float reference(float p_fRaw)
+{
+    float l_fTmp;
+    float ntc_voltage = (p_fRaw / 4095.0f) * 3.3f;
+
+    l_fTmp = ntc_voltage * 10000;               //Resistance of RT
+    l_fTmp = log(l_fTmp / f_RTO);
+    l_fTmp = (1 / ((l_fTmp / beta) + (1 / (273.15+25)))); //Temperature from thermistor
+    return l_fTmp - 273.15;                 //Conversion to Celsius
+}
+
+/* table entry with the libm log(), same equation and rounding as ntc_centiDegree() */
+static int16_t table_entry(uint32_t p_u32Raw)
+{
+    double l_dVoltage = (p_u32Raw ? p_u32Raw : 1) * (ADC_VREF_MV / 1000.0) / ADC_FULL_SCALE;
+    double l_dResistance = l_dVoltage * ADC_NTC_OHM_PER_VOLT;
+    double l_dKelvin = 1.0 / (log(l_dResistance / ADC_NTC_R25) / ADC_NTC_BETA + 1.0 / (273.15 + 25));
+    double l_dCenti = (l_dKelvin - 273.15) * 100.0;
+
+    if (l_dCenti > INT16_MAX)
+    {
+        return INT16_MAX;
+    }
+    return (int16_t)(l_dCenti < 0 ? l_dCenti - 0.5 : l_dCenti + 0.5);
+}
+
+static double now_ns(void)
+{
+    struct timespec l_sTs;
+
+    clock_gettime(CLOCK_MONOTONIC, &l_sTs);
+    return l_sTs.tv_sec * 1e9 + l_sTs.tv_nsec;
+}
+
+int main(int argc, char **argv)
+{
+    int passes = (argc > 1) ? atoi(argv[1]) : 20;
+    const uint32_t n = ADC_FULL_SCALE * RAW_STEPS;
+    const double raw_min = NTC_MIN_OHM / ADC_NTC_OHM_PER_VOLT * ADC_FULL_SCALE / (ADC_VREF_MV / 1000.0);
+    int32_t *rawq16 = (int32_t *)malloc(n * sizeof(int32_t));
+    float *rawf = (float *)malloc(n * sizeof(float));
+    int table_mismatch = 0;
+    double max_dev = 0.0, max_dev_raw = 0.0;
+    volatile float sink_f = 0.0f;
+    volatile int32_t sink_i = 0;
+    double t0, t_ref, t_new;
+    uint32_t i;
+    int p;
+
+    /* the compile time table */
+    for (i = 0; i < ADC_NTC_TABLE_SIZE; i++)
+    {
+        int16_t l_s16Expected = table_entry(i << ADC_NTC_TABLE_SHIFT);
+
+        if (ADC_sNtcTable.ps16CentiDegree[i] != l_s16Expected)
+        {
+            if (table_mismatch++ < 10)
+            {
+                printf("table[%u] = %d, libm gives %d\n", i, ADC_sNtcTable.ps16CentiDegree[i], l_s16Expected);
+            }
+        }
+    }
+    printf("table: %d entries, %d mismatch against the libm generator\n", ADC_NTC_TABLE_SIZE, table_mismatch);
+
+    /* the interpolation against the former float code */
+    for (i = 0; i < n; i++)
+    {
+        rawq16[i] = (int32_t)((RAW_STEPS + i) * (65536 / RAW_STEPS));
+        rawf[i] = (float)(RAW_STEPS + i) / RAW_STEPS;
+    }
+    for (i = 0; i < n; i++)
+    {
+        double dev;
+
+        if (rawf[i] < raw_min)
+        {
+            continue;
+        }
+        dev = fabs(ADC_NtcCentiDegree(rawq16[i]) * 0.01 - reference(rawf[i]));
+        if (dev > max_dev)
+        {
+            max_dev = dev;
+            max_dev_raw = rawf[i];
+        }
+    }
+    printf("conversion: max deviation %.3f C at raw %.4f (%.1f C), raw >= %.0f\n", max_dev, max_dev_raw, reference(max_dev_raw), raw_min);
+
+    /* timing */
+    t0 = now_ns();
+    for (p = 0; p < passes; p++)
+    {
+        for (i = 0; i < n; i++)
+        {
+            sink_f = reference(rawf[i]);
+        }
+    }
+    t_ref = (now_ns() - t0) / ((double)passes * n);
+    t0 = now_ns();
+    for (p = 0; p < passes; p++)
+    {
+        for (i = 0; i < n; i++)
+        {
+            sink_i = ADC_NtcCentiDegree(rawq16[i]);
+        }
+    }
+    t_new = (now_ns() - t0) / ((double)passes * n);
+    printf("float log(): %.2f ns/conversion, table: %.2f ns/conversion (x%.1f)\n", t_ref, t_new, t_ref / t_new);
+    (void)sink_f;
+    (void)sink_i;
+
+    free(rawq16);
+    free(rawf);
+    if (table_mismatch || max_dev > 0.5)
+    {
+        printf("FAILED\n");
+        return 1;
+    }
+    printf("all passed\n");
+    return 0;
+}
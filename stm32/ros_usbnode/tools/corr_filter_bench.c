@@ -0,0 +1,198 @@
+/****************************************************************************
+* Title                 :   perimeter matched filter host benchmark
+* Filename              :   corr_filter_bench.c
+* Author                :
+* Origin Date           :
+* Version               :   1.0.0
+
+*****************************************************************************/
+/** \file corr_filter_bench.c
+*  \brief checks CORRFILTER_Run() and CORRFILTER_RunBank() against the plain O(n*m)
+*         correlation and times them
+*
+*  Build and run on the host, from stm32/ros_usbnode:
+*
+*        gcc -O2 -Iinclude tools/corr_filter_bench.c src/corr_filter.c -o corr_filter_bench -lm
+*        ./corr_filter_bench [buffers]
+*
+*  Every buffer (noise, perimeter code at a random position and gain, ADC
+*  saturation) goes through both filters, the results must be bit identical.
+*  The bank correlates both codes in one pass, on buffers holding either code.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "corr_filter.h"
+
+#define NBPTS 1284
+#define OVERSAMPLING 3
+
+/* same codes as perimeter.c */
+static const int32_t sigcode1[]={ -2, -2, -2, 2, 2, 2, -2, -2, 2, 2, 2, 2, 2, 2, 2, 0, -2, -2, -2, 1, 2, 2, 2, 2, 2, 1, 0, 0, -2, -2, -2, -2, -2, -2, -2, -1, -1 };
+static const int32_t sigcode2[]={ -2, -3, 0, 3, 3, -1, -2, -1, 3, 3, 3, 3, 3, 2, 0, -2, -2, -2, -2, -2, -2, -2, -2, -2, 3, 3, 3, 3, 3, 3, 1, 0, -1, -2, -2, -2, -2, -2, -2, -1, -1 };
+
+/* reference: the correlation loop as it was in perimeter.c */
+static double reference(const int32_t *sigcode, int sigcode_length, uint16_t *buffer) {
+  const int n=NBPTS/OVERSAMPLING;
+  {
+    uint16_t *p=buffer;
+    for (int i=0; i<n; i++) {
+      uint16_t tmp=*(p++);
+      for (int j=OVERSAMPLING; --j>0; ) {
+        tmp+=*(p++);
+      }
+      buffer[i]=tmp;
+    }
+  }
+  int32_t *correlations=(int32_t*) (buffer+n);
+  int32_t corr_max_abs=0,corr_max=0;
+  int corr_max_pos=0;
+
+  for (int i=0; i<=n-sigcode_length; i++) {
+    int32_t sum=0;
+    uint16_t *datap=buffer+i;
+    const int32_t *sigcodep=sigcode;
+
+    for (int j=0; j<sigcode_length; j++) sum+=*(datap++)**(sigcodep++);
+    correlations[i]=sum;
+    if (sum<0) {
+      if (-sum>corr_max_abs) {
+        corr_max=sum;
+        corr_max_abs=-sum;
+        corr_max_pos=i;
+      }
+    } else {
+      if (sum>corr_max_abs) {
+        corr_max_abs=corr_max=sum;
+        corr_max_pos=i;
+      }
+    }
+  }
+  if (corr_max_abs==0) return 0;
+
+  int64_t sx2=0,sx=0;
+  int sn=0;
+  int count=n/5;
+  int p=corr_max_pos-3*sigcode_length/2;
+  while (count>0 && p>=0) {
+    int64_t s=correlations[p];
+    sx+=s; sx2+=s*s; p--; count--; sn++;
+  }
+  count=n/5;
+  p=corr_max_pos+3*sigcode_length/2;
+  while (count>0 && p<n-sigcode_length) {
+    int64_t s=correlations[p];
+    sx+=s; sx2+=s*s; p++; count--; sn++;
+  }
+  if (sn<=1) return 0;
+  double noiseDeviation=sqrt((sx2-sx*sx/(double) sn)/(sn-1));
+  if (noiseDeviation<1) return corr_max;
+  return corr_max/noiseDeviation;
+}
+
+static void fill(uint16_t *buffer, const int32_t *code, int length, int kind) {
+  int pos=rand()%(NBPTS-length*OVERSAMPLING);
+  int gain=1+rand()%600;
+  int noise=1+rand()%1500;
+
+  for (int i=0; i<NBPTS; i++) {
+    int v=2048+(rand()%(2*noise+1))-noise;
+    if (kind!=0 && i>=pos && i<pos+length*OVERSAMPLING) {
+      v+=code[(i-pos)/OVERSAMPLING]*gain;
+    }
+    if (kind==2) v=(v>2048) ? 4095 : 0; /* saturated ADC */
+    buffer[i]=v<0 ? 0 : (v>4095 ? 4095 : v);
+  }
+}
+
+static double seconds(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC,&t);
+  return t.tv_sec+t.tv_nsec*1e-9;
+}
+
+int main(int argc, char **argv) {
+  static const int32_t *codes[2]={sigcode1,sigcode2};
+  static const int lengths[2]={sizeof(sigcode1)/sizeof(int32_t),sizeof(sigcode2)/sizeof(int32_t)};
+  int buffers=(argc>1) ? atoi(argv[1]) : 2000;
+  uint16_t *input=malloc(sizeof(uint16_t)*NBPTS*buffers);
+  uint16_t work[NBPTS] __attribute__((aligned(4)));
+  double *expected=malloc(sizeof(double)*buffers);
+  int failures=0;
+
+  srand(1);
+  for (int c=0; c<2; c++) {
+    CORRFILTER_Code_t code;
+    double t0,tref,tfast;
+    volatile double sink=0;
+
+    CORRFILTER_Init(&code,codes[c],lengths[c]);
+    for (int b=0; b<buffers; b++) fill(input+b*NBPTS,codes[c],lengths[c],b%3);
+
+    t0=seconds();
+    for (int b=0; b<buffers; b++) {
+      memcpy(work,input+b*NBPTS,sizeof(work));
+      expected[b]=reference(codes[c],lengths[c],work);
+    }
+    tref=seconds()-t0;
+
+    t0=seconds();
+    for (int b=0; b<buffers; b++) {
+      double r;
+      memcpy(work,input+b*NBPTS,sizeof(work));
+      r=CORRFILTER_Run(&code,work,NBPTS,OVERSAMPLING);
+      if (memcmp(&r,&expected[b],sizeof(double))!=0) {
+        if (failures++<10) printf("sigcode%d buffer %d: %.17g != %.17g\n",c+1,b,r,expected[b]);
+      }
+      sink+=r;
+    }
+    tfast=seconds()-t0;
+
+    printf("sigcode%d: %d taps -> %d difference taps, reference %.2f us, CORRFILTER_Run %.2f us per buffer (x%.1f)\n",
+      c+1,lengths[c],code.u8Taps,tref*1e6/buffers,tfast*1e6/buffers,tref/tfast);
+  }
+  {
+    CORRFILTER_Code_t bank[2];
+    double *expected2=malloc(sizeof(double)*2*buffers);
+    double t0,tref,tbank;
+    volatile double sink=0;
+    int wrong=0;
+
+    for (int c=0; c<2; c++) CORRFILTER_Init(&bank[c],codes[c],lengths[c]);
+    for (int b=0; b<buffers; b++) fill(input+b*NBPTS,codes[b%2],lengths[b%2],1+(b/2)%2);
+
+    t0=seconds();
+    for (int b=0; b<buffers; b++) {
+      for (int c=0; c<2; c++) {
+        memcpy(work,input+b*NBPTS,sizeof(work));
+        expected2[2*b+c]=reference(codes[c],lengths[c],work);
+      }
+    }
+    tref=seconds()-t0;
+
+    t0=seconds();
+    for (int b=0; b<buffers; b++) {
+      double r[2];
+      uint8_t strongest;
+      memcpy(work,input+b*NBPTS,sizeof(work));
+      strongest=CORRFILTER_RunBank(bank,2,work,NBPTS,OVERSAMPLING,r);
+      if (memcmp(r,&expected2[2*b],sizeof(r))!=0) {
+        if (failures++<10) printf("bank buffer %d: %.17g %.17g != %.17g %.17g\n",b,r[0],r[1],expected2[2*b],expected2[2*b+1]);
+      }
+      if (strongest!=b%2) wrong++;
+      sink+=r[0]+r[1];
+    }
+    tbank=seconds()-t0;
+
+    printf("bank of 2 codes: reference %.2f us, CORRFILTER_RunBank %.2f us per buffer (x%.1f), strongest code wrong in %d of %d buffers\n",
+      tref*1e6/buffers,tbank*1e6/buffers,tref/tbank,wrong,buffers);
+    free(expected2);
+  }
+  printf("%s, %d mismatches\n",failures ? "FAILED" : "bit identical",failures);
+  free(input);
+  free(expected);
+  return failures ? 1 : 0;
+}
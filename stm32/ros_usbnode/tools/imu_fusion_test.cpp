@@ -0,0 +1,156 @@
+/****************************************************************************
+* Title                 :   IMU attitude filter host test
+* Filename              :   imu_fusion_test.cpp
+* Author                :
+* Origin Date           :
+* Version               :   1.0.0
+
+*****************************************************************************/
+/** \file imu_fusion_test.cpp
+*  \brief runs the float (F401) and the fixed point (F103) build of imu_fusion.c
+*         on the same simulated samples
+*
+*  Build and run on the host, from stm32/ros_usbnode:
+*
+*        g++ -O2 -Iinclude tools/imu_fusion_test.cpp -o imu_fusion_test
+*        ./imu_fusion_test
+*
+*  imu_fusion.c is included twice, each build in its own namespace. The IMU is
+*  tilted by roll 20 pitch -10, still for 10 s then turning at 0.5 rad/s around
+*  the vertical, at the LSM6 rate and scales. The samples carry an offset that
+*  the calibration removes and some noise. Roll and pitch have to converge on
+*  the tilt, yaw has to follow the integrated turn, and the fixed point filter
+*  has to track the float one.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "imu/imu_fusion.h"
+
+namespace fusion_float
+{
+#define BOARD_YARDFORCE500_VARIANT_B 1
+#include "../src/imu/imu_fusion.c"
+#undef BOARD_YARDFORCE500_VARIANT_B
+#undef IMUFUSION_Q30
+}
+
+namespace fusion_fixed
+{
+#include "../src/imu/imu_fusion.c"
+}
+
+#define RATE_HZ 208                             /* LSM6 output data rate */
+#define GYRO_SCALE (0.00875f * 0.0174533f)      /* rad/sec per LSB at 250 dps */
+#define ACCEL_LSB_PER_G 16384.0                 /* 2 g */
+#define DURATION_S 30
+#define TURN_START_S 10
+#define YAW_RATE 0.5                            /* rad/sec */
+
+/* the accelerometer noise alone is 0.7 deg, the filter keeps a fraction of it */
+#define TILT_LIMIT_DEG 0.2                      /* roll and pitch once settled */
+#define YAW_LIMIT_DEG 0.1
+#define FIXED_LIMIT_DEG 0.005                   /* fixed point against float */
+
+static const double roll = 20 * M_PI / 180;
+static const double pitch = -10 * M_PI / 180;
+static const float bias[6] = { 10, -20, 0, 30, -15, 5 };
+
+/* zero mean noise, about gaussian with sigma 1 */
+static double noise(void)
+{
+    double l_dSum = 0;
+    int i;
+
+    for (i = 0; i < 12; i++)
+    {
+        l_dSum += rand() / (double)RAND_MAX;
+    }
+    return l_dSum - 6;
+}
+
+static void euler(const float *q, double *p_pdEuler)
+{
+    p_pdEuler[0] = atan2(2 * (q[0] * q[1] + q[2] * q[3]), 1 - 2 * (q[1] * q[1] + q[2] * q[2])) * 180 / M_PI;
+    p_pdEuler[1] = asin(2 * (q[0] * q[2] - q[3] * q[1])) * 180 / M_PI;
+    p_pdEuler[2] = atan2(2 * (q[0] * q[3] + q[1] * q[2]), 1 - 2 * (q[2] * q[2] + q[3] * q[3])) * 180 / M_PI;
+}
+
+static double angle_diff(double p_dA, double p_dB)
+{
+    return fabs(remainder(p_dA - p_dB, 360.0));
+}
+
+int main(void)
+{
+    double yaw = 0;
+    double tilt_err[2] = { 0, 0 }, yaw_err[2] = { 0, 0 }, fixed_err = 0;
+    int n, i, fails = 0;
+
+    srand(1);
+    fusion_float::IMUFUSION_Config(RATE_HZ, GYRO_SCALE, bias, 1.0f, 0.01f);
+    fusion_float::IMUFUSION_Reset();
+    fusion_fixed::IMUFUSION_Config(RATE_HZ, GYRO_SCALE, bias, 1.0f, 0.01f);
+    fusion_fixed::IMUFUSION_Reset();
+
+    for (n = 0; n < RATE_HZ * DURATION_S; n++)
+    {
+        double t = n / (double)RATE_HZ;
+        double w = (t < TURN_START_S) ? 0 : YAW_RATE;
+        int16_t s[6];
+        float q[2][4];
+        double e[2][3];
+
+        /* gravity and the turn around the vertical in the body frame */
+        s[0] = (int16_t)lrint(-sin(pitch) * ACCEL_LSB_PER_G + bias[0] + noise() * 200);
+        s[1] = (int16_t)lrint(sin(roll) * cos(pitch) * ACCEL_LSB_PER_G + bias[1] + noise() * 200);
+        s[2] = (int16_t)lrint(cos(roll) * cos(pitch) * ACCEL_LSB_PER_G + bias[2] + noise() * 200);
+        s[3] = (int16_t)lrint(-sin(pitch) * w / GYRO_SCALE + bias[3] + noise() * 5);
+        s[4] = (int16_t)lrint(sin(roll) * cos(pitch) * w / GYRO_SCALE + bias[4] + noise() * 5);
+        s[5] = (int16_t)lrint(cos(roll) * cos(pitch) * w / GYRO_SCALE + bias[5] + noise() * 5);
+        yaw += w / RATE_HZ;
+
+        fusion_float::IMUFUSION_Update(s);
+        fusion_fixed::IMUFUSION_Update(s);
+        fusion_float::IMUFUSION_GetQuaternion(q[0]);
+        fusion_fixed::IMUFUSION_GetQuaternion(q[1]);
+        euler(q[0], e[0]);
+        euler(q[1], e[1]);
+
+        /* settled: 5 s after the start, the turn changes nothing on roll and pitch */
+        if (t >= 5)
+        {
+            for (i = 0; i < 2; i++)
+            {
+                tilt_err[i] = fmax(tilt_err[i], angle_diff(e[i][0], roll * 180 / M_PI));
+                tilt_err[i] = fmax(tilt_err[i], angle_diff(e[i][1], pitch * 180 / M_PI));
+                yaw_err[i] = fmax(yaw_err[i], angle_diff(e[i][2], yaw * 180 / M_PI));
+            }
+        }
+        for (i = 0; i < 3; i++)
+        {
+            fixed_err = fmax(fixed_err, angle_diff(e[0][i], e[1][i]));
+        }
+        if (n % (RATE_HZ * 5) == 0 || n == RATE_HZ * DURATION_S - 1)
+        {
+            printf("t=%4.1f float %7.3f %7.3f %8.3f  fixed %7.3f %7.3f %8.3f  true yaw %8.3f\n", t,
+                   e[0][0], e[0][1], e[0][2], e[1][0], e[1][1], e[1][2], remainder(yaw, 2 * M_PI) * 180 / M_PI);
+        }
+    }
+
+    for (i = 0; i < 2; i++)
+    {
+        int ok = tilt_err[i] < TILT_LIMIT_DEG && yaw_err[i] < YAW_LIMIT_DEG;
+
+        printf("%-6s roll/pitch max error %.4f deg, yaw max error %.4f deg  %s\n", i ? "fixed" : "float",
+               tilt_err[i], yaw_err[i], ok ? "ok" : "FAIL");
+        fails += !ok;
+    }
+    printf("fixed against float max %.5f deg  %s\n", fixed_err, fixed_err < FIXED_LIMIT_DEG ? "ok" : "FAIL");
+    fails += !(fixed_err < FIXED_LIMIT_DEG);
+
+    printf("%s\n", fails ? "FAILED" : "all passed");
+    return fails ? 1 : 0;
+}
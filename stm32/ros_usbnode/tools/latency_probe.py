@@ -0,0 +1,128 @@
+#!/usr/bin/env python3
+# Drive the latency scenarios on a Mowgli board running rosserial and print the
+# histograms it publishes on mower/latency (see include/latency.h):
+#   latency_probe.py cmd_vel            cmd_vel -> next drive motor request
+#   latency_probe.py service            mower_service/emergency -> drive and blade stop frames
+#   latency_probe.py input              stop button / wheel lift / tilt -> stop frames (operator driven)
+#   latency_probe.py monitor            only print what the board measures
+# The histograms are cleared on mower/latency/reset before the scenario starts.
+# The emergency probes stop at the first zero speed (blade off) frame, so the
+# mower has to be driving (not idle) for the service and input numbers to mean anything.
+import argparse
+import threading
+
+import rospy
+from geometry_msgs.msg import Twist
+from std_msgs.msg import Empty, UInt32MultiArray
+
+PROBES = ['input_drive', 'input_blade', 'service_drive', 'service_blade', 'cmd_vel']
+STATS = 5  # count, min, max, sum low, sum high
+BUCKETS = 20
+
+latest = None
+received = threading.Event()
+
+
+def latency_received(msg):
+    global latest
+    latest = list(msg.data)
+    received.set()
+
+
+def wait_histograms():
+    received.clear()
+    received.wait(3)
+    return latest
+
+
+def percentile(buckets, count, p):
+    # upper bound of the log2 bucket holding the percentile
+    target = count * p / 100.0
+    acc = 0
+    for b, n in enumerate(buckets):
+        acc += n
+        if acc >= target:
+            return (1 << (b + 1)) - 1
+    return float('inf')
+
+
+def report(data):
+    if data is None:
+        print('no histogram received on mower/latency')
+        return
+    length = STATS + BUCKETS
+    print('%-14s %7s %9s %9s %9s %9s %9s' % ('probe', 'count', 'min_us', 'mean_us', 'p50<=us', 'p99<=us', 'max_us'))
+    for i, name in enumerate(PROBES):
+        probe = data[i * length:(i + 1) * length]
+        count, lo, hi, total_low, total_high = probe[:STATS]
+        total = total_low + (total_high << 32)
+        buckets = probe[STATS:]
+        if not count:
+            print('%-14s %7d' % (name, 0))
+            continue
+        print('%-14s %7d %9d %9d %9s %9s %9d' % (name, count, lo, total // count,
+                                                 percentile(buckets, count, 50), percentile(buckets, count, 99), hi))
+
+
+def scenario_cmd_vel(args, pub_cmd_vel):
+    rate = rospy.Rate(args.rate)
+    end = rospy.Time.now() + rospy.Duration(args.duration)
+    twist = Twist()
+    while not rospy.is_shutdown() and rospy.Time.now() < end:
+        twist.linear.x = args.speed
+        pub_cmd_vel.publish(twist)
+        rate.sleep()
+
+
+def scenario_service(args, pub_cmd_vel):
+    from mower_msgs.srv import EmergencyStopSrv
+
+    rospy.wait_for_service('mower_service/emergency')
+    emergency = rospy.ServiceProxy('mower_service/emergency', EmergencyStopSrv)
+    twist = Twist()
+    twist.linear.x = args.speed
+    for i in range(args.count):
+        # drive for a while so the stop frame follows non zero speeds
+        end = rospy.Time.now() + rospy.Duration(1.0)
+        while not rospy.is_shutdown() and rospy.Time.now() < end:
+            pub_cmd_vel.publish(twist)
+            rospy.sleep(0.05)
+        emergency(1)
+        rospy.sleep(0.5)
+        emergency(0)
+        print('service emergency %d/%d' % (i + 1, args.count))
+
+
+def scenario_input(args, pub_cmd_vel):
+    for i in range(args.count):
+        input('[%d/%d] press a stop button or lift the mower, then release it and press enter' % (i + 1, args.count))
+        print('hold the play button for 2s to clear the emergency')
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Mowgli emergency and cmd_vel latency measurement')
+    parser.add_argument('scenario', choices=['cmd_vel', 'service', 'input', 'monitor'])
+    parser.add_argument('--count', type=int, default=20, help='emergencies to trigger')
+    parser.add_argument('--duration', type=float, default=10.0, help='cmd_vel scenario length (s)')
+    parser.add_argument('--rate', type=float, default=20.0, help='cmd_vel rate (Hz)')
+    parser.add_argument('--speed', type=float, default=0.1, help='cmd_vel linear speed (m/s)')
+    parser.add_argument('--keep', action='store_true', help='do not clear the histograms first')
+    args = parser.parse_args(rospy.myargv()[1:])
+
+    rospy.init_node('latency_probe', anonymous=True)
+    rospy.Subscriber('mower/latency', UInt32MultiArray, latency_received)
+    pub_reset = rospy.Publisher('mower/latency/reset', Empty, queue_size=1, latch=False)
+    pub_cmd_vel = rospy.Publisher('cmd_vel', Twist, queue_size=10)
+    rospy.sleep(1.0)
+
+    if args.scenario == 'monitor':
+        while not rospy.is_shutdown():
+            report(wait_histograms())
+            print()
+    else:
+        if not args.keep:
+            pub_reset.publish(Empty())
+            rospy.sleep(0.5)
+        {'cmd_vel': scenario_cmd_vel, 'service': scenario_service, 'input': scenario_input}[args.scenario](args, pub_cmd_vel)
+        rospy.sleep(1.5)
+        report(wait_histograms())
@@ -0,0 +1,421 @@
+/****************************************************************************
+* Title                 :   software I2C host test
+* Filename              :   soft_i2c_test.cpp
+* Author                :
+* Origin Date           :
+* Version               :   1.0.0
+
+*****************************************************************************/
+/** \file soft_i2c_test.cpp
+*  \brief runs the SW_I2C_TimerIT() state machine against a simulated slave
+*
+*  Build and run on the host, from stm32/ros_usbnode:
+*
+*        g++ -O2 -Iinclude tools/soft_i2c_test.cpp -o soft_i2c_test
+*        ./soft_i2c_test
+*
+*  soft_i2c.c is compiled as C++ so the GPIO port can be a simulated one: every
+*  BSRR write of the driver moves the bus lines at once, the slave sees the
+*  edges in the order the driver makes them. The bus is a wired AND of the
+*  master and slave outputs. The slave is a register file with auto increment,
+*  it can stretch the clock, hold SCL low, or not answer. Every timer tick is
+*  one SW_I2C_TimerIT() call.
+*/
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+/* board.h settings without a board */
+#define VALID_BOARD_DEFINED 1
+#define SOFT_I2C_TIM_INSTANCE 0
+#define SOFT_I2C_TIM_IRQ 0
+#define SOFT_I2C_TIM_CLK_ENABLE()
+
+/* simulated bus */
+static uint8_t bus_masterScl = 1, bus_masterSda = 1;
+static uint8_t bus_slaveScl = 1, bus_slaveSda = 1;
+static uint8_t bus_scl = 1, bus_sda = 1;
+static void bus_update(void);
+
+struct SimBsrr
+{
+    SimBsrr &operator=(uint32_t p_u32Value);
+};
+
+struct SimIdr
+{
+    operator uint32_t() const;
+};
+
+struct SimPort
+{
+    SimBsrr BSRR;
+    SimIdr IDR;
+};
+
+static SimPort sim_gpiob;
+
+/* HAL stubs */
+#define GPIOB (&sim_gpiob)
+#define GPIO_PIN_3 ((uint16_t)0x0008)
+#define GPIO_PIN_4 ((uint16_t)0x0010)
+#define GPIO_SPEED_FREQ_HIGH 3
+#define GPIO_MODE_OUTPUT_OD 0x11
+#define GPIO_PULLUP 1
+#define TIM_COUNTERMODE_UP 0
+#define TIM_CLOCKDIVISION_DIV1 0
+#define TIM_AUTORELOAD_PRELOAD_DISABLE 0
+#define TIM_FLAG_UPDATE 1
+#define TIM_IT_UPDATE 1
+#define __HAL_RCC_GPIOB_CLK_ENABLE()
+#define __HAL_TIM_CLEAR_FLAG(handle, flag)
+#define __HAL_TIM_ENABLE_IT(handle, it)
+#define __HAL_TIM_SET_COUNTER(handle, count)
+#define __HAL_TIM_ENABLE(handle) (tim_bRunning = 1)
+#define __HAL_TIM_DISABLE(handle) (tim_bRunning = 0)
+
+typedef enum { HAL_OK = 0, HAL_ERROR } HAL_StatusTypeDef;
+typedef struct { uint32_t Pin, Mode, Pull, Speed; } GPIO_InitTypeDef;
+typedef struct { uint32_t Prescaler, CounterMode, Period, ClockDivision, AutoReloadPreload; } TIM_Base_InitTypeDef;
+typedef struct { int Instance; TIM_Base_InitTypeDef Init; } TIM_HandleTypeDef;
+
+static uint32_t SystemCoreClock = 72000000;
+static uint8_t tim_bRunning = 0;
+
+static void HAL_GPIO_Init(SimPort *p_psPort, GPIO_InitTypeDef *p_psInit) { (void)p_psPort; (void)p_psInit; }
+static void HAL_GPIO_DeInit(SimPort *p_psPort, uint32_t p_u32Pin) { (void)p_psPort; (void)p_u32Pin; }
+static uint8_t HAL_GPIO_ReadPin(SimPort *p_psPort, uint16_t p_u16Pin) { return (p_psPort->IDR & p_u16Pin) != 0; }
+static HAL_StatusTypeDef HAL_TIM_Base_Init(TIM_HandleTypeDef *p_psHandle) { (void)p_psHandle; return HAL_OK; }
+static void HAL_NVIC_SetPriority(int p_iIrq, uint32_t p_u32Pre, uint32_t p_u32Sub) { (void)p_iIrq; (void)p_u32Pre; (void)p_u32Sub; }
+static void HAL_NVIC_EnableIRQ(int p_iIrq) { (void)p_iIrq; }
+static void HAL_NVIC_DisableIRQ(int p_iIrq) { (void)p_iIrq; }
+
+#include "../src/soft_i2c.c"
+
+void Error_Handler(void) {}
+
+/******************************************************************************
+* simulated slave, 7 bit address SLAVE_ADDRESS, register file
+*******************************************************************************/
+#define SLAVE_ADDRESS 0x6A
+
+typedef enum { SLAVE_IDLE, SLAVE_ADDRESS_BITS, SLAVE_WRITE_BITS, SLAVE_READ_BITS, SLAVE_ACK_OUT, SLAVE_ACK_IN, SLAVE_IGNORE } slave_state_e;
+
+static uint8_t slave_pu8Regs[256];
+static slave_state_e slave_eState = SLAVE_IDLE;
+static uint8_t slave_u8Shift, slave_u8Bits, slave_u8Reg;
+static uint8_t slave_bRead, slave_bRegSet;
+static uint8_t slave_bPresent = 1;
+static int slave_iStretchAt = -1;       /* SCL falling edge to stretch at, -1 never */
+static int slave_iStretchTicks = 0;     /* ticks to hold SCL low, -1 for ever */
+static int slave_iFallingEdges = 0;
+static int slave_iStarts = 0, slave_iStops = 0, slave_iMasterNacks = 0;
+
+static void slave_reset(void)
+{
+    slave_eState = SLAVE_IDLE;
+    slave_bPresent = 1;
+    slave_iStretchAt = -1;
+    slave_iStretchTicks = 0;
+    slave_iFallingEdges = 0;
+    slave_iStarts = slave_iStops = slave_iMasterNacks = 0;
+    bus_slaveScl = bus_slaveSda = 1;
+    bus_update();
+}
+
+/* SDA moved while SCL is high */
+static void slave_sdaEdge(uint8_t p_bSda)
+{
+    if (!p_bSda)
+    {
+        slave_iStarts++;
+        slave_eState = SLAVE_ADDRESS_BITS;
+        slave_u8Bits = 0;
+        slave_u8Shift = 0;
+    }
+    else
+    {
+        slave_iStops++;
+        slave_eState = SLAVE_IDLE;
+    }
+}
+
+/* SCL rising: sample SDA */
+static void slave_sclRise(void)
+{
+    switch (slave_eState)
+    {
+    case SLAVE_ADDRESS_BITS:
+    case SLAVE_WRITE_BITS:
+        slave_u8Shift = (slave_u8Shift << 1) | bus_sda;
+        slave_u8Bits++;
+        break;
+    case SLAVE_ACK_IN:
+        if (bus_sda)
+        {
+            /* master NACK, last byte */
+            slave_iMasterNacks++;
+            slave_eState = SLAVE_IGNORE;
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+/* SCL falling: drive SDA for the next bit */
+static void slave_sclFall(void)
+{
+    slave_iFallingEdges++;
+    if (slave_iFallingEdges == slave_iStretchAt)
+    {
+        bus_slaveScl = 0;
+    }
+    switch (slave_eState)
+    {
+    case SLAVE_ADDRESS_BITS:
+        if (slave_u8Bits == 8)
+        {
+            if (slave_bPresent && (slave_u8Shift >> 1) == SLAVE_ADDRESS)
+            {
+                slave_bRead = slave_u8Shift & 1;
+                if (!slave_bRead)
+                {
+                    slave_bRegSet = 0;
+                }
+                bus_slaveSda = 0;
+                slave_eState = SLAVE_ACK_OUT;
+            }
+            else
+            {
+                slave_eState = SLAVE_IGNORE;
+            }
+        }
+        break;
+    case SLAVE_WRITE_BITS:
+        if (slave_u8Bits == 8)
+        {
+            if (!slave_bRegSet)
+            {
+                slave_u8Reg = slave_u8Shift;
+                slave_bRegSet = 1;
+            }
+            else
+            {
+                slave_pu8Regs[slave_u8Reg++] = slave_u8Shift;
+            }
+            bus_slaveSda = 0;
+            slave_eState = SLAVE_ACK_OUT;
+        }
+        break;
+    case SLAVE_ACK_OUT:
+        bus_slaveSda = 1;
+        slave_u8Bits = 0;
+        slave_u8Shift = 0;
+        if (slave_bRead)
+        {
+            slave_u8Shift = slave_pu8Regs[slave_u8Reg++];
+            bus_slaveSda = (slave_u8Shift >> 7) & 1;
+            slave_u8Bits = 1;
+            slave_eState = SLAVE_READ_BITS;
+        }
+        else
+        {
+            slave_eState = SLAVE_WRITE_BITS;
+        }
+        break;
+    case SLAVE_READ_BITS:
+        if (slave_u8Bits == 8)
+        {
+            bus_slaveSda = 1;
+            slave_eState = SLAVE_ACK_IN;
+        }
+        else
+        {
+            bus_slaveSda = (slave_u8Shift >> (7 - slave_u8Bits)) & 1;
+            slave_u8Bits++;
+        }
+        break;
+    case SLAVE_ACK_IN:
+        /* master ACK, next byte */
+        slave_u8Shift = slave_pu8Regs[slave_u8Reg++];
+        bus_slaveSda = (slave_u8Shift >> 7) & 1;
+        slave_u8Bits = 1;
+        slave_eState = SLAVE_READ_BITS;
+        break;
+    default:
+        break;
+    }
+}
+
+/* wired AND, the slave reacts to every edge */
+static void bus_update(void)
+{
+    uint8_t l_bScl, l_bSda;
+
+    for (;;)
+    {
+        l_bScl = bus_masterScl && bus_slaveScl;
+        l_bSda = bus_masterSda && bus_slaveSda;
+        if (l_bScl != bus_scl)
+        {
+            bus_scl = l_bScl;
+            bus_sda = l_bSda;
+            if (l_bScl) { slave_sclRise(); } else { slave_sclFall(); }
+        }
+        else if (l_bSda != bus_sda)
+        {
+            bus_sda = l_bSda;
+            if (l_bScl)
+            {
+                slave_sdaEdge(l_bSda);
+            }
+        }
+        else
+        {
+            break;
+        }
+    }
+}
+
+SimBsrr &SimBsrr::operator=(uint32_t p_u32Value)
+{
+    uint8_t l_u8Level = (p_u32Value & 0xFFFF) ? 1 : 0;
+    uint32_t l_u32Pins = (p_u32Value & 0xFFFF) | (p_u32Value >> 16);
+
+    if (l_u32Pins & SOFT_I2C_SCL_PIN) { bus_masterScl = l_u8Level; }
+    if (l_u32Pins & SOFT_I2C_SDA_PIN) { bus_masterSda = l_u8Level; }
+    bus_update();
+    return *this;
+}
+
+SimIdr::operator uint32_t() const
+{
+    return (bus_scl ? SOFT_I2C_SCL_PIN : 0) | (bus_sda ? SOFT_I2C_SDA_PIN : 0);
+}
+
+/******************************************************************************
+* test runner
+*******************************************************************************/
+static int done_count;
+static SW_I2C_Status_e done_status;
+
+static void done(SW_I2C_Status_e p_eStatus, void *p_pvContext)
+{
+    (void)p_pvContext;
+    done_count++;
+    done_status = p_eStatus;
+}
+
+/* run the timer until the transfer is done, the slave stretches between the ticks */
+static int run(uint8_t p_u8Address, uint8_t p_u8Reg, uint8_t p_bRead, uint8_t *p_pu8Data, uint8_t p_u8Length)
+{
+    int l_iTicks = 0;
+
+    done_count = 0;
+    if (!SW_I2C_Transfer(p_u8Address << 1, p_u8Reg, p_bRead, p_pu8Data, p_u8Length, done, NULL))
+    {
+        return -1;
+    }
+    while (tim_bRunning && l_iTicks < 100000)
+    {
+        SW_I2C_TimerIT();
+        l_iTicks++;
+        if (!bus_slaveScl && slave_iStretchTicks > 0 && --slave_iStretchTicks == 0)
+        {
+            bus_slaveScl = 1;
+            bus_update();
+        }
+    }
+    return l_iTicks;
+}
+
+static int check(const char *p_pcName, int p_bOk, int p_iTicks)
+{
+    printf("%-34s %s  %d ticks (%d us at %d kHz)\n", p_pcName, p_bOk ? "ok  " : "FAIL", p_iTicks,
+           p_iTicks * 1000 / (SW_I2C_TICK_HZ / 1000), SOFT_I2C_CLOCK_HZ / 1000);
+    return p_bOk ? 0 : 1;
+}
+
+int main(void)
+{
+    uint8_t l_pu8Data[16];
+    uint8_t l_pu8Expected[16];
+    int l_iTicks, l_iFails = 0, l_iIdx;
+    int l_bIdle;
+
+    SW_I2C_Init();
+    for (l_iIdx = 0; l_iIdx < 256; l_iIdx++)
+    {
+        slave_pu8Regs[l_iIdx] = (uint8_t)(l_iIdx * 37 + 11);
+    }
+
+    /* register write, auto increment */
+    slave_reset();
+    l_pu8Data[0] = 0xA5;
+    l_pu8Data[1] = 0x3C;
+    l_iTicks = run(SLAVE_ADDRESS, 0x10, 0, l_pu8Data, 2);
+    l_iFails += check("write 2 bytes", done_count == 1 && done_status == SW_I2C_OK && slave_pu8Regs[0x10] == 0xA5 &&
+                      slave_pu8Regs[0x11] == 0x3C && slave_iStarts == 1 && slave_iStops == 1, l_iTicks);
+
+    /* burst read, repeated start, NACK on the last byte */
+    slave_reset();
+    memcpy(l_pu8Expected, &slave_pu8Regs[0x22], 12);
+    memset(l_pu8Data, 0, sizeof(l_pu8Data));
+    l_iTicks = run(SLAVE_ADDRESS, 0x22, 1, l_pu8Data, 12);
+    l_iFails += check("read 12 bytes", done_count == 1 && done_status == SW_I2C_OK && memcmp(l_pu8Data, l_pu8Expected, 12) == 0 &&
+                      slave_iStarts == 2 && slave_iStops == 1 && slave_iMasterNacks == 1, l_iTicks);
+
+    /* single byte read */
+    slave_reset();
+    l_pu8Data[0] = 0;
+    l_iTicks = run(SLAVE_ADDRESS, 0x0F, 1, l_pu8Data, 1);
+    l_iFails += check("read 1 byte", done_count == 1 && done_status == SW_I2C_OK && l_pu8Data[0] == slave_pu8Regs[0x0F] &&
+                      slave_iMasterNacks == 1, l_iTicks);
+
+    /* clock stretching in the middle of the read */
+    slave_reset();
+    slave_iStretchAt = 40;
+    slave_iStretchTicks = 50;
+    memset(l_pu8Data, 0, sizeof(l_pu8Data));
+    l_iTicks = run(SLAVE_ADDRESS, 0x22, 1, l_pu8Data, 6);
+    l_iFails += check("clock stretching, 50 ticks", done_count == 1 && done_status == SW_I2C_OK &&
+                      memcmp(l_pu8Data, l_pu8Expected, 6) == 0 && slave_iStops == 1, l_iTicks);
+
+    /* no device */
+    slave_reset();
+    slave_bPresent = 0;
+    l_iTicks = run(SLAVE_ADDRESS, 0x22, 1, l_pu8Data, 6);
+    l_bIdle = bus_scl && bus_sda;
+    l_iFails += check("no device", done_count == 1 && done_status == SW_I2C_NACK_ADDRESS && l_bIdle && slave_iStops == 1, l_iTicks);
+
+    /* SCL held low, the transfer gives up and releases the bus */
+    slave_reset();
+    slave_iStretchAt = 20;
+    slave_iStretchTicks = -1;
+    {
+        uint32_t l_u32Errors = SW_I2C_u32Errors;
+
+        l_iTicks = run(SLAVE_ADDRESS, 0x22, 1, l_pu8Data, 6);
+        l_iFails += check("SCL held low", done_count == 1 && done_status == SW_I2C_TIMEOUT && SW_I2C_u32Errors == l_u32Errors + 1 &&
+                          bus_masterScl && bus_masterSda && !SW_I2C_Busy(), l_iTicks);
+    }
+
+    /* the next transfer works once the slave lets go */
+    slave_reset();
+    memset(l_pu8Data, 0, sizeof(l_pu8Data));
+    l_iTicks = run(SLAVE_ADDRESS, 0x22, 1, l_pu8Data, 6);
+    l_iFails += check("transfer after the timeout", done_count == 1 && done_status == SW_I2C_OK && memcmp(l_pu8Data, l_pu8Expected, 6) == 0, l_iTicks);
+
+    /* busy */
+    slave_reset();
+    SW_I2C_Transfer(SLAVE_ADDRESS << 1, 0x22, 1, l_pu8Data, 6, done, NULL);
+    l_iFails += check("second transfer refused while busy", !SW_I2C_Transfer(SLAVE_ADDRESS << 1, 0x22, 1, l_pu8Data, 6, done, NULL), 0);
+    while (tim_bRunning)
+    {
+        SW_I2C_TimerIT();
+    }
+
+    printf("%s\n", l_iFails ? "FAILED" : "all passed");
+    return l_iFails ? 1 : 0;
+}
@@ -0,0 +1,225 @@
+/****************************************************************************
+* Title                 :   framed UART engine host test
+* Filename              :   uart_frame_test.c
+* Author                :
+* Origin Date           :
+* Version               :   1.0.0
+
+*****************************************************************************/
+/** \file uart_frame_test.c
+*  \brief feeds byte streams through the receive side of uart_frame.c and checks
+*         the frames handed to the callback
+*
+*  Build and run on the host, from stm32/ros_usbnode:
+*
+*        gcc -O2 -Iinclude tools/uart_frame_test.c -o uart_frame_test
+*        ./uart_frame_test
+*
+*  No board variant is defined so stm32f_board_hal.h pulls no HAL, the few HAL
+*  types and calls the engine uses are stubbed below. The streams use the drive
+*  motor frame (5 bytes preamble, 20 bytes, CRC on the last one): clean frames,
+*  frames cut short by a lost byte, garbage holding part of the preamble, a
+*  preamble split by the DMA wraparound.
+*/
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+/* board.h settings without a board */
+#define VALID_BOARD_DEFINED 1
+
+/* HAL stubs */
+typedef enum { HAL_OK = 0, HAL_ERROR, HAL_BUSY, HAL_TIMEOUT } HAL_StatusTypeDef;
+typedef enum { HAL_UART_STATE_READY = 0x20, HAL_UART_STATE_BUSY_RX = 0x22 } HAL_UART_StateTypeDef;
+typedef struct
+{
+    HAL_UART_StateTypeDef gState;
+    HAL_UART_StateTypeDef RxState;
+} UART_HandleTypeDef;
+
+static uint32_t __get_PRIMASK(void) { return 0; }
+static void __set_PRIMASK(uint32_t p_u32Primask) { (void)p_u32Primask; }
+static void __disable_irq(void) {}
+
+static HAL_StatusTypeDef HAL_UARTEx_ReceiveToIdle_DMA(UART_HandleTypeDef *p_phUart, uint8_t *p_pu8Data, uint16_t p_u16Size)
+{
+    (void)p_pu8Data; (void)p_u16Size;
+    p_phUart->RxState = HAL_UART_STATE_BUSY_RX;
+    return HAL_OK;
+}
+
+static HAL_StatusTypeDef HAL_UART_Transmit_DMA(UART_HandleTypeDef *p_phUart, const uint8_t *p_pu8Data, uint16_t p_u16Size)
+{
+    (void)p_phUart; (void)p_pu8Data; (void)p_u16Size;
+    return HAL_OK;
+}
+
+#include "../src/uart_frame.c"
+
+void Error_Handler(void) {}
+uint8_t LATENCY_Armed(uint8_t p_u8Mask) { return p_u8Mask; }
+void LATENCY_StopIT(uint8_t p_u8Mask) { (void)p_u8Mask; }
+
+/* same as main.c */
+uint8_t crcCalc(uint8_t *msg, uint8_t msg_len)
+{
+    uint8_t crc = 0x0;
+    uint8_t i = 0;
+
+    for (i = 0; i < msg_len; i++)
+    {
+        crc += msg[i];
+    }
+    return crc;
+}
+
+#define FRAME_LENGTH 20
+
+/* same as drivemotor.c */
+static const uint8_t preamble[] = { 0x55, 0xAA, 0x10, 0x01, 0xE0 };
+static const UARTFRAME_Descriptor_t descriptor = { preamble, sizeof(preamble), FRAME_LENGTH, FRAME_LENGTH - 1 };
+
+static UART_HandleTypeDef huart;
+static UARTFRAME_Handle_t handle;
+static uint16_t dma_pos;
+
+static uint8_t seq_rx[64];
+static int valid, crc_errors;
+
+static void callback(rx_status_e p_eStatus, const uint8_t *p_pu8Frame)
+{
+    if (p_eStatus == RX_VALID)
+    {
+        seq_rx[valid++] = p_pu8Frame[5];
+    }
+    else
+    {
+        crc_errors++;
+    }
+}
+
+static void reset(void)
+{
+    UARTFRAME_Init(&handle, &huart, &descriptor, callback);
+    dma_pos = 0;
+    valid = 0;
+    crc_errors = 0;
+}
+
+/* the DMA writes the bytes in the circular buffer, then the idle line event */
+static void feed(const uint8_t *p_pu8Data, int p_iLength)
+{
+    int l_iIdx;
+
+    for (l_iIdx = 0; l_iIdx < p_iLength; l_iIdx++)
+    {
+        handle.pu8RxBuffer[dma_pos++] = p_pu8Data[l_iIdx];
+        if (dma_pos == UARTFRAME_RX_BUFFER_SIZE)
+        {
+            /* DMA full event */
+            UARTFRAME_RxEventIT(&huart, dma_pos);
+            dma_pos = 0;
+        }
+    }
+    UARTFRAME_RxEventIT(&huart, dma_pos);
+}
+
+static int frame(uint8_t *p_pu8Frame, uint8_t p_u8Seq)
+{
+    int l_iIdx;
+
+    memcpy(p_pu8Frame, preamble, sizeof(preamble));
+    for (l_iIdx = sizeof(preamble); l_iIdx < FRAME_LENGTH - 1; l_iIdx++)
+    {
+        p_pu8Frame[l_iIdx] = (uint8_t)(p_u8Seq * 7 + l_iIdx);
+    }
+    p_pu8Frame[5] = p_u8Seq;
+    p_pu8Frame[FRAME_LENGTH - 1] = crcCalc(p_pu8Frame, FRAME_LENGTH - 1);
+    return FRAME_LENGTH;
+}
+
+static int check(const char *p_pcName, int p_iValid, int p_iCrcErrors, const uint8_t *p_pu8Seq)
+{
+    int l_iOk = (valid == p_iValid && crc_errors == p_iCrcErrors && memcmp(seq_rx, p_pu8Seq, p_iValid) == 0);
+
+    printf("%-34s %s  frames %d/%d  crc errors %d/%d\n", p_pcName, l_iOk ? "ok  " : "FAIL", valid, p_iValid, crc_errors, p_iCrcErrors);
+    return l_iOk ? 0 : 1;
+}
+
+int main(void)
+{
+    uint8_t stream[512];
+    static const uint8_t seq[] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16 };
+    int len, i, fails = 0;
+
+    /* back to back frames, crossing the DMA wraparound several times */
+    reset();
+    len = 0;
+    for (i = 0; i < 16; i++)
+    {
+        len += frame(&stream[len], seq[i]);
+    }
+    for (i = 0; i < len; i += 7)
+    {
+        feed(&stream[i], (len - i) < 7 ? (len - i) : 7);
+    }
+    fails += check("clean stream", 16, 0, seq);
+
+    /* a byte lost in the middle of frame 1: its last bytes and the preamble of
+     * frame 2 complete it, frame 2 must still come out */
+    reset();
+    len = frame(stream, 1);
+    memmove(&stream[10], &stream[11], FRAME_LENGTH - 11);
+    len--;
+    len += frame(&stream[len], 2);
+    len += frame(&stream[len], 3);
+    feed(stream, len);
+    fails += check("lost byte, next frame kept", 2, 1, &seq[1]);
+
+    /* a lost byte in every other frame */
+    reset();
+    len = 0;
+    for (i = 0; i < 8; i++)
+    {
+        len += frame(&stream[len], seq[i]);
+        if ((i & 1) == 0)
+        {
+            memmove(&stream[len - 6], &stream[len - 5], 5);
+            len--;
+        }
+    }
+    feed(stream, len);
+    {
+        static const uint8_t odd[] = { 2, 4, 6, 8 };
+        fails += check("lost byte in every other frame", 4, 4, odd);
+    }
+
+    /* garbage holding the start of the preamble, then a frame */
+    reset();
+    {
+        static const uint8_t garbage[] = { 0x00, 0x55, 0x55, 0xAA, 0x10, 0x55, 0xAA, 0x55, 0xAA, 0x10, 0x01, 0x55 };
+        memcpy(stream, garbage, sizeof(garbage));
+        len = sizeof(garbage);
+    }
+    len += frame(&stream[len], 1);
+    feed(stream, len);
+    fails += check("partial preambles before a frame", 1, 0, seq);
+
+    /* a preamble split by the DMA wraparound, one byte at a time */
+    reset();
+    len = 0;
+    for (i = 0; i < UARTFRAME_RX_BUFFER_SIZE - 2; i++)
+    {
+        stream[len++] = 0x55;
+    }
+    len += frame(&stream[len], 1);
+    len += frame(&stream[len], 2);
+    for (i = 0; i < len; i++)
+    {
+        feed(&stream[i], 1);
+    }
+    fails += check("preamble across the wraparound", 2, 0, seq);
+
+    printf("%s\n", fails ? "FAILED" : "all passed");
+    return fails ? 1 : 0;
+}